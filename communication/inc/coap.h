@@ -77,6 +77,7 @@ namespace CoAPCode {
 	NOT_MODIFIED = COAP_RESPONSE(2,03),
 	CHANGED = COAP_RESPONSE(2,04),
 	CONTENT = COAP_RESPONSE(2,05),
+	BLOCK_CONTINUE = COAP_RESPONSE(2,31),	// RFC 7959: the block was received, send the next one
 	BAD_REQUEST = COAP_RESPONSE(4,00),
 	UNAUTHORIZED = COAP_RESPONSE(4,01),
 	BAD_OPTION = COAP_RESPONSE(4,02),
@@ -108,9 +109,13 @@ namespace CoAPCode {
 namespace CoAPOption {
 	enum Enum {
 		NONE = 0,
+		ETAG = 4,
 		LOCATION_PATH = 8,
 		URI_PATH = 11,
-		URI_QUERY = 15
+		MAX_AGE = 14,
+		URI_QUERY = 15,
+		BLOCK2 = 23,
+		BLOCK1 = 27
 	};
 }
 
@@ -241,6 +246,184 @@ public:
     }
 };
 
+/**
+ * Decodes a CoAP message in place. The token, option values and payload are returned as views into
+ * the message buffer, which must outlive the reader. All accesses are bounds checked against the
+ * message length; a malformed message is reported by {@link #is_valid} and has no options and no
+ * payload.
+ */
+class CoAPReader
+{
+public:
+	class OptionIterator
+	{
+	public:
+		/**
+		 * Moves to the next option.
+		 * @return {@code false} if there are no more options.
+		 */
+		bool next()
+		{
+			return pos && CoAPReader::decode_option(&pos, end, &option_number, &value, &value_length) > 0;
+		}
+
+		unsigned number() const { return option_number; }
+		const uint8_t* data() const { return value; }
+		size_t length() const { return value_length; }
+
+	private:
+		const uint8_t* pos;
+		const uint8_t* end;
+		unsigned option_number;
+		const uint8_t* value;
+		size_t value_length;
+
+		OptionIterator(const uint8_t* pos, const uint8_t* end) :
+				pos(pos), end(end), option_number(0), value(nullptr), value_length(0)
+		{
+		}
+
+		friend class CoAPReader;
+	};
+
+	CoAPReader(const uint8_t* buf, size_t length);
+
+	bool is_valid() const { return valid; }
+
+	/**
+	 * The header fields are available as long as the message is at least 4 bytes long, even if
+	 * the rest of the message is malformed.
+	 */
+	bool has_header() const { return end - buf >= 4; }
+	CoAPType::Enum type() const { return has_header() ? CoAP::type(buf) : CoAPType::ERROR; }
+	CoAPCode::Enum code() const { return has_header() ? CoAPCode::Enum(buf[1]) : CoAPCode::EMPTY; }
+	message_id_t id() const { return has_header() ? buf[2]<<8 | buf[3] : 0; }
+
+	const uint8_t* token() const { return valid ? buf + 4 : nullptr; }
+	size_t token_length() const { return valid ? (buf[0] & 0x0F) : 0; }
+
+	/**
+	 * Returns an iterator positioned before the first option.
+	 */
+	OptionIterator options() const
+	{
+		return OptionIterator(valid ? options_begin : nullptr, options_end);
+	}
+
+	/**
+	 * Finds the first option with the given number.
+	 * @return {@code true} if the option was found.
+	 */
+	bool find_option(unsigned number, const uint8_t** data, size_t* length) const;
+
+	/**
+	 * Returns the payload, or {@code nullptr} if the message has no payload marker. A payload marker
+	 * followed by an empty payload is tolerated for compatibility with older firmware.
+	 */
+	const uint8_t* payload() const { return valid && options_end < end ? options_end + 1 : nullptr; }
+	size_t payload_length() const { return valid && options_end < end ? end - options_end - 1 : 0; }
+
+	/**
+	 * Decodes the option at {@code *pos}, advancing {@code *pos} past it. {@code *number} holds the
+	 * number of the previous option on entry, and is updated with the number of the decoded option.
+	 *
+	 * @return 1 if an option was decoded, 0 at the end of the options, and -1 if the option is
+	 * malformed.
+	 */
+	static int decode_option(const uint8_t** pos, const uint8_t* end, unsigned* number, const uint8_t** value, size_t* length);
+
+private:
+	const uint8_t* buf;
+	const uint8_t* end;
+	const uint8_t* options_begin;
+	const uint8_t* options_end;		// the payload marker, or the end of the message
+	bool valid;
+};
+
+/**
+ * Encodes a CoAP message in place. Writes beyond the end of the buffer are discarded and reported by
+ * {@link #overflow}.
+ */
+class CoAPWriter
+{
+public:
+	CoAPWriter(uint8_t* buf, size_t size) :
+			buf(buf), size(size), pos(0), last_option(0), has_payload(false), overflowed(false)
+	{
+	}
+
+	void header(CoAPType::Enum type, uint8_t code, message_id_t id, const uint8_t* token=nullptr, size_t token_length=0);
+
+	/**
+	 * Adds an option. Options must be added in order of increasing option number.
+	 */
+	void option(unsigned number, const void* data, size_t length);
+
+	void option(unsigned number, const char* value)
+	{
+		option(number, value, strlen(value));
+	}
+
+	/**
+	 * Adds an option with an unsigned integer value, encoded in as few bytes as possible.
+	 */
+	void option_uint(unsigned number, uint32_t value);
+
+	void payload(const void* data, size_t length);
+
+	/**
+	 * Returns the space available for a payload, which is then written in place and completed by
+	 * {@link #commit_payload}.
+	 */
+	uint8_t* payload_buffer(size_t* available);
+
+	void commit_payload(size_t length);
+
+	size_t length() const { return pos; }
+	bool overflow() const { return overflowed; }
+
+private:
+	uint8_t* buf;
+	size_t size;
+	size_t pos;
+	unsigned last_option;
+	bool has_payload;
+	bool overflowed;
+
+	uint8_t* reserve(size_t length);
+};
+
+/**
+ * The value of a Block1 or Block2 option (RFC 7959), which identifies a block of a payload that is
+ * transferred in several messages.
+ */
+struct CoAPBlock
+{
+	static const uint8_t MAX_SZX = 6;	// 1024 byte blocks
+
+	uint32_t num;	// the block number
+	uint8_t szx;	// the block size is 2^(szx + 4)
+	bool more;		// set if more blocks follow
+
+	CoAPBlock(uint32_t num=0, uint8_t szx=0, bool more=false) : num(num), szx(szx), more(more) {}
+
+	size_t size() const { return size_t(16) << szx; }
+	size_t offset() const { return num * size(); }
+
+	uint32_t value() const { return num << 4 | (more ? 0x08 : 0) | szx; }
+
+	/**
+	 * Decodes the value of a block option.
+	 * @return {@code false} if the value is malformed.
+	 */
+	static bool decode(const uint8_t* data, size_t length, CoAPBlock* block);
+
+	/**
+	 * Returns the exponent of the largest block size that is not larger than {@code max_size}.
+	 */
+	static uint8_t szx_for(size_t max_size);
+};
+
 // this uses version 0 to maintain compatiblity with the original comms lib codes
 #define COAP_MSG_HEADER(type, tokenlen) \
 	((CoAP::VERSION)<<6 | (type)<<4 | ((tokenlen) & 0xF))
@@ -245,8 +245,10 @@ public:
 
 	/**
 	 * Restores the state from this context. The persistence flag is not changed.
+	 * When the session can't be restored, {@code failure} receives the reason.
 	 */
-	RestoreStatus restore(mbedtls_ssl_context* context, bool renegotiate, uint32_t keys_checksum, message_id_t* message, restore_fn_t restorer, save_fn_t saver);
+	RestoreStatus restore(mbedtls_ssl_context* context, bool renegotiate, uint32_t keys_checksum, message_id_t* message, restore_fn_t restorer, save_fn_t saver,
+			SessionResumeFailure::Enum* failure=nullptr);
 
 	uint32_t application_state_checksum(uint32_t (*calc_crc)(const uint8_t* data, uint32_t len));
 
@@ -42,7 +42,8 @@ namespace EventType {
 	   NO_ACK = 0x2,
 	   WITH_ACK = 0x8,
 	   ASYNC = 0x10,        // not used here, but reserved since it's used in the system layer. Makes conversion simpler.
-	   ALL_FLAGS = NO_ACK | WITH_ACK | ASYNC
+	   BATCH = 0x80,        // the event may be delayed and sent together with other events in a single message
+	   ALL_FLAGS = NO_ACK | WITH_ACK | ASYNC | BATCH
   };
 
   static_assert((PUBLIC & NO_ACK)==0 &&
@@ -50,7 +51,9 @@ namespace EventType {
 	  (PUBLIC & WITH_ACK)==0 &&
 	  (PRIVATE & WITH_ACK)==0 &&
 	  (PRIVATE & ASYNC)==0 &&
-	  (PUBLIC & ASYNC)==0, "flags should be distinct from event type");
+	  (PUBLIC & ASYNC)==0 &&
+	  (PRIVATE & BATCH)==0 &&
+	  (PUBLIC & BATCH)==0, "flags should be distinct from event type");
 
 /**
  * The flags are encoded in with the event type.
@@ -32,6 +32,13 @@ namespace FileTransfer {
         };
     };
 
+    namespace Flag {
+        enum Enum {
+            COMPRESSED = 0x01,  // the file data is a raw deflate stream, written to storage inflated
+            DELTA = 0x02        // the file data is a patch against the current module, written to storage patched
+        };
+    };
+
     struct __attribute__((packed)) Chunk
     {
         uint16_t size;
@@ -54,14 +61,18 @@ namespace FileTransfer {
          * 2 means application-provided storage
          */
         Store::Enum store;
-        uint8_t reserved;       // padding
+
+        /**
+         * {@link Flag} values.
+         */
+        uint8_t flags;
     };
 
     PARTICLE_STATIC_ASSERT(Chunk_size, sizeof(Chunk)==12);
 
     struct Descriptor : public Chunk
     {
-        Descriptor() { size = sizeof(*this); }
+        Descriptor() { size = sizeof(*this); flags = 0; storage_length = 0; }
 
         /**
          * The length of the file data.
@@ -70,12 +81,17 @@ namespace FileTransfer {
 
         uint32_t file_address;
 
+        /**
+         * The length of the data written to storage. Differs from {@code file_length} for compressed files and patches.
+         */
+        uint32_t storage_length;
+
         unsigned chunk_count(unsigned chunk_size) {
             return chunk_size ? (file_length+chunk_size-1)/chunk_size : 0;
         }
     };
 
-    PARTICLE_STATIC_ASSERT(Descriptor_size, sizeof(Descriptor)==20);
+    PARTICLE_STATIC_ASSERT(Descriptor_size, sizeof(Descriptor)==24);
 
 };
 
@@ -15,6 +15,7 @@
 #include "hal_platform.h"
 #include "mesh.h"
 #include "timesyncmanager.h"
+#include "describe_cache.h"
 #include "hal_platform.h"
 
 namespace particle
@@ -91,6 +92,14 @@ class Protocol
 	 */
 	Variables variables;
 
+protected:
+	/**
+	 * Completion handlers for messages with confirmable delivery. Declared before the
+	 * members that are constructed with a reference to it.
+	 */
+	CompletionHandlerMap<message_id_t> ack_handlers;
+
+private:
 	/**
 	 * Manages device-hosted functions.
 	 */
@@ -120,6 +129,31 @@ class Protocol
 	 */
 	system_tick_t last_ack_handlers_update;
 
+	/**
+	 * The describe message being posted in blocks.
+	 */
+	struct DescribePost
+	{
+		CoAPBlock block;	// the last block posted. {@code block.more} is clear when no more blocks are pending
+		int desc_flags;
+		int msg_id;			// the message ID of the last block, or -1 if it isn't known
+		token_t token;		// the token of the last block, which the response echoes
+		uint32_t checksum;	// the checksum of the describe message when its first block was posted
+		uint8_t restarts;	// the number of times the transfer was restarted because the message changed
+
+		DescribePost() : desc_flags(0), msg_id(-1), token(0), checksum(0), restarts(0) {}
+	} describe_post;
+
+	/**
+	 * Set when the server has acknowledged in its hello that it accepts describe messages in blocks.
+	 */
+	bool blockwise_supported;
+
+	/**
+	 * The application and system sections of the describe message.
+	 */
+	DescribeCache describe_cache;
+
 	/**
 	 * The token ID for the next request made.
 	 * If we have a bone-fide CoAP layer this will eventually disappear into that layer, just like message-id has.
@@ -149,6 +183,12 @@ public:
 		 * a keep-alive for UDP
 		 */
 		PING_AS_EMPTY_MESSAGE = 1<<2,
+
+		/**
+		 * When a session is resumed without a hello, send the queued events right away instead of
+		 * a ping. The first message moves the session, and its acknowledgement confirms it.
+		 */
+		FAST_RECONNECT = 1<<3,
 	};
 
 
@@ -158,12 +198,6 @@ protected:
 	 */
 	Pinger pinger;
 
-	/**
-	 * Completion handlers for messages with confirmable delivery.
-	 */
-	CompletionHandlerMap<message_id_t> ack_handlers;
-
-
 	void set_protocol_flags(int flags)
 	{
 		this->flags = flags;
@@ -258,8 +292,58 @@ protected:
 	/**
 	 * Produces and transmits (PIGGYBACK) a describe message.
 	 * @param desc_flags Flags describing the information to provide. A combination of {@code DESCRIBE_APPLICATION) and {@code DESCRIBE_SYSTEM) flags.
+	 * @param block The block requested with a Block2 option, or {@code nullptr}. A describe message that doesn't fit
+	 *   in a single message is sent in blocks even if no block was requested.
+	 */
+	ProtocolError send_description(token_t token, message_id_t msg_id, int desc_flags, const CoAPBlock* block=nullptr);
+
+	/**
+	 * Sends a block of the describe message in response to a request with a Block2 option.
+	 */
+	ProtocolError send_description_block(token_t token, message_id_t msg_id, int desc_flags, CoAPBlock block);
+
+	/**
+	 * Posts a block of the describe message with a Block1 option. The next block is posted when the
+	 * server acknowledges this one with 2.31 Continue.
 	 */
-	ProtocolError send_description(token_t token, message_id_t msg_id, int desc_flags);
+	ProtocolError post_description_block(int desc_flags, CoAPBlock block);
+
+	/**
+	 * Returns {@code true} if the message is the server's response to the last block of the posted describe
+	 * message. The response is matched by token, since it may be sent separately from the acknowledgement.
+	 */
+	bool is_description_block_response(Message& message, CoAPType::Enum type, message_id_t msg_id);
+
+	/**
+	 * Handles the server's response to a block of a posted describe message.
+	 */
+	ProtocolError handle_description_block_response(Message& message, CoAPCode::Enum code);
+
+	/**
+	 * Returns the size of the describe message, and optionally a checksum of its content.
+	 */
+	size_t description_size(int desc_flags, uint32_t* checksum=nullptr);
+
+	/**
+	 * Writes the part of the describe message covered by {@code block} as the payload of the message written by
+	 * {@code writer}, and sets {@code block.more}.
+	 * @param size The size of the describe message.
+	 */
+	void write_description_block(CoAPWriter& writer, int desc_flags, CoAPBlock& block, unsigned block_option,
+			size_t size);
+
+	/**
+	 * Records that a complete describe message has been sent.
+	 */
+	void description_sent(int desc_flags);
+
+	/**
+	 * Returns {@code true} if the sections requested by {@code desc_flags} have already been sent
+	 * during this session and haven't changed since.
+	 */
+	bool description_unchanged(int desc_flags);
+
+	void build_application_description(Appender& appender);
 
 	/**
 	 * Decodes and dispatches a received message to its handler.
@@ -301,8 +385,10 @@ public:
 			channel(channel),
 			product_id(PRODUCT_ID),
 			product_firmware_version(PRODUCT_FIRMWARE_VERSION),
+			functions(ack_handlers),
 			publisher(this),
 			last_ack_handlers_update(0),
+			blockwise_supported(false),
 			initialized(false)
 	{
 	}
@@ -327,6 +413,27 @@ public:
 		chunkedTransfer.set_fast_ota(data);
 	}
 
+	void set_windowed_ota(unsigned data)
+	{
+		chunkedTransfer.set_windowed_ota(data);
+	}
+
+	/**
+	 * Sets the burst size and the refill interval of the event rate limiter.
+	 */
+	void set_rate_limit(bool is_system_event, uint16_t burst, system_tick_t refill_interval)
+	{
+		publisher.set_rate_limit(is_system_event, burst, refill_interval);
+	}
+
+	void set_fast_reconnect(unsigned data)
+	{
+		if (data)
+			flags |= FAST_RECONNECT;
+		else
+			flags &= ~FAST_RECONNECT;
+	}
+
 	void set_handlers(CommunicationsHandlers& handlers)
 	{
 		copy_and_init(&this->handlers, sizeof(this->handlers), &handlers, handlers.size);
@@ -392,7 +499,7 @@ public:
 	 */
 	ProtocolError post_description(int desc_flags);
 
-	// Returns true on success, false on sending timeout or rate-limiting failure
+	// Returns true if the event was sent or queued, false on sending timeout or when the publish queue is full
 	bool send_event(const char *event_name, const char *data, int ttl,
 			EventType::Enum event_type, int flags, CompletionHandler handler)
 	{
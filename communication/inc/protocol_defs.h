@@ -18,7 +18,49 @@ namespace particle { namespace protocol {
 #define PRODUCT_FIRMWARE_VERSION (0xffff)
 #endif
 
+#ifndef MAX_SUBSCRIPTIONS
 #define MAX_SUBSCRIPTIONS (6)       // 2 system and 4 application
+#endif
+
+#ifndef PUBLISH_QUEUE_SIZE
+#define PUBLISH_QUEUE_SIZE (4)      // application events deferred by the rate limiter
+#endif
+
+#ifndef SYSTEM_PUBLISH_QUEUE_SIZE
+#define SYSTEM_PUBLISH_QUEUE_SIZE (4)   // system events deferred by the rate limiter
+#endif
+
+#ifndef PUBLISH_USER_EVENT_BURST
+#define PUBLISH_USER_EVENT_BURST (4)        // application events sent in a burst
+#endif
+
+#ifndef PUBLISH_USER_EVENT_INTERVAL
+#define PUBLISH_USER_EVENT_INTERVAL (1000)  // milliseconds for each application event after a burst
+#endif
+
+#ifndef PUBLISH_SYSTEM_EVENT_BURST
+#define PUBLISH_SYSTEM_EVENT_BURST (255)    // system events sent in a burst
+#endif
+
+#ifndef PUBLISH_SYSTEM_EVENT_INTERVAL
+#define PUBLISH_SYSTEM_EVENT_INTERVAL (65536 / 255) // milliseconds for each system event after a burst
+#endif
+
+#ifndef PUBLISH_BATCH_SIZE
+#define PUBLISH_BATCH_SIZE (512)    // maximum payload of a batch of events
+#endif
+
+#ifndef PUBLISH_BATCH_DELAY
+#define PUBLISH_BATCH_DELAY (1000)  // maximum time an event waits in a batch, in milliseconds
+#endif
+
+#ifndef MAX_PENDING_FUNCTION_CALLS
+#define MAX_PENDING_FUNCTION_CALLS (4)  // function calls that haven't returned their result yet
+#endif
+
+#ifndef DESCRIBE_MAX_SIZE
+#define DESCRIBE_MAX_SIZE (4096)    // larger describe messages are sent in blocks
+#endif
 
 enum ProtocolError
 {
@@ -66,6 +108,9 @@ const chunk_index_t NO_CHUNKS_MISSING = 65535;
 const chunk_index_t MAX_CHUNKS        = 65535;
 const size_t MISSED_CHUNKS_TO_SEND    = 40u;
 const size_t MINIMUM_CHUNK_INCREASE   = 2u;
+const chunk_index_t OTA_WINDOW_CHUNKS       = 64;   // chunks the server may send from the first missing chunk in windowed OTA
+const chunk_index_t OTA_WINDOW_ACK_INTERVAL = 8;    // chunks received between two window status reports
+const unsigned OTA_WINDOW_STATUS_TIMEOUT    = 2000; // milliseconds without a chunk before the window status is repeated
 const size_t MAX_EVENT_TTL_SECONDS    = 16777215;
 const size_t MAX_OPTION_DELTA_LENGTH  = 12;
 #if PLATFORM_ID<2
@@ -85,6 +130,9 @@ const size_t MAX_OPTION_DELTA_LENGTH  = 12;
 // Timeout in milliseconds given to receive an acknowledgement for a published event
 const unsigned SEND_EVENT_ACK_TIMEOUT = 20000;
 
+// Timeout in milliseconds given to receive an acknowledgement for the result of a function call
+const unsigned FUNCTION_RESULT_ACK_TIMEOUT = 20000;
+
 #ifndef PROTOCOL_BUFFER_SIZE
     #if PLATFORM_ID<2
         #define PROTOCOL_BUFFER_SIZE 640
@@ -114,7 +162,24 @@ namespace Connection
 enum Enum
 {
     PING = 0,
-    FAST_OTA = 1
+    FAST_OTA = 1,
+    WINDOWED_OTA = 2,
+    FAST_RECONNECT = 3
+};
+}
+
+/**
+ * Reasons why a persisted session wasn't resumed, as reported by the {@code cloud:resrsn} diagnostic.
+ */
+namespace SessionResumeFailure
+{
+enum Enum
+{
+    NONE = 0,
+    NO_SESSION = 1,         // no valid session is persisted
+    KEYS_CHANGED = 2,       // the session was established with different keys
+    EXPIRED = 3,            // the session was resumed too many times without the server confirming it
+    RESTORE_ERROR = 4       // the session state couldn't be restored
 };
 }
 
@@ -124,6 +189,20 @@ typedef std::function<int()> callback;
 const product_id_t UNDEFINED_PRODUCT_ID = product_id_t(-1);
 const product_firmware_version_t UNDEFINED_PRODUCT_VERSION = product_firmware_version_t(-1);
 
+/**
+ * Flags of the UpdateBegin request, echoed in the UpdateReady response for the modes the device accepts.
+ * UpdateBegin is refused with 4.15 when the device lacks the memory to process a compressed file or
+ * a patch, and the server then sends the plain image.
+ */
+namespace UpdateBeginFlag {
+enum Enum {
+    FAST_OTA      = 0x01,   // chunks are not acknowledged individually
+    WINDOWED_OTA  = 0x02,   // the device reports received chunks with a selective acknowledgement bitmap
+    COMPRESSED    = 0x04,   // the file is a raw deflate stream, followed in UpdateBegin by its inflated length
+    DELTA         = 0x08    // the file is a patch against the current module, followed in UpdateBegin by the patched length
+};
+}
+
 namespace UpdateFlag {
 enum Enum {
     ERROR         = 0x00,
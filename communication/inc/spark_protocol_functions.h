@@ -124,9 +124,18 @@ struct SparkCallbacks
 	void (*notify_client_messages_processed)(void* reserved);
 
 	// size == 56
+
+	/**
+	 * Optional callback - may be null.
+	 * @return the FileTransfer::Flag values of the updates the device can currently process. Compressed
+	 * files and patches are not advertised to the server when this is null.
+	 */
+	int (*firmware_update_flags)(void* reserved);
+
+	// size == 60
 };
 
-PARTICLE_STATIC_ASSERT(SparkCallbacks_size, sizeof(SparkCallbacks)==(sizeof(void*)*14));
+PARTICLE_STATIC_ASSERT(SparkCallbacks_size, sizeof(SparkCallbacks)==(sizeof(void*)*15));
 
 /**
  * Application-supplied callbacks. (Deliberately distinct from the system-supplied
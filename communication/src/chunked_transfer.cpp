@@ -20,6 +20,7 @@
 #include "chunked_transfer.h"
 #include "service_debug.h"
 #include "coap.h"
+#include "system_error.h"
 #include <algorithm>
 
 namespace particle { namespace protocol {
@@ -45,11 +46,34 @@ ProtocolError ChunkedTransfer::handle_update_begin(
             DEBUG("Fast OTA: %s", fast_ota_value?"enabled":"disabled");
         }
 
+        if (!windowed_ota_enabled || !(flags & UpdateBeginFlag::FAST_OTA)) {
+            // the windowed mode extends fast OTA
+            flags &= ~UpdateBeginFlag::WINDOWED_OTA;
+        }
+
         file.chunk_size = decode_uint16(queue + 9);
         file.file_length = decode_uint32(queue + 11);
         file.store = FileTransfer::Store::Enum(decode_uint8(queue + 15));
         file.file_address = decode_uint32(queue + 16);
         file.chunk_address = file.file_address;
+        file.flags = 0;
+        file.storage_length = file.file_length;
+        if ((flags & (UpdateBeginFlag::COMPRESSED | UpdateBeginFlag::DELTA)) && actual_len >= 24)
+        {
+            if (flags & UpdateBeginFlag::COMPRESSED)
+            {
+                file.flags |= FileTransfer::Flag::COMPRESSED;
+            }
+            if (flags & UpdateBeginFlag::DELTA)
+            {
+                file.flags |= FileTransfer::Flag::DELTA;
+            }
+            file.storage_length = decode_uint32(queue + 20);
+        }
+        else
+        {
+            flags &= ~(UpdateBeginFlag::COMPRESSED | UpdateBeginFlag::DELTA);
+        }
     }
     else
     {
@@ -58,18 +82,26 @@ ProtocolError ChunkedTransfer::handle_update_begin(
         file.store = FileTransfer::Store::FIRMWARE;
         file.file_address = 0;
         file.chunk_address = 0;
+        file.flags = 0;
+        file.storage_length = 0;
     }
+    windowed = false;
+    next_chunk = 0;
     // check the parameters only
-    bool success = !callbacks->prepare_for_firmware_update(file, 1, NULL);
+    const int prepared = callbacks->prepare_for_firmware_update(file, 1, NULL);
+    bool success = !prepared;
     if (success)
     {
         success = file.chunk_count(file.chunk_size) < MAX_CHUNKS;
     }
+    // a compressed file or a patch that can't be processed for lack of memory is refused with 4.15,
+    // so that the server sends the plain image instead
+    const bool fallback = prepared == SYSTEM_ERROR_NO_MEMORY && (file.flags & (FileTransfer::Flag::COMPRESSED | FileTransfer::Flag::DELTA));
     Message response;
     channel.response(message, response, 16);
     size_t size = success ?
     		Messages::empty_ack(response.buf(), 0, 0) :
-			Messages::coded_ack(response.buf(), token, RESPONSE_CODE(5, 03), 0, 0);
+			Messages::coded_ack(response.buf(), token, fallback ? RESPONSE_CODE(4, 15) : RESPONSE_CODE(5, 03), 0, 0);
     response.set_length(size);
     response.set_id(msg_id);
     ProtocolError error = channel.send(response);
@@ -98,8 +130,21 @@ ProtocolError ChunkedTransfer::handle_update_begin(
             // know the correct size of the bitmap.
             set_chunks_received(flags & 1 ? 0 : 0xFF);
 
-            // send update_reaady - use fast OTA if available
-            size_t size = Messages::update_ready(updateReady.buf(), 0, token, (flags & 0x1), channel.is_unreliable());
+            windowed = flags & UpdateBeginFlag::WINDOWED_OTA;
+            window_base = 0;
+            chunks_since_status = 0;
+            last_status_millis = last_chunk_millis;
+
+            // send update_reaady - use fast OTA if available, and the window size in windowed mode
+            const uint8_t ready_flags = flags & (UpdateBeginFlag::FAST_OTA | UpdateBeginFlag::WINDOWED_OTA | UpdateBeginFlag::COMPRESSED | UpdateBeginFlag::DELTA);
+            size_t size;
+            if (windowed) {
+                uint8_t ready[] = { ready_flags,
+                        uint8_t(OTA_WINDOW_CHUNKS >> 8), uint8_t(OTA_WINDOW_CHUNKS & 0xFF) };
+                size = Messages::separate_response_with_payload(updateReady.buf(), 0, token, 0x44, ready, sizeof(ready), channel.is_unreliable());
+            } else {
+                size = Messages::update_ready(updateReady.buf(), 0, token, ready_flags, channel.is_unreliable());
+            }
             updateReady.set_length(size);
             updateReady.set_confirm_received(true);
             error = channel.send(updateReady);
@@ -172,7 +217,7 @@ ProtocolError ChunkedTransfer::handle_chunk(token_t token, Message& message,
         const uint8_t* chunk = queue + payload;
         file.chunk_size = message.length() - payload;
         file.chunk_address = file.file_address + (chunk_index * chunk_size);
-        if (chunk_index >= MAX_CHUNKS)
+        if (chunk_index >= MAX_CHUNKS || chunk_index >= file.chunk_count(chunk_size))
         {
             WARN("invalid chunk index %d", chunk_index);
             return NO_ERROR;
@@ -182,9 +227,22 @@ ProtocolError ChunkedTransfer::handle_chunk(token_t token, Message& message,
         bool crc_valid = (crc == given_crc);
         DEBUG("chunk idx=%d crc=%d fast=%d updating=%d", chunk_index,
                 crc_valid, fast_ota, updating);
+        bool save = crc_valid;
+        if (crc_valid && (file.flags & (FileTransfer::Flag::COMPRESSED | FileTransfer::Flag::DELTA)) && chunk_index != next_chunk)
+        {
+            // compressed data and patches are decoded as they're saved, so the chunks are saved in order. A chunk
+            // that was already saved is acknowledged again, a later one is requested again later.
+            WARN("chunk out of order %d: expected %d", chunk_index, next_chunk);
+            crc_valid = chunk_index < next_chunk;
+            save = false;
+        }
         if (crc_valid)
         {
-            callbacks->save_firmware_chunk(file, chunk, NULL);
+            if (save)
+            {
+                callbacks->save_firmware_chunk(file, chunk, NULL);
+                next_chunk = chunk_index + 1;
+            }
             if (!fast_ota)
             {
                 // message is confirmable for regular OTA or when
@@ -209,10 +267,64 @@ ProtocolError ChunkedTransfer::handle_chunk(token_t token, Message& message,
             if (error)
                 return error;
         }
+        if (windowed && fast_ota)
+        {
+            // report regularly, and as soon as the last missing chunk has arrived
+            if (++chunks_since_status >= OTA_WINDOW_ACK_INTERVAL || next_chunk_missing(window_base) == NO_CHUNKS_MISSING)
+            {
+                return send_window_status(channel);
+            }
+        }
     }
     return NO_ERROR;
 }
 
+ProtocolError ChunkedTransfer::send_window_status(MessageChannel& channel)
+{
+    const chunk_index_t chunks = file.chunk_count(chunk_size);
+    window_base = next_chunk_missing(window_base);
+    if (window_base == NO_CHUNKS_MISSING)
+    {
+        window_base = chunks;
+    }
+    chunks_since_status = 0;
+    last_status_millis = callbacks->millis();
+
+    const size_t bitmap_size = OTA_WINDOW_CHUNKS / 8;
+    Message message;
+    ProtocolError error = channel.create(message, 4 + 2 + 1 + 4 + bitmap_size);
+    if (error)
+    {
+        return error;
+    }
+    CoAPWriter writer(message.buf(), message.capacity());
+    writer.header(CoAPType::NON, CoAPCode::POST, 0);
+    writer.option(CoAPOption::URI_PATH, "w");
+    size_t available = 0;
+    uint8_t* payload = writer.payload_buffer(&available);
+    if (available < 4 + bitmap_size)
+    {
+        return INSUFFICIENT_STORAGE;
+    }
+    payload[0] = window_base >> 8;
+    payload[1] = window_base & 0xFF;
+    payload[2] = OTA_WINDOW_CHUNKS >> 8;
+    payload[3] = OTA_WINDOW_CHUNKS & 0xFF;
+    // bit n is set if chunk window_base+n has been received
+    uint8_t* bits = payload + 4;
+    memset(bits, 0, bitmap_size);
+    for (chunk_index_t i = 0; i < OTA_WINDOW_CHUNKS && unsigned(window_base + i) < chunks; i++)
+    {
+        if (is_chunk_received(window_base + i))
+        {
+            bits[i >> 3] |= uint8_t(1 << (i & 7));
+        }
+    }
+    writer.commit_payload(4 + bitmap_size);
+    message.set_length(writer.length());
+    return channel.send(message);
+}
+
 size_t ChunkedTransfer::notify_update_done(Message& msg, Message& response, MessageChannel& channel, token_t token, uint8_t code)
 {
     size_t msgsz = 16;
@@ -335,8 +447,17 @@ ProtocolError ChunkedTransfer::send_missing_chunks(MessageChannel& channel,
 
 ProtocolError ChunkedTransfer::idle(MessageChannel& channel)
 {
-    /* Timeout to resend missing chunks removed.
-     * Leaving idle() here in case we need to add something in the future. */
+    /* Timeout to resend missing chunks removed in the regular mode.
+     * In windowed mode the server waits for the window status before sending more chunks,
+     * so it's repeated in case it was lost. */
+    if (windowed && is_updating())
+    {
+        const system_tick_t now = callbacks->millis();
+        if (now - last_chunk_millis >= OTA_WINDOW_STATUS_TIMEOUT && now - last_status_millis >= OTA_WINDOW_STATUS_TIMEOUT)
+        {
+            return send_window_status(channel);
+        }
+    }
     return NO_ERROR;
 }
 
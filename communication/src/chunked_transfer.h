@@ -90,6 +90,21 @@ private:
 	bool fast_ota_override;
 	bool fast_ota_value;
 
+	/**
+	 * Windowed transfer: the device reports the received chunks with a selective acknowledgement
+	 * bitmap, and the server only sends chunks within the window that starts at the first missing chunk.
+	 */
+	bool windowed_ota_enabled;
+	bool windowed;
+	chunk_index_t window_base;
+	chunk_index_t chunks_since_status;
+	system_tick_t last_status_millis;
+
+	/**
+	 * The next chunk to save when the chunks have to be saved in order.
+	 */
+	chunk_index_t next_chunk;
+
 protected:
 
 	unsigned chunk_bitmap_size()
@@ -115,10 +130,18 @@ protected:
 
 	chunk_index_t next_chunk_missing(chunk_index_t start);
 	void set_chunks_received(uint8_t value);
+
+	/**
+	 * Sends the window status: the index of the first missing chunk, the window size and a bitmap of
+	 * the chunks received within the window.
+	 */
+	ProtocolError send_window_status(MessageChannel& channel);
 public:
 
 	ChunkedTransfer() :
-			updating(false), callbacks(nullptr), fast_ota_override(false), fast_ota_value(true)
+			updating(false), callbacks(nullptr), fast_ota_override(false), fast_ota_value(true),
+			windowed_ota_enabled(true), windowed(false), window_base(0), chunks_since_status(0),
+			last_status_millis(0), next_chunk(0)
 	{
 	}
 
@@ -150,6 +173,24 @@ public:
 		fast_ota_override = true;
 	}
 
+	/**
+	 * Enables or disables accepting the windowed transfer mode when the server offers it.
+	 */
+	void set_windowed_ota(bool enabled)
+	{
+		windowed_ota_enabled = enabled;
+	}
+
+	bool is_windowed_ota_enabled()
+	{
+		return windowed_ota_enabled;
+	}
+
+	bool is_windowed()
+	{
+		return windowed;
+	}
+
 	bool is_updating()
 	{
 		return updating;
@@ -159,6 +200,7 @@ public:
 	{
 		updating = false;
 		last_chunk_millis = 0;    // this is used for the time latency also
+		windowed = false;
 	}
 
 	void cancel();
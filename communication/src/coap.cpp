@@ -45,6 +45,7 @@ CoAPCode::Enum CoAP::code(const unsigned char *message) {
         case CoAPCode::CHANGED: return CoAPCode::CHANGED;
         case CoAPCode::NOT_MODIFIED: return CoAPCode::NOT_MODIFIED;
         case CoAPCode::CONTENT: return CoAPCode::CONTENT;
+        case CoAPCode::BLOCK_CONTINUE: return CoAPCode::BLOCK_CONTINUE;
         default:
             // todo - add all recognised codes. Via a smart macro to void manually repeating them.
             if (CoAPCode::is_success(code)) {    // should have been handled above.
@@ -88,5 +89,210 @@ size_t CoAP::option_decode(unsigned char **option) {
     return option_length;
 }
 
+namespace {
+
+/**
+ * Decodes the extended value of an option delta or length nibble.
+ */
+bool decode_option_value(uint8_t nibble, const uint8_t** pos, const uint8_t* end, size_t* value)
+{
+    if (nibble < 13) {
+        *value = nibble;
+    } else if (nibble == 13) {
+        if (end - *pos < 1) {
+            return false;
+        }
+        *value = **pos + 13;
+        *pos += 1;
+    } else if (nibble == 14) {
+        if (end - *pos < 2) {
+            return false;
+        }
+        *value = (((*pos)[0] << 8) | (*pos)[1]) + 269;
+        *pos += 2;
+    } else {
+        // 15 is reserved for the payload marker
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+int CoAPReader::decode_option(const uint8_t** pos, const uint8_t* end, unsigned* number, const uint8_t** value, size_t* length) {
+    const uint8_t* p = *pos;
+    if (p >= end || *p == 0xFF) {
+        return 0;
+    }
+    const uint8_t delta_nibble = *p >> 4;
+    const uint8_t length_nibble = *p & 0x0F;
+    ++p;
+    size_t delta, len;
+    if (!decode_option_value(delta_nibble, &p, end, &delta) ||
+            !decode_option_value(length_nibble, &p, end, &len) ||
+            size_t(end - p) < len) {
+        return -1;
+    }
+    *number += delta;
+    *value = p;
+    *length = len;
+    *pos = p + len;
+    return 1;
+}
+
+CoAPReader::CoAPReader(const uint8_t* buf, size_t length) :
+        buf(buf),
+        end(buf + length),
+        options_begin(end),
+        options_end(end),
+        valid(false) {
+    if (length < 4) {
+        return;
+    }
+    const size_t token_length = buf[0] & 0x0F;
+    if (token_length > 8 || length < 4 + token_length) {
+        return;
+    }
+    options_begin = buf + 4 + token_length;
+    const uint8_t* p = options_begin;
+    unsigned number = 0;
+    const uint8_t* value;
+    size_t value_length;
+    int result;
+    while ((result = decode_option(&p, end, &number, &value, &value_length)) > 0) {
+    }
+    if (result < 0) {
+        return;
+    }
+    options_end = p;
+    valid = true;
+}
+
+bool CoAPReader::find_option(unsigned number, const uint8_t** data, size_t* length) const {
+    OptionIterator it = options();
+    while (it.next()) {
+        if (it.number() == number) {
+            *data = it.data();
+            *length = it.length();
+            return true;
+        }
+        if (it.number() > number) {
+            break;
+        }
+    }
+    return false;
+}
+
+const uint8_t CoAPBlock::MAX_SZX;
+
+bool CoAPBlock::decode(const uint8_t* data, size_t length, CoAPBlock* block) {
+    if (length > 3) {
+        return false;
+    }
+    uint32_t value = 0;
+    for (size_t i = 0; i < length; ++i) {
+        value = value << 8 | data[i];
+    }
+    const uint8_t szx = value & 0x07;
+    if (szx > MAX_SZX) {
+        return false; // 7 is reserved
+    }
+    block->num = value >> 4;
+    block->szx = szx;
+    block->more = value & 0x08;
+    return true;
+}
+
+uint8_t CoAPBlock::szx_for(size_t max_size) {
+    uint8_t szx = 0;
+    while (szx < MAX_SZX && (size_t(16) << (szx + 1)) <= max_size) {
+        ++szx;
+    }
+    return szx;
+}
+
+uint8_t* CoAPWriter::reserve(size_t length) {
+    if (overflowed || size - pos < length) {
+        overflowed = true;
+        return nullptr;
+    }
+    uint8_t* p = buf + pos;
+    pos += length;
+    return p;
+}
+
+void CoAPWriter::header(CoAPType::Enum type, uint8_t code, message_id_t id, const uint8_t* token, size_t token_length) {
+    uint8_t* p = reserve(4 + token_length);
+    if (p) {
+        CoAP::header(p, type, CoAPCode::Enum(code), token_length, token, id);
+    }
+}
+
+void CoAPWriter::option(unsigned number, const void* data, size_t length) {
+    const unsigned delta = number - last_option;
+    const uint8_t delta_nibble = CoAP::option_value_nibble(delta);
+    const uint8_t length_nibble = CoAP::option_value_nibble(length);
+    const size_t option_size = 1 + (delta_nibble == 13 ? 1 : delta_nibble == 14 ? 2 : 0) +
+            (length_nibble == 13 ? 1 : length_nibble == 14 ? 2 : 0) + length;
+    uint8_t* p = reserve(option_size);
+    if (p) {
+        *p++ = (delta_nibble << 4) | length_nibble;
+        p += CoAP::extended_option_value(p, delta_nibble, delta);
+        p += CoAP::extended_option_value(p, length_nibble, length);
+        if (length) {
+            memcpy(p, data, length);
+        }
+        last_option = number;
+    }
+}
+
+void CoAPWriter::option_uint(unsigned number, uint32_t value) {
+    uint8_t bytes[4];
+    size_t length = 0;
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        const uint8_t b = value >> shift;
+        if (b || length) {
+            bytes[length++] = b;
+        }
+    }
+    option(number, bytes, length);
+}
+
+void CoAPWriter::payload(const void* data, size_t length) {
+    if (!length) {
+        return;
+    }
+    size_t available = 0;
+    uint8_t* p = payload_buffer(&available);
+    if (p && available >= length) {
+        memcpy(p, data, length);
+        commit_payload(length);
+    } else {
+        overflowed = true;
+    }
+}
+
+uint8_t* CoAPWriter::payload_buffer(size_t* available) {
+    *available = 0;
+    if (overflowed || has_payload || size - pos < 2) {
+        // the payload marker must be followed by at least one byte
+        return nullptr;
+    }
+    *available = size - pos - 1;
+    return buf + pos + 1;
+}
+
+void CoAPWriter::commit_payload(size_t length) {
+    if (!length || overflowed || has_payload) {
+        // an empty payload has no payload marker
+        return;
+    }
+    uint8_t* p = reserve(1 + length);
+    if (p) {
+        *p = 0xFF;
+        has_payload = true;
+    }
+}
+
 }
 }
@@ -67,25 +67,83 @@ void CoAPMessageStore::message_timeout(CoAPMessage& msg, Channel& channel)
  */
 void CoAPMessageStore::process(system_tick_t time, Channel& channel)
 {
-	CoAPMessage* msg = head;
-	CoAPMessage* prev = nullptr;
-	while (msg!=nullptr)
+	while (queue_size && time_has_passed(time, queue[0]->get_timeout()))
 	{
-		if (time_has_passed(time, msg->get_timeout()) && !retransmit(msg, channel, time))
+		CoAPMessage* msg = queue[0];
+		if (retransmit(msg, channel, time))
 		{
-			remove(msg, prev);
-			message_timeout(*msg, channel);
-			delete msg;
-			msg = (prev==nullptr) ? head : prev->get_next();
+			// the message has a new timeout
+			queue_sift_down(0);
 		}
 		else
 		{
-			prev = msg;
-			msg = msg->get_next();
+			remove(msg->get_id());
+			message_timeout(*msg, channel);
+			delete msg;
 		}
 	}
 }
 
+void CoAPMessageStore::queue_sift_up(uint16_t index)
+{
+	CoAPMessage* msg = queue[index];
+	while (index>0)
+	{
+		const uint16_t parent = (index-1)/2;
+		if (!due_before(msg, queue[parent]))
+			break;
+		queue_place(queue[parent], index);
+		index = parent;
+	}
+	queue_place(msg, index);
+}
+
+void CoAPMessageStore::queue_sift_down(uint16_t index)
+{
+	CoAPMessage* msg = queue[index];
+	for (;;)
+	{
+		uint16_t child = index*2+1;
+		if (child>=queue_size)
+			break;
+		if (child+1<queue_size && due_before(queue[child+1], queue[child]))
+			child++;
+		if (!due_before(queue[child], msg))
+			break;
+		queue_place(queue[child], index);
+		index = child;
+	}
+	queue_place(msg, index);
+}
+
+bool CoAPMessageStore::queue_push(CoAPMessage* msg)
+{
+	if (queue_size==queue_capacity)
+	{
+		const uint16_t capacity = queue_capacity ? queue_capacity*2 : 4;
+		CoAPMessage** q = (CoAPMessage**)realloc(queue, capacity*sizeof(CoAPMessage*));
+		if (!q)
+			return false;
+		queue = q;
+		queue_capacity = capacity;
+	}
+	queue_place(msg, queue_size++);
+	queue_sift_up(msg->queue_index);
+	return true;
+}
+
+void CoAPMessageStore::queue_remove(CoAPMessage* msg)
+{
+	const uint16_t index = msg->queue_index;
+	CoAPMessage* last = queue[--queue_size];
+	if (last!=msg)
+	{
+		queue_place(last, index);
+		queue_sift_down(index);
+		queue_sift_up(last->queue_index);
+	}
+}
+
 
 /**
  * Registers that this message has been sent from the application.
@@ -108,7 +166,12 @@ ProtocolError CoAPMessageStore::send(Message& msg, system_tick_t time)
 			coapmsg->prepare_retransmit(time);
 		else
 			coapmsg->set_expiration(time+CoAPMessage::MAX_TRANSMIT_SPAN);
-		add(*coapmsg);
+		const ProtocolError error = add(*coapmsg);
+		if (error)
+		{
+			delete coapmsg;
+			return error;
+		}
 	}
 	return NO_ERROR;
 }
@@ -159,22 +222,16 @@ ProtocolError CoAPMessageStore::receive(Message& msg, Channel& channel, system_t
 			// the timeout here is ideally purely academic since the application will respond immediately with an ACK/RESET
 			// which will be stored in place of this message, with it's own timeout.
 			coapmsg->set_expiration(time+CoAPMessage::MAX_TRANSMIT_SPAN);
-			add(*coapmsg);
+			const ProtocolError error = add(*coapmsg);
+			if (error)
+			{
+				delete coapmsg;
+				return error;
+			}
 		}
 	}
 	// else it's a NON message - pass through
 	return NO_ERROR;
 }
 
-bool CoAPMessageStore::has_unacknowledged_requests() const
-{
-	// TODO: Use a message counter
-	for (const CoAPMessage* msg = head; msg != nullptr; msg = msg->get_next()) {
-		if (is_confirmable((uint8_t*)msg->get_data()))
-			return true;
-	}
-
-	return false;
-}
-
 }}
@@ -127,6 +127,11 @@ private:
 	// uint8_t reserved;
 	std::function<void(Delivery)>* delivered;
 
+	/**
+	 * The position of this message in the retransmission queue of the message store holding it.
+	 */
+	uint16_t queue_index;
+
 
 	/**
 	 * How many data bytes follow.
@@ -140,6 +145,8 @@ private:
 
 	static uint16_t message_count;
 
+	friend class CoAPMessageStore;
+
 	/**
 	 * Notification that the message has been delivered to the server.
 	 */
@@ -164,7 +171,7 @@ public:
 	static const uint8_t NSTART = 1;
 
 
-	CoAPMessage(message_id_t id_) : next(nullptr), timeout(0), id(id_), transmit_count(0), delivered(nullptr), data_len(0) {
+	CoAPMessage(message_id_t id_) : next(nullptr), timeout(0), id(id_), transmit_count(0), delivered(nullptr), queue_index(0), data_len(0) {
 		message_count++;
 	}
 
@@ -295,24 +302,68 @@ inline bool time_has_passed(system_tick_t now, system_tick_t tick)
 
 /**
  * A mix-in class that provides message resending for reliable delivery of messages.
+ *
+ * Messages are indexed by ID in a small hash table, and ordered by their timeout in a
+ * binary min-heap so that processing only needs to look at the messages that are due.
  */
 class CoAPMessageStore
 {
 	LOG_CATEGORY("comm.coap");
 
 	/**
-	 * The head of the list of messages.
+	 * The number of hash buckets. Message IDs are assigned sequentially so the low bits
+	 * spread consecutive messages evenly over the buckets.
+	 */
+	static const unsigned BUCKET_COUNT = 16;
+	static_assert((BUCKET_COUNT & (BUCKET_COUNT-1))==0, "BUCKET_COUNT must be a power of 2");
+
+	/**
+	 * The messages hashed by ID. Each bucket is a singly-linked list of messages,
+	 * most recently added first.
+	 */
+	CoAPMessage* buckets[BUCKET_COUNT];
+
+	/**
+	 * The retransmission queue: a binary min-heap of all stored messages ordered by timeout.
+	 */
+	CoAPMessage** queue;
+	uint16_t queue_size;
+	uint16_t queue_capacity;
+
+	/**
+	 * The number of stored confirmable messages.
 	 */
-	CoAPMessage* head;
+	uint16_t confirmable_count;
+
+	static inline CoAPMessage*& bucket_for(CoAPMessage** buckets, message_id_t id)
+	{
+		return buckets[id & (BUCKET_COUNT-1)];
+	}
+
+	static inline bool due_before(const CoAPMessage* a, const CoAPMessage* b)
+	{
+		return int32_t(a->get_timeout()-b->get_timeout()) < 0;
+	}
+
+	inline void queue_place(CoAPMessage* message, uint16_t index)
+	{
+		queue[index] = message;
+		message->queue_index = index;
+	}
+
+	void queue_sift_up(uint16_t index);
+	void queue_sift_down(uint16_t index);
+	bool queue_push(CoAPMessage* message);
+	void queue_remove(CoAPMessage* message);
 
 	/**
-	 * Retrieves the message with the given ID and the previous message.
+	 * Retrieves the message with the given ID and the previous message in its bucket.
 	 * If no message exists with the given id, nullptr is returned.
 	 */
 	CoAPMessage* for_id(message_id_t id, CoAPMessage*& prev) const
 	{
 		prev = nullptr;
-		CoAPMessage* next = head;
+		CoAPMessage* next = bucket_for(const_cast<CoAPMessage**>(buckets), id);
 		while (next)
 		{
 			if (next->matches(id))
@@ -324,33 +375,40 @@ class CoAPMessageStore
 	}
 
 	/**
-	 * Removes a message given the message to remove and the previous entry in the list.
+	 * Removes a message given the message to remove and the previous entry in its bucket.
 	 */
 	void remove(CoAPMessage* message, CoAPMessage* previous)
 	{
 		if (previous)
 			previous->set_next(message->get_next());
 		else
-			head = message->get_next();
+			bucket_for(buckets, message->get_id()) = message->get_next();
 		message->removed();
+		queue_remove(message);
+		if (message->get_type()==CoAPType::CON)
+			confirmable_count--;
 	}
 
 	void message_timeout(CoAPMessage& msg, Channel& channel);
 
 public:
 
-	CoAPMessageStore() : head(nullptr) {}
+	CoAPMessageStore() : buckets(), queue(nullptr), queue_size(0), queue_capacity(0), confirmable_count(0) {}
 
 	~CoAPMessageStore() {
 		clear();
+		free(queue);
 	}
 
 	bool has_messages() const
 	{
-		return head!=nullptr;
+		return queue_size!=0;
 	}
 
-	bool has_unacknowledged_requests() const;
+	bool has_unacknowledged_requests() const
+	{
+		return confirmable_count!=0;
+	}
 
 	/**
 	 * Retrieves the current confirmable message that is still
@@ -381,8 +439,13 @@ public:
 		clear_message(message.get_id());
 		if (message.get_next())
 			return INVALID_STATE;
-		message.set_next(head);
-		head = &message;
+		if (!queue_push(&message))
+			return INSUFFICIENT_STORAGE;
+		CoAPMessage*& bucket = bucket_for(buckets, message.get_id());
+		message.set_next(bucket);
+		bucket = &message;
+		if (message.get_type()==CoAPType::CON)
+			confirmable_count++;
 		return NO_ERROR;
 	}
 
@@ -444,9 +507,9 @@ public:
 	 */
 	void clear()
 	{
-		while (head!=nullptr)
+		while (queue_size)
 		{
-			delete remove(head->get_id());
+			delete remove(queue[queue_size-1]->get_id());
 		}
 	}
 
@@ -2,3 +2,6 @@
 
 particle::SimpleIntegerDiagnosticData g_rateLimitedEventsCounter(DIAG_ID_CLOUD_RATE_LIMITED_EVENTS, DIAG_NAME_CLOUD_RATE_LIMITED_EVENTS);
 particle::SimpleIntegerDiagnosticData g_unacknowledgedMessageCounter(DIAG_ID_CLOUD_UNACKNOWLEDGED_MESSAGES, DIAG_NAME_CLOUD_UNACKNOWLEDGED_MESSAGES);
+particle::SimpleIntegerDiagnosticData g_sessionResumeCounter(DIAG_ID_CLOUD_SESSION_RESUMES, DIAG_NAME_CLOUD_SESSION_RESUMES);
+particle::SimpleIntegerDiagnosticData g_sessionResumeFailureCounter(DIAG_ID_CLOUD_SESSION_RESUME_FAILURES, DIAG_NAME_CLOUD_SESSION_RESUME_FAILURES);
+particle::SimpleIntegerDiagnosticData g_sessionResumeFailureReason(DIAG_ID_CLOUD_SESSION_RESUME_FAILURE_REASON, DIAG_NAME_CLOUD_SESSION_RESUME_FAILURE_REASON);
@@ -2,3 +2,6 @@
 
 extern particle::SimpleIntegerDiagnosticData g_rateLimitedEventsCounter;
 extern particle::SimpleIntegerDiagnosticData g_unacknowledgedMessageCounter;
+extern particle::SimpleIntegerDiagnosticData g_sessionResumeCounter;
+extern particle::SimpleIntegerDiagnosticData g_sessionResumeFailureCounter;
+extern particle::SimpleIntegerDiagnosticData g_sessionResumeFailureReason;
@@ -0,0 +1,188 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "appender.h"
+
+#include <cstdint>
+#include <new>
+
+namespace particle { namespace protocol {
+
+/**
+ * Caches the sections of the describe message, so that the message isn't rebuilt each time it is
+ * requested or sent in blocks.
+ *
+ * A section is keyed by the state checksum it was built for, i.e. the checksum of the registered
+ * functions and variables, or of the system modules. It is rebuilt only when that checksum changes.
+ * Each cached section also has a CRC of its content, which tells whether the content sent to the
+ * cloud during the current session is still up to date.
+ */
+class DescribeCache
+{
+public:
+	enum Section
+	{
+		APPLICATION,
+		SYSTEM,
+		SECTION_COUNT
+	};
+
+	typedef uint32_t (*CrcFn)(const uint8_t* data, uint32_t length);
+
+	DescribeCache() :
+			sections(),
+			calc_crc(nullptr),
+			builds(0)
+	{
+	}
+
+	~DescribeCache()
+	{
+		clear();
+	}
+
+	void init(CrcFn calc_crc)
+	{
+		this->calc_crc = calc_crc;
+	}
+
+	/**
+	 * Appends a section of the describe message. The section is built by calling
+	 * {@code build(Appender&)} unless it is cached for the given state checksum. If the section
+	 * can't be cached, it is built directly into the appender.
+	 */
+	template<typename BuildFn>
+	void append(Section section, uint32_t state_crc, Appender& appender, BuildFn build)
+	{
+		Entry& entry = sections[section];
+		if (!entry.data || entry.state_crc != state_crc)
+		{
+			update(entry, state_crc, build);
+		}
+		if (entry.data)
+		{
+			appender.append(entry.data, entry.size);
+		}
+		else
+		{
+			build(appender);
+		}
+	}
+
+	/**
+	 * Returns {@code true} if the section is cached and its content has been sent during the
+	 * current session.
+	 */
+	bool is_sent(Section section) const
+	{
+		const Entry& entry = sections[section];
+		return entry.data && entry.sent && entry.sent_crc == entry.crc;
+	}
+
+	/**
+	 * Records that the current content of a cached section has been sent.
+	 */
+	void set_sent(Section section)
+	{
+		Entry& entry = sections[section];
+		entry.sent = entry.data != nullptr;
+		entry.sent_crc = entry.crc;
+	}
+
+	/**
+	 * Forgets what was sent, e.g. when a new session is started.
+	 */
+	void reset_sent()
+	{
+		for (Entry& entry: sections)
+		{
+			entry.sent = false;
+		}
+	}
+
+	/**
+	 * Returns the number of times the sections have been built for caching.
+	 */
+	unsigned build_count() const
+	{
+		return builds;
+	}
+
+	void clear()
+	{
+		for (Entry& entry: sections)
+		{
+			delete[] entry.data;
+			entry = Entry();
+		}
+	}
+
+private:
+	struct Entry
+	{
+		uint8_t* data;
+		size_t size;
+		uint32_t state_crc;
+		uint32_t crc;
+		uint32_t sent_crc;
+		bool sent;
+
+		Entry() :
+				data(nullptr),
+				size(0),
+				state_crc(0),
+				crc(0),
+				sent_crc(0),
+				sent(false)
+		{
+		}
+	};
+
+	Entry sections[SECTION_COUNT];
+	CrcFn calc_crc;
+	unsigned builds;
+
+	template<typename BuildFn>
+	void update(Entry& entry, uint32_t state_crc, BuildFn build)
+	{
+		delete[] entry.data;
+		entry.data = nullptr;
+		++builds;
+		BufferAppender2 counter(nullptr, 0);
+		build(counter);
+		uint8_t* data = new(std::nothrow) uint8_t[counter.dataSize() ? counter.dataSize() : 1];
+		if (!data)
+		{
+			return;
+		}
+		BufferAppender2 appender((char*)data, counter.dataSize());
+		build(appender);
+		if (appender.dataSize() != counter.dataSize())
+		{
+			delete[] data;	// the section changed while it was being built
+			return;
+		}
+		entry.data = data;
+		entry.size = appender.dataSize();
+		entry.state_crc = state_crc;
+		entry.crc = calc_crc ? calc_crc(data, entry.size) : 0;
+	}
+};
+
+} } // namespace particle::protocol
@@ -76,14 +76,23 @@ void SessionPersist::update(mbedtls_ssl_context* context, save_fn_t saver, messa
 	}
 }
 
-auto SessionPersist::restore(mbedtls_ssl_context* context, bool renegotiate, uint32_t keys_checksum, message_id_t* next_id, restore_fn_t restorer, save_fn_t saver) -> RestoreStatus
+auto SessionPersist::restore(mbedtls_ssl_context* context, bool renegotiate, uint32_t keys_checksum, message_id_t* next_id, restore_fn_t restorer, save_fn_t saver,
+		SessionResumeFailure::Enum* failure) -> RestoreStatus
 {
+	SessionResumeFailure::Enum dummy;
+	if (!failure) {
+		failure = &dummy;
+	}
+	*failure = SessionResumeFailure::NO_SESSION;
 	if (!restore_this_from(restorer)) {
 		return NO_SESSION;
 	}
 
 	if (!is_valid() || keys_checksum!=this->keys_checksum) {
 		LOG(WARN,"discarding session: valid %d, keys_sum: %d/%d", is_valid(), keys_checksum, this->keys_checksum);
+		if (is_valid()) {
+			*failure = SessionResumeFailure::KEYS_CHANGED;
+		}
 		return NO_SESSION;
 	}
 
@@ -92,9 +101,13 @@ auto SessionPersist::restore(mbedtls_ssl_context* context, bool renegotiate, uin
 	    invalidate();
 	    save(saver);
 	    LOG(WARN, "session has expired after %d uses", use_count());
+	    *failure = SessionResumeFailure::EXPIRED;
 	    return NO_SESSION;
 	}
 
+	// anything going wrong from here on is an error restoring the session
+	*failure = SessionResumeFailure::RESTORE_ERROR;
+
     increment_use_count();
     save(saver);
 
@@ -347,6 +360,7 @@ ProtocolError DTLSMessageChannel::setup_context()
 ProtocolError DTLSMessageChannel::establish(uint32_t& flags, uint32_t app_state_crc)
 {
 	int ret = 0;
+	resume_failure = SessionResumeFailure::NONE;
 	// LOG(INFO,"setup context");
 	ProtocolError error = setup_context();
 	if (error) {
@@ -355,7 +369,8 @@ ProtocolError DTLSMessageChannel::establish(uint32_t& flags, uint32_t app_state_
 	}
 	bool renegotiate = false;
 
-	SessionPersist::RestoreStatus restoreStatus = sessionPersist.restore(&ssl_context, renegotiate, keys_checksum, coap_state, callbacks.restore, callbacks.save);
+	SessionResumeFailure::Enum failure = SessionResumeFailure::NONE;
+	SessionPersist::RestoreStatus restoreStatus = sessionPersist.restore(&ssl_context, renegotiate, keys_checksum, coap_state, callbacks.restore, callbacks.save, &failure);
 	LOG(INFO,"(CMPL,RENEG,NO_SESS,ERR) restoreStatus=%d", restoreStatus);
 	if (restoreStatus==SessionPersist::COMPLETE)
 	{
@@ -379,6 +394,8 @@ ProtocolError DTLSMessageChannel::establish(uint32_t& flags, uint32_t app_state_
 	}
 	else // no session or clear
 	{
+		LOG(INFO,"session not resumed, reason %d", failure);
+		resume_failure = failure;
 		reset_session();
 		ProtocolError error = setup_context();
 		if (error)
@@ -527,7 +544,7 @@ bool DTLSMessageChannel::is_unreliable()
 
 ProtocolError DTLSMessageChannel::command(Command command, void* arg)
 {
-	LOG(INFO,"session cmd (CLS,DIS,MOV,LOD,SAV): %d", command);
+	LOG(INFO,"session cmd (CLS,DIS,MOV,LOD,SAV,RSN): %d", command);
 	switch (command)
 	{
 	case CLOSE:
@@ -549,6 +566,10 @@ ProtocolError DTLSMessageChannel::command(Command command, void* arg)
 	case SAVE_SESSION:
 		sessionPersist.save(callbacks.save);
 		break;
+
+	case GET_RESUME_FAILURE:
+		*static_cast<SessionResumeFailure::Enum*>(arg) = resume_failure;
+		break;
 	}
 	return NO_ERROR;
 }
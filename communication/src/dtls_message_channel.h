@@ -101,6 +101,7 @@ private:
 	 */
 	message_id_t* coap_state;
 	bool move_session;
+	SessionResumeFailure::Enum resume_failure;
 	const uint8_t* device_id;
 
     void init();
@@ -122,7 +123,7 @@ private:
 	void reset_session();
 
  public:
-	DTLSMessageChannel() : coap_state(nullptr), move_session(false) {}
+	DTLSMessageChannel() : coap_state(nullptr), move_session(false), resume_failure(SessionResumeFailure::NONE) {}
 
 	ProtocolError init(const uint8_t* core_private, size_t core_private_len,
 		const uint8_t* core_public, size_t core_public_len,
@@ -0,0 +1,205 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "protocol_defs.h"
+#include "events.h"
+#include "messages.h"
+
+#include "completion_handler.h"
+
+#include <new>
+
+namespace particle { namespace protocol {
+
+/**
+ * Accumulates events to be sent to the cloud in a single message.
+ *
+ * The batch is due to be sent once it holds {@code MAX_EVENTS} events, or once its oldest event has
+ * waited for the configured delay. Each event keeps its own completion handler, which is invoked
+ * with the result of sending the batch.
+ */
+class EventBatch
+{
+public:
+	static const size_t MAX_EVENTS = 8;
+
+	EventBatch() :
+			buffer(nullptr),
+			max_size(PUBLISH_BATCH_SIZE),
+			max_delay(PUBLISH_BATCH_DELAY),
+			length(0),
+			count(0),
+			deadline(0)
+	{
+	}
+
+	~EventBatch()
+	{
+		fail(SYSTEM_ERROR_CANCELLED);
+		delete[] buffer;
+	}
+
+	/**
+	 * Sets the maximum payload size and the maximum time an event waits in the batch.
+	 * Takes effect when the batch is empty.
+	 */
+	void configure(size_t max_size, system_tick_t max_delay)
+	{
+		if (!count)
+		{
+			delete[] buffer;
+			buffer = nullptr;
+			this->max_size = max_size;
+		}
+		this->max_delay = max_delay;
+	}
+
+	/**
+	 * Adds an event to the batch.
+	 * @return {@code NO_ERROR} if the event was added, or {@code INSUFFICIENT_STORAGE} if it doesn't
+	 * fit in the remaining space or the buffer couldn't be allocated.
+	 */
+	ProtocolError add(const char* event_name, const char* data, int ttl, EventType::Enum event_type,
+			system_tick_t time, CompletionHandler&& handler)
+	{
+		if (count == MAX_EVENTS)
+			return INSUFFICIENT_STORAGE;
+		if (!buffer)
+		{
+			buffer = new (std::nothrow) uint8_t[max_size];
+			if (!buffer)
+				return INSUFFICIENT_STORAGE;
+		}
+		const size_t n = Messages::event_batch_record(buffer + length, max_size - length, event_name, data, ttl, event_type);
+		if (!n)
+			return INSUFFICIENT_STORAGE;
+		if (!count)
+			deadline = time + max_delay;
+		length += n;
+		handlers[count++] = std::move(handler);
+		return NO_ERROR;
+	}
+
+	/**
+	 * Determines if an event of the given size would fit in an empty batch.
+	 */
+	bool fits_empty(const char* event_name, const char* data) const
+	{
+		const size_t name_len = strnlen(event_name, MAX_EVENT_NAME_LENGTH);
+		const size_t data_len = data ? strnlen(data, MAX_EVENT_DATA_LENGTH) : 0;
+		return 1 + 1 + name_len + 3 + 2 + data_len <= max_size;
+	}
+
+	bool is_due(system_tick_t time) const
+	{
+		return count == MAX_EVENTS || (count && int32_t(time - deadline) >= 0);
+	}
+
+	size_t events() const { return count; }
+	const uint8_t* payload() const { return buffer; }
+	size_t payload_length() const { return length; }
+
+	/**
+	 * Empties the batch, returning a handler that forwards the result of sending the batch to
+	 * the completion handlers of its events.
+	 */
+	CompletionHandler take_completion()
+	{
+		Completion* completion = new (std::nothrow) Completion();
+		if (!completion)
+		{
+			fail(SYSTEM_ERROR_NO_MEMORY);
+			return CompletionHandler();
+		}
+		for (size_t i = 0; i < count; i++)
+			completion->handlers[i] = std::move(handlers[i]);
+		completion->count = count;
+		length = 0;
+		count = 0;
+		return CompletionHandler(complete, completion);
+	}
+
+	/**
+	 * Empties the batch, passing each of its events to {@code fn} along with the event's completion
+	 * handler. The event name and data passed to {@code fn} aren't null-terminated.
+	 */
+	template<typename F>
+	void unbatch(F fn)
+	{
+		const uint8_t* p = buffer;
+		const size_t n = count;
+		length = 0;
+		count = 0;
+		for (size_t i = 0; i < n; i++)
+		{
+			const auto event_type = EventType::Enum(*p++);
+			const size_t name_len = *p++;
+			const char* event_name = reinterpret_cast<const char*>(p);
+			p += name_len;
+			const int ttl = p[0] << 16 | p[1] << 8 | p[2];
+			p += 3;
+			const size_t data_len = p[0] << 8 | p[1];
+			p += 2;
+			const char* data = reinterpret_cast<const char*>(p);
+			p += data_len;
+			fn(event_name, name_len, data, data_len, ttl, event_type, std::move(handlers[i]));
+		}
+	}
+
+	/**
+	 * Empties the batch, completing the handlers of its events with the given error.
+	 */
+	void fail(int error)
+	{
+		for (size_t i = 0; i < count; i++)
+			handlers[i].setError(error);
+		length = 0;
+		count = 0;
+	}
+
+private:
+	struct Completion
+	{
+		CompletionHandler handlers[MAX_EVENTS];
+		size_t count;
+	};
+
+	uint8_t* buffer;
+	size_t max_size;
+	system_tick_t max_delay;
+	size_t length;
+	size_t count;
+	system_tick_t deadline;
+	CompletionHandler handlers[MAX_EVENTS];
+
+	static void complete(int error, const void* data, void* callback_data, void* reserved)
+	{
+		Completion* completion = static_cast<Completion*>(callback_data);
+		for (size_t i = 0; i < completion->count; i++)
+		{
+			if (error)
+				completion->handlers[i].setError(error);
+			else
+				completion->handlers[i].setResult();
+		}
+		delete completion;
+	}
+};
+
+}}
@@ -24,6 +24,8 @@
 #include "message_channel.h"
 #include "messages.h"
 #include "spark_descriptor.h"
+#include "completion_handler.h"
+#include "logging.h"
 
 
 namespace particle
@@ -31,20 +33,71 @@ namespace particle
 namespace protocol
 {
 
+/**
+ * Handles function calls from the cloud.
+ *
+ * A call is acknowledged as soon as it is received, and the user function runs asynchronously,
+ * i.e. on the application thread, or after the protocol loop on single-threaded platforms. Its
+ * result is sent as a separate confirmable response, whose acknowledgement is tracked like that of
+ * an event. Results of calls received in a previous session are dropped, since the cloud no longer
+ * waits for them.
+ */
 class Functions
 {
     char function_arg[MAX_FUNCTION_ARG_LENGTH+1]; // add one for null terminator
 
+    CompletionHandlerMap<message_id_t>& ack_handlers;
+    unsigned session;
+    unsigned pending;
+
+    static void function_result_sent(int error, const void* data, void* callback_data, void* reserved)
+    {
+        if (error)
+        {
+            LOG(WARN, "Function result not acknowledged: %d", error);
+        }
+    }
+
     ProtocolError function_result(MessageChannel& channel, const void* result, SparkReturnType::Enum, token_t token)
     {
         Message message;
         channel.create(message, Messages::function_return_size);
         size_t length = Messages::function_return(message.buf(), 0, token, long(result), channel.is_unreliable());
         message.set_length(length);
-        return channel.send(message);
+        const ProtocolError error = channel.send(message);
+        if (!error && channel.is_unreliable())
+        {
+            ack_handlers.addHandler(message.get_id(), CompletionHandler(function_result_sent, nullptr),
+                    FUNCTION_RESULT_ACK_TIMEOUT);
+        }
+        return error;
     }
 
 public:
+    explicit Functions(CompletionHandlerMap<message_id_t>& ack_handlers) :
+            ack_handlers(ack_handlers),
+            session(0),
+            pending(0)
+    {
+    }
+
+    /**
+     * Called when a new session is started. Results of the calls received so far are dropped.
+     */
+    void reset()
+    {
+        ++session;
+        pending = 0;
+    }
+
+    /**
+     * Returns the number of calls that haven't returned their result yet.
+     */
+    unsigned pending_calls() const
+    {
+        return pending;
+    }
+
     ProtocolError handle_function_call(token_t token, message_id_t message_id, Message& message, MessageChannel& channel,
             int (*call_function)(const char *function_key, const char *arg, SparkDescriptor::FunctionResultCallback callback, void* reserved))
     {
@@ -101,21 +154,50 @@ public:
         memcpy(function_arg, queue + q_index + 1, function_arg_length);
         function_arg[function_arg_length] = 0; // null terminate string
 
+        // too many calls are in progress: the function isn't called
+        const bool accepted = (pending < MAX_PENDING_FUNCTION_CALLS);
+        uint8_t code = 0x00;
+        if (!has_function)
+        {
+            code = RESPONSE_CODE(4,00);
+        }
+        else if (!accepted)
+        {
+            code = RESPONSE_CODE(5,03);
+        }
+
         Message response;
         channel.response(message, response, 16);
         // send ACK
-        size_t response_length = Messages::coded_ack(response.buf(), has_function ? 0x00 : RESPONSE_CODE(4,00), 0, 0);
+        size_t response_length = Messages::coded_ack(response.buf(), code, 0, 0);
         response.set_id(message_id);
         response.set_length(response_length);
         ProtocolError error = channel.send(response);
         if (error) {
             return error;
         }
+        if (!accepted)
+        {
+            LOG(WARN, "Function call rejected, %u calls in progress", pending);
+            return NO_ERROR;
+        }
 
         // call the given user function
+        ++pending;
+        const unsigned call_session = session;
         auto callback = [=,&channel] (const void* result, SparkReturnType::Enum resultType )
-            { return this->function_result(channel, result, resultType, token); };
-        call_function(function_key, function_arg, callback, NULL);
+        {
+            if (call_session != this->session)
+            {
+                return false; // the call was received in a previous session
+            }
+            --pending;
+            return this->function_result(channel, result, resultType, token) == NO_ERROR;
+        };
+        if (call_function(function_key, function_arg, callback, NULL) != 0)
+        {
+            --pending; // the function is not registered and the callback won't be called
+        }
         return NO_ERROR;
     }
 };
@@ -173,6 +173,13 @@ struct Channel
 		 * Save session - saves the session to persistent store.
 		 */
 		SAVE_SESSION = 4,
+
+		/**
+		 * Get the reason the last established session wasn't resumed from persistent store.
+		 * {@code arg} points to a {@code SessionResumeFailure::Enum}, which is left unchanged
+		 * by channels that don't persist sessions.
+		 */
+		GET_RESUME_FAILURE = 5,
 	};
 
 
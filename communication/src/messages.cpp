@@ -159,52 +159,41 @@ size_t Messages::update_done(uint8_t* buf, message_id_t message_id, bool confirm
 
 size_t Messages::function_return(unsigned char *buf, message_id_t message_id, token_t token, int return_value, bool confirmable)
 {
-	buf[0] = confirmable ? 0x41 : 0x51; // non-confirmable, one-byte token
-	buf[1] = 0x44; // response code 2.04 CHANGED
-	buf[2] = message_id >> 8;
-	buf[3] = message_id & 0xff;
-	buf[4] = token;
-	buf[5] = 0xff; // payload marker
-	buf[6] = return_value >> 24;
-	buf[7] = return_value >> 16 & 0xff;
-	buf[8] = return_value >> 8 & 0xff;
-	buf[9] = return_value & 0xff;
-	return function_return_size;
+	CoAPWriter writer(buf, function_return_size);
+	writer.header(confirmable ? CoAPType::CON : CoAPType::NON, CoAPCode::CHANGED, message_id, &token, sizeof(token));
+	const uint8_t value[] = { uint8_t(return_value >> 24), uint8_t(return_value >> 16), uint8_t(return_value >> 8), uint8_t(return_value) };
+	writer.payload(value, sizeof(value));
+	return writer.length();
 }
 
 size_t Messages::variable_value(unsigned char *buf, message_id_t message_id, token_t token, bool return_value)
 {
-	size_t size = content(buf, message_id, token);
-	buf[size++] = return_value ? 1 : 0;
-	return size;
+	const uint8_t value = return_value ? 1 : 0;
+	return variable_value(buf, message_id, token, &value, sizeof(value));
 }
 
 size_t Messages::variable_value(unsigned char *buf, message_id_t message_id,
 		token_t token, int return_value)
 {
-	size_t size = content(buf, message_id, token);
-	buf[size++] = return_value >> 24;
-	buf[size++] = return_value >> 16 & 0xff;
-	buf[size++] = return_value >> 8 & 0xff;
-	buf[size++] = return_value & 0xff;
-	return size;
+	const uint8_t value[] = { uint8_t(return_value >> 24), uint8_t(return_value >> 16), uint8_t(return_value >> 8), uint8_t(return_value) };
+	return variable_value(buf, message_id, token, value, sizeof(value));
 }
 
 size_t Messages::variable_value(unsigned char *buf, message_id_t message_id,
 		token_t token, double return_value)
 {
-	size_t size = content(buf, message_id, token);
-	memcpy(buf + size, &return_value, 8);
-	return size+sizeof(double);
+	return variable_value(buf, message_id, token, &return_value, sizeof(return_value));
 }
 
 // Returns the length of the buffer to send
 size_t Messages::variable_value(unsigned char *buf, message_id_t message_id,
 		token_t token, const void *return_value, int length)
 {
-	size_t size = content(buf, message_id, token);
-	memcpy(buf + size, return_value, length);
-	return size + length;
+	// the caller guarantees the buffer can hold the value
+	CoAPWriter writer(buf, 6 + length);
+	writer.header(CoAPType::ACK, CoAPCode::CONTENT, message_id, &token, sizeof(token));
+	writer.payload(return_value, length);
+	return writer.length();
 }
 
 size_t Messages::time_request(uint8_t* buf, uint16_t message_id, uint8_t token)
@@ -324,33 +313,74 @@ size_t Messages::separate_response_with_payload(unsigned char *buf, uint16_t mes
 
 size_t Messages::event(uint8_t buf[], uint16_t message_id, const char *event_name,
              const char *data, int ttl, EventType::Enum event_type, bool confirmable)
+{
+  const size_t name_len = strnlen(event_name, MAX_EVENT_NAME_LENGTH);
+  const size_t data_len = data ? strnlen(data, MAX_EVENT_DATA_LENGTH) : 0;
+  return event(buf, message_id, event_name, name_len, data, data_len, ttl, event_type, confirmable);
+}
+
+size_t Messages::event(uint8_t buf[], uint16_t message_id, const char *event_name, size_t name_len,
+             const char *data, size_t data_len, int ttl, EventType::Enum event_type, bool confirmable)
+{
+  // header, event type, name, Max-Age and payload
+  CoAPWriter writer(buf, 4 + 2 + (2 + name_len) + 4 + (1 + data_len));
+  writer.header(confirmable ? CoAPType::CON : CoAPType::NON, CoAPCode::POST, message_id);
+  const char type = event_type;
+  writer.option(CoAPOption::URI_PATH, &type, sizeof(type));
+  if (name_len)
+  {
+    writer.option(CoAPOption::URI_PATH, event_name, name_len);
+  }
+
+  if (60 != ttl)
+  {
+    // a 3-byte value, as sent by earlier firmware
+    const uint8_t max_age[] = { uint8_t(ttl >> 16), uint8_t(ttl >> 8), uint8_t(ttl) };
+    writer.option(CoAPOption::MAX_AGE, max_age, sizeof(max_age));
+  }
+
+  writer.payload(data, data_len);
+  return writer.length();
+}
+
+size_t Messages::event_batch(uint8_t buf[], uint16_t message_id)
 {
   uint8_t *p = buf;
-  *p++ = confirmable ? 0x40 : 0x50; // non-confirmable /confirmable, no token
+  *p++ = 0x40; // confirmable, no token
   *p++ = 0x02; // code 0.02 POST request
   *p++ = message_id >> 8;
   *p++ = message_id & 0xff;
   *p++ = 0xb1; // one-byte Uri-Path option
-  *p++ = event_type;
-
-  size_t name_data_len = strnlen(event_name, MAX_EVENT_NAME_LENGTH);
-  p += event_name_uri_path(p, event_name, name_data_len);
+  *p++ = 'b';
+  *p++ = 0xff;
+  return p - buf;
+}
 
-  if (60 != ttl)
+size_t Messages::event_batch_record(uint8_t buf[], size_t size, const char *event_name,
+             const char *data, int ttl, EventType::Enum event_type)
+{
+  const size_t name_len = strnlen(event_name, MAX_EVENT_NAME_LENGTH);
+  const size_t data_len = data ? strnlen(data, MAX_EVENT_DATA_LENGTH) : 0;
+  const size_t record_len = 1 + 1 + name_len + 3 + 2 + data_len;
+  if (record_len > size)
   {
-    *p++ = 0x33;
-    *p++ = (ttl >> 16) & 0xff;
-    *p++ = (ttl >> 8) & 0xff;
-    *p++ = ttl & 0xff;
+    return 0;
   }
 
-  if (NULL != data)
+  uint8_t *p = buf;
+  *p++ = event_type;
+  *p++ = name_len;
+  memcpy(p, event_name, name_len);
+  p += name_len;
+  *p++ = (ttl >> 16) & 0xff;
+  *p++ = (ttl >> 8) & 0xff;
+  *p++ = ttl & 0xff;
+  *p++ = data_len >> 8;
+  *p++ = data_len & 0xff;
+  if (data_len)
   {
-    name_data_len = strnlen(data, MAX_EVENT_DATA_LENGTH);
-
-    *p++ = 0xff;
-    memcpy(p, data, name_data_len);
-    p += name_data_len;
+    memcpy(p, data, data_len);
+    p += data_len;
   }
 
   return p - buf;
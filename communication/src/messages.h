@@ -89,6 +89,27 @@ public:
 	static size_t event(uint8_t buf[], uint16_t message_id, const char *event_name,
 	             const char *data, int ttl, EventType::Enum event_type, bool confirmable);
 
+	/**
+	 * Writes an event message whose name and data aren't null-terminated.
+	 */
+	static size_t event(uint8_t buf[], uint16_t message_id, const char *event_name, size_t name_len,
+	             const char *data, size_t data_len, int ttl, EventType::Enum event_type, bool confirmable);
+
+	/**
+	 * Writes the header of a confirmable message carrying a batch of events. The payload that
+	 * follows is a sequence of records written by {@link #event_batch_record}.
+	 */
+	static size_t event_batch(uint8_t buf[], uint16_t message_id);
+
+	/**
+	 * Writes one event record of a batch: the event type, the length-prefixed event name, a
+	 * 3-byte TTL and the length-prefixed event data.
+	 *
+	 * @return the number of bytes written, or 0 if the record doesn't fit in {@code size} bytes.
+	 */
+	static size_t event_batch_record(uint8_t buf[], size_t size, const char *event_name,
+			const char *data, int ttl, EventType::Enum event_type);
+
 
     static inline size_t empty_ack(unsigned char *buf,
                           unsigned char message_id_msb,
@@ -24,9 +24,70 @@ LOG_SOURCE_CATEGORY("comm.protocol")
 #include "chunked_transfer.h"
 #include "subscriptions.h"
 #include "functions.h"
+#include "communication_diagnostic.h"
+
+#include <algorithm>
 
 namespace particle { namespace protocol {
 
+namespace {
+
+/**
+ * Space reserved in a message for the CoAP header and options preceding a block of the describe message.
+ */
+const size_t DESCRIBE_BLOCK_OVERHEAD = 16;
+
+/**
+ * Offset of the flags in the payload of a hello message.
+ */
+const size_t HELLO_FLAGS_OFFSET = 5;
+
+/**
+ * Maximum number of times a posted describe message is restarted because it changed between its blocks.
+ */
+const uint8_t DESCRIBE_MAX_RESTARTS = 2;
+
+/**
+ * Computes a 32-bit FNV-1a hash of the appended data, without storing it.
+ */
+class ChecksumAppender : public BufferAppender2
+{
+public:
+	ChecksumAppender() :
+			BufferAppender2(nullptr, 0),
+			hash(2166136261u)
+	{
+	}
+
+	bool append(const uint8_t* data, size_t length) override
+	{
+		for (size_t i = 0; i < length; ++i)
+		{
+			hash = (hash ^ data[i]) * 16777619u;
+		}
+		return BufferAppender2::append(data, length);
+	}
+
+	uint32_t checksum() const
+	{
+		return hash;
+	}
+
+private:
+	uint32_t hash;
+};
+
+} // namespace
+
+const auto HELLO_FLAG_OTA_UPGRADE_SUCCESSFUL = 1;
+const auto HELLO_FLAG_DIAGNOSTICS_SUPPORT = 2;
+const auto HELLO_FLAG_IMMEDIATE_UPDATES_SUPPORT = 4;
+const auto HELLO_FLAG_WINDOWED_OTA_SUPPORT = 8;
+const auto HELLO_FLAG_COMPRESSED_OTA_SUPPORT = 16;
+const auto HELLO_FLAG_DELTA_OTA_SUPPORT = 32;
+const auto HELLO_FLAG_BLOCKWISE_SUPPORT = 64;
+const auto HELLO_FLAG_EVENT_BATCH_SUPPORT = 128;
+
 /**
  * Sends an empty acknowledgement for the given message
  */
@@ -63,6 +124,17 @@ ProtocolError Protocol::handle_received_message(Message& message,
 		}
 		notify_message_complete(msg_id, code);
 	}
+	if (describe_post.block.more && is_description_block_response(message, type, msg_id)) {
+		ProtocolError error = handle_description_block_response(message, code);
+		if (type==CoAPType::CON) {
+			// a separate response is acknowledged like any other confirmable message
+			const ProtocolError ack_error = send_empty_ack(message, msg_id);
+			if (error == NO_ERROR) {
+				error = ack_error;
+			}
+		}
+		return error;
+	}
 
 	ProtocolError error = NO_ERROR;
 	//LOG(WARN,"message type %d", message_type);
@@ -73,13 +145,22 @@ ProtocolError Protocol::handle_received_message(Message& message,
 	{
 		// 4 bytes header, 1 byte token, 2 bytes Uri-Path
 		// 2 bytes optional single character Uri-Query for describe flags
+		// optional Block2 option requesting a block of the describe message
+		CoAPReader reader(queue, message.length());
+		const uint8_t* value = nullptr;
+		size_t length = 0;
 		int descriptor_type = DESCRIBE_DEFAULT;
-		if (message.length()>8 && queue[8] <= DESCRIBE_MAX) {
-			descriptor_type = queue[8];
-		} else if (message.length() > 8) {
-			LOG(WARN, "Invalid DESCRIBE flags %02x", queue[8]);
+		if (reader.find_option(CoAPOption::URI_QUERY, &value, &length) && length == 1) {
+			if (value[0] <= DESCRIBE_MAX) {
+				descriptor_type = value[0];
+			} else {
+				LOG(WARN, "Invalid DESCRIBE flags %02x", value[0]);
+			}
 		}
-		error = send_description(token, msg_id, descriptor_type);
+		CoAPBlock block;
+		const bool has_block = reader.find_option(CoAPOption::BLOCK2, &value, &length) &&
+				CoAPBlock::decode(value, length, &block);
+		error = send_description(token, msg_id, descriptor_type, has_block ? &block : nullptr);
 		break;
 	}
 
@@ -90,7 +171,9 @@ ProtocolError Protocol::handle_received_message(Message& message,
 	case CoAPMessageType::VARIABLE_REQUEST:
 	{
 		char variable_key[MAX_VARIABLE_KEY_LENGTH+1];
-		variables.decode_variable_request(variable_key, message);
+		error = variables.decode_variable_request(variable_key, message);
+		if (error)
+			return error;
 		return variables.handle_variable_request(variable_key, message,
 				channel, token, msg_id,
 				descriptor.variable_type, descriptor.get_variable);
@@ -126,10 +209,19 @@ ProtocolError Protocol::handle_received_message(Message& message,
 		return channel.send(message);
 
 	case CoAPMessageType::HELLO:
+	{
+		// the server acknowledges the extensions it supports in the flags of its own hello,
+		// which are read before the acknowledgement overwrites the message
+		CoAPReader reader(queue, message.length());
+		const uint8_t* payload = reader.payload();
+		const uint8_t server_flags = reader.payload_length() > HELLO_FLAGS_OFFSET ? payload[HELLO_FLAGS_OFFSET] : 0;
+		publisher.set_batch_supported(server_flags & HELLO_FLAG_EVENT_BATCH_SUPPORT);
+		blockwise_supported = server_flags & HELLO_FLAG_BLOCKWISE_SUPPORT;
 		if (message.get_type()==CoAPType::CON)
 			send_empty_ack(message, msg_id);
 		descriptor.ota_upgrade_status_sent();
 		break;
+	}
 
 	case CoAPMessageType::TIME:
 		handle_time_response(
@@ -240,6 +332,7 @@ void Protocol::init(const SparkCallbacks &callbacks,
 
 	chunkedTransferCallbacks.init(&this->callbacks);
 	chunkedTransfer.init(&chunkedTransferCallbacks);
+	describe_cache.init(this->callbacks.calculate_crc);
 
 	initialized = true;
 }
@@ -291,10 +384,21 @@ int Protocol::begin()
 	// FIXME: Pending completion handlers should be cancelled at the end of a previous session
 	ack_handlers.clear();
 	last_ack_handlers_update = callbacks.millis();
+	describe_post.block.more = false;
 
 	uint32_t channel_flags = 0;
 	ProtocolError error = channel.establish(channel_flags, application_state_checksum());
 	bool session_resumed = (error==SESSION_RESUMED);
+	if (session_resumed) {
+		++g_sessionResumeCounter;
+	} else {
+		SessionResumeFailure::Enum reason = SessionResumeFailure::NONE;
+		channel.command(MessageChannel::GET_RESUME_FAILURE, &reason);
+		if (reason != SessionResumeFailure::NONE) {
+			++g_sessionResumeFailureCounter;
+			g_sessionResumeFailureReason = reason;
+		}
+	}
 	if (error && !session_resumed) {
 		LOG(ERROR,"handshake failed with code %d", error);
 		return error;
@@ -313,6 +417,18 @@ int Protocol::begin()
 	if (session_resumed && channel.is_unreliable() && (flags & SKIP_SESSION_RESUME_HELLO))
 	{
 		LOG(INFO,"resumed session - not sending HELLO message");
+		if ((flags & FAST_RECONNECT) && publisher.has_pending())
+		{
+			LOG(INFO,"resumed session - sending queued events");
+			// only an acknowledged message confirms the session, events sent without
+			// acknowledgement are followed by the ping
+			bool confirmed = false;
+			publisher.flush(channel, callbacks.millis(), &confirmed);
+			if (confirmed) {
+				last_message_millis = callbacks.millis();
+				return error;
+			}
+		}
 		const auto r = ping(true);
 		if (r != NO_ERROR) {
 			error = r;
@@ -324,6 +440,14 @@ int Protocol::begin()
 	// todo - this will return code 0 even when the session was resumed,
 	// causing all the application events to be sent.
 
+	// the server requests the describe message again after the hello
+	describe_cache.reset_sent();
+	// and no longer waits for the results of the function calls made before it
+	functions.reset();
+	// batches and describe blocks are only sent once the new session has confirmed they are supported
+	publisher.set_batch_supported(false);
+	blockwise_supported = false;
+
 	LOG(INFO,"Sending HELLO message");
 	error = hello(descriptor.was_ota_upgrade_successful());
 	if (error)
@@ -343,10 +467,6 @@ int Protocol::begin()
 	return error;
 }
 
-const auto HELLO_FLAG_OTA_UPGRADE_SUCCESSFUL = 1;
-const auto HELLO_FLAG_DIAGNOSTICS_SUPPORT = 2;
-const auto HELLO_FLAG_IMMEDIATE_UPDATES_SUPPORT = 4;
-
 /**
  * Send the hello message over the channel.
  * @param was_ota_upgrade_successful {@code true} if the previous OTA update was successful.
@@ -357,7 +477,17 @@ ProtocolError Protocol::hello(bool was_ota_upgrade_successful)
 	channel.create(message);
 
 	uint8_t flags = was_ota_upgrade_successful ? HELLO_FLAG_OTA_UPGRADE_SUCCESSFUL : 0;
-	flags |= HELLO_FLAG_DIAGNOSTICS_SUPPORT | HELLO_FLAG_IMMEDIATE_UPDATES_SUPPORT;
+	flags |= HELLO_FLAG_DIAGNOSTICS_SUPPORT | HELLO_FLAG_IMMEDIATE_UPDATES_SUPPORT | HELLO_FLAG_BLOCKWISE_SUPPORT |
+			HELLO_FLAG_EVENT_BATCH_SUPPORT;
+	// the system knows whether it has the memory to inflate or patch an image, and whether it can
+	// read the current module to apply a patch against
+	const int update_flags = callbacks.firmware_update_flags ? callbacks.firmware_update_flags(nullptr) : 0;
+	if (update_flags & FileTransfer::Flag::COMPRESSED)
+		flags |= HELLO_FLAG_COMPRESSED_OTA_SUPPORT;
+	if (update_flags & FileTransfer::Flag::DELTA)
+		flags |= HELLO_FLAG_DELTA_OTA_SUPPORT;
+	if (chunkedTransfer.is_windowed_ota_enabled())
+		flags |= HELLO_FLAG_WINDOWED_OTA_SUPPORT;
 	size_t len = build_hello(message, flags);
 	message.set_length(len);
 	message.set_confirm_received(true);
@@ -432,6 +562,12 @@ ProtocolError Protocol::event_loop(CoAPMessageType::Enum& message_type)
 		}
 	}
 
+	// Send the events deferred by the rate limiter
+	if (!error && !chunkedTransfer.is_updating())
+	{
+		error = publisher.process(channel, callbacks.millis());
+	}
+
 	if (error)
 	{
 		// bail if and only if there was an error
@@ -458,53 +594,21 @@ void Protocol::build_describe_message(Appender& appender, int desc_flags)
 		appender.append("{");
 		bool has_content = false;
 
+		// the sections are keyed by the state checksums the system maintains, which change when
+		// functions or variables are registered and when the modules are updated
 		if (desc_flags & DESCRIBE_APPLICATION)
 		{
 			has_content = true;
-			appender.append("\"f\":[");
-
-			int num_keys = descriptor.num_functions();
-			int i;
-			for (i = 0; i < num_keys; ++i)
+			const auto build = [this](Appender& a) { build_application_description(a); };
+			if (descriptor.app_state_selector_info)
 			{
-				if (i)
-				{
-					appender.append(',');
-				}
-				appender.append('"');
-
-				const char* key = descriptor.get_function_key(i);
-				size_t function_name_length = strlen(key);
-				if (MAX_FUNCTION_KEY_LENGTH < function_name_length)
-				{
-					function_name_length = MAX_FUNCTION_KEY_LENGTH;
-				}
-				appender.append((const uint8_t*) key, function_name_length);
-				appender.append('"');
+				describe_cache.append(DescribeCache::APPLICATION, descriptor.app_state_selector_info(
+						SparkAppStateSelector::DESCRIBE_APP, SparkAppStateUpdate::COMPUTE, 0, nullptr), appender, build);
 			}
-
-			appender.append("],\"v\":{");
-
-			num_keys = descriptor.num_variables();
-			for (i = 0; i < num_keys; ++i)
+			else
 			{
-				if (i)
-				{
-					appender.append(',');
-				}
-				appender.append('"');
-				const char* key = descriptor.get_variable_key(i);
-				size_t variable_name_length = strlen(key);
-				SparkReturnType::Enum t = descriptor.variable_type(key);
-				if (MAX_VARIABLE_KEY_LENGTH < variable_name_length)
-				{
-					variable_name_length = MAX_VARIABLE_KEY_LENGTH;
-				}
-				appender.append((const uint8_t*) key, variable_name_length);
-				appender.append("\":");
-				appender.append('0' + (char) t);
+				build(appender);
 			}
-			appender.append('}');
 		}
 
 		if (descriptor.append_system_info && (desc_flags & DESCRIBE_SYSTEM))
@@ -514,39 +618,114 @@ void Protocol::build_describe_message(Appender& appender, int desc_flags)
 				appender.append(',');
 			}
 			has_content = true;
-			descriptor.append_system_info(append_instance, &appender, nullptr);
+			const auto build = [this](Appender& a) { descriptor.append_system_info(append_instance, &a, nullptr); };
+			if (descriptor.app_state_selector_info)
+			{
+				describe_cache.append(DescribeCache::SYSTEM, descriptor.app_state_selector_info(
+						SparkAppStateSelector::DESCRIBE_SYSTEM, SparkAppStateUpdate::COMPUTE, 0, nullptr), appender, build);
+			}
+			else
+			{
+				build(appender);
+			}
 		}
 		appender.append('}');
 	}
 }
 
+void Protocol::build_application_description(Appender& appender)
+{
+	appender.append("\"f\":[");
+
+	int num_keys = descriptor.num_functions();
+	int i;
+	for (i = 0; i < num_keys; ++i)
+	{
+		if (i)
+		{
+			appender.append(',');
+		}
+		appender.append('"');
+
+		const char* key = descriptor.get_function_key(i);
+		size_t function_name_length = strlen(key);
+		if (MAX_FUNCTION_KEY_LENGTH < function_name_length)
+		{
+			function_name_length = MAX_FUNCTION_KEY_LENGTH;
+		}
+		appender.append((const uint8_t*) key, function_name_length);
+		appender.append('"');
+	}
+
+	appender.append("],\"v\":{");
+
+	num_keys = descriptor.num_variables();
+	for (i = 0; i < num_keys; ++i)
+	{
+		if (i)
+		{
+			appender.append(',');
+		}
+		appender.append('"');
+		const char* key = descriptor.get_variable_key(i);
+		size_t variable_name_length = strlen(key);
+		SparkReturnType::Enum t = descriptor.variable_type(key);
+		if (MAX_VARIABLE_KEY_LENGTH < variable_name_length)
+		{
+			variable_name_length = MAX_VARIABLE_KEY_LENGTH;
+		}
+		appender.append((const uint8_t*) key, variable_name_length);
+		appender.append("\":");
+		appender.append('0' + (char) t);
+	}
+	appender.append('}');
+}
+
 ProtocolError Protocol::generate_and_send_description(MessageChannel& channel, Message& message,
                                                       size_t header_size, int desc_flags)
 {
     ProtocolError error;
 
-    BufferAppender appender((message.buf() + header_size), (message.capacity() - header_size));
+    BlockAppender appender((message.buf() + header_size), (message.capacity() - header_size), 0);
     build_describe_message(appender, desc_flags);
-
-    const size_t msglen = (appender.next() - (uint8_t*)message.buf());
-    message.set_length(msglen);
-    if (appender.overflowed())
+    if (appender.hasMore())
     {
-        LOG(ERROR, "Describe message overflowed by %d bytes", appender.overflowed());
-        // There is no point in continuing to run, the device will be constantly reconnecting
-        // to the cloud. It's better to clearly indicate that the describe message is never going
-        // to go through to the cloud by going into a panic state, otherwise one would have to
-        // sift through logs to find 'Describe message overflowed by %d bytes' message to understand
-        // what's going on.
-        SPARK_ASSERT(!appender.overflowed());
+        // The caller sends the describe message in blocks instead
+        LOG(INFO, "Describe message of %u bytes is sent in blocks", (unsigned)appender.dataSize());
+        return INSUFFICIENT_STORAGE;
     }
 
+    message.set_length(header_size + appender.blockSize());
+
     LOG(INFO, "Posting '%s%s%s' describe message", desc_flags & DESCRIBE_SYSTEM ? "S" : "",
         desc_flags & DESCRIBE_APPLICATION ? "A" : "", desc_flags & DESCRIBE_METRICS ? "M" : "");
 
     error = channel.send(message);
 
-    if (error == NO_ERROR && descriptor.app_state_selector_info &&
+    if (error == NO_ERROR)
+    {
+        description_sent(desc_flags);
+    }
+	// Log error code
+    else
+    {
+        LOG(ERROR, "Channel failed to send message with error-code <%d>", error);
+    }
+
+    return error;
+}
+
+void Protocol::description_sent(int desc_flags)
+{
+    if (desc_flags & DESCRIBE_APPLICATION)
+    {
+        describe_cache.set_sent(DescribeCache::APPLICATION);
+    }
+    if (descriptor.append_system_info && (desc_flags & DESCRIBE_SYSTEM))
+    {
+        describe_cache.set_sent(DescribeCache::SYSTEM);
+    }
+    if (descriptor.app_state_selector_info &&
         (desc_flags & DESCRIBE_APPLICATION || desc_flags & DESCRIBE_SYSTEM))
     {
         this->channel.command(Channel::SAVE_SESSION);
@@ -566,23 +745,167 @@ ProtocolError Protocol::generate_and_send_description(MessageChannel& channel, M
         }
         this->channel.command(Channel::LOAD_SESSION);
     }
-	// Log error code
-    else if (NO_ERROR != error)
+}
+
+bool Protocol::description_unchanged(int desc_flags)
+{
+    if (!(desc_flags & (DESCRIBE_APPLICATION | DESCRIBE_SYSTEM)) || (desc_flags & DESCRIBE_METRICS))
     {
-        LOG(ERROR, "Channel failed to send message with error-code <%d>", error);
+        return false;
     }
-
-    return error;
+    // bring the cached sections up to date
+    BufferAppender2 counter(nullptr, 0);
+    build_describe_message(counter, desc_flags);
+    return (!(desc_flags & DESCRIBE_APPLICATION) || describe_cache.is_sent(DescribeCache::APPLICATION)) &&
+        (!(desc_flags & DESCRIBE_SYSTEM) || !descriptor.append_system_info || describe_cache.is_sent(DescribeCache::SYSTEM));
 }
 
 ProtocolError Protocol::post_description(int desc_flags)
 {
+    if (description_unchanged(desc_flags))
+    {
+        LOG(INFO, "Describe message is unchanged, not posting it");
+        return NO_ERROR;
+    }
+
     Message message;
     channel.create(message);
     const size_t header_size =
         Messages::describe_post_header(message.buf(), message.capacity(), 0, (desc_flags & 0xFF));
 
-    return generate_and_send_description(channel, message, header_size, desc_flags);
+    describe_post.block.more = false;
+    const ProtocolError error = generate_and_send_description(channel, message, header_size, desc_flags);
+    if (error != INSUFFICIENT_STORAGE)
+    {
+        return error;
+    }
+    if (!blockwise_supported)
+    {
+        LOG(ERROR, "Describe message is too large, and the server doesn't accept it in blocks");
+        return error;
+    }
+    describe_post.restarts = 0;
+    return post_description_block(desc_flags, CoAPBlock(0, CoAPBlock::szx_for(message.capacity() - DESCRIBE_BLOCK_OVERHEAD)));
+}
+
+ProtocolError Protocol::post_description_block(int desc_flags, CoAPBlock block)
+{
+    // the blocks are built separately, so they only make up a valid message if it doesn't change in between
+    uint32_t checksum = 0;
+    const size_t size = description_size(desc_flags, &checksum);
+    if (block.num && checksum != describe_post.checksum)
+    {
+        if (describe_post.restarts >= DESCRIBE_MAX_RESTARTS)
+        {
+            LOG(ERROR, "Describe message keeps changing, abandoning the transfer");
+            describe_post.block.more = false;
+            return NO_ERROR;
+        }
+        LOG(WARN, "Describe message changed during the transfer, restarting it");
+        ++describe_post.restarts;
+        block = CoAPBlock(0, block.szx);
+    }
+    describe_post.checksum = checksum;
+
+    Message message;
+    channel.create(message);
+    const token_t token = next_token();
+    CoAPWriter writer(message.buf(), message.capacity());
+    writer.header(CoAPType::CON, CoAPCode::POST, 0, &token, sizeof(token));
+    writer.option(CoAPOption::URI_PATH, "d");
+    const uint8_t query = desc_flags & 0xFF;
+    writer.option(CoAPOption::URI_QUERY, &query, sizeof(query));
+    write_description_block(writer, desc_flags, block, CoAPOption::BLOCK1, size);
+    message.set_length(writer.length());
+
+    LOG(INFO, "Posting block %u of '%s%s%s' describe message", (unsigned)block.num, desc_flags & DESCRIBE_SYSTEM ? "S" : "",
+        desc_flags & DESCRIBE_APPLICATION ? "A" : "", desc_flags & DESCRIBE_METRICS ? "M" : "");
+
+    const ProtocolError error = channel.send(message);
+    describe_post.block = block;
+    describe_post.desc_flags = desc_flags;
+    describe_post.msg_id = message.has_id() ? message.get_id() : -1;
+    describe_post.token = token;
+    if (error)
+    {
+        describe_post.block.more = false;
+        LOG(ERROR, "Channel failed to send message with error-code <%d>", error);
+    }
+    else if (!block.more)
+    {
+        description_sent(desc_flags);
+    }
+    return error;
+}
+
+bool Protocol::is_description_block_response(Message& message, CoAPType::Enum type, message_id_t msg_id)
+{
+    if (type == CoAPType::RESET)
+    {
+        return msg_id == describe_post.msg_id;
+    }
+    // an empty acknowledgement carries no token, the separate response that follows it does
+    CoAPReader reader(message.buf(), message.length());
+    return (reader.code() >> 5) >= 2 && reader.token_length() == sizeof(token_t) &&
+        reader.token()[0] == describe_post.token;
+}
+
+ProtocolError Protocol::handle_description_block_response(Message& message, CoAPCode::Enum code)
+{
+    CoAPBlock& block = describe_post.block;
+    if (code != CoAPCode::BLOCK_CONTINUE)
+    {
+        LOG(WARN, "Describe block %u not continued, code %d.%02d", (unsigned)block.num, code >> 5, code & 0x1f);
+        block.more = false;
+        return NO_ERROR;
+    }
+    CoAPBlock next(block.num + 1, block.szx);
+    CoAPReader reader(message.buf(), message.length());
+    const uint8_t* value = nullptr;
+    size_t length = 0;
+    CoAPBlock server_block;
+    if (reader.find_option(CoAPOption::BLOCK1, &value, &length) && CoAPBlock::decode(value, length, &server_block))
+    {
+        // the server acknowledges the block at its own block size, which may be smaller than ours
+        const bool smaller = server_block.szx < block.szx;
+        if (smaller ? server_block.offset() != block.offset() : server_block.num != block.num)
+        {
+            LOG(WARN, "Unexpected describe block %u continued, expected %u", (unsigned)server_block.num, (unsigned)block.num);
+            return NO_ERROR;
+        }
+        if (smaller)
+        {
+            next.num = (block.offset() + block.size()) / server_block.size();
+            next.szx = server_block.szx;
+        }
+    }
+    return post_description_block(describe_post.desc_flags, next);
+}
+
+size_t Protocol::description_size(int desc_flags, uint32_t* checksum)
+{
+    ChecksumAppender counter;
+    build_describe_message(counter, desc_flags);
+    if (checksum)
+    {
+        *checksum = counter.checksum();
+    }
+    return counter.dataSize();
+}
+
+void Protocol::write_description_block(CoAPWriter& writer, int desc_flags, CoAPBlock& block, unsigned block_option,
+        size_t size)
+{
+    block.more = block.offset() + block.size() < size;
+    writer.option_uint(block_option, block.value());
+    size_t available = 0;
+    uint8_t* payload = writer.payload_buffer(&available);
+    if (payload)
+    {
+        BlockAppender appender(payload, std::min(available, block.size()), block.offset());
+        build_describe_message(appender, desc_flags);
+        writer.commit_payload(appender.blockSize());
+    }
 }
 
 /**
@@ -590,15 +913,72 @@ ProtocolError Protocol::post_description(int desc_flags)
  * @param desc_flags Flags describing the information to provide. A combination of {@code
  * DESCRIBE_APPLICATION) and {@code DESCRIBE_SYSTEM) flags.
  */
-ProtocolError Protocol::send_description(token_t token, message_id_t msg_id, int desc_flags)
+ProtocolError Protocol::send_description(token_t token, message_id_t msg_id, int desc_flags, const CoAPBlock* block)
+{
+    Message message;
+    channel.create(message);
+    if (!block)
+    {
+        uint8_t* buf = message.buf();
+        message.set_id(msg_id);
+        size_t desc = Messages::description(buf, msg_id, token);
+
+        const ProtocolError error = generate_and_send_description(channel, message, desc, desc_flags);
+        if (error != INSUFFICIENT_STORAGE)
+        {
+            return error;
+        }
+        if (!blockwise_supported)
+        {
+            LOG(ERROR, "Describe message is too large, and the server doesn't accept it in blocks");
+            CoAPWriter writer(message.buf(), message.capacity());
+            writer.header(CoAPType::ACK, CoAPCode::INTERNAL_SERVER_ERROR, msg_id, &token, sizeof(token));
+            message.set_length(writer.length());
+            return channel.send(message);
+        }
+    }
+    // the block size is limited by the message buffer, and the first block is sent if none was requested
+    CoAPBlock requested = block ? *block : CoAPBlock(0, CoAPBlock::MAX_SZX);
+    const uint8_t szx = std::min(requested.szx, CoAPBlock::szx_for(message.capacity() - DESCRIBE_BLOCK_OVERHEAD));
+    const CoAPBlock response_block(requested.offset() >> (szx + 4), szx);
+    return send_description_block(token, msg_id, desc_flags, response_block);
+}
+
+ProtocolError Protocol::send_description_block(token_t token, message_id_t msg_id, int desc_flags, CoAPBlock block)
 {
     Message message;
     channel.create(message);
-    uint8_t* buf = message.buf();
     message.set_id(msg_id);
-    size_t desc = Messages::description(buf, msg_id, token);
+    CoAPWriter writer(message.buf(), message.capacity());
+    uint32_t checksum = 0;
+    const size_t size = description_size(desc_flags, &checksum);
+    if (block.num && block.offset() >= size)
+    {
+        // RFC 7959: a block past the end of the representation is a bad option
+        LOG(WARN, "Describe block %u is out of range", (unsigned)block.num);
+        writer.header(CoAPType::ACK, CoAPCode::BAD_OPTION, msg_id, &token, sizeof(token));
+        message.set_length(writer.length());
+        return channel.send(message);
+    }
+    writer.header(CoAPType::ACK, CoAPCode::CONTENT, msg_id, &token, sizeof(token));
+    // the ETag tells the server whether the blocks it fetched belong to the same describe message
+    writer.option(CoAPOption::ETAG, &checksum, sizeof(checksum));
+    write_description_block(writer, desc_flags, block, CoAPOption::BLOCK2, size);
+    message.set_length(writer.length());
 
-    return generate_and_send_description(channel, message, desc, desc_flags);
+    LOG(INFO, "Sending block %u of '%s%s%s' describe message", (unsigned)block.num, desc_flags & DESCRIBE_SYSTEM ? "S" : "",
+        desc_flags & DESCRIBE_APPLICATION ? "A" : "", desc_flags & DESCRIBE_METRICS ? "M" : "");
+
+    const ProtocolError error = channel.send(message);
+    if (error)
+    {
+        LOG(ERROR, "Channel failed to send message with error-code <%d>", error);
+    }
+    else if (!block.more)
+    {
+        description_sent(desc_flags);
+    }
+    return error;
 }
 
 int Protocol::ChunkedTransferCallbacks::prepare_for_firmware_update(FileTransfer::Descriptor& data, uint32_t flags, void* reserved)
@@ -628,7 +1008,7 @@ system_tick_t Protocol::ChunkedTransferCallbacks::millis()
 
 int Protocol::get_describe_data(spark_protocol_describe_data* data, void* reserved)
 {
-	data->maximum_size = 768;  // a conservative guess based on dtls and lightssl encryption overhead and the CoAP data
+	data->maximum_size = DESCRIBE_MAX_SIZE;  // describe messages that don't fit in one message are sent in blocks
 	BufferAppender2 appender(nullptr,  0);	// don't need to store the data, just count the size
 	build_describe_message(appender, data->flags);
 	data->current_size = appender.dataSize();
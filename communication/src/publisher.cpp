@@ -19,6 +19,260 @@
 
 #include "protocol.h"
 
-void particle::protocol::Publisher::add_ack_handler(message_id_t msg_id, CompletionHandler handler) {
+#include <new>
+
+namespace particle
+{
+namespace protocol
+{
+
+ProtocolError Publisher::send_event(MessageChannel& channel, const char* event_name,
+		const char* data, int ttl, EventType::Enum event_type, int flags,
+		system_tick_t time, CompletionHandler handler)
+{
+	const bool is_system_event = is_system(event_name);
+	if ((flags & EventType::BATCH) && batch_supported && !is_system_event && batch.fits_empty(event_name, data)) {
+		return add_to_batch(channel, event_name, data, ttl, event_type, time, std::move(handler));
+	}
+	const size_t name_len = strnlen(event_name, MAX_EVENT_NAME_LENGTH);
+	const size_t data_len = data ? strnlen(data, MAX_EVENT_DATA_LENGTH) : 0;
+	return send_event(channel, is_system_event, event_name, name_len, data, data_len, ttl, event_type, flags, time,
+			std::move(handler));
+}
+
+ProtocolError Publisher::send_event(MessageChannel& channel, bool is_system_event, const char* event_name,
+		size_t name_len, const char* data, size_t data_len, int ttl, EventType::Enum event_type, int flags,
+		system_tick_t time, CompletionHandler&& handler)
+{
+	EventQueue& queue = is_system_event ? system_queue : user_queue;
+	// events already waiting in the queue go first
+	const bool deferred = queue.head || is_rate_limited(is_system_event, time);
+	if (deferred && queue.count >= queue.max_count) {
+		g_rateLimitedEventsCounter++;
+		handler.setError(toSystemError(BANDWIDTH_EXCEEDED));
+		return BANDWIDTH_EXCEEDED;
+	}
+
+	Message message;
+	ProtocolError error = channel.create(message);
+	if (error) {
+		handler.setError(toSystemError(error));
+		return error;
+	}
+	bool confirmable = channel.is_unreliable();
+	if (flags & EventType::NO_ACK) {
+		confirmable = false;
+	} else if (flags & EventType::WITH_ACK) {
+		confirmable = true;
+	}
+	size_t msglen = Messages::event(message.buf(), 0, event_name, name_len, data, data_len, ttl,
+			event_type, confirmable);
+	message.set_length(msglen);
+	if (deferred) {
+		return enqueue(queue, message, flags, std::move(handler));
+	}
+	return send(channel, message, flags, std::move(handler));
+}
+
+ProtocolError Publisher::process(MessageChannel& channel, system_tick_t time)
+{
+	if (batch.is_due(time)) {
+		const ProtocolError error = flush_batch(channel, time);
+		if (error && error != BANDWIDTH_EXCEEDED) {
+			return error;
+		}
+	}
+	if (!queued) {
+		return NO_ERROR;
+	}
+	const ProtocolError error = drain(system_queue, system_bucket, channel, time);
+	if (error) {
+		return error;
+	}
+	return drain(user_queue, user_bucket, channel, time);
+}
+
+ProtocolError Publisher::flush(MessageChannel& channel, system_tick_t time, bool* confirmed)
+{
+	const unsigned count = confirmable_sent;
+	ProtocolError error = flush_batch(channel, time);
+	if (!error || error == BANDWIDTH_EXCEEDED) {
+		error = process(channel, time);
+	}
+	if (confirmed) {
+		*confirmed = confirmable_sent != count;
+	}
+	return error;
+}
+
+ProtocolError Publisher::flush_batch(MessageChannel& channel, system_tick_t time)
+{
+	if (!batch.events()) {
+		return NO_ERROR;
+	}
+	if (!batch_supported) {
+		return unbatch(channel, time);
+	}
+	if (is_rate_limited(false, time)) {
+		return BANDWIDTH_EXCEEDED;
+	}
+	Message message;
+	ProtocolError error = channel.create(message);
+	if (!error) {
+		const size_t header_len = Messages::event_batch(message.buf(), 0);
+		if (message.capacity() < header_len + batch.payload_length()) {
+			error = INSUFFICIENT_STORAGE;
+		} else {
+			memcpy(message.buf() + header_len, batch.payload(), batch.payload_length());
+			message.set_length(header_len + batch.payload_length());
+		}
+	}
+	if (error) {
+		batch.fail(toSystemError(error));
+		return error;
+	}
+	// the batch is always confirmable, its events are complete once it's acknowledged
+	return send(channel, message, EventType::WITH_ACK, batch.take_completion());
+}
+
+ProtocolError Publisher::unbatch(MessageChannel& channel, system_tick_t time)
+{
+	ProtocolError result = NO_ERROR;
+	batch.unbatch([&](const char* event_name, size_t name_len, const char* data, size_t data_len, int ttl,
+			EventType::Enum event_type, CompletionHandler&& handler) {
+		// batched events are confirmable, and so are the messages replacing the batch
+		const ProtocolError error = send_event(channel, false, event_name, name_len, data, data_len, ttl, event_type,
+				EventType::WITH_ACK, time, std::move(handler));
+		if (error && !result) {
+			result = error;
+		}
+	});
+	return result;
+}
+
+void Publisher::clear(int error)
+{
+	batch.fail(error);
+	EventQueue* queues[] = { &system_queue, &user_queue };
+	for (EventQueue* queue: queues) {
+		while (queue->head) {
+			QueuedEvent* event = queue->head;
+			queue->head = event->next;
+			event->handler.setError(error);
+			event->~QueuedEvent();
+			delete[] reinterpret_cast<uint8_t*>(event);
+		}
+		queue->tail = nullptr;
+		queue->count = 0;
+	}
+	queued = 0;
+}
+
+ProtocolError Publisher::add_to_batch(MessageChannel& channel, const char* event_name, const char* data, int ttl,
+		EventType::Enum event_type, system_tick_t time, CompletionHandler&& handler)
+{
+	ProtocolError error = batch.add(event_name, data, ttl, event_type, time, std::move(handler));
+	if (error == INSUFFICIENT_STORAGE && batch.events()) {
+		// make room for the event by sending the events collected so far
+		error = flush_batch(channel, time);
+		if (error == BANDWIDTH_EXCEEDED) {
+			g_rateLimitedEventsCounter++;
+		}
+		if (!error) {
+			error = batch.add(event_name, data, ttl, event_type, time, std::move(handler));
+		}
+	}
+	if (error) {
+		handler.setError(toSystemError(error));
+		return error;
+	}
+	if (batch.is_due(time)) {
+		// the event has been accepted, the batch is retried by process() if it can't be sent now
+		error = flush_batch(channel, time);
+		if (error != BANDWIDTH_EXCEEDED) {
+			return error;
+		}
+	}
+	return NO_ERROR;
+}
+
+ProtocolError Publisher::enqueue(EventQueue& queue, const Message& message, int flags, CompletionHandler&& handler)
+{
+	uint8_t* memory = new (std::nothrow) uint8_t[sizeof(QueuedEvent)+message.length()];
+	if (!memory) {
+		handler.setError(toSystemError(INSUFFICIENT_STORAGE));
+		return INSUFFICIENT_STORAGE;
+	}
+	QueuedEvent* event = new (memory)QueuedEvent();		// in-place new
+	event->next = nullptr;
+	event->handler = std::move(handler);
+	event->flags = flags;
+	event->length = message.length();
+	memcpy(event->data(), message.buf(), message.length());
+	if (queue.tail) {
+		queue.tail->next = event;
+	} else {
+		queue.head = event;
+	}
+	queue.tail = event;
+	queue.count++;
+	queued++;
+	return NO_ERROR;
+}
+
+ProtocolError Publisher::drain(EventQueue& queue, TokenBucket& bucket, MessageChannel& channel, system_tick_t time)
+{
+	while (queue.head && bucket.consume(time)) {
+		QueuedEvent* event = queue.head;
+		queue.head = event->next;
+		if (!queue.head) {
+			queue.tail = nullptr;
+		}
+		queue.count--;
+		queued--;
+
+		Message message;
+		ProtocolError error = channel.create(message);
+		if (!error && message.capacity() < event->length) {
+			error = INSUFFICIENT_STORAGE;
+		}
+		if (!error) {
+			// the message ID is assigned by the channel when the event is actually sent
+			message.copy(event->data(), event->length);
+			error = send(channel, message, event->flags, std::move(event->handler));
+		} else {
+			event->handler.setError(toSystemError(error));
+		}
+		event->~QueuedEvent();
+		delete[] reinterpret_cast<uint8_t*>(event);
+		if (error) {
+			return error;
+		}
+	}
+	return NO_ERROR;
+}
+
+ProtocolError Publisher::send(MessageChannel& channel, Message& message, int flags, CompletionHandler&& handler)
+{
+	const ProtocolError result = channel.send(message);
+	if (result == NO_ERROR) {
+		if (message.get_type() == CoAPType::CON) {
+			++confirmable_sent;
+		}
+		// Register completion handler only if acknowledgement was requested explicitly
+		if ((flags & EventType::WITH_ACK) && message.has_id()) {
+		    add_ack_handler(message.get_id(), std::move(handler));
+		} else {
+		    handler.setResult();
+		}
+	} else {
+		handler.setError(toSystemError(result));
+	}
+	return result;
+}
+
+void Publisher::add_ack_handler(message_id_t msg_id, CompletionHandler handler) {
     protocol->add_ack_handler(msg_id, std::move(handler), SEND_EVENT_ACK_TIMEOUT);
 }
+
+}}
@@ -23,6 +23,7 @@
 #include "events.h"
 #include "message_channel.h"
 #include "messages.h"
+#include "event_batch.h"
 
 #include "completion_handler.h"
 #include "communication_diagnostic.h"
@@ -34,95 +35,271 @@ namespace protocol
 
 class Protocol;
 
+/**
+ * A token bucket holding up to {@code capacity} tokens, gaining one token every
+ * {@code refill_interval} milliseconds.
+ */
+class TokenBucket
+{
+public:
+	TokenBucket(uint16_t capacity, system_tick_t refill_interval) :
+			capacity(capacity),
+			tokens(capacity),
+			refill_interval(refill_interval ? refill_interval : 1),
+			last_refill(0),
+			started(false)
+	{
+	}
+
+	void configure(uint16_t capacity, system_tick_t refill_interval)
+	{
+		this->capacity = capacity;
+		this->refill_interval = refill_interval ? refill_interval : 1;
+		if (tokens > capacity)
+			tokens = capacity;
+	}
+
+	/**
+	 * Takes a token from the bucket.
+	 * @return {@code true} if a token was available.
+	 */
+	bool consume(system_tick_t millis)
+	{
+		refill(millis);
+		if (!tokens)
+			return false;
+		--tokens;
+		return true;
+	}
+
+	uint16_t available(system_tick_t millis)
+	{
+		refill(millis);
+		return tokens;
+	}
+
+private:
+	uint16_t capacity;
+	uint16_t tokens;
+	system_tick_t refill_interval;
+	system_tick_t last_refill;
+	bool started;
+
+	void refill(system_tick_t millis)
+	{
+		if (!started || tokens >= capacity)
+		{
+			// a full bucket doesn't accumulate time towards the next token
+			started = true;
+			last_refill = millis;
+			return;
+		}
+		const system_tick_t earned = (millis - last_refill) / refill_interval;   // unsigned arithmetic handles millis() overflow
+		if (earned >= system_tick_t(capacity - tokens))
+		{
+			tokens = capacity;
+			last_refill = millis;
+		}
+		else if (earned)
+		{
+			tokens += earned;
+			last_refill += earned * refill_interval;
+		}
+	}
+};
+
+/**
+ * Sends events to the cloud, deferring those that exceed the rate limits.
+ *
+ * System and application events are rate limited by separate token buckets. An event that cannot
+ * be sent straight away is encoded and kept in a bounded queue until {@link #process} finds a token
+ * for it. System and application events have queues of their own, so that application events can't
+ * take the room of system events, and queued system events are sent first.
+ *
+ * Application events published with {@code EventType::BATCH} are collected in an {@link EventBatch}
+ * and sent together in a single confirmable message, which takes one application event token.
+ * This requires the server to support batches, see {@link #set_batch_supported}.
+ */
 class Publisher
 {
 public:
+	/**
+	 * Application events: bursts of 4 events, 1 event per second on average, by default.
+	 */
+	static const uint16_t USER_EVENT_BURST = PUBLISH_USER_EVENT_BURST;
+	static const system_tick_t USER_EVENT_INTERVAL = PUBLISH_USER_EVENT_INTERVAL;
+
+	/**
+	 * System events: 255 events per 65536 milliseconds, by default.
+	 */
+	static const uint16_t SYSTEM_EVENT_BURST = PUBLISH_SYSTEM_EVENT_BURST;
+	static const system_tick_t SYSTEM_EVENT_INTERVAL = PUBLISH_SYSTEM_EVENT_INTERVAL;
+
 	explicit Publisher(Protocol* protocol) :
-			protocol(protocol)
+			protocol(protocol),
+			system_bucket(SYSTEM_EVENT_BURST, SYSTEM_EVENT_INTERVAL),
+			user_bucket(USER_EVENT_BURST, USER_EVENT_INTERVAL),
+			system_queue(SYSTEM_PUBLISH_QUEUE_SIZE),
+			user_queue(PUBLISH_QUEUE_SIZE),
+			queued(0),
+			batch_supported(false),
+			confirmable_sent(0)
 	{
 	}
 
+	~Publisher()
+	{
+		clear(SYSTEM_ERROR_CANCELLED);
+	}
+
 	inline bool is_system(const char* event_name)
 	{
 		return !strncmp(event_name, "spark", 5) || !strncmp(event_name, "particle", 8);
 	}
 
+	/**
+	 * Sets the burst size and the refill interval of the rate limiter for either system or
+	 * application events.
+	 */
+	void set_rate_limit(bool is_system_event, uint16_t burst, system_tick_t refill_interval)
+	{
+		(is_system_event ? system_bucket : user_bucket).configure(burst, refill_interval);
+	}
+
+	/**
+	 * Sets the maximum number of either system or application events deferred by the rate limiter.
+	 * Events already queued are not discarded.
+	 */
+	void set_queue_size(bool is_system_event, size_t size)
+	{
+		(is_system_event ? system_queue : user_queue).max_count = size;
+	}
+
+	/**
+	 * Sets the maximum payload size of a batch of events and the maximum time an event waits
+	 * for the batch to be sent.
+	 */
+	void set_batch_policy(size_t max_size, system_tick_t max_delay)
+	{
+		batch.configure(max_size, max_delay);
+	}
+
+	size_t batched_events() const
+	{
+		return batch.events();
+	}
+
+	/**
+	 * Sets whether the server accepts batches of events. Until it does, events published with
+	 * {@code EventType::BATCH} are sent individually, and so are the events already in the batch.
+	 */
+	void set_batch_supported(bool supported)
+	{
+		batch_supported = supported;
+	}
+
+	bool is_batch_supported() const
+	{
+		return batch_supported;
+	}
+
+	/**
+	 * Takes a token from the rate limiter for the given kind of events.
+	 * @return {@code true} if no token is available, i.e. the event can't be sent yet.
+	 */
 	bool is_rate_limited(bool is_system_event, system_tick_t millis)
 	{
-		if (is_system_event)
-		{
-			static uint16_t lastMinute = 0;
-			static uint8_t eventsThisMinute = 0;
-
-			uint16_t currentMinute = uint16_t(millis >> 16);
-			if (currentMinute == lastMinute)
-			{      // == handles millis() overflow
-				if (eventsThisMinute == 255)
-					return true;
-			}
-			else
-			{
-				lastMinute = currentMinute;
-				eventsThisMinute = 0;
-			}
-			eventsThisMinute++;
-		}
-		else
-		{
-			static system_tick_t recent_event_ticks[5] =
-			{ (system_tick_t) -1000, (system_tick_t) -1000,
-					(system_tick_t) -1000, (system_tick_t) -1000,
-					(system_tick_t) -1000 };
-			static int evt_tick_idx = 0;
-
-			system_tick_t now = recent_event_ticks[evt_tick_idx] = millis;
-			evt_tick_idx++;
-			evt_tick_idx %= 5;
-			if (now - recent_event_ticks[evt_tick_idx] < 1000)
-			{
-				// exceeded allowable burst of 4 events per second
-				return true;
-			}
-		}
-		return false;
+		return !(is_system_event ? system_bucket : user_bucket).consume(millis);
 	}
 
+	size_t queued_events() const
+	{
+		return queued;
+	}
+
+	/**
+	 * Sends an event, or queues it if the rate limit has been reached. The completion handler is
+	 * invoked once the event has actually been sent (or acknowledged, with {@code EventType::WITH_ACK}).
+	 *
+	 * @return {@code BANDWIDTH_EXCEEDED} if the event is over the rate limit and the queue is full.
+	 */
 	ProtocolError send_event(MessageChannel& channel, const char* event_name,
 			const char* data, int ttl, EventType::Enum event_type, int flags,
-			system_tick_t time, CompletionHandler handler)
-	{
-		bool is_system_event = is_system(event_name);
-		bool rate_limited = is_rate_limited(is_system_event, time);
-		if (rate_limited) {
-			g_rateLimitedEventsCounter++;
-			return BANDWIDTH_EXCEEDED;
-		}
+			system_tick_t time, CompletionHandler handler);
 
-		Message message;
-		channel.create(message);
-		bool confirmable = channel.is_unreliable();
-		if (flags & EventType::NO_ACK) {
-			confirmable = false;
-		} else if (flags & EventType::WITH_ACK) {
-			confirmable = true;
-		}
-		size_t msglen = Messages::event(message.buf(), 0, event_name, data, ttl,
-				event_type, confirmable);
-		message.set_length(msglen);
-		const ProtocolError result = channel.send(message);
-		if (result == NO_ERROR) {
-			// Register completion handler only if acknowledgement was requested explicitly
-			if ((flags & EventType::WITH_ACK) && message.has_id()) {
-			    add_ack_handler(message.get_id(), std::move(handler));
-			} else {
-			    handler.setResult();
-			}
-		}
-		return result;
+	/**
+	 * Sends the batch of events if it is due, and the queued events for which tokens are available.
+	 */
+	ProtocolError process(MessageChannel& channel, system_tick_t time);
+
+	/**
+	 * Sends the pending batch of events.
+	 *
+	 * @return {@code BANDWIDTH_EXCEEDED} if the batch has to wait for a token.
+	 */
+	ProtocolError flush_batch(MessageChannel& channel, system_tick_t time);
+
+	/**
+	 * Sends the batch of events without waiting for its delay, and the queued events for which
+	 * tokens are available.
+	 *
+	 * @param confirmed Receives {@code true} if any of the events was sent as a confirmable message.
+	 */
+	ProtocolError flush(MessageChannel& channel, system_tick_t time, bool* confirmed = nullptr);
+
+	/**
+	 * Returns {@code true} if events are waiting in the batch or in the queues.
+	 */
+	bool has_pending() const
+	{
+		return queued || batch.events();
 	}
 
+	/**
+	 * Discards all queued and batched events, completing their handlers with the given error.
+	 */
+	void clear(int error);
+
 private:
+	struct QueuedEvent
+	{
+		QueuedEvent* next;
+		CompletionHandler handler;
+		int flags;
+		size_t length;
+
+		uint8_t* data() { return reinterpret_cast<uint8_t*>(this+1); }
+	};
+
+	struct EventQueue
+	{
+		QueuedEvent* head;
+		QueuedEvent* tail;
+		size_t count;
+		size_t max_count;
+
+		explicit EventQueue(size_t max_count) : head(nullptr), tail(nullptr), count(0), max_count(max_count) {}
+	};
+
 	Protocol* protocol;
+	TokenBucket system_bucket;
+	TokenBucket user_bucket;
+	EventQueue system_queue;
+	EventQueue user_queue;
+	size_t queued;
+	EventBatch batch;
+	bool batch_supported;
+	unsigned confirmable_sent;
+
+	ProtocolError add_to_batch(MessageChannel& channel, const char* event_name, const char* data, int ttl,
+			EventType::Enum event_type, system_tick_t time, CompletionHandler&& handler);
+	ProtocolError send_event(MessageChannel& channel, bool is_system_event, const char* event_name, size_t name_len,
+			const char* data, size_t data_len, int ttl, EventType::Enum event_type, int flags, system_tick_t time,
+			CompletionHandler&& handler);
+	ProtocolError unbatch(MessageChannel& channel, system_tick_t time);
+	ProtocolError enqueue(EventQueue& queue, const Message& message, int flags, CompletionHandler&& handler);
+	ProtocolError drain(EventQueue& queue, TokenBucket& bucket, MessageChannel& channel, system_tick_t time);
+	ProtocolError send(MessageChannel& channel, Message& message, int flags, CompletionHandler&& handler);
 
 	void add_ack_handler(message_id_t msg_id, CompletionHandler handler);
 };
@@ -200,6 +200,12 @@ int spark_protocol_set_connection_property(ProtocolFacade* protocol, unsigned pr
     } else if (property_id == particle::protocol::Connection::FAST_OTA)
     {
         protocol->set_fast_ota(data);
+    } else if (property_id == particle::protocol::Connection::WINDOWED_OTA)
+    {
+        protocol->set_windowed_ota(data);
+    } else if (property_id == particle::protocol::Connection::FAST_RECONNECT)
+    {
+        protocol->set_fast_reconnect(data);
     }
     return 0;
 }
@@ -19,6 +19,9 @@
 
 #pragma once
 
+#include <algorithm>
+#include <cstring>
+
 namespace particle
 {
 namespace protocol
@@ -37,8 +40,110 @@ public:
 private:
 	FilteringEventHandler event_handlers[MAX_SUBSCRIPTIONS];
 
+	/**
+	 * Indices of the registered handlers ordered by their filter, and the length
+	 * of each filter. Rebuilt whenever the handlers change so that an event can be
+	 * matched by binary searching for the filters that are a prefix of its name.
+	 */
+	uint8_t sorted_handlers[MAX_SUBSCRIPTIONS];
+	uint8_t filter_lengths[MAX_SUBSCRIPTIONS];
+	uint8_t handler_count;
+
+	static_assert(MAX_SUBSCRIPTIONS <= 255, "handler indices are stored as uint8_t");
+	static_assert(sizeof(FilteringEventHandler::filter) <= 255, "filter lengths are stored as uint8_t");
+
+	/**
+	 * Lexicographically compares a filter with the first {@code name_length} characters of an event name.
+	 */
+	static int compare_filter(const char* filter, size_t filter_length, const char* name, size_t name_length)
+	{
+		const int cmp = memcmp(filter, name, std::min(filter_length, name_length));
+		if (cmp)
+			return cmp;
+		return (filter_length > name_length) - (filter_length < name_length);
+	}
+
+	void rebuild_index()
+	{
+		handler_count = 0;
+		const int NUM_HANDLERS = sizeof(event_handlers)
+				/ sizeof(FilteringEventHandler);
+		for (int i = 0; i < NUM_HANDLERS; i++)
+		{
+			if (NULL == event_handlers[i].handler)
+			{
+				break;
+			}
+			filter_lengths[i] = strnlen(event_handlers[i].filter, sizeof(event_handlers[i].filter));
+			// insertion sort, the table is small and changes rarely
+			size_t pos = handler_count++;
+			for (; pos > 0; --pos)
+			{
+				const uint8_t prev = sorted_handlers[pos - 1];
+				if (compare_filter(event_handlers[prev].filter, filter_lengths[prev],
+						event_handlers[i].filter, filter_lengths[i]) <= 0)
+				{
+					break;
+				}
+				sorted_handlers[pos] = prev;
+			}
+			sorted_handlers[pos] = i;
+		}
+	}
+
 protected:
 
+	/**
+	 * Flags the handlers whose filter is a prefix of the given event name.
+	 *
+	 * All filters that are a prefix of the name sort at or before the name itself. The last
+	 * such candidate is found by binary search; if it doesn't match, any remaining match is
+	 * also a prefix of the part the candidate has in common with the name, so the search
+	 * continues with that shorter prefix over the preceding filters.
+	 *
+	 * @param matched Set to {@code true} for each matching handler index.
+	 * @return The number of matching handlers.
+	 */
+	size_t match_event_handlers(const char* name, size_t name_length, bool matched[MAX_SUBSCRIPTIONS]) const
+	{
+		size_t count = 0;
+		size_t end = handler_count;
+		while (end > 0)
+		{
+			size_t lo = 0;
+			size_t hi = end;
+			while (lo < hi)
+			{
+				const size_t mid = (lo + hi) / 2;
+				const uint8_t index = sorted_handlers[mid];
+				if (compare_filter(event_handlers[index].filter, filter_lengths[index], name, name_length) <= 0)
+					lo = mid + 1;
+				else
+					hi = mid;
+			}
+			if (0 == lo)
+			{
+				break;
+			}
+			end = lo - 1;
+			const uint8_t index = sorted_handlers[end];
+			const size_t filter_length = filter_lengths[index];
+			size_t common = 0;
+			while (common < filter_length && common < name_length
+					&& event_handlers[index].filter[common] == name[common])
+			{
+				++common;
+			}
+			if (common == filter_length)
+			{
+				matched[index] = true;
+				++count;
+			}
+			name_length = common;
+		}
+		return count;
+	}
+
 	ProtocolError send_subscription(MessageChannel& channel, const char* filter, const char* device_id, SubscriptionScope::Enum scope)
 	{
 	    size_t msglen;
@@ -63,6 +168,7 @@ public:
 	Subscriptions()
 	{
 		memset(&event_handlers, 0, sizeof(event_handlers));
+		rebuild_index();
 	}
 
 	uint32_t compute_subscriptions_checksum(calculate_crc_fn calculate_crc)
@@ -102,75 +208,48 @@ public:
 			}
 		}
 
-		// end of CoAP message
-		unsigned char *end = queue + len;
-		// start of event name option (location path) - 6 bytes
-		// 4 bytes coap header, 2 bytes for the location path of the message
-		// plus the size of the token.
-		unsigned char *event_name = queue + 6 + (queue[0] & 0xF);
-		size_t event_name_length = CoAP::option_decode(&event_name);
-		if (0 == event_name_length)
+		CoAPReader reader(queue, len);
+		CoAPReader::OptionIterator option = reader.options();
+		// the first Uri-Path option is the event type, the event name follows
+		if (!reader.is_valid() || !option.next() || option.number() != CoAPOption::URI_PATH ||
+				!option.next() || option.number() != CoAPOption::URI_PATH || !option.length())
 		{
 			// error, malformed CoAP option
 			return MALFORMED_MESSAGE;
 		}
 
-		unsigned char *next_src = event_name + event_name_length;
-		unsigned char *next_dst = next_src;
-		while (next_src < end && 0x00 == (*next_src & 0xf0))
+		// the event name is decoded in place: any further Uri-Path options, i.e. an event name
+		// with slashes, are moved back to follow the first one
+		unsigned char *event_name = queue + (option.data() - queue);
+		unsigned char *next_dst = event_name + option.length();
+		while (option.next() && option.number() == CoAPOption::URI_PATH)
 		{
-			// there's another Uri-Path option, i.e., event name with slashes
-			size_t option_len = CoAP::option_decode(&next_src);
 			*next_dst++ = '/';
-			if (next_dst != next_src)
-			{
-				// at least one extra byte has been used to encode a CoAP Uri-Path option length
-				memmove(next_dst, next_src, option_len);
-			}
-			next_src += option_len;
-			next_dst += option_len;
-		}
-		event_name_length = next_dst - event_name;
-
-		if (next_src < end && 0x30 == (*next_src & 0xf0))
-		{
-			// Max-Age option is next, which we ignore
-			size_t next_len = CoAP::option_decode(&next_src);
-			next_src += next_len;
+			memmove(next_dst, option.data(), option.length());
+			next_dst += option.length();
 		}
+		const size_t event_name_length = next_dst - event_name;
 
 		unsigned char *data = NULL;
-		if (next_src < end && 0xff == *next_src)
+		if (reader.payload())
 		{
-			// payload is next
-			data = next_src + 1;
+			data = queue + (reader.payload() - queue);
 			// null terminate data string
-			*end = 0;
+			queue[len] = 0;
 		}
 		// null terminate event name string
 		event_name[event_name_length] = 0;
 
-		const int NUM_HANDLERS = sizeof(event_handlers)
-				/ sizeof(FilteringEventHandler);
-		for (int i = 0; i < NUM_HANDLERS; i++)
+		bool matched[MAX_SUBSCRIPTIONS] = {};
+		if (!match_event_handlers((const char*) event_name, event_name_length, matched))
 		{
-			if (NULL == event_handlers[i].handler)
-			{
-				break;
-			}
-			const size_t MAX_FILTER_LENGTH = sizeof(event_handlers[i].filter);
-			const size_t filter_length = strnlen(event_handlers[i].filter,
-					MAX_FILTER_LENGTH);
-
-			if (event_name_length < filter_length)
-			{
-				// does not match this filter, try the next event handler
-				continue;
-			}
+			return NO_ERROR;
+		}
 
-			const int cmp = memcmp(event_handlers[i].filter, event_name,
-					filter_length);
-			if (0 == cmp)
+		// handlers are invoked in registration order
+		for (int i = 0; i < handler_count; i++)
+		{
+			if (matched[i])
 			{
 				// don't call the handler directly, use a callback for it.
 				if (!call_event_handler)
@@ -195,7 +274,6 @@ public:
 							(const char*) data, NULL);
 				}
 			}
-			// else continue the for loop to try the next handler
 		}
 		return NO_ERROR;
 	}
@@ -247,6 +325,7 @@ public:
 				}
 			}
 		}
+		rebuild_index();
 	}
 
 	/**
@@ -306,6 +385,7 @@ public:
 				memcpy(event_handlers[i].device_id, id, id_len);
 				event_handlers[i].device_id[id_len] = 0;
 				event_handlers[i].scope = scope;
+				rebuild_index();
 				return NO_ERROR;
 			}
 		}
@@ -39,22 +39,18 @@ public:
 
     ProtocolError decode_variable_request(char variable_key[MAX_VARIABLE_KEY_LENGTH+1], Message& message)
     {
-        uint8_t* queue = message.buf();
-        uint8_t queue_offset = 8;
-
-        // copy the variable key
-        size_t variable_key_length;
-        if (queue[7] == 0x0d) {
-            variable_key_length = 0x0d + (queue[8] & 0xFF);
-            queue_offset++;
-        } else {
-            variable_key_length = queue[7] & 0x0F;
+        // the variable key is the Uri-Path option following "v"
+        CoAPReader reader(message.buf(), message.length());
+        CoAPReader::OptionIterator option = reader.options();
+        if (!option.next() || !option.next() || option.number() != CoAPOption::URI_PATH) {
+            return MALFORMED_MESSAGE;
         }
+        size_t variable_key_length = option.length();
         if (variable_key_length > MAX_VARIABLE_KEY_LENGTH) {
             variable_key_length = MAX_VARIABLE_KEY_LENGTH;
         }
 
-        memcpy(variable_key, queue + queue_offset, variable_key_length);
+        memcpy(variable_key, option.data(), variable_key_length);
         memset(variable_key + variable_key_length, 0, MAX_VARIABLE_KEY_LENGTH+1 - variable_key_length);
         return NO_ERROR;
     }
@@ -83,13 +79,17 @@ public:
         {
             const char *str_val = (const char *)get_variable(variable_key);
 
-            // 2-byte leading length, 16 potential padding bytes
-            int max_length = message.capacity();
-            int str_length = strlen(str_val);
-            if (str_length > max_length) {
-                str_length = max_length;
+            // the value is written in place, truncated to the space left in the message
+            CoAPWriter writer(queue, message.capacity());
+            writer.header(CoAPType::ACK, CoAPCode::CONTENT, message_id, &token, sizeof(token));
+            size_t available = 0;
+            uint8_t* payload = writer.payload_buffer(&available);
+            const size_t str_length = strnlen(str_val, available);
+            if (str_length) {
+                memcpy(payload, str_val, str_length);
+                writer.commit_payload(str_length);
             }
-            response = Messages::variable_value(queue, message_id, token, str_val, str_length);
+            response = writer.length();
         }
         else if(SparkReturnType::DOUBLE == var_type)
         {
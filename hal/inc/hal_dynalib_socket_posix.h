@@ -50,6 +50,12 @@ DYNALIB_FN(14, hal_socket, sock_socket, int(int, int, int))
 DYNALIB_FN(15, hal_socket, sock_fcntl, int(int, int, ...))
 DYNALIB_FN(16, hal_socket, sock_poll, int(struct pollfd*, nfds_t, int))
 DYNALIB_FN(17, hal_socket, sock_select, int(int, fd_set*, fd_set*, fd_set*, struct timeval*))
+DYNALIB_FN(18, hal_socket, sock_sendmmsg, int(int, struct sock_mmsghdr*, unsigned int, int))
+DYNALIB_FN(19, hal_socket, sock_recvmmsg, int(int, struct sock_mmsghdr*, unsigned int, int))
+DYNALIB_FN(20, hal_socket, sock_recv_pbuf, int(int, struct pbuf**, int, struct sockaddr*, socklen_t*))
+DYNALIB_FN(21, hal_socket, sock_send_pbuf, int(int, struct pbuf*, int, const struct sockaddr*, socklen_t))
+DYNALIB_FN(22, hal_socket, sock_pbuf_alloc, struct pbuf*(size_t))
+DYNALIB_FN(23, hal_socket, sock_pbuf_free, void(struct pbuf*))
 
 DYNALIB_END(hal_socket)
 
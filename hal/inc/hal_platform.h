@@ -235,6 +235,10 @@
 #define HAL_PLATFORM_COMPRESSED_BINARIES (0)
 #endif // HAL_PLATFORM_COMPRESSED_BINARIES
 
+#ifndef HAL_PLATFORM_FLASH_READ_MODULE
+#define HAL_PLATFORM_FLASH_READ_MODULE (0)
+#endif // HAL_PLATFORM_FLASH_READ_MODULE
+
 #ifndef HAL_PLATFORM_NETWORK_MULTICAST
 #define HAL_PLATFORM_NETWORK_MULTICAST (0)
 #endif // HAL_PLATFORM_NETWORK_MULTICAST
@@ -83,6 +83,11 @@
 #define HAL_PLATFORM_FUELGAUGE_MAX17043_I2C (HAL_I2C_INTERFACE3)
 #endif // PLATFORM_ID == PLATFORM_ELECTRON_PRODUCTION
 
+#if PLATFORM_ID == PLATFORM_GCC || (PLATFORM_ID >= PLATFORM_PHOTON_PRODUCTION && PLATFORM_ID != PLATFORM_NEWHAL)
+// HAL_FLASH_Read_Module() can read the modules currently in flash
+#define HAL_PLATFORM_FLASH_READ_MODULE (1)
+#endif // PLATFORM_ID == PLATFORM_GCC || PLATFORM_ID >= PLATFORM_PHOTON_PRODUCTION
+
 #if HAL_PLATFORM_WIFI
 #define HAL_PLATFORM_NETWORK_MULTICAST (1)
 #endif // HAL_PLATFORM_WIFI
@@ -150,6 +150,17 @@ hal_update_complete_t HAL_FLASH_End(hal_module_t* module);
  */
 hal_update_complete_t HAL_FLASH_ApplyPendingUpdate(hal_module_t* module, bool dryRun, void* reserved);
 
+/**
+ * Reads part of a module from the location designated for it, e.g. to apply a patch to the module.
+ * @param module_function   The function of the module.
+ * @param module_index      The function index of the module.
+ * @param offset            The offset of the data within the module.
+ * @param data              Buffer receiving the data.
+ * @param length            The number of bytes to read.
+ * @return 0 on success, a negative system error code otherwise.
+ */
+int HAL_FLASH_Read_Module(uint8_t module_function, uint8_t module_index, uint32_t offset, uint8_t* data, uint32_t length, void* reserved);
+
 uint32_t HAL_FLASH_ModuleAddress(uint32_t address);
 uint32_t HAL_FLASH_ModuleLength(uint32_t address);
 bool HAL_FLASH_VerifyCRC32(uint32_t address, uint32_t length);
@@ -49,6 +49,19 @@ typedef int sock_result_t;
 /** Compatibility SOCKET_WAIT_FOREVER definition */
 #define SOCKET_WAIT_FOREVER (0xffffffff)
 
+struct pbuf;
+
+/**
+ * A message for sock_sendmmsg() and sock_recvmmsg().
+ */
+struct sock_mmsghdr {
+    void* msg_buf;               /**< Message data */
+    size_t msg_buflen;           /**< Size of the message (sock_sendmmsg()) or of the receive buffer (sock_recvmmsg()) */
+    struct sockaddr* msg_name;   /**< Target address (sock_sendmmsg()) or source address (sock_recvmmsg(), optional) */
+    socklen_t msg_namelen;       /**< Address length, on return from sock_recvmmsg() the actual size of the source address */
+    size_t msg_len;              /**< On return, the number of bytes sent or received */
+};
+
 /**
  * Accept a connection on a socket.
  *
@@ -235,6 +248,93 @@ ssize_t sock_send(int s, const void* dataptr, size_t size, int flags);
 ssize_t sock_sendto(int s, const void* dataptr, size_t size, int flags,
                     const struct sockaddr* to, socklen_t tolen);
 
+/**
+ * Send multiple messages through a datagram socket.
+ *
+ * The messages are sent in order. Only datagram sockets are supported.
+ *
+ * @param[in]     s        a socket that has been created with sock_socket()
+ * @param[inout]  msgvec   the messages to send, on return msg_len of each sent message
+ *                         contains the number of bytes sent
+ * @param[in]     vlen     the number of messages
+ * @param[in]     flags    a combination of MSG_MORE and MSG_DONTWAIT
+ *
+ * @returns    The number of messages sent or -1 if the first message could not be sent,
+ *             with errno set accordingly.
+ */
+int sock_sendmmsg(int s, struct sock_mmsghdr* msgvec, unsigned int vlen, int flags);
+
+/**
+ * Receive multiple messages from a datagram socket.
+ *
+ * The first message is received according to @p flags and the receive timeout of the socket.
+ * The following messages are received only if they are already queued.
+ *
+ * @param[in]     s        a socket that has been created with sock_socket()
+ * @param[inout]  msgvec   the receive buffers, on return msg_len and msg_namelen of each
+ *                         received message are updated
+ * @param[in]     vlen     the number of receive buffers
+ * @param[in]     flags    The flags
+ *
+ * @returns    The number of messages received or -1 if no message could be received,
+ *             with errno set accordingly.
+ */
+int sock_recvmmsg(int s, struct sock_mmsghdr* msgvec, unsigned int vlen, int flags);
+
+/**
+ * Receive data from the socket without copying it.
+ *
+ * The data is returned in the pbuf chain it was received in. Stream sockets return the next
+ * received segment, datagram sockets return the next datagram as a whole.
+ *
+ * @param[in]    s        a socket that has been created with sock_socket()
+ * @param[out]   p        the received data, which should be freed with sock_pbuf_free()
+ * @param[in]    flags    a combination of MSG_DONTWAIT
+ * @param[out]   from     the source address of the data (optional)
+ * @param[inout] fromlen  length of source address in bytes, on return it will
+ *                        contain the actual size of the source address
+ *
+ * @returns    The number of bytes received, 0 if a stream socket has been closed by the peer,
+ *             or -1 on error, with errno set accordingly.
+ */
+ssize_t sock_recv_pbuf(int s, struct pbuf** p, int flags, struct sockaddr* from, socklen_t* fromlen);
+
+/**
+ * Send a pbuf chain through the socket.
+ *
+ * Datagram sockets send the chain as is, without copying it. Stream sockets copy the data into
+ * the TCP send buffer, in the same way sock_send() does.
+ *
+ * @param[in]  s        a socket that has been created with sock_socket()
+ * @param[in]  p        the data to send. The pbuf chain is freed by this function,
+ *                      whether the data is sent or not
+ * @param[in]  flags    a combination of MSG_MORE and MSG_DONTWAIT
+ * @param[in]  to       target address (optional)
+ * @param[in]  tolen    target address length
+ *
+ * @returns    The number of bytes sent or -1 on error, with errno set accordingly.
+ */
+ssize_t sock_send_pbuf(int s, struct pbuf* p, int flags, const struct sockaddr* to, socklen_t tolen);
+
+/**
+ * Allocate a pbuf for sock_send_pbuf().
+ *
+ * The pbuf is contiguous, and has room for the protocol headers, so that the network stack
+ * doesn't need to allocate separate pbufs for them.
+ *
+ * @param[in]  size     the size of the data
+ *
+ * @returns    The pbuf, or NULL if it could not be allocated.
+ */
+struct pbuf* sock_pbuf_alloc(size_t size);
+
+/**
+ * Free a pbuf chain returned by sock_recv_pbuf() or sock_pbuf_alloc().
+ *
+ * @param[in]  p        the pbuf chain
+ */
+void sock_pbuf_free(struct pbuf* p);
+
 /**
  * Create an endpoint for communication - a socket.
  *
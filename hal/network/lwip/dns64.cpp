@@ -21,12 +21,19 @@
 
 #include "system_error.h"
 #include "logging.h"
+#include "timer_hal.h"
+#include "c_string.h"
+
+#include "spark_wiring_diagnostics.h"
 
 #include "lwiplock.h"
 #include "lwip_util.h"
 
 #include "lwip/dns.h"
 
+#include <algorithm>
+#include <strings.h>
+
 LOG_SOURCE_CATEGORY("net.dns64")
 
 #ifndef DEBUG_DNS64
@@ -128,8 +135,16 @@ struct Record { // RFC 1035, 4.1.3
 // Maximum size of a UDP message
 const size_t MAX_MESSAGE_SIZE = 512; // RFC 1035, 2.3.4
 
-// Value of the TTL field sent in all response messages
-const uint32_t DEFAULT_TTL = 0; // Do not cache (RFC 1035, 4.1.3)
+// Maximum number of cached lookup results
+const size_t CACHE_SIZE = 8;
+
+// Time in seconds for which a resolved address is cached. LwIP's DNS client doesn't report the TTL
+// of upstream records, so the cached answers and the synthesized records use a fixed TTL instead
+const uint32_t CACHE_TTL = 300;
+
+// Time in seconds for which a failed lookup is cached. LwIP doesn't tell NXDOMAIN from other errors,
+// so this is kept short
+const uint32_t NEGATIVE_CACHE_TTL = 60;
 
 // Timeout for select() in milliseconds
 const unsigned SOCKET_RECV_TIMEOUT = 1000;
@@ -193,7 +208,7 @@ ssize_t writeRecord(char* data, size_t size, const Record& r) {
     Record rr = {};
     rr.type = lwip_htons(r.type);
     rr.cls = lwip_htons(r.cls);
-    rr.ttl = lwip_htons(r.ttl);
+    rr.ttl = lwip_htonl(r.ttl);
     rr.rdlength = lwip_htons(r.rdlength);
     memcpy(data, &rr, sizeof(Record));
     return sizeof(Record);
@@ -298,14 +313,33 @@ uint16_t systemToDnsError(int error) {
     }
 }
 
+SimpleIntegerDiagnosticData g_cacheHits(DIAG_ID_NETWORK_DNS64_CACHE_HITS, DIAG_NAME_NETWORK_DNS64_CACHE_HITS);
+SimpleIntegerDiagnosticData g_cacheMisses(DIAG_ID_NETWORK_DNS64_CACHE_MISSES, DIAG_NAME_NETWORK_DNS64_CACHE_MISSES);
+
 } // particle::net::
 
+struct Dns64::CacheEntry {
+    CString name;
+    ip_addr_t addr;
+    system_tick_t expiresAt;
+    uint16_t type; // Type of the address that was looked up
+    bool found;
+};
+
 struct Dns64::Context {
     ip6_addr_t prefix;
     int sock;
+    // Cached lookup results, most recently used first
+    CacheEntry cache[CACHE_SIZE];
+    size_t cacheSize;
+    // Queries for which a lookup is in progress
+    Query* pending;
 
     Context() :
-            sock(-1) {
+            sock(-1),
+            cache(),
+            cacheSize(0),
+            pending(nullptr) {
     }
 
     ~Context() {
@@ -313,6 +347,50 @@ struct Dns64::Context {
             LOG(ERROR, "Unable to close socket");
         }
     }
+
+    const CacheEntry* findCached(const char* name, uint16_t type) {
+        const auto now = HAL_Timer_Get_Milli_Seconds();
+        for (size_t i = 0; i < cacheSize; ++i) {
+            const auto& e = cache[i];
+            if (e.type == type && strcasecmp(e.name, name) == 0) {
+                if ((int32_t)(e.expiresAt - now) <= 0) {
+                    return nullptr; // Expired
+                }
+                std::rotate(cache, cache + i, cache + i + 1);
+                return &cache[0];
+            }
+        }
+        return nullptr;
+    }
+
+    void addCached(const char* name, uint16_t type, const ip_addr_t* addr) {
+        size_t i = 0;
+        while (i < cacheSize && (cache[i].type != type || strcasecmp(cache[i].name, name) != 0)) {
+            ++i;
+        }
+        if (i == cacheSize) {
+            CString n(name);
+            if (!n) {
+                return;
+            }
+            if (cacheSize < CACHE_SIZE) {
+                ++cacheSize;
+            } else {
+                --i; // Replace the least recently used entry
+            }
+            cache[i].name = std::move(n);
+        }
+        auto& e = cache[i];
+        e.type = type;
+        e.found = (addr != nullptr);
+        if (addr) {
+            ip_addr_copy(e.addr, *addr);
+        }
+        e.expiresAt = HAL_Timer_Get_Milli_Seconds() + (addr ? CACHE_TTL : NEGATIVE_CACHE_TTL) * 1000;
+        std::rotate(cache, cache + i, cache + i + 1);
+    }
+
+    void removePending(Query* q);
 };
 
 struct Dns64::Query {
@@ -321,8 +399,38 @@ struct Dns64::Query {
     Header h;
     Question q;
     uint16_t type;
+    CString name; // Name being looked up, set while the lookup is in progress
+    Query* next; // Next query in the list of pending queries or waiting queries
+    Query* waiting; // Queries waiting for the result of the same lookup
+
+    Query() :
+            srcAddr(),
+            h(),
+            q(),
+            type(0),
+            next(nullptr),
+            waiting(nullptr) {
+    }
+
+    ~Query() {
+        while (waiting) {
+            const auto w = waiting;
+            waiting = w->next;
+            delete w;
+        }
+    }
 };
 
+void Dns64::Context::removePending(Query* q) {
+    for (Query** p = &pending; *p; p = &(*p)->next) {
+        if (*p == q) {
+            *p = q->next;
+            q->next = nullptr;
+            break;
+        }
+    }
+}
+
 int Dns64::init(if_t iface, const ip6_addr_t& prefix, uint16_t port) {
     // Initialize the context
     ctx_.reset(new(std::nothrow) Context);
@@ -412,9 +520,10 @@ int Dns64::processQuery(char* data, size_t size, const sockaddr_in6& srcAddr) {
         // Perform a DNS lookup
         q->type = q->q.qtype; // Try getting an address of the requested type first
         ip_addr_t addr = {};
-        ret = getHostByName(name, &addr, q.get());
+        uint32_t ttl = 0;
+        ret = getHostByName(name, &addr, &ttl, q.get(), ctx_.get());
         if (ret == GetHostByNameResult::DONE) {
-            ret = sendResponse(addr, name, *q, ctx_.get());
+            ret = sendResponse(addr, ttl, name, *q, ctx_.get());
             if (ret < 0) {
                 LOG_DEBUG(ERROR, "Unable to send response: %d", ret);
             }
@@ -466,7 +575,7 @@ int Dns64::parseQuery(char* data, size_t size, Query* q, const char** name) {
     return 0;
 }
 
-int Dns64::sendResponse(const ip_addr_t& addr, const char* name, const Query& q, Context* ctx) {
+int Dns64::sendResponse(const ip_addr_t& addr, uint32_t ttl, const char* name, const Query& q, Context* ctx) {
     ip_addr_t raddr = {}; // Resolved address
     if (q.q.qtype == Type::AAAA && IP_IS_V4(&addr)) {
         const auto addr6 = transformAddress(*ip_2_ip4(&addr), ctx->prefix);
@@ -503,7 +612,7 @@ int Dns64::sendResponse(const ip_addr_t& addr, const char* name, const Query& q,
     Record r = {};
     r.type = IP_IS_V6(&raddr) ? Type::AAAA : Type::A;
     r.cls = Class::IN;
-    r.ttl = DEFAULT_TTL;
+    r.ttl = ttl;
     r.rdlength = addrSize;
     data += CHECK(writeRecord(data, end - data, r));
     if (end - data < (ptrdiff_t)addrSize) {
@@ -546,38 +655,100 @@ int Dns64::sendErrorResponse(int error, const char* name, const Query& q, Contex
     return 0;
 }
 
-int Dns64::getHostByName(const char* name, ip_addr_t* addr, Query* q) {
+int Dns64::getHostByName(const char* name, ip_addr_t* addr, uint32_t* ttl, Query* q, Context* ctx) {
+    for (;;) {
+        const auto e = ctx->findCached(name, q->type);
+        if (!e) {
+            break;
+        }
+        if (e->found) {
+            ++g_cacheHits;
+            ip_addr_copy(*addr, e->addr);
+            *ttl = (e->expiresAt - HAL_Timer_Get_Milli_Seconds() + 999) / 1000;
+            return GetHostByNameResult::DONE;
+        }
+        if (q->type != Type::AAAA) {
+            ++g_cacheHits;
+            return SYSTEM_ERROR_NOT_FOUND;
+        }
+        q->type = Type::A; // The host is known to have no IPv6 address
+    }
+    ++g_cacheMisses;
+    // Wait for the result of an identical lookup if there's one in progress
+    for (auto p = ctx->pending; p; p = p->next) {
+        if (p->type == q->type && strcasecmp(p->name, name) == 0) {
+            q->next = p->waiting;
+            p->waiting = q;
+            return GetHostByNameResult::PENDING;
+        }
+    }
+    q->name = CString(name);
+    if (!q->name) {
+        return SYSTEM_ERROR_NO_MEMORY;
+    }
     const uint8_t addrType = (q->type == Type::A) ? LWIP_DNS_ADDRTYPE_IPV4 : LWIP_DNS_ADDRTYPE_IPV6;
     LwipTcpIpCoreLock lock; // LwIP's DNS client API is not thread-safe
     const auto lwipRet = dns_gethostbyname_addrtype(name, addr, Dns64::dnsCallback, q, addrType);
     lock.unlock();
     if (lwipRet == ERR_INPROGRESS) {
+        q->next = ctx->pending;
+        ctx->pending = q;
         return GetHostByNameResult::PENDING;
     } else if (lwipRet != ERR_OK) {
         return lwipToSystemError(lwipRet);
     }
+    ctx->addCached(name, q->type, addr);
+    *ttl = CACHE_TTL;
     return GetHostByNameResult::DONE;
 }
 
 void Dns64::dnsCallback(const char* name, const ip_addr_t* addr, void* data) {
     DEBUG("dns_found_callback: name: %s, address: %s", name ? name : "NULL", addr ? IPADDR_NTOA(addr) : "NULL");
     std::unique_ptr<Query> q(static_cast<Query*>(data));
-    if (!name) {
-        return;
-    }
     const auto ctx = q->ctx.lock();
     if (!ctx) {
         return;
     }
+    ctx->removePending(q.get());
+    if (!name) {
+        // LwIP gave up on the lookup without a result. Nothing is cached, so that the next query
+        // for the same name starts a new lookup
+        const auto fail = [&q, &ctx](const Query& query) {
+            const int ret = sendErrorResponse(SYSTEM_ERROR_NETWORK, q->name, query, ctx.get());
+            if (ret < 0) {
+                LOG_DEBUG(WARN, "Unable to send error response: %d", ret);
+            }
+        };
+        fail(*q);
+        for (auto w = q->waiting; w; w = w->next) {
+            fail(*w);
+        }
+        return; // The waiting queries are freed along with this one
+    }
+    ctx->addCached(name, q->type, addr);
+    // Complete the queries that were waiting for the same lookup
+    auto w = q->waiting;
+    q->waiting = nullptr;
+    completeQuery(std::move(q), name, addr, ctx.get());
+    while (w) {
+        std::unique_ptr<Query> wq(w);
+        w = w->next;
+        wq->next = nullptr;
+        completeQuery(std::move(wq), name, addr, ctx.get());
+    }
+}
+
+void Dns64::completeQuery(std::unique_ptr<Query> q, const char* name, const ip_addr_t* addr, Context* ctx) {
     int ret = 0;
     if (addr) {
-        ret = sendResponse(*addr, name, *q, ctx.get());
+        ret = sendResponse(*addr, CACHE_TTL, name, *q, ctx);
     } else if (q->type == Type::AAAA) {
         q->type = Type::A; // Try getting an IPv4 address
         ip_addr_t addr = {};
-        ret = getHostByName(name, &addr, q.get());
+        uint32_t ttl = 0;
+        ret = getHostByName(name, &addr, &ttl, q.get(), ctx);
         if (ret == GetHostByNameResult::DONE) {
-            ret = sendResponse(addr, name, *q, ctx.get());
+            ret = sendResponse(addr, ttl, name, *q, ctx);
             if (ret < 0) {
                 LOG_DEBUG(ERROR, "Unable to send response: %d", ret);
             }
@@ -590,7 +761,7 @@ void Dns64::dnsCallback(const char* name, const ip_addr_t* addr, void* data) {
         ret = SYSTEM_ERROR_NOT_FOUND;
     }
     if (ret < 0) {
-        ret = sendErrorResponse(ret, name, *q, ctx.get());
+        ret = sendErrorResponse(ret, name, *q, ctx);
         if (ret < 0) {
             LOG_DEBUG(WARN, "Unable to send error response: %d", ret);
         }
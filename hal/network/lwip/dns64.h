@@ -49,6 +49,7 @@ private:
 
     struct Context;
     struct Query;
+    struct CacheEntry;
 
     std::shared_ptr<Context> ctx_;
     std::unique_ptr<char[]> buf_;
@@ -56,10 +57,11 @@ private:
     int processQuery(char* data, size_t size, const sockaddr_in6& srcAddr);
     static int parseQuery(char* data, size_t size, Query* q, const char** name);
 
-    static int sendResponse(const ip_addr_t& addr, const char* name, const Query& q, Context* ctx);
+    static int sendResponse(const ip_addr_t& addr, uint32_t ttl, const char* name, const Query& q, Context* ctx);
     static int sendErrorResponse(int error, const char* name, const Query& q, Context* ctx);
 
-    static int getHostByName(const char* name, ip_addr_t* addr, Query* q);
+    static int getHostByName(const char* name, ip_addr_t* addr, uint32_t* ttl, Query* q, Context* ctx);
+    static void completeQuery(std::unique_ptr<Query> q, const char* name, const ip_addr_t* addr, Context* ctx);
 
     static void dnsCallback(const char* name, const ip_addr_t* addr, void* data);
 };
@@ -87,11 +87,46 @@ const size_t DEFAULT_MAX_TRANSLATION_ENTRIES = DEFAULT_POOL_SIZE / NAT64_ENTRY_S
 
 const size_t DEFAULT_SESSION_CLEANUP_TIMEOUT = 1000;
 
+uint32_t lifetimeToTicks(uint32_t lifetime) {
+    return (lifetime + DEFAULT_SESSION_CLEANUP_TIMEOUT - 1) / DEFAULT_SESSION_CLEANUP_TIMEOUT;
+}
+
+/* Finalizer of MurmurHash3 */
+uint32_t hashMix(uint32_t h) {
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+    return h;
+}
+
+uint32_t hashAddress(const Ip6TransportAddress& addr) {
+    /* Zone is not taken into account */
+    const auto& a = addr.address();
+    return hashMix(a.addr[0] ^ a.addr[1] ^ a.addr[2] ^ a.addr[3] ^ addr.l4Id());
+}
+
+uint32_t hashAddress(const Ip4TransportAddress& addr) {
+    return hashMix(ip4_addr_get_u32(&addr.address()) ^ addr.l4Id());
+}
+
+/* Sessions are keyed by their BIB and the IPv4 address of the remote peer,
+ * which is known in both directions.
+ */
+uint32_t hashSession(const BibEntry* bib, const Ip4TransportAddress& dst4) {
+    return hashMix((uint32_t)(uintptr_t)bib ^ hashAddress(dst4));
+}
+
 static_assert(MEMP_NUM_SYS_TIMEOUT > LWIP_NUM_SYS_TIMEOUT_INTERNAL, "An extra timeout should be allocated for NAT64 service. Increase MEMP_NUM_SYS_TIMEOUT");
 
 } /* anonymous */
 
-Nat64::Nat64() {
+Nat64::Nat64()
+        : udpPorts_(DEFAULT_UDP_NAT_MIN_PORT, DEFAULT_UDP_NAT_MAX_PORT),
+          icmpNextId_(DEFAULT_ICMP_NAT_MIN_ID),
+          timerWheel_(),
+          ticks_(0) {
     IP6_ADDR(&pref64_, PP_HTONL(0x64ff9b), 0, 0, 0);
     unsigned int rVal;
     particle::Random::genSecure((char*)&rVal, sizeof(rVal));
@@ -118,6 +153,9 @@ bool Nat64::enable(const Rule& rule) {
     rule_ = new Rule(rule);
     if (!pool_) {
         pool_.reset(new SimpleAllocedPool(DEFAULT_MAX_TRANSLATION_ENTRIES * NAT64_ENTRY_SIZE));
+        if (!udpPorts_.init()) {
+            LOG(ERROR, "Failed to allocate UDP port map");
+        }
         enableSessionTimer();
     }
     return true;
@@ -271,13 +309,13 @@ int Nat64::natInput(const ip_addr_t* src, const ip_addr_t* dst, L4Protocol proto
                   IP6ADDR_NTOA(&bib->src6().address()), bib->src6().l4Id(),
                   IP4ADDR_NTOA(&bib->dst4().address()), bib->dst4().l4Id());
         /* Lookup session */
-        session = bib->lookupSession(srcAddr, dstAddr);
+        session = lookupSession(bib, srcAddr, dstAddr);
 
         /* FIXME: flag to enable full-cone NAT */
         if (!session && dstAddr.isV6()) {
             /* Attempt to create a new session */
             LOG_DEBUG(TRACE, "No matching session found, trying to create one");
-            session = bib->addSession(dstAddr, protoLifetime, *pool_);
+            session = addSession(bib, dstAddr, protoLifetime);
         } else if (!session && dstAddr.isV4()) {
             LOG_DEBUG(WARN, "Not creating a new session, full-cone NAT is not enabled");
         }
@@ -288,8 +326,11 @@ int Nat64::natInput(const ip_addr_t* src, const ip_addr_t* dst, L4Protocol proto
                       IP6ADDR_NTOA(&session->dst6().address()), session->dst6().l4Id(),
                       IP4ADDR_NTOA(&session->src4().address()), session->src4().l4Id(),
                       IP4ADDR_NTOA(&session->dst4().address()), session->dst4().l4Id(),
-                      session->lifetime());
-            session->setLifetime(protoLifetime);
+                      (unsigned long)(session->expiry() - ticks_) * DEFAULT_SESSION_CLEANUP_TIMEOUT);
+            refreshSession(session, protoLifetime);
+        } else if (bib->empty()) {
+            /* Don't keep a BIB without sessions around */
+            removeBib(bib);
         }
     } else {
         LOG_DEBUG(TRACE, "No matching BIB");
@@ -411,20 +452,37 @@ bool Nat64::filter(const IpTransportAddress& src, const IpTransportAddress& dst,
     return false;
 }
 
+Bib6Table& Nat64::bib6Table(L4Protocol proto) {
+    return proto == L4_PROTO_UDP ? udpBib6Table_ : icmpBib6Table_;
+}
+
+Bib4Table& Nat64::bib4Table(L4Protocol proto) {
+    return proto == L4_PROTO_UDP ? udpBib4Table_ : icmpBib4Table_;
+}
+
 BibEntry* Nat64::lookupBib(const IpTransportAddress& src, const IpTransportAddress& dst, L4Protocol proto) {
-    BibTable& tbl = proto == L4_PROTO_UDP ? udpBibTable_ : icmpBibTable_;
-    const IpTransportAddress& addr = src.isV6() ? src : dst;
-    for (auto entry = tbl.front(); entry != nullptr; entry = entry->next) {
-        if (entry->matches(addr)) {
+    if (!src.isV6()) {
+        return lookupBib4(dst, proto);
+    }
+    const Ip6TransportAddress src6(src);
+    for (auto entry = bib6Table(proto).front(hashAddress(src6)); entry != nullptr; entry = Bib6Table::next(entry)) {
+        if (entry->src6() == src6) {
             return entry;
         }
     }
     return nullptr;
 }
 
-BibEntry* Nat64::addBib(const IpTransportAddress& src, const IpTransportAddress& dst, L4Protocol proto) {
-    BibTable& tbl = proto == L4_PROTO_UDP ? udpBibTable_ : icmpBibTable_;
+BibEntry* Nat64::lookupBib4(const Ip4TransportAddress& dst4, L4Protocol proto) {
+    for (auto entry = bib4Table(proto).front(hashAddress(dst4)); entry != nullptr; entry = Bib4Table::next(entry)) {
+        if (entry->dst4() == dst4) {
+            return entry;
+        }
+    }
+    return nullptr;
+}
 
+BibEntry* Nat64::addBib(const IpTransportAddress& src, const IpTransportAddress& dst, L4Protocol proto) {
     if (src.isV4()) {
         LOG_DEBUG(TRACE, "Not creating a new BIB for a connection initiated from IPv4 side");
         return nullptr;
@@ -447,8 +505,12 @@ BibEntry* Nat64::addBib(const IpTransportAddress& src, const IpTransportAddress&
                     if (pool_) {
                         BibEntry* bib = static_cast<BibEntry*>(pool_->alloc(NAT64_ENTRY_SIZE));
                         if (bib) {
-                            new (bib) BibEntry(src, src4);
-                            tbl.pushFront(bib);
+                            new (bib) BibEntry(src, src4, proto);
+                            bib6Table(proto).insert(hashAddress(bib->src6()), bib);
+                            bib4Table(proto).insert(hashAddress(bib->dst4()), bib);
+                            if (proto == L4_PROTO_UDP) {
+                                udpPorts_.set(src4.port(), true);
+                            }
                             return bib;
                         }
                     }
@@ -463,6 +525,81 @@ BibEntry* Nat64::addBib(const IpTransportAddress& src, const IpTransportAddress&
     return nullptr;
 }
 
+void Nat64::removeBib(BibEntry* bib) {
+    const auto proto = bib->protocol();
+    bib6Table(proto).remove(hashAddress(bib->src6()), bib);
+    bib4Table(proto).remove(hashAddress(bib->dst4()), bib);
+    if (proto == L4_PROTO_UDP) {
+        udpPorts_.set(bib->dst4().port(), false);
+    }
+    bib->~BibEntry();
+    pool_->free(bib);
+}
+
+SessionEntry* Nat64::lookupSession(BibEntry* bib, const IpTransportAddress& src, const IpTransportAddress& dst) {
+    Ip4TransportAddress dst4;
+    if (src.isV6()) {
+        ip4_addr_t addr = {};
+        unmap_ipv4_mapped_ipv6(&addr, ip_2_ip6(&dst.address()));
+        dst4 = Ip4TransportAddress(addr, dst.l4Id());
+    } else {
+        dst4 = Ip4TransportAddress(src);
+    }
+    for (auto s = sessionTable_.front(hashSession(bib, dst4)); s != nullptr; s = SessionTable::next(s)) {
+        if (s->bib() == bib && s->matches(src, dst)) {
+            return s;
+        }
+    }
+
+    return nullptr;
+}
+
+SessionEntry* Nat64::addSession(BibEntry* bib, const Ip6TransportAddress& dst6, uint32_t lifetime) {
+    auto sess = static_cast<SessionEntry*>(pool_->alloc(NAT64_ENTRY_SIZE));
+    if (!sess) {
+        LOG_DEBUG(TRACE, "Failed to allocate new session");
+        return nullptr;
+    }
+    new (sess) SessionEntry(bib, dst6);
+    bib->addSession();
+    sessionTable_.insert(hashSession(bib, sess->dst4()), sess);
+    sess->setExpiry(ticks_ + lifetimeToTicks(lifetime));
+    auto& slot = timerWheel_[sess->expiry() % NAT64_TIMER_WHEEL_SIZE];
+    sess->nextTimer = slot;
+    slot = sess;
+    return sess;
+}
+
+void Nat64::refreshSession(SessionEntry* session, uint32_t lifetime) {
+    /* The session stays in its current slot of the timer wheel. Since a lifetime can only
+     * be extended, the slot is reached before the new expiration time.
+     */
+    const uint32_t expiry = ticks_ + lifetimeToTicks(lifetime);
+    if ((int32_t)(expiry - session->expiry()) > 0) {
+        session->setExpiry(expiry);
+    }
+}
+
+void Nat64::removeSession(SessionEntry* session) {
+    auto bib = session->bib();
+    LOG_DEBUG(TRACE, "Session timed out %s#%u <-> %s#%u, %s#%u <-> %s#%u",
+              IP6ADDR_NTOA(&session->src6().address()), session->src6().l4Id(),
+              IP6ADDR_NTOA(&session->dst6().address()), session->dst6().l4Id(),
+              IP4ADDR_NTOA(&session->src4().address()), session->src4().l4Id(),
+              IP4ADDR_NTOA(&session->dst4().address()), session->dst4().l4Id());
+    sessionTable_.remove(hashSession(bib, session->dst4()), session);
+    session->~SessionEntry();
+    pool_->free(session);
+
+    bib->removeSession();
+    if (bib->empty()) {
+        LOG_DEBUG(TRACE, "%s BIB %s#%u <-> %s#%u timed out", bib->protocol() == L4_PROTO_UDP ? "UDP" : "ICMP",
+                  IP6ADDR_NTOA(&bib->src6().address()), bib->src6().l4Id(),
+                  IP4ADDR_NTOA(&bib->dst4().address()), bib->dst4().l4Id());
+        removeBib(bib);
+    }
+}
+
 bool Nat64::findNextL4Id(Ip4TransportAddress& src, L4Protocol proto) {
     if (proto == L4_PROTO_UDP) {
         return findNextUdpPort(src);
@@ -474,25 +611,20 @@ bool Nat64::findNextL4Id(Ip4TransportAddress& src, L4Protocol proto) {
 }
 
 bool Nat64::findNextUdpPort(Ip4TransportAddress& src) {
-    uint16_t port = udpNextPort_;
-    do {
-        src.setPort(port);
-        if (!lookupBib(src, src, L4_PROTO_UDP)) {
-            udpNextPort_ = nextBoundId(port, DEFAULT_UDP_NAT_MIN_PORT, DEFAULT_UDP_NAT_MAX_PORT);
-            return true;
-        }
-
-        port = nextBoundId(port, DEFAULT_UDP_NAT_MIN_PORT, DEFAULT_UDP_NAT_MAX_PORT);
-    } while(port != udpNextPort_);
-
-    return false;
+    uint16_t port = 0;
+    if (!udpPorts_.findFree(udpNextPort_, &port)) {
+        return false;
+    }
+    src.setPort(port);
+    udpNextPort_ = nextBoundId(port, DEFAULT_UDP_NAT_MIN_PORT, DEFAULT_UDP_NAT_MAX_PORT);
+    return true;
 }
 
 bool Nat64::findNextIcmpId(Ip4TransportAddress& src) {
     uint16_t id = icmpNextId_;
     do {
         src.setIcmpId(id);
-        if (!lookupBib(src, src, L4_PROTO_ICMP)) {
+        if (!lookupBib4(src, L4_PROTO_ICMP)) {
             icmpNextId_ = nextBoundId(id, DEFAULT_ICMP_NAT_MIN_ID, DEFAULT_ICMP_NAT_MAX_ID);
             return true;
         }
@@ -503,35 +635,22 @@ bool Nat64::findNextIcmpId(Ip4TransportAddress& src) {
     return false;
 }
 
-void Nat64::timeout(uint32_t dt) {
-    for (auto bib = udpBibTable_.front(), p = static_cast<BibEntry*>(nullptr); bib != nullptr;) {
-        if (bib->timeout(dt, *pool_)) {
-            LOG_DEBUG(TRACE, "UDP BIB %s#%u <-> %s#%u timed out",
-                      IP6ADDR_NTOA(&bib->src6().address()), bib->src6().l4Id(),
-                      IP4ADDR_NTOA(&bib->dst4().address()), bib->dst4().l4Id());
-
-            auto popped = udpBibTable_.pop(bib, p);
-            bib = popped->next;
-            pool_->free(popped);
-        } else {
-            p = bib;
-            bib = bib->next;
-        }
-    }
-
-    for (auto bib = icmpBibTable_.front(), p = static_cast<BibEntry*>(nullptr); bib != nullptr;) {
-        if (bib->timeout(dt, *pool_)) {
-            LOG_DEBUG(TRACE, "ICMP BIB %s#%u <-> %s#%u timed out",
-                      IP6ADDR_NTOA(&bib->src6().address()), bib->src6().l4Id(),
-                      IP4ADDR_NTOA(&bib->dst4().address()), bib->dst4().l4Id());
-
-            auto popped = udpBibTable_.pop(bib, p);
-            bib = popped->next;
-            pool_->free(popped);
+void Nat64::timeout() {
+    ++ticks_;
+    auto& slot = timerWheel_[ticks_ % NAT64_TIMER_WHEEL_SIZE];
+    auto s = slot;
+    slot = nullptr;
+    while (s) {
+        auto next = s->nextTimer;
+        if ((int32_t)(s->expiry() - ticks_) <= 0) {
+            removeSession(s);
         } else {
-            p = bib;
-            bib = bib->next;
+            /* Refreshed or expires in one of the next rounds */
+            auto& newSlot = timerWheel_[s->expiry() % NAT64_TIMER_WHEEL_SIZE];
+            s->nextTimer = newSlot;
+            newSlot = s;
         }
+        s = next;
     }
 }
 
@@ -547,6 +666,6 @@ void Nat64::disableSessionTimer() {
 
 void Nat64::timeoutHandlerCb(void* arg) {
     auto self = static_cast<Nat64*>(arg);
-    self->timeout(DEFAULT_SESSION_CLEANUP_TIMEOUT);
+    self->timeout();
     sys_timeout(DEFAULT_SESSION_CLEANUP_TIMEOUT, &timeoutHandlerCb, self);
 }
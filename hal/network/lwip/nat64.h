@@ -25,8 +25,8 @@
 #include <lwip/netif.h>
 #include <lwip/pbuf.h>
 #include <memory>
+#include <new>
 #include <cstring>
-#include "intrusive_list.h"
 #include "simple_pool_allocator.h"
 #include "logging.h"
 #include "ipaddr_util.h"
@@ -141,41 +141,76 @@ private:
 
 class BibEntry;
 class SessionEntry;
-class RuleEntry;
 
-using BibTable = particle::IntrusiveList<BibEntry>;
-using SessionTable = particle::IntrusiveList<SessionEntry>;
-using RuleTable = particle::IntrusiveList<RuleEntry>;
+/* Intrusive hash table with a fixed number of buckets. Collisions are chained through
+ * the link pointer given by NextT, so that an entry can be a member of several tables.
+ */
+template <typename T, T* T::*NextT, size_t N>
+class HashTable {
+public:
+    static_assert(N > 0 && (N & (N - 1)) == 0, "Number of buckets should be a power of 2");
+
+    HashTable();
+
+    T* front(uint32_t hash) const;
+    static T* next(const T* item);
+
+    void insert(uint32_t hash, T* item);
+    bool remove(uint32_t hash, T* item);
 
-template <typename DerivedT>
-class ListNode {
+private:
+    T* buckets_[N];
+};
+
+/* Bitmap of the allocated L4 identifiers (ports or ICMP IDs) within a range */
+class L4IdMap {
 public:
-    DerivedT* next;
+    L4IdMap(uint16_t min, uint16_t max);
+
+    bool init();
+
+    /* Finds the first free ID at or after `from`, wrapping around */
+    bool findFree(uint16_t from, uint16_t* id) const;
+    void set(uint16_t id, bool allocated);
+
+private:
+    uint16_t min_;
+    uint16_t max_;
+    std::unique_ptr<uint32_t[]> bits_;
+
+    size_t words() const;
 };
 
-class BibEntry : public ListNode<BibEntry> {
+static const size_t NAT64_BIB_TABLE_SIZE = 32;
+static const size_t NAT64_SESSION_TABLE_SIZE = 64;
+static const size_t NAT64_TIMER_WHEEL_SIZE = 64;
+
+class BibEntry {
 public:
-    BibEntry(const Ip6TransportAddress& src6, const Ip4TransportAddress& dst4);
+    BibEntry(const Ip6TransportAddress& src6, const Ip4TransportAddress& dst4, L4Protocol proto);
 
     const Ip6TransportAddress& src6() const;
     const Ip4TransportAddress& dst4() const;
+    L4Protocol protocol() const;
 
     bool matches(const IpTransportAddress& addr) const;
     bool empty() const;
 
-    SessionEntry* lookupSession(const IpTransportAddress& src, const IpTransportAddress& dst);
-    SessionEntry* addSession(const Ip6TransportAddress& dst, uint32_t lifetime, particle::SimpleAllocator& allocator);
+    void addSession();
+    void removeSession();
 
-    bool timeout(uint32_t dt, particle::SimpleAllocator& allocator);
+    /* Links in the tables indexed by the IPv6 and IPv4 transport addresses */
+    BibEntry* next6;
+    BibEntry* next4;
 
 private:
     Ip6TransportAddress src6_;
     Ip4TransportAddress dst4_;
-
-    SessionTable sessions_;
+    uint8_t proto_;
+    uint16_t sessions_;
 };
 
-class SessionEntry : public ListNode<SessionEntry> {
+class SessionEntry {
 public:
     SessionEntry(BibEntry* bib, const Ip6TransportAddress& dst6);
 
@@ -188,18 +223,25 @@ public:
 
     bool matches(const IpTransportAddress& src, const IpTransportAddress& dst);
 
-    uint32_t setLifetime(uint32_t lifetime);
-    uint32_t lifetime() const;
+    /* Expiration time in session timer ticks */
+    uint32_t setExpiry(uint32_t expiry);
+    uint32_t expiry() const;
 
-    bool timeout(uint32_t dt);
+    /* Links in the session table and in the timer wheel */
+    SessionEntry* next;
+    SessionEntry* nextTimer;
 
 private:
     BibEntry* bib_;
     Ip6TransportAddress dst6_;
 
-    uint32_t lifetime_;
+    uint32_t expiry_;
 };
 
+using Bib6Table = HashTable<BibEntry, &BibEntry::next6, NAT64_BIB_TABLE_SIZE>;
+using Bib4Table = HashTable<BibEntry, &BibEntry::next4, NAT64_BIB_TABLE_SIZE>;
+using SessionTable = HashTable<SessionEntry, &SessionEntry::next, NAT64_SESSION_TABLE_SIZE>;
+
 static const size_t NAT64_ENTRY_SIZE = std::max(sizeof(BibEntry), sizeof(SessionEntry));
 
 class Nat64 {
@@ -221,13 +263,20 @@ protected:
     bool filter(const IpTransportAddress& src, const IpTransportAddress& dst, netif* in) const;
 
     BibEntry* lookupBib(const IpTransportAddress& src, const IpTransportAddress& dst, L4Protocol proto);
+    BibEntry* lookupBib4(const Ip4TransportAddress& dst4, L4Protocol proto);
     BibEntry* addBib(const IpTransportAddress& src, const IpTransportAddress& dst, L4Protocol proto);
+    void removeBib(BibEntry* bib);
+
+    SessionEntry* lookupSession(BibEntry* bib, const IpTransportAddress& src, const IpTransportAddress& dst);
+    SessionEntry* addSession(BibEntry* bib, const Ip6TransportAddress& dst6, uint32_t lifetime);
+    void refreshSession(SessionEntry* session, uint32_t lifetime);
+    void removeSession(SessionEntry* session);
 
     bool findNextL4Id(Ip4TransportAddress& src, L4Protocol proto);
     bool findNextUdpPort(Ip4TransportAddress& src);
     bool findNextIcmpId(Ip4TransportAddress& src);
 
-    void timeout(uint32_t dt);
+    void timeout();
 
     void enableSessionTimer();
     void disableSessionTimer();
@@ -235,6 +284,8 @@ protected:
     static void timeoutHandlerCb(void* arg);
 
 private:
+    Bib6Table& bib6Table(L4Protocol proto);
+    Bib4Table& bib4Table(L4Protocol proto);
 
 private:
     /* TODO: a list of rules */
@@ -243,11 +294,22 @@ private:
     /* Defaults to 64:ff9b::/96 */
     ip6_addr_t pref64_;
 
-    BibTable udpBibTable_;
+    Bib6Table udpBib6Table_;
+    Bib4Table udpBib4Table_;
+    L4IdMap udpPorts_;
     uint16_t udpNextPort_;
-    BibTable icmpBibTable_;
+    Bib6Table icmpBib6Table_;
+    Bib4Table icmpBib4Table_;
     uint16_t icmpNextId_;
 
+    SessionTable sessionTable_;
+
+    /* Sessions are filed in the timer wheel by their expiration tick. A refreshed session is
+     * moved to its new slot lazily, when the wheel reaches the slot it was filed in.
+     */
+    SessionEntry* timerWheel_[NAT64_TIMER_WHEEL_SIZE];
+    uint32_t ticks_;
+
     std::unique_ptr<SimpleAllocedPool> pool_;
 };
 
@@ -407,10 +469,107 @@ inline netif* Rule::outside() const {
     return outside_;
 }
 
+/* HashTable */
+template <typename T, T* T::*NextT, size_t N>
+inline HashTable<T, NextT, N>::HashTable()
+        : buckets_() {
+}
+
+template <typename T, T* T::*NextT, size_t N>
+inline T* HashTable<T, NextT, N>::front(uint32_t hash) const {
+    return buckets_[hash & (N - 1)];
+}
+
+template <typename T, T* T::*NextT, size_t N>
+inline T* HashTable<T, NextT, N>::next(const T* item) {
+    return item->*NextT;
+}
+
+template <typename T, T* T::*NextT, size_t N>
+inline void HashTable<T, NextT, N>::insert(uint32_t hash, T* item) {
+    T*& head = buckets_[hash & (N - 1)];
+    item->*NextT = head;
+    head = item;
+}
+
+template <typename T, T* T::*NextT, size_t N>
+inline bool HashTable<T, NextT, N>::remove(uint32_t hash, T* item) {
+    for (T** p = &buckets_[hash & (N - 1)]; *p != nullptr; p = &((*p)->*NextT)) {
+        if (*p == item) {
+            *p = item->*NextT;
+            item->*NextT = nullptr;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* L4IdMap */
+inline L4IdMap::L4IdMap(uint16_t min, uint16_t max)
+        : min_(min),
+          max_(max) {
+}
+
+inline bool L4IdMap::init() {
+    if (!bits_) {
+        bits_.reset(new(std::nothrow) uint32_t[words()]());
+    }
+    return (bool)bits_;
+}
+
+inline size_t L4IdMap::words() const {
+    return ((size_t)max_ - min_) / 32 + 1;
+}
+
+inline bool L4IdMap::findFree(uint16_t from, uint16_t* id) const {
+    if (!bits_ || from < min_ || from > max_) {
+        return false;
+    }
+    const size_t count = (size_t)max_ - min_ + 1;
+    const size_t start = from - min_;
+    /* IDs preceding the starting one in its word are checked last, after wrapping around */
+    const uint32_t before = (1u << (start % 32)) - 1;
+    size_t w = start / 32;
+    for (size_t i = 0; i <= words(); ++i, w = (w + 1) % words()) {
+        uint32_t taken = bits_[w];
+        if (i == 0) {
+            taken |= before;
+        } else if (i == words()) {
+            taken |= ~before;
+        }
+        if (~taken != 0) {
+            const size_t n = w * 32 + __builtin_ctz(~taken);
+            if (n < count) {
+                *id = min_ + n;
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+inline void L4IdMap::set(uint16_t id, bool allocated) {
+    if (!bits_ || id < min_ || id > max_) {
+        return;
+    }
+    const size_t n = id - min_;
+    if (allocated) {
+        bits_[n / 32] |= (1u << (n % 32));
+    } else {
+        bits_[n / 32] &= ~(1u << (n % 32));
+    }
+}
+
 /* BibEntry */
-inline BibEntry::BibEntry(const Ip6TransportAddress& src6, const Ip4TransportAddress& dst4)
-        : src6_(src6),
-          dst4_(dst4) {
+inline BibEntry::BibEntry(const Ip6TransportAddress& src6, const Ip4TransportAddress& dst4, L4Protocol proto)
+        : next6(nullptr),
+          next4(nullptr),
+          src6_(src6),
+          dst4_(dst4),
+          proto_(proto),
+          sessions_(0) {
 }
 
 inline const Ip6TransportAddress& BibEntry::src6() const {
@@ -421,6 +580,10 @@ inline const Ip4TransportAddress& BibEntry::dst4() const {
     return dst4_;
 }
 
+inline L4Protocol BibEntry::protocol() const {
+    return static_cast<L4Protocol>(proto_);
+}
+
 inline bool BibEntry::matches(const IpTransportAddress& addr) const {
     if (addr.isV4()) {
         return dst4() == addr;
@@ -432,59 +595,26 @@ inline bool BibEntry::matches(const IpTransportAddress& addr) const {
 }
 
 inline bool BibEntry::empty() const {
-    return sessions_.front() == nullptr;
+    return sessions_ == 0;
 }
 
-inline SessionEntry* BibEntry::lookupSession(const IpTransportAddress& src, const IpTransportAddress& dst) {
-    for (auto* s = sessions_.front(); s != nullptr; s = s->next) {
-        if (s->matches(src, dst)) {
-            return s;
-        }
-    }
-
-    return nullptr;
+inline void BibEntry::addSession() {
+    ++sessions_;
 }
 
-inline SessionEntry* BibEntry::addSession(const Ip6TransportAddress& dst, uint32_t lifetime, particle::SimpleAllocator& allocator) {
-    auto sess = (SessionEntry*)allocator.alloc(NAT64_ENTRY_SIZE);
-    if (sess) {
-        new(sess) SessionEntry(this, dst);
-        sess->setLifetime(lifetime);
-        sessions_.pushFront(sess);
-        return sess;
+inline void BibEntry::removeSession() {
+    if (sessions_ > 0) {
+        --sessions_;
     }
-
-    LOG_DEBUG(TRACE, "Failed to allocate new session");
-
-    return nullptr;
-}
-
-inline bool BibEntry::timeout(uint32_t dt, particle::SimpleAllocator& allocator) {
-    using namespace particle::net;
-    for (auto s = sessions_.front(), p = static_cast<SessionEntry*>(nullptr); s != nullptr;) {
-        if (s->timeout(dt)) {
-            LOG_DEBUG(TRACE, "Session timed out %s#%u <-> %s#%u, %s#%u <-> %s#%u",
-                      IP6ADDR_NTOA(&s->src6().address()), s->src6().l4Id(),
-                      IP6ADDR_NTOA(&s->dst6().address()), s->dst6().l4Id(),
-                      IP4ADDR_NTOA(&s->src4().address()), s->src4().l4Id(),
-                      IP4ADDR_NTOA(&s->dst4().address()), s->dst4().l4Id());
-            auto popped = sessions_.pop(s, p);
-            s = popped->next;
-            allocator.free(popped);
-        } else {
-            p = s;
-            s = s->next;
-        }
-    }
-
-    return empty();
 }
 
 /* SessionEntry */
 inline SessionEntry::SessionEntry(BibEntry* bib, const Ip6TransportAddress& dst6)
-        : bib_(bib),
+        : next(nullptr),
+          nextTimer(nullptr),
+          bib_(bib),
           dst6_(dst6),
-          lifetime_(0) {
+          expiry_(0) {
 }
 
 inline BibEntry* SessionEntry::bib() {
@@ -520,22 +650,13 @@ inline bool SessionEntry::matches(const IpTransportAddress& src, const IpTranspo
     return false;
 }
 
-inline uint32_t SessionEntry::setLifetime(uint32_t lifetime) {
-    std::swap(lifetime_, lifetime);
-    return lifetime;
+inline uint32_t SessionEntry::setExpiry(uint32_t expiry) {
+    std::swap(expiry_, expiry);
+    return expiry;
 }
 
-inline uint32_t SessionEntry::lifetime() const {
-    return lifetime_;
-}
-
-inline bool SessionEntry::timeout(uint32_t dt) {
-    if (lifetime() <= dt) {
-        setLifetime(0);
-        return true;
-    }
-    setLifetime(lifetime() - dt);
-    return false;
+inline uint32_t SessionEntry::expiry() const {
+    return expiry_;
 }
 
 } } } /* particle::net::nat */
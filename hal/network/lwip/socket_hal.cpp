@@ -23,7 +23,11 @@
 
 /* socket_hal_posix_impl.h should get included from socket_hal.h automagically */
 #include "socket_hal.h"
+#include "lwiplock.h"
 #include <cstdarg>
+#include <cerrno>
+
+using namespace particle::net;
 
 int sock_accept(int s, struct sockaddr* addr, socklen_t* addrlen) {
   return lwip_accept(s, addr, addrlen);
@@ -83,6 +87,48 @@ ssize_t sock_sendto(int s, const void* dataptr, size_t size, int flags,
   return lwip_sendto(s, dataptr, size, flags, to, tolen);
 }
 
+int sock_sendmmsg(int s, struct sock_mmsghdr* msgvec, unsigned int vlen, int flags) {
+  int type = 0;
+  socklen_t len = sizeof(type);
+  if (lwip_getsockopt(s, SOL_SOCKET, SO_TYPE, &type, &len) != 0) {
+    return -1;
+  }
+  if (type != SOCK_DGRAM) {
+    /* Sending through a stream socket may block with the core locked */
+    errno = EOPNOTSUPP;
+    return -1;
+  }
+  /* The core lock is recursive: keep it locked for the whole batch, instead of locking
+     and unlocking it for every message */
+  LwipTcpIpCoreLock lk;
+  unsigned int i = 0;
+  for (; i < vlen; ++i) {
+    struct sock_mmsghdr* msg = &msgvec[i];
+    const ssize_t ret = lwip_sendto(s, msg->msg_buf, msg->msg_buflen, flags, msg->msg_name, msg->msg_namelen);
+    if (ret < 0) {
+      break;
+    }
+    msg->msg_len = ret;
+  }
+  return (i > 0 || vlen == 0) ? (int)i : -1;
+}
+
+int sock_recvmmsg(int s, struct sock_mmsghdr* msgvec, unsigned int vlen, int flags) {
+  unsigned int i = 0;
+  for (; i < vlen; ++i) {
+    struct sock_mmsghdr* msg = &msgvec[i];
+    const ssize_t ret = lwip_recvfrom(s, msg->msg_buf, msg->msg_buflen, flags, msg->msg_name,
+        msg->msg_name ? &msg->msg_namelen : nullptr);
+    if (ret < 0) {
+      break;
+    }
+    msg->msg_len = ret;
+    /* Only wait for the first message */
+    flags |= MSG_DONTWAIT;
+  }
+  return (i > 0 || vlen == 0) ? (int)i : -1;
+}
+
 int sock_socket(int domain, int type, int protocol) {
   return lwip_socket(domain, type, protocol);
 }
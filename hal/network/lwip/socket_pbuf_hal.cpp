@@ -0,0 +1,213 @@
+/*
+ * Copyright (c) 2018 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+/**
+ * @file
+ * @brief
+ *  This file implements the pbuf-based part of socket_hal for the platforms using LwIP.
+ */
+
+/* socket_hal_posix_impl.h should get included from socket_hal.h automagically */
+#include "socket_hal.h"
+#include "lwiplock.h"
+#include "ipsockaddr.h"
+#include <lwip/api.h>
+#include <lwip/pbuf.h>
+#include <lwip/priv/sockets_priv.h>
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+
+using namespace particle::net;
+
+namespace {
+
+struct lwip_sock* get_sock(int s) {
+  struct lwip_sock* sock = lwip_socket_dbg_get_socket(s);
+  if (!sock || !sock->conn) {
+    errno = EBADF;
+    return nullptr;
+  }
+  return sock;
+}
+
+void ipaddr_port_to_sockaddr_len(struct netconn* conn, ip_addr_t* addr, u16_t port, struct sockaddr* saddr,
+    socklen_t* saddrlen) {
+#if LWIP_IPV4 && LWIP_IPV6
+  /* Report IPv4 addresses as IPv4-mapped IPv6 addresses to IPv6 sockets, as lwip_recvfrom() does */
+  if (NETCONNTYPE_ISIPV6(netconn_type(conn)) && IP_IS_V4(addr)) {
+    ip4_2_ipv4_mapped_ipv6(ip_2_ip6(addr), ip_2_ip4(addr));
+    IP_SET_TYPE(addr, IPADDR_TYPE_V6);
+  }
+#endif /* LWIP_IPV4 && LWIP_IPV6 */
+  struct sockaddr_storage ss = {};
+  ipaddr_port_to_sockaddr(addr, port, (struct sockaddr*)&ss);
+  const socklen_t len = ((struct sockaddr*)&ss)->sa_len;
+  memcpy(saddr, &ss, std::min(*saddrlen, len));
+  *saddrlen = len;
+}
+
+int sockaddr_to_ipaddr_port_checked(const struct sockaddr* saddr, socklen_t saddrlen, ip_addr_t* addr,
+    u16_t* port) {
+  if (saddr->sa_family == AF_INET && saddrlen >= sizeof(struct sockaddr_in)) {
+    sockaddr_to_ipaddr_port(saddr, addr, port);
+    return 0;
+  }
+#if LWIP_IPV6
+  if (saddr->sa_family == AF_INET6 && saddrlen >= sizeof(struct sockaddr_in6)) {
+    sockaddr_to_ipaddr_port(saddr, addr, port);
+#if LWIP_IPV4
+    /* Send to IPv4-mapped IPv6 addresses over IPv4, as lwip_sendto() does */
+    if (ip6_addr_isipv4mappedipv6(ip_2_ip6(addr))) {
+      unmap_ipv4_mapped_ipv6(ip_2_ip4(addr), ip_2_ip6(addr));
+      IP_SET_TYPE(addr, IPADDR_TYPE_V4);
+    }
+#endif /* LWIP_IPV4 */
+    return 0;
+  }
+#endif /* LWIP_IPV6 */
+  errno = EINVAL;
+  return -1;
+}
+
+} /* anonymous */
+
+ssize_t sock_recv_pbuf(int s, struct pbuf** p, int flags, struct sockaddr* from, socklen_t* fromlen) {
+  struct lwip_sock* sock = get_sock(s);
+  if (!sock) {
+    return -1;
+  }
+  struct netconn* conn = sock->conn;
+  const u8_t apiflags = (flags & MSG_DONTWAIT) ? NETCONN_DONTBLOCK : 0;
+  ip_addr_t addr = {};
+  u16_t port = 0;
+  struct pbuf* q = nullptr;
+  if (NETCONNTYPE_GROUP(netconn_type(conn)) == NETCONN_TCP) {
+    /* Return the data left over by sock_recv() first */
+    q = sock->lastdata.pbuf;
+    sock->lastdata.pbuf = nullptr;
+    if (q) {
+      /* lwip_recv() only updates the receive window for the data it has copied */
+      netconn_tcp_recvd(conn, q->tot_len);
+    } else {
+      const err_t err = netconn_recv_tcp_pbuf_flags(conn, &q, apiflags);
+      if (err == ERR_CLSD) {
+        *p = nullptr;
+        return 0;
+      }
+      if (err != ERR_OK) {
+        errno = err_to_errno(err);
+        return -1;
+      }
+    }
+    if (from && fromlen) {
+      netconn_getaddr(conn, &addr, &port, 0 /* remote */);
+    }
+  } else {
+    struct netbuf* buf = sock->lastdata.netbuf;
+    sock->lastdata.netbuf = nullptr;
+    if (!buf) {
+      const err_t err = netconn_recv_udp_raw_netbuf_flags(conn, &buf, apiflags);
+      if (err != ERR_OK) {
+        errno = err_to_errno(err);
+        return -1;
+      }
+    }
+    ip_addr_copy(addr, *netbuf_fromaddr(buf));
+    port = netbuf_fromport(buf);
+    /* Take the pbuf chain over from the netbuf */
+    q = buf->p;
+    buf->p = buf->ptr = nullptr;
+    netbuf_delete(buf);
+  }
+  if (from && fromlen) {
+    ipaddr_port_to_sockaddr_len(conn, &addr, port, from, fromlen);
+  }
+  *p = q;
+  return q ? q->tot_len : 0;
+}
+
+ssize_t sock_send_pbuf(int s, struct pbuf* p, int flags, const struct sockaddr* to, socklen_t tolen) {
+  struct lwip_sock* sock = get_sock(s);
+  if (!sock || !p) {
+    sock_pbuf_free(p);
+    if (sock) {
+      errno = EINVAL;
+    }
+    return -1;
+  }
+  struct netconn* conn = sock->conn;
+  err_t err = ERR_OK;
+  ssize_t sent = 0;
+  if (NETCONNTYPE_GROUP(netconn_type(conn)) == NETCONN_TCP) {
+    /* TCP segments can't reference the pbufs: the data is copied, as with lwip_send() */
+    u8_t apiflags = NETCONN_COPY;
+    if (flags & MSG_DONTWAIT) {
+      apiflags |= NETCONN_DONTBLOCK;
+    }
+    for (struct pbuf* q = p; q; q = q->next) {
+      size_t written = 0;
+      err = netconn_write_partly(conn, q->payload, q->len,
+          apiflags | ((q->next || (flags & MSG_MORE)) ? NETCONN_MORE : 0), &written);
+      sent += written;
+      if (err != ERR_OK || written < q->len) {
+        break;
+      }
+    }
+    sock_pbuf_free(p);
+    if (sent > 0) {
+      return sent;
+    }
+  } else {
+    ip_addr_t addr = {};
+    u16_t port = 0;
+    if (to && sockaddr_to_ipaddr_port_checked(to, tolen, &addr, &port) != 0) {
+      sock_pbuf_free(p);
+      return -1;
+    }
+    struct netbuf* buf = netbuf_new();
+    if (!buf) {
+      sock_pbuf_free(p);
+      errno = ENOMEM;
+      return -1;
+    }
+    /* The netbuf takes the pbuf chain over, and frees it when it's deleted */
+    buf->p = buf->ptr = p;
+    sent = p->tot_len;
+    err = to ? netconn_sendto(conn, buf, &addr, port) : netconn_send(conn, buf);
+    netbuf_delete(buf);
+  }
+  if (err != ERR_OK) {
+    errno = err_to_errno(err);
+    return -1;
+  }
+  return sent;
+}
+
+struct pbuf* sock_pbuf_alloc(size_t size) {
+  if (size > 0xffff) {
+    return nullptr;
+  }
+  LwipTcpIpCoreLock lk;
+  return pbuf_alloc(PBUF_TRANSPORT, size, PBUF_RAM);
+}
+
+void sock_pbuf_free(struct pbuf* p) {
+  if (p) {
+    LwipTcpIpCoreLock lk;
+    pbuf_free(p);
+  }
+}
@@ -27,6 +27,7 @@
 #include "hw_config.h"
 #include <string.h>
 #include "parse_server_address.h"
+#include "system_error.h"
 
 void HAL_System_Info(hal_system_info_t* info, bool create, void* reserved)
 {
@@ -81,6 +82,12 @@ hal_update_complete_t HAL_FLASH_ApplyPendingUpdate(hal_module_t* module, bool dr
     return HAL_UPDATE_ERROR;
 }
 
+int HAL_FLASH_Read_Module(uint8_t module_function, uint8_t module_index, uint32_t offset, uint8_t* data, uint32_t length, void* reserved)
+{
+    // Not implemented for Core
+    return SYSTEM_ERROR_NOT_SUPPORTED;
+}
+
 void HAL_FLASH_Read_ServerAddress(ServerAddress* server_addr)
 {
     uint8_t buf[EXTERNAL_FLASH_SERVER_DOMAIN_LENGTH];
@@ -6,6 +6,7 @@
 #include "core_hal.h"
 #include "filesystem.h"
 #include "bytes2hexbuf.h"
+#include "system_error.h"
 
 void HAL_System_Info(hal_system_info_t* info, bool create, void* reserved)
 {
@@ -63,6 +64,26 @@ hal_update_complete_t HAL_FLASH_ApplyPendingUpdate(hal_module_t* module, bool dr
     return HAL_UPDATE_ERROR;
 }
 
+/**
+ * The virtual device has no flash, so the current modules are read from files
+ * named after the module, e.g. module_5_1.bin for the user part.
+ */
+int HAL_FLASH_Read_Module(uint8_t module_function, uint8_t module_index, uint32_t offset, uint8_t* data, uint32_t length, void* reserved)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "module_%d_%d.bin", module_function, module_index);
+    FILE* f = fopen(name, "rb");
+    if (!f) {
+        return SYSTEM_ERROR_NOT_FOUND;
+    }
+    int result = 0;
+    if (fseek(f, offset, SEEK_SET) != 0 || fread(data, 1, length, f) != length) {
+        result = SYSTEM_ERROR_OUT_OF_RANGE;
+    }
+    fclose(f);
+    return result;
+}
+
 /**
  * Set the claim code for this device.
  * @param code  The claim code to set. If null, clears the claim code.
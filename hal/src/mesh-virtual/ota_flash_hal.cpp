@@ -6,6 +6,7 @@
 #include "core_hal.h"
 #include "filesystem.h"
 #include "bytes2hexbuf.h"
+#include "system_error.h"
 
 void HAL_System_Info(hal_system_info_t* info, bool create, void* reserved)
 {
@@ -58,6 +59,12 @@ int HAL_FLASH_OTA_Validate(hal_module_t* mod, bool userDepsOptional, module_vali
      return HAL_UPDATE_APPLIED;
 }
 
+int HAL_FLASH_Read_Module(uint8_t module_function, uint8_t module_index, uint32_t offset, uint8_t* data, uint32_t length, void* reserved)
+{
+    // Not implemented for the virtual device
+    return SYSTEM_ERROR_NOT_SUPPORTED;
+}
+
 
 
 /**
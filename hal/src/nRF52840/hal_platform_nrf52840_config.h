@@ -80,6 +80,8 @@
 
 #define HAL_PLATFORM_COMPRESSED_BINARIES (1)
 
+#define HAL_PLATFORM_FLASH_READ_MODULE (1)
+
 #define HAL_PLATFORM_NETWORK_MULTICAST (1)
 
 #define HAL_PLATFORM_BUTTON_DEBOUNCE_IN_SYSTICK (1)
@@ -44,15 +44,18 @@ void otPlatSettingsInit(otInstance* aInstance)
 }
 
 otError otPlatSettingsBeginChange(otInstance* aInstance) {
-    return OT_ERROR_NONE;
+    int r = s_settingsFile.beginTransaction();
+    return r == 0 ? OT_ERROR_NONE : OT_ERROR_FAILED;
 }
 
 otError otPlatSettingsCommitChange(otInstance* aInstance) {
-    return OT_ERROR_NONE;
+    int r = s_settingsFile.commitTransaction();
+    return r == 0 ? OT_ERROR_NONE : OT_ERROR_FAILED;
 }
 
 otError otPlatSettingsAbandonChange(otInstance* aInstance) {
-    return OT_ERROR_NOT_IMPLEMENTED;
+    int r = s_settingsFile.abortTransaction();
+    return r == 0 ? OT_ERROR_NONE : OT_ERROR_FAILED;
 }
 
 otError otPlatSettingsGet(otInstance* aInstance, uint16_t aKey, int aIndex, uint8_t* aValue, uint16_t* aValueLength) {
@@ -43,6 +43,9 @@
 #include "deviceid_hal.h"
 #include <memory>
 #include "platform_radio_stack.h"
+#include "crc32_regions.h"
+#include "flash_hal.h"
+#include "system_error.h"
 
 #define OTA_CHUNK_SIZE                 (512)
 #define BOOTLOADER_RANDOM_BACKOFF_MIN  (200)
@@ -332,15 +335,59 @@ uint16_t HAL_OTA_ChunkSize()
     return OTA_CHUNK_SIZE;
 }
 
+/**
+ * The CRC of the OTA image, computed as it is written so that validating the image doesn't
+ * need to read it back. The module's CRC is the trailer following the module.
+ */
+static particle::Crc32Regions ota_crc(HAL_Core_Compute_CRC32);
+static uint32_t ota_crc_address = 0;
+
 bool HAL_FLASH_Begin(uint32_t address, uint32_t length, void* reserved)
 {
     FLASH_Begin(address, length);
+    ota_crc_address = address;
+    ota_crc.reset(length, sizeof(uint32_t));
     return true;
 }
 
 int HAL_FLASH_Update(const uint8_t *pBuffer, uint32_t address, uint32_t length, void* reserved)
 {
-    return FLASH_Update(pBuffer, address, length);
+    int result = FLASH_Update(pBuffer, address, length);
+    if (result == 0 && address >= ota_crc_address)
+    {
+        ota_crc.update(address - ota_crc_address, pBuffer, length);
+    }
+    else
+    {
+        // the image has to be read back
+        ota_crc.reset(0);
+    }
+    return result;
+}
+
+/**
+ * Checks the integrity of the OTA module using the CRC computed while it was written, or by
+ * reading it back if the written image doesn't match the module.
+ */
+static void validate_ota_integrity(hal_module_t* module)
+{
+    const uint32_t length = module_length(module->info);
+    bool valid = false;
+    if (ota_crc.isComplete() && length + sizeof(uint32_t) == ota_crc.size())
+    {
+        const uint8_t* trailer = ota_crc.trailer();
+        const uint32_t expected = uint32_t(trailer[0]) << 24 | uint32_t(trailer[1]) << 16 | uint32_t(trailer[2]) << 8 | trailer[3];
+        valid = (ota_crc.crc() == expected);
+    }
+    else
+    {
+        valid = FLASH_VerifyCRC32(FLASH_INTERNAL, module->bounds.start_address, length);
+    }
+    module->validity_checked |= MODULE_VALIDATION_INTEGRITY;
+    if (valid)
+    {
+        module->validity_result |= MODULE_VALIDATION_INTEGRITY;
+    }
 }
 
 static hal_update_complete_t flash_bootloader(hal_module_t* mod, uint32_t moduleLength)
@@ -385,7 +432,12 @@ int HAL_FLASH_OTA_Validate(hal_module_t* mod, bool userDepsOptional, module_vali
 {
     hal_module_t module;
 
-    bool module_fetched = fetch_module(&module, &module_ota, userDepsOptional, flags);
+    // the integrity is checked separately to avoid reading back the image when its CRC is already known
+    bool module_fetched = fetch_module(&module, &module_ota, userDepsOptional, (module_validation_flags_t)(flags & ~MODULE_VALIDATION_INTEGRITY));
+    if (module_fetched && (flags & MODULE_VALIDATION_INTEGRITY))
+    {
+        validate_ota_integrity(&module);
+    }
 
     if (mod) 
     {
@@ -476,6 +528,18 @@ hal_update_complete_t HAL_FLASH_ApplyPendingUpdate(hal_module_t* module, bool dr
     return result;
 }
 
+int HAL_FLASH_Read_Module(uint8_t module_function, uint8_t module_index, uint32_t offset, uint8_t* data, uint32_t length, void* reserved)
+{
+    const module_bounds_t* bounds = find_module_bounds(module_function, module_index, HAL_PLATFORM_MCU_DEFAULT);
+    if (!bounds || bounds->store != MODULE_STORE_MAIN) {
+        return SYSTEM_ERROR_NOT_FOUND;
+    }
+    if (offset > bounds->maximum_size || length > bounds->maximum_size - offset) {
+        return SYSTEM_ERROR_OUT_OF_RANGE;
+    }
+    return hal_flash_read(bounds->start_address + offset, data, length);
+}
+
 
 void HAL_FLASH_Read_ServerAddress(ServerAddress* server_addr)
 {
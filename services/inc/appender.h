@@ -139,6 +139,56 @@ private:
     size_t dataSize_;
 };
 
+// Buffer appender that only stores the data at a given offset, e.g. one block of a larger message,
+// and counts the total size of the data
+class BlockAppender: public Appender {
+public:
+    BlockAppender(uint8_t* buf, size_t size, size_t offset) :
+            buf_(buf),
+            bufSize_(size),
+            offset_(offset),
+            dataSize_(0) {
+    }
+
+    virtual bool append(const uint8_t* data, size_t size) override {
+        const size_t start = dataSize_;
+        dataSize_ += size;
+        if (dataSize_ > offset_ && start < offset_ + bufSize_) {
+            const size_t skip = (start < offset_) ? offset_ - start : 0;
+            const size_t pos = start + skip - offset_;
+            size_t n = size - skip;
+            if (n > bufSize_ - pos) {
+                n = bufSize_ - pos;
+            }
+            memcpy(buf_ + pos, data + skip, n);
+        }
+        return true;
+    }
+
+    // Size of the data stored in the buffer
+    size_t blockSize() const {
+        if (dataSize_ <= offset_) {
+            return 0;
+        }
+        return (dataSize_ - offset_ < bufSize_) ? dataSize_ - offset_ : bufSize_;
+    }
+
+    // Returns true if there is more data after the stored block
+    bool hasMore() const {
+        return dataSize_ > offset_ + bufSize_;
+    }
+
+    size_t dataSize() const {
+        return dataSize_;
+    }
+
+private:
+    uint8_t* const buf_;
+    const size_t bufSize_;
+    const size_t offset_;
+    size_t dataSize_;
+};
+
 } // namespace particle
 
 #endif // defined(__cplusplus)
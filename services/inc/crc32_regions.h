@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace particle {
+
+/**
+ * Computes the CRC-32 of data that is written in pieces and in any order, such as the chunks of
+ * an OTA update.
+ *
+ * Each contiguous region keeps its own CRC, which is merged with its neighbours' once the gap
+ * between them is filled. The last {@code trailerSize} bytes of the data are not included in the
+ * CRC and are kept aside instead, so that the CRC stored at the end of a module can be checked
+ * without reading the module back.
+ *
+ * Tracking is abandoned if a write partially overlaps a region that was already written, or if more
+ * than {@code MAX_REGIONS} regions are needed; the caller then has to compute the CRC the usual way.
+ */
+class Crc32Regions {
+public:
+    typedef uint32_t(*ComputeFn)(const uint8_t* data, uint32_t size);
+
+    static const size_t MAX_REGIONS = 16;
+    static const size_t MAX_TRAILER_SIZE = 4;
+
+    /**
+     * @param compute Function computing the standard CRC-32 of a buffer, e.g. a hardware accelerated
+     *        one. {@link #compute} is used if {@code nullptr}.
+     */
+    explicit Crc32Regions(ComputeFn compute = nullptr);
+
+    /**
+     * Starts tracking data of the given size.
+     */
+    void reset(size_t size, size_t trailerSize = 0);
+
+    /**
+     * Adds data written at the given offset. Data beyond the tracked size is ignored, and writing the
+     * same range again is assumed to write the same data.
+     */
+    void update(size_t offset, const uint8_t* data, size_t size);
+
+    /**
+     * Returns {@code true} if all of the data has been written and the CRC is known.
+     */
+    bool isComplete() const;
+
+    bool isValid() const {
+        return valid_;
+    }
+
+    /**
+     * Returns the CRC of the data, excluding the trailer. Only meaningful if {@link #isComplete}.
+     */
+    uint32_t crc() const {
+        return count_ ? regions_[0].crc : 0;
+    }
+
+    /**
+     * Returns the size of the data, including the trailer.
+     */
+    size_t size() const {
+        return size_;
+    }
+
+    const uint8_t* trailer() const {
+        return trailer_;
+    }
+
+    size_t regionCount() const {
+        return count_;
+    }
+
+    /**
+     * Computes the standard CRC-32 (as used by zlib) of a buffer.
+     */
+    static uint32_t compute(const uint8_t* data, uint32_t size);
+
+    /**
+     * Returns the CRC of the concatenation of two buffers given their CRCs and the size of the second
+     * buffer.
+     */
+    static uint32_t combine(uint32_t crc1, uint32_t crc2, size_t size2);
+
+private:
+    struct Region {
+        size_t start;
+        size_t end;
+        uint32_t crc;
+    };
+
+    Region regions_[MAX_REGIONS];
+    size_t count_;
+    size_t size_;
+    size_t trailerSize_;
+    uint8_t trailer_[MAX_TRAILER_SIZE];
+    uint8_t trailerReceived_;
+    bool valid_;
+    ComputeFn compute_;
+
+    void add(size_t start, size_t end, uint32_t crc);
+    void remove(size_t index);
+};
+
+} // namespace particle
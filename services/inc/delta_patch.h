@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "crc32_regions.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace particle {
+
+/**
+ * Applies a binary patch to a module as the patch is received, without buffering the patch or the
+ * patched image.
+ *
+ * The patch format follows bsdiff, with 32-bit fields. All integers are little endian:
+ *
+ * <pre>
+ * header:  'P' 'D' 'L' 'T' | version (1) | module function (1) | module index (1) | reserved (1) |
+ *          source size (4) | source CRC-32 (4) | target size (4)
+ * command: diff length (4) | extra length (4) | seek (4, signed) | diff data | extra data
+ * </pre>
+ *
+ * Commands follow the header until the whole target has been produced. For each command, the diff
+ * data is added bytewise to the source data at the current source position, then the extra data is
+ * copied as is, then the source position is moved by {@code seek} bytes. The source CRC is checked
+ * before anything is written, so a patch is never applied to a module it wasn't made for.
+ */
+class DeltaPatch {
+public:
+    static const uint8_t VERSION = 1;
+    static const size_t HEADER_SIZE = 20;
+    static const size_t COMMAND_SIZE = 12;
+    static const size_t BUFFER_SIZE = 128;
+
+    struct Header {
+        uint8_t version;
+        uint8_t moduleFunction;
+        uint8_t moduleIndex;
+        uint32_t sourceSize;
+        uint32_t sourceCrc;
+        uint32_t targetSize;
+    };
+
+    /**
+     * Provides the module being patched and receives the patched image.
+     */
+    class Handler {
+    public:
+        virtual ~Handler() = default;
+
+        /**
+         * Called once the header has been received. Returning an error aborts the patch.
+         */
+        virtual int openSource(const Header& header) = 0;
+        virtual int readSource(size_t offset, uint8_t* data, size_t size) = 0;
+        virtual int writeTarget(size_t offset, const uint8_t* data, size_t size) = 0;
+    };
+
+    /**
+     * @param handler Handler instance.
+     * @param compute Function computing the standard CRC-32 of a buffer. {@link Crc32Regions#compute}
+     *        is used if {@code nullptr}.
+     */
+    explicit DeltaPatch(Handler* handler, Crc32Regions::ComputeFn compute = nullptr);
+
+    /**
+     * Processes the next part of the patch.
+     *
+     * @return 0 on success, or a negative result code in case of an error. The patch can't be
+     *         continued after an error.
+     */
+    int write(const uint8_t* data, size_t size);
+
+    /**
+     * Returns {@code true} if the whole target has been written.
+     */
+    bool isDone() const {
+        return state_ == State::DONE;
+    }
+
+    /**
+     * Returns the patch header. Only meaningful once some commands have been received.
+     */
+    const Header& header() const {
+        return header_;
+    }
+
+    /**
+     * Returns the number of bytes of the target written so far.
+     */
+    size_t targetOffset() const {
+        return targetOffset_;
+    }
+
+private:
+    enum class State {
+        HEADER,
+        COMMAND,
+        DIFF,
+        EXTRA,
+        DONE,
+        FAILED
+    };
+
+    Header header_;
+    uint8_t field_[HEADER_SIZE];
+    size_t fieldSize_;
+    size_t sourceOffset_;
+    size_t targetOffset_;
+    size_t diffLeft_;
+    size_t extraLeft_;
+    int32_t seek_;
+    State state_;
+    Handler* handler_;
+    Crc32Regions::ComputeFn compute_;
+
+    int parseHeader();
+    int parseCommand();
+    int checkSource();
+    int writeDiff(const uint8_t* data, size_t size);
+    int writeExtra(const uint8_t* data, size_t size);
+    int endCommand();
+    size_t readField(const uint8_t* data, size_t size, size_t fieldSize);
+};
+
+} // namespace particle
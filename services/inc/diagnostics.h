@@ -48,6 +48,8 @@
 #define DIAG_NAME_NETWORK_CELLULAR_CELL_GLOBAL_IDENTITY_MOBILE_NETWORK_CODE "net:cell:cgi:mnc"
 #define DIAG_NAME_NETWORK_CELLULAR_CELL_GLOBAL_IDENTITY_LOCATION_AREA_CODE "net:cell:cgi:lac"
 #define DIAG_NAME_NETWORK_CELLULAR_CELL_GLOBAL_IDENTITY_CELL_ID "net:cell:cgi:ci"
+#define DIAG_NAME_NETWORK_DNS64_CACHE_HITS "net:dns64:hit"
+#define DIAG_NAME_NETWORK_DNS64_CACHE_MISSES "net:dns64:miss"
 #define DIAG_NAME_CLOUD_CONNECTION_STATUS "cloud:stat"
 #define DIAG_NAME_CLOUD_CONNECTION_ERROR_CODE "cloud:err"
 #define DIAG_NAME_CLOUD_DISCONNECTS "cloud:dconn"
@@ -56,8 +58,15 @@
 #define DIAG_NAME_CLOUD_REPEATED_MESSAGES "coap:resend"
 #define DIAG_NAME_CLOUD_UNACKNOWLEDGED_MESSAGES "coap:unack"
 #define DIAG_NAME_CLOUD_RATE_LIMITED_EVENTS "pub:limit"
+#define DIAG_NAME_CLOUD_SESSION_RESUMES "cloud:resume"
+#define DIAG_NAME_CLOUD_SESSION_RESUME_FAILURES "cloud:resfail"
+#define DIAG_NAME_CLOUD_SESSION_RESUME_FAILURE_REASON "cloud:resrsn"
 #define DIAG_NAME_SYSTEM_TOTAL_RAM "sys:tram"
 #define DIAG_NAME_SYSTEM_USED_RAM "sys:uram"
+#define DIAG_NAME_SYSTEM_POOL_USED "sys:pool:used"
+#define DIAG_NAME_SYSTEM_POOL_PEAK "sys:pool:peak"
+#define DIAG_NAME_SYSTEM_POOL_FRAGMENTED "sys:pool:frag"
+#define DIAG_NAME_SYSTEM_POOL_FAILURES "sys:pool:fail"
 
 #ifdef __cplusplus
 extern "C" {
@@ -93,6 +102,8 @@ typedef enum diag_id {
     DIAG_ID_NETWORK_CELLULAR_CELL_GLOBAL_IDENTITY_MOBILE_NETWORK_CODE = 41, // net:cell:cgi:mnc
     DIAG_ID_NETWORK_CELLULAR_CELL_GLOBAL_IDENTITY_LOCATION_AREA_CODE = 42, // net:cell:cgi:lac
     DIAG_ID_NETWORK_CELLULAR_CELL_GLOBAL_IDENTITY_CELL_ID = 43, // net:cell:cgi:ci
+    DIAG_ID_NETWORK_DNS64_CACHE_HITS = 51, // net:dns64:hit
+    DIAG_ID_NETWORK_DNS64_CACHE_MISSES = 52, // net:dns64:miss
     DIAG_ID_CLOUD_CONNECTION_STATUS = 10, // cloud:stat
     DIAG_ID_CLOUD_CONNECTION_ERROR_CODE = 13, // cloud:err
     DIAG_ID_CLOUD_DISCONNECTS = 14, // cloud:dconn
@@ -101,8 +112,15 @@ typedef enum diag_id {
     DIAG_ID_CLOUD_REPEATED_MESSAGES = 21, // coap:resend
     DIAG_ID_CLOUD_UNACKNOWLEDGED_MESSAGES = 22, // coap:unack
     DIAG_ID_CLOUD_RATE_LIMITED_EVENTS = 20, // pub:throttle
+    DIAG_ID_CLOUD_SESSION_RESUMES = 44, // cloud:resume
+    DIAG_ID_CLOUD_SESSION_RESUME_FAILURES = 45, // cloud:resfail
+    DIAG_ID_CLOUD_SESSION_RESUME_FAILURE_REASON = 46, // cloud:resrsn
     DIAG_ID_SYSTEM_TOTAL_RAM = 25, // sys:tram
     DIAG_ID_SYSTEM_USED_RAM = 26, // sys:uram
+    DIAG_ID_SYSTEM_POOL_USED = 47, // sys:pool:used
+    DIAG_ID_SYSTEM_POOL_PEAK = 48, // sys:pool:peak
+    DIAG_ID_SYSTEM_POOL_FRAGMENTED = 49, // sys:pool:frag
+    DIAG_ID_SYSTEM_POOL_FAILURES = 50, // sys:pool:fail
     DIAG_ID_USER = 32768 // Base value for application-specific source IDs
 } diag_id;
 
@@ -22,16 +22,41 @@
 #if (defined(HAL_PLATFORM_FILESYSTEM) && HAL_PLATFORM_FILESYSTEM == 1)
 
 #include <stdint.h>
+#include <stddef.h>
 #include "service_debug.h"
 #include "system_error.h"
 #include "filesystem.h"
 
+// Size after which the queue continues in a new segment file
+#ifndef FILE_QUEUE_SEGMENT_SIZE
+#define FILE_QUEUE_SEGMENT_SIZE (4096)
+#endif
+
+// Default number of changes after which the queue is synchronized with the filesystem
+#ifndef FILE_QUEUE_DEFAULT_SYNC_INTERVAL
+#define FILE_QUEUE_DEFAULT_SYNC_INTERVAL (1)
+#endif
+
 namespace particle {
 
 namespace fs {
 
 /**
- * Implements a queue on top of a file.
+ * Implements a persistent queue on top of a set of files.
+ *
+ * The queue is a log split into segment files named `<path>.<n>`. New entries are appended to the
+ * last segment, which stays open, and a new segment is started once it reaches
+ * FILE_QUEUE_SEGMENT_SIZE bytes. The position of the front entry is kept in a read cursor, which is
+ * persisted in `<path>.idx`, so removing an entry doesn't rewrite the log. Segments that have been
+ * read through are deleted by compact(), which is meant to be called when the caller is idle.
+ *
+ * Appended entries and the read cursor are synchronized with the filesystem every `syncInterval`
+ * changes, or when sync() is called. Changes that are not synchronized yet are lost on reset: an
+ * appended entry disappears, and a removed entry is delivered again.
+ *
+ * When the queue is opened, an entry that was only partially written at the end of the log is
+ * discarded. If the read cursor is missing or invalid, the segments are found by listing the
+ * directory, and the queue is read again from the oldest segment.
  */
 class FileQueue {
 
@@ -42,187 +67,106 @@ public:
             ACTIVE = 1<<0,		// when this bit is set the entry is active. When the bit is reset, the entry is not valid and can ce ignored.
         };
 
-        uint16_t size;
+        uint16_t size;      // size of the entry, including this header
         uint16_t flags;
 
     };
 
-    FileQueue(const char* path) : path_(path)
-    {
-    }
-
-    ~FileQueue() {
-
-    }
-
-    int _open() {
-        auto fs = filesystem_get_instance(nullptr);
-        SPARK_ASSERT(fs);
-
-        FsLock lk(fs);
-        fs_ = fs;
-
-        SPARK_ASSERT(!filesystem_mount(fs_));
-        return 0;
-    }
+    explicit FileQueue(const char* path, unsigned syncInterval = FILE_QUEUE_DEFAULT_SYNC_INTERVAL);
+    ~FileQueue();
 
     /**
      * Add an entry to the back of the queue.
      */
-    int pushBack(void* item, uint16_t size) {
-        // append a new item to the file
-        FsLock lk(fs_);
-        _open();
-        int ret = lfs_file_open(lfs(), &write_file_, path_, LFS_O_WRONLY | LFS_O_APPEND | LFS_O_CREAT);
-        if (ret>=0) {
-            QueueEntry entry = { .size = uint16_t(size+sizeof(QueueEntry)), .flags = QueueEntry::ACTIVE };
-            ret = file_write(&write_file_, &entry, sizeof(entry));
-            ret = preserve_error(file_write(&write_file_, item, size), ret);
-            ret = preserve_error(lfs_file_close(lfs(), &write_file_), ret);   // always close even if there are other errors
-        }
-        LOG(INFO, "add item to file queue %s, size %d, result %d", path_, size, ret);
-        return ret;
-    }
+    int pushBack(const void* item, uint16_t size);
 
     /**
-     * Retrieve the front queue entry in the file.
+     * Retrieve the front queue entry.
      *
      * @param entry	The entry to populate
      * @param buffer	the buffer to fill with the contents of the entry.
-     * @param length	The length of the buffer. Only as much data
-     * as will fit into the buffer is copied.
-     * @return SYSTEM_ERROR_NOT_FOUND when there is no such entry.
+     * @param length	The length of the buffer.
+     * @return SYSTEM_ERROR_NOT_FOUND when there is no such entry, or SYSTEM_ERROR_TOO_LARGE
+     * when the buffer is too small for the entry.
      */
-    int front(QueueEntry& entry, void* buffer, uint16_t length) {
-        FsLock lk(fs_);
-        int ret = _front(entry, true);
-        if (ret>=0) {
-            int remaining = entry.size-sizeof(entry);
-        	if (remaining>length) {
-        		LOG(ERROR,  "Buffer length %d is too small. Need at least %d", length, remaining);
-        		ret = LFS_ERR_INVAL;
-        	} else {
-        		ret = lfs_file_read(lfs(), &read_file_, buffer, remaining);
-				if (ret!=int(remaining)) {
-					LOG(ERROR, "Incomplete queue record. Expected length %d but read %d", remaining, ret);
-					clear();
-					ret = LFS_ERR_IO;
-				} else {
-					ret = 0;	// no error
-					LOG(INFO, "Retrieved entry from file queue, size %d", entry.size);
-				}
-        	}
-            ret = preserve_error(lfs_file_close(lfs(), &read_file_), ret);
-        }
-        return ret;
-    }
+    int front(QueueEntry& entry, void* buffer, uint16_t length);
 
     /**
-     * Locate the offset in the file of the first non-expired entry
-     * and retrieve the entry.
-     *
-     * @return >=0 when the entry was successfully retrieved.
-     * <0 for an error condition.
+     * Remove the front entry. Only the read cursor is updated.
      */
-    int _front(QueueEntry& entry, bool keepOpen) {
-        _open();
-        int ret = lfs_file_open(lfs(), &read_file_, path_, LFS_O_RDONLY);
-        if (!ret) {
-			while (!ret) {
-				ret = lfs_file_read(lfs(), &read_file_, &entry, sizeof(entry));
-				if (ret==sizeof(QueueEntry)) {
-					ret = 0; 	// all good
-					if (entry.flags & QueueEntry::ACTIVE) {
-						break;
-					}
-				} else {
-					ret = LFS_ERR_IO;
-					break;	// problem reading
-				}
-				ret = lfs_file_seek(lfs(), &read_file_, entry.size-sizeof(entry), LFS_SEEK_CUR);
-				if (ret>=0) {
-					ret = 0;
-				}
-			}
-			if (ret || !keepOpen) {
-				ret = preserve_error(lfs_file_close(lfs(), &read_file_), ret);
-			}
-        }
-        return ret;
-    }
+    int popFront();
 
     /**
-     * Remove the front item in the queue. This is done by clearing the ACTIVE flag in the queue entry.
+     * Remove all entries and the queue files.
      */
-    int popFront() {
-        FsLock lk(fs_);
-        QueueEntry entry;
-        int ret = _front(entry, true);
-        // file position points to the start of the file data for the first ACTIVE entry.
-        int offset = lfs_file_tell(lfs(), &read_file_);
-        ret = lfs_file_close(lfs(), &read_file_);
-
-        bool isLast = false;
-        if (ret>=0) {
-            int ret = lfs_file_open(lfs(), &read_file_, path_, LFS_O_RDWR);
-            if (!ret) {
-                offset -= sizeof(entry);	// offset is at the start of the entry
-                ret = lfs_file_seek(lfs(), &read_file_, offset, LFS_SEEK_SET);
-                if (ret>=0) ret = 0;
-                entry.flags &= ~QueueEntry::ACTIVE;
-                if (!ret) {
-                	ret = lfs_file_write(lfs(), &read_file_, &entry, sizeof(entry));
-                	if (ret==sizeof(entry))
-                		ret = 0;
-                }
-                lfs_soff_t length = lfs_file_size(lfs(), &read_file_);
-                isLast = (length>=0 && length==(offset+entry.size));
-                ret = preserve_error(lfs_file_close(lfs(), &read_file_), ret);
-            }
-        }
-        if (isLast && !ret) {
-        	LOG(INFO, "Removed last entry from file queue, deleting file %s", path_);
-            // when the last entry has been cleared remove the file
-            ret = clear();
-        }
-        return ret;
-    }
+    int clear();
 
-    int clear() {
-    	FsLock lk(fs_);
-    	return lfs_remove(lfs(), path_);
-    }
+    /**
+     * Synchronize the appended entries and the read cursor with the filesystem.
+     */
+    int sync();
+
+    /**
+     * Delete the segments that have been read through.
+     */
+    int compact();
+
+    /**
+     * Get the number of entries in the queue.
+     */
+    int size();
+
+    /**
+     * Synchronize the queue and close its files. The queue is reopened on the next access.
+     */
+    void close();
 
 private:
+    struct __attribute__((__packed__)) QueueState {
+        uint32_t magick;
+        uint32_t oldestSegment;
+        uint32_t headSegment;
+        uint32_t headOffset;
+    };
 
-    int file_write(lfs_file* file, void* data, uint16_t size) {
-		int ret = lfs_file_write(lfs(), file, data, size);
-		if (ret<0) {
-			LOG(ERROR, "Error writing %d bytes to file %s: error %d", size, path_, ret);
-		}
-		else if (ret!=size) {
-			LOG(ERROR, "wrote only %d bytes to file %s, expected %d bytes to be written", ret, path_, size);
-			ret = LFS_ERR_IO;
-		}
-		else {
-			ret = 0;
-		}
-		return ret;
-	}
+    filesystem_t* fs_;
+    lfs_file_t readFile_;
+    lfs_file_t writeFile_;
+    const char* path_;
+    unsigned syncInterval_;
+
+    uint32_t oldestSegment_;    // oldest segment that hasn't been deleted
+    uint32_t headSegment_;      // read cursor
+    uint32_t headOffset_;
+    uint32_t tailSegment_;      // segment the entries are appended to
+    uint32_t tailOffset_;
+    uint32_t headEnd_;          // size of the head segment, if it's not the tail segment
+    size_t count_;
+    unsigned unsyncedWrites_;
+    unsigned unsyncedPops_;
+    bool open_;
+    bool readOpen_;
+    bool readStale_;
+    bool writeOpen_;
+
+    int open();
+    void closeFiles();
+    int importLegacyFile();
+    int findSegments();
+    int scan();
+    int append(const void* item, uint16_t size);
+    int readHeader(QueueEntry& entry);
+    int openWriteFile();
+    int openReadFile();
+    int syncWrites();
+    int saveState();
+    int removeAll();
+    int removeFiles(uint32_t first, uint32_t last);
+    int segmentPath(char* buf, size_t size, uint32_t segment) const;
 
     lfs_t* lfs() {
-        _open();
         return &fs_->instance;
     }
-
-    static int preserve_error(int first, int second) {
-    	return first<0 ? first : second;
-    }
-
-    filesystem_t* fs_ = nullptr;
-    lfs_file_t read_file_ = {};
-    lfs_file_t write_file_ = {};
-    const char* path_;
 };
 
 } // fs
@@ -0,0 +1,304 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include <new>
+
+#include "spark_wiring_interrupts.h"
+
+#include "allocator.h"
+#include "system_error.h"
+
+// Smallest block size, in bytes. Each size class is twice as large as the previous one
+#ifndef SLAB_POOL_MIN_BLOCK_SIZE
+#define SLAB_POOL_MIN_BLOCK_SIZE (8)
+#endif
+
+#ifndef SLAB_POOL_CLASS_COUNT
+#define SLAB_POOL_CLASS_COUNT (6)   // 8 to 256 bytes
+#endif
+
+struct SlabPoolStats {
+    size_t size; // Size of the pool
+    size_t used; // Bytes in allocated blocks, including the block headers
+    size_t peakUsed; // High-water mark of used bytes
+    size_t requested; // Bytes requested by the allocated blocks
+    size_t cached; // Bytes in freed blocks that are kept for reuse by their size class
+    size_t failures; // Allocations that failed
+};
+
+/**
+ * Pool allocator with segregated size classes.
+ *
+ * A request is rounded up to the nearest size class. A block is taken from the free list of its
+ * class, or carved from the untouched part of the pool, or else taken from the free list of a
+ * larger class. A freed block is put back to the free list of its class. Both operations take
+ * constant time. When all blocks are freed the whole pool becomes untouched again, which undoes any
+ * fragmentation between the classes.
+ *
+ * Requests larger than the largest size class, and requests that no size class can serve, fall
+ * back to a first-fit search of the blocks freed by such requests, and then to a block of the
+ * exact size carved from the untouched part of the pool.
+ */
+class SlabBasePool: public particle::SimpleAllocator {
+public:
+    virtual void* alloc(size_t size) override {
+        if (!begin_) {
+            return nullptr;
+        }
+        const int cls = sizeClass(size);
+        BlockHeader* b = nullptr;
+        if (cls >= 0) {
+            b = takeFree(cls);
+            if (!b) {
+                b = carve(cls);
+            }
+            for (int c = cls + 1; !b && c < SLAB_POOL_CLASS_COUNT; ++c) {
+                b = takeFree(c);
+            }
+        }
+        if (!b) {
+            b = takeFirstFit(size);
+        }
+        if (!b) {
+            b = carveExact(size);
+        }
+        if (!b) {
+            ++stats_.failures;
+            return nullptr;
+        }
+        b->requested = size;
+        stats_.used += blockSize(b);
+        stats_.requested += size;
+        if (stats_.used > stats_.peakUsed) {
+            stats_.peakUsed = stats_.used;
+        }
+        return b->data;
+    }
+
+    virtual void free(void* p) override {
+        if (p == nullptr) {
+            return;
+        }
+        BlockHeader* b = reinterpret_cast<BlockHeader*>(static_cast<uint8_t*>(p) - sizeof(BlockHeader));
+        stats_.used -= blockSize(b);
+        stats_.requested -= b->requested;
+        if (stats_.used == 0) {
+            // Nothing is allocated: start over with an untouched pool
+            reset(begin_, stats_.size, false);
+            return;
+        }
+        if (isExact(b) && reinterpret_cast<uint8_t*>(b) + blockSize(b) == ptr_) {
+            // The block was the last one carved: return it to the untouched part of the pool
+            ptr_ = reinterpret_cast<uint8_t*>(b);
+            return;
+        }
+        BlockHeader** list = isExact(b) ? &exactFreeList_ : &freeList_[b->cls];
+        FreeBlock* f = reinterpret_cast<FreeBlock*>(b->data);
+        f->next = *list;
+        *list = b;
+        stats_.cached += blockSize(b);
+    }
+
+    // FIXME: This API is here for compatibility with the existing system code and unit tests
+    void* allocate(size_t size) {
+        return this->alloc(size);
+    }
+
+    void deallocate(void* p) {
+        this->free(p);
+    }
+
+    const SlabPoolStats& stats() const {
+        return stats_;
+    }
+
+    // Bytes that are not available for allocations of the given size although they are not in use
+    size_t fragmented(size_t size) const {
+        const int cls = sizeClass(size);
+        size_t n = 0;
+        for (int c = 0; c < SLAB_POOL_CLASS_COUNT; ++c) {
+            if (c < cls || cls < 0) {
+                n += countFree(c) * blockSize(c);
+            }
+        }
+        for (const BlockHeader* b = exactFreeList_; b; b = reinterpret_cast<const FreeBlock*>(b->data)->next) {
+            if (b->cls < size) {
+                n += blockSize(b);
+            }
+        }
+        return n;
+    }
+
+    static size_t maxBlockSize() {
+        return SLAB_POOL_MIN_BLOCK_SIZE << (SLAB_POOL_CLASS_COUNT - 1);
+    }
+
+protected:
+    SlabBasePool() {
+        reset();
+    }
+
+    SlabBasePool(void* location, size_t size) {
+        reset(static_cast<uint8_t*>(location), size);
+    }
+
+    void reset(uint8_t* data = nullptr, size_t size = 0, bool resetStats = true) {
+        begin_ = data;
+        ptr_ = data;
+        end_ = data + size;
+        for (auto& f: freeList_) {
+            f = nullptr;
+        }
+        exactFreeList_ = nullptr;
+        if (resetStats) {
+            stats_ = SlabPoolStats();
+        }
+        stats_.size = size;
+        stats_.used = 0;
+        stats_.requested = 0;
+        stats_.cached = 0;
+    }
+
+    uint8_t* begin_;
+
+// Leaving these protected to simplify unit testing
+// private:
+
+    struct BlockHeader {
+        uint16_t cls; // Size class, or the capacity of a block of exact size
+        uint16_t requested;
+        uint8_t data[0] __attribute__((aligned(sizeof(uintptr_t))));
+    };
+
+    struct FreeBlock {
+        BlockHeader* next;
+    };
+
+    static_assert(sizeof(BlockHeader) % sizeof(uintptr_t) == 0, "SlabBasePool: size of header should be a multiple of uintptr_t");
+    static_assert(SLAB_POOL_MIN_BLOCK_SIZE >= sizeof(FreeBlock), "SlabBasePool: minimum block size is too small");
+    static_assert(SLAB_POOL_MIN_BLOCK_SIZE >= SLAB_POOL_CLASS_COUNT, "SlabBasePool: the capacity of a block of exact size can't be told from a size class");
+
+    static int sizeClass(size_t size) {
+        size_t s = SLAB_POOL_MIN_BLOCK_SIZE;
+        for (int c = 0; c < SLAB_POOL_CLASS_COUNT; ++c, s <<= 1) {
+            if (size <= s) {
+                return c;
+            }
+        }
+        return -1;
+    }
+
+    static size_t blockSize(int cls) {
+        return sizeof(BlockHeader) + (SLAB_POOL_MIN_BLOCK_SIZE << cls);
+    }
+
+    static bool isExact(const BlockHeader* b) {
+        return b->cls >= SLAB_POOL_CLASS_COUNT;
+    }
+
+    static size_t blockSize(const BlockHeader* b) {
+        return isExact(b) ? sizeof(BlockHeader) + b->cls : blockSize(b->cls);
+    }
+
+    static size_t exactCapacity(size_t size) {
+        const size_t align = sizeof(uintptr_t);
+        return (std::max<size_t>(size, SLAB_POOL_MIN_BLOCK_SIZE) + align - 1) / align * align;
+    }
+
+    BlockHeader* takeFree(int cls) {
+        BlockHeader* b = freeList_[cls];
+        if (b) {
+            freeList_[cls] = reinterpret_cast<FreeBlock*>(b->data)->next;
+            stats_.cached -= blockSize(cls);
+        }
+        return b;
+    }
+
+    BlockHeader* carve(int cls) {
+        if (size_t(end_ - ptr_) < blockSize(cls)) {
+            return nullptr;
+        }
+        BlockHeader* b = reinterpret_cast<BlockHeader*>(ptr_);
+        b->cls = cls;
+        ptr_ += blockSize(cls);
+        return b;
+    }
+
+    BlockHeader* takeFirstFit(size_t size) {
+        for (BlockHeader** p = &exactFreeList_; *p; p = &reinterpret_cast<FreeBlock*>((*p)->data)->next) {
+            BlockHeader* b = *p;
+            if (b->cls >= size) {
+                *p = reinterpret_cast<FreeBlock*>(b->data)->next;
+                stats_.cached -= blockSize(b);
+                return b;
+            }
+        }
+        return nullptr;
+    }
+
+    BlockHeader* carveExact(size_t size) {
+        const size_t capacity = exactCapacity(size);
+        if (capacity > UINT16_MAX || size_t(end_ - ptr_) < sizeof(BlockHeader) + capacity) {
+            return nullptr;
+        }
+        BlockHeader* b = reinterpret_cast<BlockHeader*>(ptr_);
+        b->cls = capacity;
+        ptr_ += sizeof(BlockHeader) + capacity;
+        return b;
+    }
+
+    size_t countFree(int cls) const {
+        size_t n = 0;
+        for (const BlockHeader* b = freeList_[cls]; b; b = reinterpret_cast<const FreeBlock*>(b->data)->next) {
+            ++n;
+        }
+        return n;
+    }
+
+    uint8_t* ptr_;
+    uint8_t* end_;
+    BlockHeader* freeList_[SLAB_POOL_CLASS_COUNT];
+    BlockHeader* exactFreeList_; // Freed blocks of exact size, searched first-fit
+    SlabPoolStats stats_;
+};
+
+class SlabAllocedPool : public SlabBasePool {
+public:
+    SlabAllocedPool(size_t size) :
+        SlabBasePool(reinterpret_cast<void*>(new uint8_t[size]), size) {
+    }
+
+    SlabAllocedPool(void* ptr, size_t size) :
+        SlabAllocedPool(size) {
+    }
+
+    virtual ~SlabAllocedPool() {
+        delete[] begin_;
+    }
+};
+
+class SlabStaticPool : public SlabBasePool {
+public:
+    SlabStaticPool(void* ptr, size_t size) :
+        SlabBasePool(ptr, size) {
+    }
+};
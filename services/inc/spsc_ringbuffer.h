@@ -0,0 +1,231 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SERVICES_SPSC_RINGBUFFER_H
+#define SERVICES_SPSC_RINGBUFFER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+
+namespace particle {
+namespace services {
+
+/**
+ * Lock-free ring buffer for a single producer and a single consumer, e.g. an ISR and a thread.
+ *
+ * The producer only writes the head index and the consumer only writes the tail index. The data
+ * is published with release/acquire ordering on these indices, so no critical section is needed
+ * as long as each side is used from one context at a time. The indices run over twice the size of
+ * the buffer, so that the whole buffer can be used and a full buffer is told apart from an empty one.
+ *
+ * Besides copying in and out, the producer can acquire a contiguous region of free space, fill it
+ * (e.g. by DMA) and then commit it, and the consumer can peek at a contiguous region of data and
+ * then release it.
+ */
+template <typename T>
+class SpscRingBuffer {
+public:
+    static_assert(std::is_trivially_copyable<T>::value, "T must be trivially copyable");
+
+    SpscRingBuffer();
+    SpscRingBuffer(T* buffer, size_t size);
+
+    // Not thread-safe: neither side may use the buffer meanwhile
+    void init(T* buffer, size_t size);
+    void reset();
+
+    size_t size() const;
+
+    bool empty() const;
+    bool full() const;
+
+    // Producer side
+    size_t space() const;
+    bool put(const T& v);
+    size_t put(const T* v, size_t size);
+    T* acquire(size_t* size);
+    void commit(size_t size);
+
+    // Consumer side
+    size_t data() const;
+    bool get(T* v);
+    size_t get(T* v, size_t size);
+    const T* peek(size_t* size) const;
+    void release(size_t size);
+
+private:
+    T* buffer_;
+    size_t size_;
+    std::atomic<size_t> head_;
+    std::atomic<size_t> tail_;
+
+    size_t index(size_t pos) const;
+    size_t advance(size_t pos, size_t n) const;
+    size_t distance(size_t head, size_t tail) const;
+};
+
+template <typename T>
+inline SpscRingBuffer<T>::SpscRingBuffer()
+        : SpscRingBuffer(nullptr, 0) {
+}
+
+template <typename T>
+inline SpscRingBuffer<T>::SpscRingBuffer(T* buffer, size_t size)
+        : buffer_(buffer),
+          size_(size),
+          head_(0),
+          tail_(0) {
+}
+
+template <typename T>
+inline void SpscRingBuffer<T>::init(T* buffer, size_t size) {
+    buffer_ = buffer;
+    size_ = size;
+    reset();
+}
+
+template <typename T>
+inline void SpscRingBuffer<T>::reset() {
+    head_.store(0, std::memory_order_relaxed);
+    tail_.store(0, std::memory_order_release);
+}
+
+template <typename T>
+inline size_t SpscRingBuffer<T>::size() const {
+    return size_;
+}
+
+template <typename T>
+inline bool SpscRingBuffer<T>::empty() const {
+    return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire);
+}
+
+template <typename T>
+inline bool SpscRingBuffer<T>::full() const {
+    return distance(head_.load(std::memory_order_acquire), tail_.load(std::memory_order_acquire)) == size_;
+}
+
+template <typename T>
+inline size_t SpscRingBuffer<T>::space() const {
+    return size_ - distance(head_.load(std::memory_order_relaxed), tail_.load(std::memory_order_acquire));
+}
+
+template <typename T>
+inline bool SpscRingBuffer<T>::put(const T& v) {
+    return put(&v, 1) == 1;
+}
+
+template <typename T>
+inline size_t SpscRingBuffer<T>::put(const T* v, size_t size) {
+    const size_t head = head_.load(std::memory_order_relaxed);
+    const size_t free = size_ - distance(head, tail_.load(std::memory_order_acquire));
+    if (size > free) {
+        size = free;
+    }
+    if (size == 0) {
+        return 0;
+    }
+    const size_t pos = index(head);
+    const size_t n = (size < size_ - pos) ? size : size_ - pos;
+    memcpy(buffer_ + pos, v, n * sizeof(T));
+    memcpy(buffer_, v + n, (size - n) * sizeof(T));
+    head_.store(advance(head, size), std::memory_order_release);
+    return size;
+}
+
+template <typename T>
+inline T* SpscRingBuffer<T>::acquire(size_t* size) {
+    const size_t head = head_.load(std::memory_order_relaxed);
+    const size_t free = size_ - distance(head, tail_.load(std::memory_order_acquire));
+    const size_t pos = index(head);
+    *size = (free < size_ - pos) ? free : size_ - pos;
+    return *size ? buffer_ + pos : nullptr;
+}
+
+template <typename T>
+inline void SpscRingBuffer<T>::commit(size_t size) {
+    const size_t head = head_.load(std::memory_order_relaxed);
+    head_.store(advance(head, size), std::memory_order_release);
+}
+
+template <typename T>
+inline size_t SpscRingBuffer<T>::data() const {
+    return distance(head_.load(std::memory_order_acquire), tail_.load(std::memory_order_relaxed));
+}
+
+template <typename T>
+inline bool SpscRingBuffer<T>::get(T* v) {
+    return get(v, 1) == 1;
+}
+
+template <typename T>
+inline size_t SpscRingBuffer<T>::get(T* v, size_t size) {
+    const size_t tail = tail_.load(std::memory_order_relaxed);
+    const size_t avail = distance(head_.load(std::memory_order_acquire), tail);
+    if (size > avail) {
+        size = avail;
+    }
+    if (size == 0) {
+        return 0;
+    }
+    if (v) {
+        const size_t pos = index(tail);
+        const size_t n = (size < size_ - pos) ? size : size_ - pos;
+        memcpy(v, buffer_ + pos, n * sizeof(T));
+        memcpy(v + n, buffer_, (size - n) * sizeof(T));
+    }
+    tail_.store(advance(tail, size), std::memory_order_release);
+    return size;
+}
+
+template <typename T>
+inline const T* SpscRingBuffer<T>::peek(size_t* size) const {
+    const size_t tail = tail_.load(std::memory_order_relaxed);
+    const size_t avail = distance(head_.load(std::memory_order_acquire), tail);
+    const size_t pos = index(tail);
+    *size = (avail < size_ - pos) ? avail : size_ - pos;
+    return *size ? buffer_ + pos : nullptr;
+}
+
+template <typename T>
+inline void SpscRingBuffer<T>::release(size_t size) {
+    const size_t tail = tail_.load(std::memory_order_relaxed);
+    tail_.store(advance(tail, size), std::memory_order_release);
+}
+
+template <typename T>
+inline size_t SpscRingBuffer<T>::index(size_t pos) const {
+    return pos >= size_ ? pos - size_ : pos;
+}
+
+template <typename T>
+inline size_t SpscRingBuffer<T>::advance(size_t pos, size_t n) const {
+    pos += n;
+    return pos >= 2 * size_ ? pos - 2 * size_ : pos;
+}
+
+template <typename T>
+inline size_t SpscRingBuffer<T>::distance(size_t head, size_t tail) const {
+    return head >= tail ? head - tail : head + 2 * size_ - tail;
+}
+
+} // services
+} // particle
+
+#endif // SERVICES_SPSC_RINGBUFFER_H
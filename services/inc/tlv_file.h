@@ -19,6 +19,7 @@
 #define SERVICES_TLV_FILE_H
 
 #include "filesystem.h"
+#include "spark_wiring_vector.h"
 #include <stdio.h>
 
 namespace particle { namespace services { namespace settings {
@@ -47,6 +48,13 @@ public:
     int add(uint16_t key, const uint8_t* value, uint16_t length);
     int del(uint16_t key, int index = -1);
 
+    /* Changes made between beginTransaction() and commitTransaction() are kept in RAM and
+     * written at once into a new, compacted file. abortTransaction() discards them.
+     */
+    int beginTransaction();
+    int commitTransaction();
+    int abortTransaction();
+
 private:
     struct FileFooter {
         uint32_t reserved;  /* CRC32? */
@@ -65,6 +73,14 @@ private:
     } __attribute__((__packed__));
     static_assert(sizeof(TlvHeader) == sizeof(uint32_t) * 2, "sizeof(TlvHeader) != 8");
 
+    /* Directory entry of a record. The records are listed in the order they appear in the file */
+    struct Entry {
+        uint16_t key;
+        uint16_t length;
+        uint32_t offset;    /* Offset of the record header in the file */
+        uint8_t* data;      /* Value changed by a pending transaction, or nullptr */
+    };
+
 private:
     lfs_t* lfs();
 
@@ -74,7 +90,12 @@ private:
 
     int mkdir(char* dir);
 
-    ssize_t find(uint16_t key, int index, uint16_t* dataSize);
+    int buildIndex();
+    void clearIndex();
+    int findEntry(uint16_t key, int index) const;
+    int removeRecord(int entry);
+    int writeCompacted();
+
     int readFooter(FileFooter& footer);
 
     ssize_t seek(ssize_t offset, int whence = SEEK_SET);
@@ -87,6 +108,9 @@ private:
     bool open_ = false;
     filesystem_t* fs_ = nullptr;
     lfs_file_t file_ = {};
+
+    Vector<Entry> index_;
+    bool transaction_ = false;
 };
 
 } } } /* namespace particle::services::settings */
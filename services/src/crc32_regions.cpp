@@ -0,0 +1,168 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "crc32_regions.h"
+
+#include <algorithm>
+
+namespace particle {
+
+namespace {
+
+const uint32_t CRC32_POLY = 0xedb88320; // reflected
+
+// Multiplies two polynomials modulo the CRC polynomial
+uint32_t multModP(uint32_t a, uint32_t b) {
+    uint32_t m = (uint32_t)1 << 31;
+    uint32_t p = 0;
+    for (;;) {
+        if (a & m) {
+            p ^= b;
+            if ((a & (m - 1)) == 0) {
+                break;
+            }
+        }
+        m >>= 1;
+        b = (b & 1) ? (b >> 1) ^ CRC32_POLY : b >> 1;
+    }
+    return p;
+}
+
+// Returns x^(8 * n) modulo the CRC polynomial, i.e. the operator that appends n zero bytes
+uint32_t appendZeros(size_t n) {
+    uint32_t p = (uint32_t)1 << 31; // x^0
+    uint32_t q = (uint32_t)1 << 23; // x^8
+    while (n) {
+        if (n & 1) {
+            p = multModP(q, p);
+        }
+        n >>= 1;
+        q = multModP(q, q);
+    }
+    return p;
+}
+
+} // namespace
+
+Crc32Regions::Crc32Regions(ComputeFn compute) :
+        count_(0),
+        size_(0),
+        trailerSize_(0),
+        trailer_(),
+        trailerReceived_(0),
+        valid_(false),
+        compute_(compute ? compute : Crc32Regions::compute) {
+}
+
+void Crc32Regions::reset(size_t size, size_t trailerSize) {
+    count_ = 0;
+    trailerReceived_ = 0;
+    valid_ = trailerSize <= MAX_TRAILER_SIZE && trailerSize < size;
+    size_ = valid_ ? size : 0;
+    trailerSize_ = valid_ ? trailerSize : 0;
+}
+
+void Crc32Regions::update(size_t offset, const uint8_t* data, size_t size) {
+    if (!valid_ || offset >= size_ || !size) {
+        return;
+    }
+    size = std::min(size, size_ - offset);
+    // Keep the trailer aside
+    const size_t dataEnd = size_ - trailerSize_;
+    for (size_t i = std::max(offset, dataEnd); i < offset + size; ++i) {
+        trailer_[i - dataEnd] = data[i - offset];
+        trailerReceived_ |= 1 << (i - dataEnd);
+    }
+    if (offset >= dataEnd) {
+        return;
+    }
+    const size_t end = std::min(offset + size, dataEnd);
+    // Find the first region that starts at or after the written data
+    size_t i = 0;
+    while (i < count_ && regions_[i].start < offset) {
+        ++i;
+    }
+    if (i > 0 && regions_[i - 1].end > offset) {
+        if (end > regions_[i - 1].end) {
+            valid_ = false;
+        }
+        return; // Written again
+    }
+    if (i < count_ && regions_[i].start < end) {
+        if (regions_[i].start > offset || end > regions_[i].end) {
+            valid_ = false;
+        }
+        return;
+    }
+    add(offset, end, compute_(data, end - offset));
+}
+
+void Crc32Regions::add(size_t start, size_t end, uint32_t crc) {
+    size_t i = 0;
+    while (i < count_ && regions_[i].start < start) {
+        ++i;
+    }
+    const bool mergePrev = i > 0 && regions_[i - 1].end == start;
+    const bool mergeNext = i < count_ && regions_[i].start == end;
+    if (mergePrev) {
+        Region& prev = regions_[i - 1];
+        prev.crc = combine(prev.crc, crc, end - start);
+        prev.end = end;
+        if (mergeNext) {
+            prev.crc = combine(prev.crc, regions_[i].crc, regions_[i].end - regions_[i].start);
+            prev.end = regions_[i].end;
+            remove(i);
+        }
+    } else if (mergeNext) {
+        Region& next = regions_[i];
+        next.crc = combine(crc, next.crc, next.end - next.start);
+        next.start = start;
+    } else if (count_ < MAX_REGIONS) {
+        std::copy_backward(regions_ + i, regions_ + count_, regions_ + count_ + 1);
+        regions_[i] = { start, end, crc };
+        ++count_;
+    } else {
+        valid_ = false;
+    }
+}
+
+void Crc32Regions::remove(size_t index) {
+    std::copy(regions_ + index + 1, regions_ + count_, regions_ + index);
+    --count_;
+}
+
+bool Crc32Regions::isComplete() const {
+    return valid_ && count_ == 1 && regions_[0].start == 0 && regions_[0].end == size_ - trailerSize_ &&
+            trailerReceived_ == (1 << trailerSize_) - 1;
+}
+
+uint32_t Crc32Regions::compute(const uint8_t* data, uint32_t size) {
+    uint32_t crc = 0xffffffff;
+    while (size--) {
+        crc ^= *data++;
+        for (unsigned i = 0; i < 8; ++i) {
+            crc = (crc >> 1) ^ (CRC32_POLY & (0 - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+uint32_t Crc32Regions::combine(uint32_t crc1, uint32_t crc2, size_t size2) {
+    return multModP(appendZeros(size2), crc1) ^ crc2;
+}
+
+} // namespace particle
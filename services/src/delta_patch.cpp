@@ -0,0 +1,195 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "delta_patch.h"
+
+#include "endian_util.h"
+#include "check.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace particle {
+
+namespace {
+
+const uint8_t MAGIC[] = { 'P', 'D', 'L', 'T' };
+
+template<typename T>
+T readLittleEndian(const uint8_t* data) {
+    T val;
+    memcpy(&val, data, sizeof(T));
+    return littleEndianToNative(val);
+}
+
+} // namespace
+
+DeltaPatch::DeltaPatch(Handler* handler, Crc32Regions::ComputeFn compute) :
+        header_(),
+        fieldSize_(0),
+        sourceOffset_(0),
+        targetOffset_(0),
+        diffLeft_(0),
+        extraLeft_(0),
+        seek_(0),
+        state_(State::HEADER),
+        handler_(handler),
+        compute_(compute ? compute : Crc32Regions::compute) {
+}
+
+int DeltaPatch::write(const uint8_t* data, size_t size) {
+    if (state_ == State::FAILED) {
+        return SYSTEM_ERROR_INVALID_STATE;
+    }
+    // Anything following the last command, such as the padding of the last chunk, is ignored
+    while (size > 0 && state_ != State::DONE) {
+        size_t n = 0;
+        int result = 0;
+        switch (state_) {
+        case State::HEADER:
+            n = readField(data, size, HEADER_SIZE);
+            if (fieldSize_ == HEADER_SIZE) {
+                result = parseHeader();
+            }
+            break;
+        case State::COMMAND:
+            n = readField(data, size, COMMAND_SIZE);
+            if (fieldSize_ == COMMAND_SIZE) {
+                result = parseCommand();
+            }
+            break;
+        case State::DIFF:
+            n = std::min(size, diffLeft_);
+            result = writeDiff(data, n);
+            break;
+        case State::EXTRA:
+            n = std::min(size, extraLeft_);
+            result = writeExtra(data, n);
+            break;
+        default:
+            break;
+        }
+        if (result < 0) {
+            state_ = State::FAILED;
+            return result;
+        }
+        data += n;
+        size -= n;
+    }
+    return 0;
+}
+
+size_t DeltaPatch::readField(const uint8_t* data, size_t size, size_t fieldSize) {
+    const size_t n = std::min(size, fieldSize - fieldSize_);
+    memcpy(field_ + fieldSize_, data, n);
+    fieldSize_ += n;
+    return n;
+}
+
+int DeltaPatch::parseHeader() {
+    fieldSize_ = 0;
+    if (memcmp(field_, MAGIC, sizeof(MAGIC)) != 0) {
+        return SYSTEM_ERROR_BAD_DATA;
+    }
+    header_.version = field_[4];
+    header_.moduleFunction = field_[5];
+    header_.moduleIndex = field_[6];
+    header_.sourceSize = readLittleEndian<uint32_t>(field_ + 8);
+    header_.sourceCrc = readLittleEndian<uint32_t>(field_ + 12);
+    header_.targetSize = readLittleEndian<uint32_t>(field_ + 16);
+    if (header_.version != VERSION) {
+        return SYSTEM_ERROR_NOT_SUPPORTED;
+    }
+    if (!header_.targetSize) {
+        return SYSTEM_ERROR_BAD_DATA;
+    }
+    CHECK(handler_->openSource(header_));
+    CHECK(checkSource());
+    state_ = State::COMMAND;
+    return 0;
+}
+
+int DeltaPatch::checkSource() {
+    uint8_t buf[BUFFER_SIZE];
+    uint32_t crc = 0;
+    for (size_t offset = 0; offset < header_.sourceSize;) {
+        const size_t n = std::min(sizeof(buf), header_.sourceSize - offset);
+        CHECK(handler_->readSource(offset, buf, n));
+        crc = Crc32Regions::combine(crc, compute_(buf, n), n);
+        offset += n;
+    }
+    if (crc != header_.sourceCrc) {
+        return SYSTEM_ERROR_BAD_DATA; // Not the module the patch was made for
+    }
+    return 0;
+}
+
+int DeltaPatch::parseCommand() {
+    fieldSize_ = 0;
+    const uint32_t diff = readLittleEndian<uint32_t>(field_);
+    const uint32_t extra = readLittleEndian<uint32_t>(field_ + 4);
+    seek_ = readLittleEndian<int32_t>(field_ + 8);
+    if ((uint64_t)diff + extra > header_.targetSize - targetOffset_ || diff > header_.sourceSize - sourceOffset_) {
+        return SYSTEM_ERROR_BAD_DATA;
+    }
+    diffLeft_ = diff;
+    extraLeft_ = extra;
+    state_ = State::DIFF;
+    return endCommand();
+}
+
+int DeltaPatch::writeDiff(const uint8_t* data, size_t size) {
+    uint8_t buf[BUFFER_SIZE];
+    while (size > 0) {
+        const size_t n = std::min(size, sizeof(buf));
+        CHECK(handler_->readSource(sourceOffset_, buf, n));
+        for (size_t i = 0; i < n; ++i) {
+            buf[i] += data[i];
+        }
+        CHECK(handler_->writeTarget(targetOffset_, buf, n));
+        sourceOffset_ += n;
+        targetOffset_ += n;
+        diffLeft_ -= n;
+        data += n;
+        size -= n;
+    }
+    return endCommand();
+}
+
+int DeltaPatch::writeExtra(const uint8_t* data, size_t size) {
+    CHECK(handler_->writeTarget(targetOffset_, data, size));
+    targetOffset_ += size;
+    extraLeft_ -= size;
+    return endCommand();
+}
+
+int DeltaPatch::endCommand() {
+    if (state_ == State::DIFF && !diffLeft_) {
+        state_ = State::EXTRA;
+    }
+    if (state_ == State::EXTRA && !extraLeft_) {
+        const int64_t offset = (int64_t)sourceOffset_ + seek_;
+        if (offset < 0 || offset > (int64_t)header_.sourceSize) {
+            return SYSTEM_ERROR_BAD_DATA;
+        }
+        sourceOffset_ = offset;
+        state_ = (targetOffset_ == header_.targetSize) ? State::DONE : State::COMMAND;
+    }
+    return 0;
+}
+
+} // namespace particle
@@ -0,0 +1,588 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "hal_platform.h"
+
+#if HAL_PLATFORM_FILESYSTEM
+
+#include "file_queue.h"
+
+#include "scope_guard.h"
+#include "check.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace particle {
+
+namespace fs {
+
+namespace {
+
+const uint32_t QUEUE_STATE_MAGICK = 0x51534631; // "QSF1"
+
+const size_t MAX_PATH_LENGTH = 64;
+
+} // unnamed
+
+FileQueue::FileQueue(const char* path, unsigned syncInterval) :
+        fs_(filesystem_get_instance(nullptr)),
+        readFile_(),
+        writeFile_(),
+        path_(path),
+        syncInterval_(syncInterval ? syncInterval : 1),
+        oldestSegment_(0),
+        headSegment_(0),
+        headOffset_(0),
+        tailSegment_(0),
+        tailOffset_(0),
+        headEnd_(0),
+        count_(0),
+        unsyncedWrites_(0),
+        unsyncedPops_(0),
+        open_(false),
+        readOpen_(false),
+        readStale_(false),
+        writeOpen_(false) {
+}
+
+FileQueue::~FileQueue() {
+    close();
+}
+
+int FileQueue::pushBack(const void* item, uint16_t size) {
+    const FsLock lock(fs_);
+    CHECK(open());
+    CHECK(append(item, size));
+    LOG_DEBUG(TRACE, "Added item to file queue %s, size %u", path_, (unsigned)size);
+    return 0;
+}
+
+int FileQueue::front(QueueEntry& entry, void* buffer, uint16_t length) {
+    const FsLock lock(fs_);
+    CHECK(open());
+    QueueEntry e = {};
+    CHECK(readHeader(e));
+    const size_t remaining = e.size - sizeof(QueueEntry);
+    if (remaining > length) {
+        LOG(ERROR, "Buffer length %u is too small. Need at least %u", (unsigned)length, (unsigned)remaining);
+        return SYSTEM_ERROR_TOO_LARGE;
+    }
+    const lfs_ssize_t r = lfs_file_read(lfs(), &readFile_, buffer, remaining);
+    if (r != (lfs_ssize_t)remaining) {
+        LOG(ERROR, "Incomplete queue record. Expected length %u but read %d", (unsigned)remaining, (int)r);
+        return SYSTEM_ERROR_FILE;
+    }
+    entry = e;
+    return 0;
+}
+
+int FileQueue::popFront() {
+    const FsLock lock(fs_);
+    CHECK(open());
+    QueueEntry entry = {};
+    CHECK(readHeader(entry));
+    headOffset_ += entry.size;
+    --count_;
+    if (++unsyncedPops_ >= syncInterval_) {
+        CHECK(saveState());
+    }
+    return 0;
+}
+
+int FileQueue::clear() {
+    const FsLock lock(fs_);
+    CHECK(open());
+    LOG(INFO, "Clearing file queue %s", path_);
+    return removeAll();
+}
+
+int FileQueue::sync() {
+    const FsLock lock(fs_);
+    if (!open_) {
+        return 0;
+    }
+    CHECK(syncWrites());
+    if (unsyncedPops_ > 0) {
+        CHECK(saveState());
+    }
+    return 0;
+}
+
+int FileQueue::compact() {
+    const FsLock lock(fs_);
+    CHECK(open());
+    if (count_ == 0) {
+        // Nothing left to read: start over with the first segment
+        if (tailSegment_ != 0 || tailOffset_ != 0) {
+            LOG_DEBUG(TRACE, "File queue %s is empty, removing its files", path_);
+            CHECK(removeAll());
+        }
+        return 0;
+    }
+    if (oldestSegment_ == headSegment_) {
+        return 0;
+    }
+    // Persist the read cursor before the segments it has passed are removed
+    if (unsyncedPops_ > 0) {
+        CHECK(saveState());
+    }
+    LOG_DEBUG(TRACE, "Removing segments %u-%u of file queue %s", (unsigned)oldestSegment_,
+            (unsigned)headSegment_ - 1, path_);
+    CHECK(removeFiles(oldestSegment_, headSegment_ - 1));
+    oldestSegment_ = headSegment_;
+    return saveState();
+}
+
+int FileQueue::size() {
+    const FsLock lock(fs_);
+    CHECK(open());
+    return count_;
+}
+
+void FileQueue::close() {
+    const FsLock lock(fs_);
+    if (!open_) {
+        return;
+    }
+    sync();
+    closeFiles();
+    open_ = false;
+}
+
+int FileQueue::open() {
+    if (open_) {
+        return 0;
+    }
+    CHECK_TRUE(fs_, SYSTEM_ERROR_FILE);
+    CHECK(filesystem_mount(fs_));
+
+    // Restore the read cursor
+    char path[MAX_PATH_LENGTH];
+    const int n = snprintf(path, sizeof(path), "%s.idx", path_);
+    CHECK_TRUE(n > 0 && (size_t)n < sizeof(path), SYSTEM_ERROR_TOO_LARGE);
+    QueueState state = {};
+    bool restored = false;
+    lfs_file_t file = {};
+    if (lfs_file_open(lfs(), &file, path, LFS_O_RDONLY) == LFS_ERR_OK) {
+        const lfs_ssize_t r = lfs_file_read(lfs(), &file, &state, sizeof(state));
+        lfs_file_close(lfs(), &file);
+        if (r != (lfs_ssize_t)sizeof(state) || state.magick != QUEUE_STATE_MAGICK || state.oldestSegment > state.headSegment) {
+            LOG(ERROR, "Invalid state of file queue %s", path_);
+        } else {
+            restored = true;
+        }
+    }
+    lfs_info info = {};
+    if (restored) {
+        oldestSegment_ = state.oldestSegment;
+        headSegment_ = state.headSegment;
+        headOffset_ = state.headOffset;
+        // Find the last segment
+        tailSegment_ = headSegment_;
+        for (;;) {
+            CHECK(segmentPath(path, sizeof(path), tailSegment_ + 1));
+            if (lfs_stat(lfs(), path, &info) != LFS_ERR_OK) {
+                break;
+            }
+            ++tailSegment_;
+        }
+    } else {
+        CHECK(findSegments());
+    }
+    tailOffset_ = 0;
+    CHECK(segmentPath(path, sizeof(path), tailSegment_));
+    if (lfs_stat(lfs(), path, &info) == LFS_ERR_OK) {
+        tailOffset_ = info.size;
+    }
+
+    unsyncedWrites_ = 0;
+    unsyncedPops_ = 0;
+    readOpen_ = false;
+    writeOpen_ = false;
+    open_ = true;
+
+    int r = scan();
+    if (r == SYSTEM_ERROR_BAD_DATA) {
+        LOG(ERROR, "File queue %s is corrupted, removing its files", path_);
+        r = removeAll();
+    }
+    if (r >= 0) {
+        r = importLegacyFile();
+    }
+    if (r < 0) {
+        closeFiles();
+        open_ = false;
+        return r;
+    }
+    return 0;
+}
+
+void FileQueue::closeFiles() {
+    if (readOpen_) {
+        lfs_file_close(lfs(), &readFile_);
+        readOpen_ = false;
+    }
+    if (writeOpen_) {
+        lfs_file_close(lfs(), &writeFile_);
+        writeOpen_ = false;
+    }
+}
+
+int FileQueue::importLegacyFile() {
+    // Older versions kept the whole queue in a single file, and marked the removed entries as inactive
+    lfs_info info = {};
+    if (lfs_stat(lfs(), path_, &info) != LFS_ERR_OK || info.type != LFS_TYPE_REG) {
+        return 0;
+    }
+    lfs_file_t file = {};
+    CHECK_TRUE(lfs_file_open(lfs(), &file, path_, LFS_O_RDONLY) == LFS_ERR_OK, SYSTEM_ERROR_FILE);
+    unsigned imported = 0;
+    int r = 0;
+    for (;;) {
+        QueueEntry entry = {};
+        if (lfs_file_read(lfs(), &file, &entry, sizeof(entry)) != (lfs_ssize_t)sizeof(entry) || entry.size < sizeof(entry)) {
+            break;
+        }
+        const size_t size = entry.size - sizeof(entry);
+        if (!(entry.flags & QueueEntry::ACTIVE)) {
+            if (lfs_file_seek(lfs(), &file, size, LFS_SEEK_CUR) < 0) {
+                break;
+            }
+            continue;
+        }
+        const auto data = malloc(size ? size : 1);
+        if (!data) {
+            r = SYSTEM_ERROR_NO_MEMORY;
+            break;
+        }
+        SCOPE_GUARD({
+            free(data);
+        });
+        if (lfs_file_read(lfs(), &file, data, size) != (lfs_ssize_t)size) {
+            break;
+        }
+        r = append(data, size);
+        if (r < 0) {
+            break;
+        }
+        ++imported;
+    }
+    lfs_file_close(lfs(), &file);
+    if (r >= 0) {
+        r = syncWrites();
+    }
+    CHECK(r);
+    LOG(INFO, "Imported %u entries from file queue %s", imported, path_);
+    CHECK_TRUE(lfs_remove(lfs(), path_) == LFS_ERR_OK, SYSTEM_ERROR_FILE);
+    return 0;
+}
+
+int FileQueue::findSegments() {
+    // Without a read cursor, the queue starts at the oldest segment that hasn't been deleted
+    oldestSegment_ = 0;
+    headSegment_ = 0;
+    headOffset_ = 0;
+    tailSegment_ = 0;
+    char dirPath[MAX_PATH_LENGTH] = "/";
+    const char* name = path_;
+    const char* slash = strrchr(path_, '/');
+    if (slash) {
+        const size_t n = std::max<size_t>(slash - path_, 1);
+        CHECK_TRUE(n < sizeof(dirPath), SYSTEM_ERROR_TOO_LARGE);
+        memcpy(dirPath, path_, n);
+        dirPath[n] = '\0';
+        name = slash + 1;
+    }
+    const size_t nameLen = strlen(name);
+    lfs_dir_t dir = {};
+    if (lfs_dir_open(lfs(), &dir, dirPath) != LFS_ERR_OK) {
+        return 0;
+    }
+    SCOPE_GUARD({
+        lfs_dir_close(lfs(), &dir);
+    });
+    bool found = false;
+    lfs_info info = {};
+    while (lfs_dir_read(lfs(), &dir, &info) > 0) {
+        if (info.type != LFS_TYPE_REG || strncmp(info.name, name, nameLen) != 0 || info.name[nameLen] != '.' ||
+                !isdigit((unsigned char)info.name[nameLen + 1])) {
+            continue;
+        }
+        char* end = nullptr;
+        const uint32_t segment = strtoul(info.name + nameLen + 1, &end, 10);
+        if (*end != '\0') {
+            continue;
+        }
+        if (!found || segment < oldestSegment_) {
+            oldestSegment_ = segment;
+        }
+        if (!found || segment > tailSegment_) {
+            tailSegment_ = segment;
+        }
+        found = true;
+    }
+    if (found) {
+        LOG(WARN, "Restored file queue %s from segments %u-%u", path_, (unsigned)oldestSegment_, (unsigned)tailSegment_);
+    }
+    headSegment_ = oldestSegment_;
+    return 0;
+}
+
+int FileQueue::scan() {
+    // Count the entries from the read cursor to the end of the log
+    count_ = 0;
+    char path[MAX_PATH_LENGTH];
+    bool torn = false;
+    uint32_t tornOffset = 0;
+    for (uint32_t segment = headSegment_; segment <= tailSegment_; ++segment) {
+        CHECK(segmentPath(path, sizeof(path), segment));
+        lfs_file_t file = {};
+        if (lfs_file_open(lfs(), &file, path, LFS_O_RDONLY) != LFS_ERR_OK) {
+            if (segment == tailSegment_ && (segment != headSegment_ || headOffset_ == 0)) {
+                break; // Nothing has been written to the last segment yet
+            }
+            return SYSTEM_ERROR_BAD_DATA;
+        }
+        SCOPE_GUARD({
+            lfs_file_close(lfs(), &file);
+        });
+        const lfs_soff_t size = lfs_file_size(lfs(), &file);
+        CHECK_TRUE(size >= 0, SYSTEM_ERROR_FILE);
+        uint32_t offset = (segment == headSegment_) ? headOffset_ : 0;
+        CHECK_TRUE(offset <= (uint32_t)size, SYSTEM_ERROR_BAD_DATA);
+        while (offset + sizeof(QueueEntry) <= (uint32_t)size) {
+            QueueEntry entry = {};
+            CHECK_TRUE(lfs_file_seek(lfs(), &file, offset, LFS_SEEK_SET) >= 0, SYSTEM_ERROR_FILE);
+            CHECK_TRUE(lfs_file_read(lfs(), &file, &entry, sizeof(entry)) == (lfs_ssize_t)sizeof(entry), SYSTEM_ERROR_FILE);
+            if (entry.size < sizeof(entry) || offset + entry.size > (uint32_t)size) {
+                break;
+            }
+            offset += entry.size;
+            ++count_;
+        }
+        if (offset != (uint32_t)size) {
+            if (segment != tailSegment_) {
+                return SYSTEM_ERROR_BAD_DATA;
+            }
+            // The last entry was not completely written: discard it, keeping the entries before it
+            torn = true;
+            tornOffset = offset;
+        }
+    }
+    if (torn) {
+        LOG(WARN, "Discarding incomplete entry at the end of file queue %s", path_);
+        CHECK(segmentPath(path, sizeof(path), tailSegment_));
+        lfs_file_t file = {};
+        CHECK_TRUE(lfs_file_open(lfs(), &file, path, LFS_O_WRONLY) == LFS_ERR_OK, SYSTEM_ERROR_FILE);
+        int r = lfs_file_truncate(lfs(), &file, tornOffset);
+        const int r2 = lfs_file_close(lfs(), &file);
+        if (r == LFS_ERR_OK) {
+            r = r2;
+        }
+        CHECK_TRUE(r == LFS_ERR_OK, SYSTEM_ERROR_FILE);
+        tailOffset_ = tornOffset;
+    }
+    return 0;
+}
+
+int FileQueue::append(const void* item, uint16_t size) {
+    CHECK_TRUE(size <= UINT16_MAX - sizeof(QueueEntry), SYSTEM_ERROR_TOO_LARGE);
+    if (!writeOpen_) {
+        CHECK(openWriteFile());
+    }
+    QueueEntry entry = {};
+    entry.size = size + sizeof(QueueEntry);
+    entry.flags = QueueEntry::ACTIVE;
+    if (lfs_file_write(lfs(), &writeFile_, &entry, sizeof(entry)) != (lfs_ssize_t)sizeof(entry) ||
+            lfs_file_write(lfs(), &writeFile_, item, size) != (lfs_ssize_t)size) {
+        LOG(ERROR, "Unable to write %u bytes to file queue %s", (unsigned)entry.size, path_);
+        // Discard the partially written entry
+        lfs_file_truncate(lfs(), &writeFile_, tailOffset_);
+        lfs_file_close(lfs(), &writeFile_);
+        writeOpen_ = false;
+        return SYSTEM_ERROR_FILE;
+    }
+    tailOffset_ += entry.size;
+    ++count_;
+    ++unsyncedWrites_;
+    if (tailOffset_ >= FILE_QUEUE_SEGMENT_SIZE) {
+        // Continue in a new segment
+        CHECK(syncWrites());
+        lfs_file_close(lfs(), &writeFile_);
+        writeOpen_ = false;
+        ++tailSegment_;
+        tailOffset_ = 0;
+    } else if (unsyncedWrites_ >= syncInterval_) {
+        CHECK(syncWrites());
+    }
+    return 0;
+}
+
+int FileQueue::readHeader(QueueEntry& entry) {
+    for (;;) {
+        if (count_ == 0) {
+            return SYSTEM_ERROR_NOT_FOUND;
+        }
+        if (headSegment_ == tailSegment_) {
+            // The entries are not visible to the other file handle until they are synchronized
+            CHECK(syncWrites());
+        }
+        if (!readOpen_ || readStale_) {
+            CHECK(openReadFile());
+        }
+        if (headOffset_ + sizeof(QueueEntry) <= headEnd_) {
+            break;
+        }
+        CHECK_TRUE(headSegment_ != tailSegment_, SYSTEM_ERROR_BAD_DATA);
+        // The head segment has been read through
+        lfs_file_close(lfs(), &readFile_);
+        readOpen_ = false;
+        ++headSegment_;
+        headOffset_ = 0;
+    }
+    CHECK_TRUE(lfs_file_seek(lfs(), &readFile_, headOffset_, LFS_SEEK_SET) >= 0, SYSTEM_ERROR_FILE);
+    CHECK_TRUE(lfs_file_read(lfs(), &readFile_, &entry, sizeof(entry)) == (lfs_ssize_t)sizeof(entry), SYSTEM_ERROR_FILE);
+    CHECK_TRUE(entry.size >= sizeof(entry) && headOffset_ + entry.size <= headEnd_, SYSTEM_ERROR_BAD_DATA);
+    return 0;
+}
+
+int FileQueue::openWriteFile() {
+    char path[MAX_PATH_LENGTH];
+    CHECK(segmentPath(path, sizeof(path), tailSegment_));
+    const int r = lfs_file_open(lfs(), &writeFile_, path, LFS_O_WRONLY | LFS_O_APPEND | LFS_O_CREAT);
+    if (r != LFS_ERR_OK) {
+        LOG(ERROR, "Unable to open file %s: %d", path, r);
+        return SYSTEM_ERROR_FILE;
+    }
+    writeOpen_ = true;
+    return 0;
+}
+
+int FileQueue::openReadFile() {
+    if (readOpen_) {
+        lfs_file_close(lfs(), &readFile_);
+        readOpen_ = false;
+    }
+    char path[MAX_PATH_LENGTH];
+    CHECK(segmentPath(path, sizeof(path), headSegment_));
+    const int r = lfs_file_open(lfs(), &readFile_, path, LFS_O_RDONLY);
+    if (r != LFS_ERR_OK) {
+        LOG(ERROR, "Unable to open file %s: %d", path, r);
+        return SYSTEM_ERROR_FILE;
+    }
+    readOpen_ = true;
+    readStale_ = false;
+    const lfs_soff_t size = lfs_file_size(lfs(), &readFile_);
+    CHECK_TRUE(size >= 0, SYSTEM_ERROR_FILE);
+    headEnd_ = size;
+    return 0;
+}
+
+int FileQueue::syncWrites() {
+    if (!writeOpen_ || unsyncedWrites_ == 0) {
+        return 0;
+    }
+    const int r = lfs_file_sync(lfs(), &writeFile_);
+    if (r != LFS_ERR_OK) {
+        LOG(ERROR, "Unable to synchronize file queue %s: %d", path_, r);
+        return SYSTEM_ERROR_FILE;
+    }
+    unsyncedWrites_ = 0;
+    if (headSegment_ == tailSegment_) {
+        readStale_ = true;
+    }
+    return 0;
+}
+
+int FileQueue::saveState() {
+    char path[MAX_PATH_LENGTH];
+    const int n = snprintf(path, sizeof(path), "%s.idx", path_);
+    CHECK_TRUE(n > 0 && (size_t)n < sizeof(path), SYSTEM_ERROR_TOO_LARGE);
+    QueueState state = {};
+    state.magick = QUEUE_STATE_MAGICK;
+    state.oldestSegment = oldestSegment_;
+    state.headSegment = headSegment_;
+    state.headOffset = headOffset_;
+    lfs_file_t file = {};
+    int r = lfs_file_open(lfs(), &file, path, LFS_O_WRONLY | LFS_O_CREAT | LFS_O_TRUNC);
+    if (r == LFS_ERR_OK) {
+        if (lfs_file_write(lfs(), &file, &state, sizeof(state)) != (lfs_ssize_t)sizeof(state)) {
+            r = LFS_ERR_IO;
+        }
+        const int r2 = lfs_file_close(lfs(), &file);
+        if (r == LFS_ERR_OK) {
+            r = r2;
+        }
+    }
+    if (r != LFS_ERR_OK) {
+        LOG(ERROR, "Unable to save state of file queue %s: %d", path_, r);
+        return SYSTEM_ERROR_FILE;
+    }
+    unsyncedPops_ = 0;
+    return 0;
+}
+
+int FileQueue::removeAll() {
+    closeFiles();
+    int r = removeFiles(oldestSegment_, tailSegment_);
+    char path[MAX_PATH_LENGTH];
+    const int n = snprintf(path, sizeof(path), "%s.idx", path_);
+    CHECK_TRUE(n > 0 && (size_t)n < sizeof(path), SYSTEM_ERROR_TOO_LARGE);
+    const int r2 = lfs_remove(lfs(), path);
+    if (r2 != LFS_ERR_OK && r2 != LFS_ERR_NOENT && r >= 0) {
+        r = SYSTEM_ERROR_FILE;
+    }
+    oldestSegment_ = 0;
+    headSegment_ = 0;
+    headOffset_ = 0;
+    tailSegment_ = 0;
+    tailOffset_ = 0;
+    headEnd_ = 0;
+    count_ = 0;
+    unsyncedWrites_ = 0;
+    unsyncedPops_ = 0;
+    return r;
+}
+
+int FileQueue::removeFiles(uint32_t first, uint32_t last) {
+    int result = 0;
+    char path[MAX_PATH_LENGTH];
+    for (uint32_t segment = first; segment <= last; ++segment) {
+        CHECK(segmentPath(path, sizeof(path), segment));
+        const int r = lfs_remove(lfs(), path);
+        if (r != LFS_ERR_OK && r != LFS_ERR_NOENT) {
+            LOG(ERROR, "Unable to remove file %s: %d", path, r);
+            result = SYSTEM_ERROR_FILE;
+        }
+    }
+    return result;
+}
+
+int FileQueue::segmentPath(char* buf, size_t size, uint32_t segment) const {
+    const int n = snprintf(buf, size, "%s.%u", path_, (unsigned)segment);
+    CHECK_TRUE(n > 0 && (size_t)n < size, SYSTEM_ERROR_TOO_LARGE);
+    return 0;
+}
+
+} // fs
+} // particle
+
+#endif // HAL_PLATFORM_FILESYSTEM
@@ -24,6 +24,7 @@
 #include "service_debug.h"
 #include "system_error.h"
 #include <algorithm>
+#include <memory>
 
 /* FIXME: once filesystem interface is finalized, convert the implementation not to use
  * LittleFS API.
@@ -32,6 +33,24 @@
 using namespace particle::services::settings;
 using namespace particle::fs;
 
+namespace {
+
+/* Size of the buffer used to move data within the file */
+const size_t COPY_CHUNK_SIZE = 64;
+
+/* lfs_file_read() stops at the end of the file, so a short read means that the record or
+ * the footer being read is truncated
+ */
+ssize_t readFully(lfs_t* lfs, lfs_file_t* file, void* buf, size_t length) {
+    const lfs_ssize_t r = lfs_file_read(lfs, file, buf, length);
+    if (r >= 0 && (size_t)r != length) {
+        return SYSTEM_ERROR_BAD_DATA;
+    }
+    return r;
+}
+
+} /* anonymous */
+
 TlvFile::TlvFile(const char* path) {
     SPARK_ASSERT(path != nullptr);
     path_ = strdup(path);
@@ -39,6 +58,7 @@ TlvFile::TlvFile(const char* path) {
 }
 
 TlvFile::~TlvFile() {
+    clearIndex();
     if (path_) {
         free(path_);
         path_ = nullptr;
@@ -119,16 +139,21 @@ ssize_t TlvFile::get(uint16_t key, uint8_t* value, uint16_t length, int index) {
         return SYSTEM_ERROR_INVALID_ARGUMENT;
     }
 
-    uint16_t dataSize;
     ssize_t ret = SYSTEM_ERROR_NOT_FOUND;
-    ssize_t pos = find(key, index, &dataSize);
-    if (pos >= 0) {
+    const int i = findEntry(key, index);
+    if (i >= 0) {
         /* Found it */
-        const size_t toRead = std::min(length, dataSize);
+        const Entry& entry = index_[i];
+        const size_t toRead = std::min(length, entry.length);
         if (toRead) {
-            ret = seek(pos + sizeof(TlvHeader));
-            if (ret >= 0) {
-                ret = read(value, toRead);
+            if (entry.data) {
+                memcpy(value, entry.data, toRead);
+                ret = toRead;
+            } else {
+                ret = seek(entry.offset + sizeof(TlvHeader));
+                if (ret >= 0) {
+                    ret = read(value, toRead);
+                }
             }
         }
     }
@@ -143,6 +168,21 @@ int TlvFile::set(uint16_t key, const uint8_t* value, uint16_t length, int index)
         return SYSTEM_ERROR_INVALID_STATE;
     }
 
+    /* A value of the same size is overwritten in place, unless there are other values with the
+     * same key, whose order would change otherwise
+     */
+    const int i = findEntry(key, index);
+    if (!transaction_ && i >= 0 && index_[i].length == length && findEntry(key, 1) < 0) {
+        ssize_t r = seek(index_[i].offset + sizeof(TlvHeader));
+        if (r >= 0 && length) {
+            r = write(value, length);
+        }
+        if (r < 0) {
+            return r;
+        }
+        return sync();
+    }
+
     /* Delete previous entry */
     int ret = del(key, index);
     if (!(ret == 0 || ret == SYSTEM_ERROR_NOT_FOUND)) {
@@ -159,6 +199,29 @@ int TlvFile::add(uint16_t key, const uint8_t* value, uint16_t length) {
         return SYSTEM_ERROR_INVALID_STATE;
     }
 
+    if (transaction_) {
+        Entry entry = {};
+        entry.key = key;
+        entry.length = length;
+        entry.data = (uint8_t*)malloc(length ? length : 1);
+        if (!entry.data) {
+            return SYSTEM_ERROR_NO_MEMORY;
+        }
+        if (length) {
+            memcpy(entry.data, value, length);
+        }
+        if (!index_.append(entry)) {
+            free(entry.data);
+            return SYSTEM_ERROR_NO_MEMORY;
+        }
+        return 0;
+    }
+
+    /* Make sure the new entry can be added to the index once the record is written */
+    if (!index_.reserve(index_.size() + 1)) {
+        return SYSTEM_ERROR_NO_MEMORY;
+    }
+
     FileFooter footer;
     int ret = readFooter(footer);
     if (ret < 0) {
@@ -198,7 +261,15 @@ int TlvFile::add(uint16_t key, const uint8_t* value, uint16_t length) {
         return ret;
     }
 
-    return sync();
+    ret = sync();
+    if (!ret) {
+        Entry entry = {};
+        entry.key = key;
+        entry.length = length;
+        entry.offset = pos;
+        index_.append(entry);
+    }
+    return ret;
 }
 
 int TlvFile::del(uint16_t key, int index) {
@@ -208,84 +279,66 @@ int TlvFile::del(uint16_t key, int index) {
         return SYSTEM_ERROR_INVALID_STATE;
     }
 
-    int ret = 0;
+    bool deleted = false;
 
     for (;;) {
-        uint16_t dataSize = 0;
-        ssize_t pos = find(key, index, &dataSize);
-        if (pos < 0) {
-            return pos;
+        const int i = findEntry(key, index);
+        if (i < 0) {
+            return deleted ? 0 : SYSTEM_ERROR_NOT_FOUND;
         }
 
-        /* FIXME: this will only work on LittleFS. Provide a different implementation later
-         * when filesystem API is finalized and TlvFile implementation is refactored not to use
-         * LittleFS API.
-         */
-        const ssize_t fileSize = size();
+        int ret = removeRecord(i);
+        if (ret) {
+            return ret;
+        }
+        deleted = true;
 
-        FileFooter footer;
-        ret = readFooter(footer);
+        if (index >= 0) {
+            return 0;
+        }
+    }
+}
 
-        while (ret == 0) {
-            lfs_file_t f;
-            ret = lfs_file_open(lfs(), &f, path_, LFS_O_RDONLY);
-            if (ret) {
-                break;
-            }
+int TlvFile::beginTransaction() {
+    FsLock lk(fs_);
 
-            size_t wpos = pos;
-            size_t rpos = wpos + sizeof(TlvHeader) + dataSize;
+    if (!open_ || transaction_) {
+        return SYSTEM_ERROR_INVALID_STATE;
+    }
 
-            ret = seek(wpos);
-            if (ret < 0) {
-                break;
-            }
+    transaction_ = true;
 
-            ret = lfs_file_seek(lfs(), &f, rpos, LFS_SEEK_SET);
-            if (ret < 0) {
-                break;
-            }
+    return 0;
+}
 
-            for (; rpos < footer.size && ret > 0; ++wpos, ++rpos) {
-                uint8_t tmp;
-                ret = lfs_file_read(lfs(), &f, &tmp, sizeof(tmp));
-                if (ret < 0) {
-                    break;
-                }
+int TlvFile::commitTransaction() {
+    FsLock lk(fs_);
 
-                ret = write(&tmp, sizeof(tmp));
-                if (ret < 0) {
-                    break;
-                }
-            }
+    if (!open_ || !transaction_) {
+        return SYSTEM_ERROR_INVALID_STATE;
+    }
 
-            if (ret > 0) {
-                /* Write footer */
-                footer.size -= sizeof(TlvHeader) + dataSize;
-                ret = write((const uint8_t*)&footer, sizeof(footer));
-                if (ret < 0) {
-                    break;
-                }
-                /* Truncate */
-                ret = lfs_file_truncate(lfs(), &file_, fileSize - (sizeof(TlvHeader) + dataSize));
-                if (ret < 0) {
-                    break;
-                }
-                ret = sync();
-            }
+    transaction_ = false;
 
-            lfs_file_close(lfs(), &f);
+    int ret = writeCompacted();
+    if (ret) {
+        /* Discard the pending changes */
+        buildIndex();
+    }
 
-            break;
-        }
+    return ret;
+}
 
+int TlvFile::abortTransaction() {
+    FsLock lk(fs_);
 
-        if (ret || index >= 0) {
-            break;
-        }
+    if (!open_ || !transaction_) {
+        return SYSTEM_ERROR_INVALID_STATE;
     }
 
-    return ret;
+    transaction_ = false;
+
+    return buildIndex();
 }
 
 lfs_t* TlvFile::lfs() {
@@ -335,6 +388,9 @@ int TlvFile::open() {
     r = sync();
 
 open_done:
+    if (!r) {
+        r = buildIndex();
+    }
     if (r) {
         lfs_file_close(lfs(), &file_);
         open_ = false;
@@ -364,6 +420,8 @@ int TlvFile::close() {
     /* Close */
 
     open_ = false;
+    transaction_ = false;
+    clearIndex();
 
     return lfs_file_close(lfs(), &file_);
 }
@@ -404,7 +462,7 @@ ssize_t TlvFile::seek(ssize_t offset, int whence) {
 }
 
 ssize_t TlvFile::read(uint8_t* buf, size_t length) {
-    return lfs_file_read(lfs(), &file_, buf, length);
+    return readFully(lfs(), &file_, buf, length);
 }
 
 ssize_t TlvFile::write(const uint8_t* buf, size_t length) {
@@ -441,19 +499,17 @@ int TlvFile::readFooter(FileFooter& footer) {
     return SYSTEM_ERROR_BAD_DATA;
 }
 
-ssize_t TlvFile::find(uint16_t key, int index, uint16_t* dataSize) {
+int TlvFile::buildIndex() {
+    clearIndex();
+
     FileFooter footer;
     int r = readFooter(footer);
     if (r) {
         return r;
     }
 
-    ssize_t candidatePos = -1;
-    int candidateIdx = -1;
-    uint16_t candidateSize = 0;
-
     TlvHeader header;
-    for (ssize_t pos = 0; pos >= 0 && (pos + sizeof(TlvHeader)) <= footer.size;) {
+    for (ssize_t pos = 0; (pos + sizeof(TlvHeader)) <= footer.size;) {
         r = seek(pos);
         if (r < 0) {
             return r;
@@ -461,7 +517,8 @@ ssize_t TlvFile::find(uint16_t key, int index, uint16_t* dataSize) {
 
         ssize_t rd = read((uint8_t*)&header, sizeof(header));
         if (rd < (ssize_t)sizeof(TlvHeader)) {
-            return SYSTEM_ERROR_BAD_DATA;
+            /* Keep the records read so far */
+            break;
         }
 
         if (header.magick != TLV_HEADER_MAGICK) {
@@ -470,26 +527,192 @@ ssize_t TlvFile::find(uint16_t key, int index, uint16_t* dataSize) {
             continue;
         }
 
-        if (header.key == key) {
-            candidatePos = pos;
+        Entry entry = {};
+        entry.key = header.key;
+        entry.length = header.length;
+        entry.offset = pos;
+        if (!index_.append(entry)) {
+            clearIndex();
+            return SYSTEM_ERROR_NO_MEMORY;
+        }
+
+        pos += sizeof(TlvHeader) + header.length;
+    }
+
+    return 0;
+}
+
+void TlvFile::clearIndex() {
+    for (Entry& entry: index_) {
+        free(entry.data);
+    }
+    index_.clear();
+}
+
+int TlvFile::findEntry(uint16_t key, int index) const {
+    int candidate = -1;
+    int candidateIdx = -1;
+
+    for (int i = 0; i < index_.size(); ++i) {
+        if (index_[i].key == key) {
+            candidate = i;
             ++candidateIdx;
-            candidateSize = header.length;
             if (index >= 0 && candidateIdx >= index) {
-                break;
+                return i;
             }
         }
+    }
 
-        pos += sizeof(TlvHeader) + header.length;
+    return index < 0 ? candidate : -1;
+}
+
+int TlvFile::removeRecord(int i) {
+    if (transaction_) {
+        free(index_[i].data);
+        index_.removeAt(i);
+        return 0;
+    }
+
+    /* FIXME: this will only work on LittleFS. Provide a different implementation later
+     * when filesystem API is finalized and TlvFile implementation is refactored not to use
+     * LittleFS API.
+     */
+    const size_t recordSize = sizeof(TlvHeader) + index_[i].length;
+    const ssize_t fileSize = size();
+    if (fileSize < 0) {
+        return fileSize;
+    }
+
+    FileFooter footer;
+    ssize_t ret = readFooter(footer);
+    if (ret) {
+        return ret;
+    }
+
+    /* Move the following records over the removed one */
+    lfs_file_t f;
+    ret = lfs_file_open(lfs(), &f, path_, LFS_O_RDONLY);
+    if (ret) {
+        return ret;
+    }
+
+    size_t rpos = index_[i].offset + recordSize;
+
+    ret = seek(index_[i].offset);
+    if (ret >= 0) {
+        ret = lfs_file_seek(lfs(), &f, rpos, LFS_SEEK_SET);
     }
 
-    if ((index >= 0 && candidateIdx == index) || (index < 0 && candidateIdx >= 0)) {
-        if (dataSize) {
-            *dataSize = candidateSize;
+    uint8_t buf[COPY_CHUNK_SIZE];
+    while (ret >= 0 && rpos < footer.size) {
+        const size_t n = std::min(sizeof(buf), footer.size - rpos);
+        ret = readFully(lfs(), &f, buf, n);
+        if (ret >= 0) {
+            ret = write(buf, n);
         }
-        return candidatePos;
+        rpos += n;
     }
 
-    return SYSTEM_ERROR_NOT_FOUND;
+    if (ret >= 0) {
+        /* Write footer */
+        footer.size -= recordSize;
+        ret = write((const uint8_t*)&footer, sizeof(footer));
+    }
+    if (ret >= 0) {
+        /* Truncate */
+        ret = lfs_file_truncate(lfs(), &file_, fileSize - recordSize);
+    }
+    if (ret >= 0) {
+        ret = sync();
+    }
+
+    lfs_file_close(lfs(), &f);
+
+    if (ret < 0) {
+        return ret;
+    }
+
+    index_.removeAt(i);
+    for (int j = i; j < index_.size(); ++j) {
+        index_[j].offset -= recordSize;
+    }
+
+    return 0;
+}
+
+int TlvFile::writeCompacted() {
+    /* Write the records into a new file, which then replaces the current one */
+    const size_t pathLen = strlen(path_);
+    std::unique_ptr<char[]> tmpPath(new(std::nothrow) char[pathLen + sizeof(".tmp")]);
+    if (!tmpPath) {
+        return SYSTEM_ERROR_NO_MEMORY;
+    }
+    memcpy(tmpPath.get(), path_, pathLen);
+    memcpy(tmpPath.get() + pathLen, ".tmp", sizeof(".tmp"));
+
+    FileFooter footer;
+    ssize_t ret = readFooter(footer);
+    if (ret) {
+        return ret;
+    }
+
+    lfs_file_t f;
+    ret = lfs_file_open(lfs(), &f, tmpPath.get(), LFS_O_CREAT | LFS_O_TRUNC | LFS_O_WRONLY);
+    if (ret) {
+        return ret;
+    }
+
+    uint32_t pos = 0;
+    uint8_t buf[COPY_CHUNK_SIZE];
+    for (int i = 0; i < index_.size() && ret >= 0; ++i) {
+        const Entry& entry = index_[i];
+        TlvHeader header = {};
+        header.magick = TLV_HEADER_MAGICK;
+        header.key = entry.key;
+        header.length = entry.length;
+        ret = lfs_file_write(lfs(), &f, &header, sizeof(header));
+        if (entry.data) {
+            if (ret >= 0 && entry.length) {
+                ret = lfs_file_write(lfs(), &f, entry.data, entry.length);
+            }
+        } else {
+            if (ret >= 0) {
+                ret = seek(entry.offset + sizeof(TlvHeader));
+            }
+            for (size_t done = 0; ret >= 0 && done < entry.length;) {
+                const size_t n = std::min(sizeof(buf), (size_t)entry.length - done);
+                ret = read(buf, n);
+                if (ret >= 0) {
+                    ret = lfs_file_write(lfs(), &f, buf, n);
+                }
+                done += n;
+            }
+        }
+        pos += sizeof(TlvHeader) + entry.length;
+    }
+
+    if (ret >= 0) {
+        footer.magick = TLV_FILE_MAGICK;
+        footer.size = pos;
+        ret = lfs_file_write(lfs(), &f, &footer, sizeof(footer));
+    }
+
+    const int r = lfs_file_close(lfs(), &f);
+    if (ret >= 0) {
+        ret = r;
+    }
+
+    if (ret < 0) {
+        lfs_remove(lfs(), tmpPath.get());
+        return ret;
+    }
+
+    /* Reopening the file rebuilds the index */
+    close();
+    ret = lfs_rename(lfs(), tmpPath.get(), path_);
+    const int r2 = open();
+
+    return ret < 0 ? ret : r2;
 }
 
 #endif /* HAL_PLATFORM_FILESYSTEM == 1 */
@@ -19,20 +19,23 @@
 #pragma once
 
 #include "logging.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
 
 /**
- * A simple append-only list. The elements are never deallocated.
+ * A simple append-only list of up to {@code MAX_SIZE} elements. The elements are never deallocated.
  */
 // todo - perhaps replace this with our vector implementation?
 template <typename T> class append_list
 {
-    uint8_t count;
-    uint8_t capacity;
+    uint16_t count;
+    uint16_t capacity;
     uint8_t block_size;
     T* store;
 
     bool expand(unsigned capacity) {
-        if (capacity>255)
+        if (capacity>MAX_SIZE)
             return false;
 
         T* new_store = (T*)realloc(store, sizeof(T)*capacity);
@@ -45,6 +48,8 @@ template <typename T> class append_list
 
 public:
 
+    static const unsigned MAX_SIZE = 65535;
+
     append_list(unsigned block=5) : count(0), capacity(0), block_size(block), store(NULL) {}
 
     T* add() {
@@ -52,7 +57,7 @@ public:
     }
 
     T* add(const T& item) {
-        bool space = (count<capacity || expand(count+block_size));
+        bool space = (count<capacity || (count<MAX_SIZE && expand(std::min<unsigned>(count+block_size, MAX_SIZE))));
         T* result = nullptr;
         if (space) {
         	result = store + count;
@@ -75,3 +80,124 @@ public:
 };
 
 
+/**
+ * An append-only list of items identified by a string key. A hash index over the keys
+ * lets items be looked up without comparing the key of every item in the list.
+ *
+ * Keys are compared up to {@code key_length} characters, as with strncmp(). Like append_list, the
+ * list holds up to {@code append_list<T>::MAX_SIZE} items.
+ */
+template <typename T, const char* (*key_of)(const T&), size_t key_length>
+class keyed_append_list
+{
+    append_list<T> items;
+
+    // Index + 1 of the most recently added item in each bucket, or 0 if the bucket is empty
+    uint16_t* buckets;
+    // Index + 1 of the next item in the same bucket as each item, or 0 at the end of the chain
+    uint16_t* chain;
+    unsigned bucket_count;
+    unsigned chain_capacity;
+
+    static uint32_t hash(const char* key) {
+        // FNV-1a
+        uint32_t h = 2166136261u;
+        for (size_t i = 0; i < key_length && key[i]; i++) {
+            h = (h ^ (uint8_t)key[i]) * 16777619u;
+        }
+        return h;
+    }
+
+    unsigned bucket_of(const char* key) const {
+        return hash(key) & (bucket_count - 1);
+    }
+
+    void link(unsigned index) {
+        const unsigned b = bucket_of(key_of(items[index]));
+        chain[index] = buckets[b];
+        buckets[b] = index + 1;
+    }
+
+    bool rehash(unsigned count) {
+        uint16_t* new_buckets = (uint16_t*)realloc(buckets, sizeof(uint16_t) * count);
+        if (!new_buckets) {
+            return false;
+        }
+        buckets = new_buckets;
+        bucket_count = count;
+        memset(buckets, 0, sizeof(uint16_t) * bucket_count);
+        for (unsigned i = 0; i < items.size(); i++) {
+            link(i);
+        }
+        return true;
+    }
+
+    bool reserve(unsigned count) {
+        if (count > append_list<T>::MAX_SIZE) {
+            return false;
+        }
+        if (count > chain_capacity) {
+            uint16_t* new_chain = (uint16_t*)realloc(chain, sizeof(uint16_t) * (count + 7));
+            if (!new_chain) {
+                return false;
+            }
+            chain = new_chain;
+            chain_capacity = count + 7;
+        }
+        // keep the load factor at or below 2 items per bucket
+        if (count > bucket_count * 2) {
+            return rehash(bucket_count ? bucket_count * 2 : 8);
+        }
+        return true;
+    }
+
+public:
+
+    keyed_append_list(unsigned block=5) : items(block), buckets(NULL), chain(NULL), bucket_count(0), chain_capacity(0) {}
+
+    /**
+     * Finds the item with the given key.
+     * @return The item, or NULL if no item has that key.
+     */
+    T* find(const char* key) {
+        if (!bucket_count) {
+            return NULL;
+        }
+        for (unsigned i = buckets[bucket_of(key)]; i; i = chain[i - 1]) {
+            T& item = items[i - 1];
+            if (0 == strncmp(key_of(item), key, key_length)) {
+                return &item;
+            }
+        }
+        return NULL;
+    }
+
+    /**
+     * Adds an item. The caller is responsible for ensuring that no other item has the same key.
+     */
+    T* add(const T& item) {
+        if (!reserve(items.size() + 1)) {
+            return nullptr;
+        }
+        T* result = items.add(item);
+        if (result) {
+            link(items.size() - 1);
+        }
+        return result;
+    }
+
+    /**
+     * Removes the most recently added item.
+     */
+    void removeLast() {
+        unsigned index = items.size();
+        if (index--) {
+            // the last item is always at the head of its bucket
+            buckets[bucket_of(key_of(items[index]))] = chain[index];
+            items.removeAt(index);
+        }
+    }
+
+    T& operator[](unsigned index) { return items[index]; }
+    unsigned size() { return items.size(); }
+};
@@ -82,6 +82,13 @@ int Spark_Finish_Firmware_Update(FileTransfer::Descriptor& file, uint32_t flags,
  */
 int Spark_Save_Firmware_Chunk(FileTransfer::Descriptor& file, const uint8_t* chunk, void* reserved);
 
+/**
+ * Determines the kinds of update that can currently be processed.
+ * @param reserved NULL
+ * @return the FileTransfer::Flag values of the compressed files and patches that can be processed.
+ */
+int Spark_Firmware_Update_Flags(void* reserved);
+
 typedef enum
 {
     /**
@@ -156,12 +163,22 @@ int system_set_flag(system_flag_t flag, uint8_t value, void* reserved);
 int system_get_flag(system_flag_t flag, uint8_t* value,void* reserved);
 int system_refresh_flag(system_flag_t flag);
 
+/**
+ * Flags supported by `system_format_diag_data()`.
+ */
+typedef enum system_format_diag_flag {
+    SYSTEM_FORMAT_DIAG_FLAG_BINARY = 0x01, // Binary format
+    SYSTEM_FORMAT_DIAG_FLAG_DELTA = 0x02, // Compact binary format containing only the values changed since the last committed call
+    SYSTEM_FORMAT_DIAG_FLAG_FULL = 0x04, // Include all values in the compact binary format
+    SYSTEM_FORMAT_DIAG_FLAG_COMMIT = 0x08 // Use the formatted values as the base of the next compact snapshot
+} system_format_diag_flag;
+
 /**
  * Formats the diagnostic data using an appender function.
  *
  * @param id Array of data source IDs. This argument can be set to NULL to format all registered data sources.
  * @param count Number of data source IDs in the array.
- * @param flags Formatting flags.
+ * @param flags Formatting flags (see `system_format_diag_flag`).
  * @param append Appender function.
  * @param append_data Opaque data passed to the appender function.
  * @param reserved Reserved argument (should be set to NULL).
@@ -92,22 +92,31 @@ ProtocolFacade* system_cloud_protocol_instance(void)
     return sp;
 }
 
-static append_list<User_Var_Lookup_Table_t> vars(5);
-static append_list<User_Func_Lookup_Table_t> funcs(5);
+static const char* var_key(const User_Var_Lookup_Table_t& var)
+{
+    return var.userVarKey;
+}
+
+static const char* func_key(const User_Func_Lookup_Table_t& func)
+{
+    return func.userFuncKey;
+}
+
+static keyed_append_list<User_Var_Lookup_Table_t, var_key, USER_VAR_KEY_LENGTH> vars(5);
+static keyed_append_list<User_Func_Lookup_Table_t, func_key, USER_FUNC_KEY_LENGTH> funcs(5);
+
+/**
+ * The checksum of the registered functions and variables, recomputed only after a registration changes.
+ */
+static uint32_t describe_app_checksum = 0;
+static bool describe_app_checksum_valid = false;
 
 User_Var_Lookup_Table_t* find_var_by_key(const char* varKey)
 {
-    for (int i = vars.size(); i-->0; )
-    {
-        if (0 == strncmp(vars[i].userVarKey, varKey, USER_VAR_KEY_LENGTH))
-        {
-            return &vars[i];
-        }
-    }
-    return NULL;
+    return vars.find(varKey);
 }
 
-template<typename T> T* add_if_sufficient_describe(append_list<T>& list, const char* name, const char* itemType, const T& value) {
+template<typename L, typename T> T* add_if_sufficient_describe(L& list, const char* name, const char* itemType, const T& value) {
 	T* result = list.add(value);
 	if (result) {
 		spark_protocol_describe_data data;
@@ -115,7 +124,8 @@ template<typename T> T* add_if_sufficient_describe(append_list<T>& list, const c
 		data.flags = particle::protocol::DESCRIBE_APPLICATION;
 		if (!spark_protocol_get_describe_data(spark_protocol_instance(), &data, nullptr)) {
 			if (data.maximum_size<data.current_size) {
-				list.removeAt(list.size()-1);
+				list.removeLast();
+				describe_app_checksum_valid = false;
 				result = nullptr;
 			}
 		}
@@ -138,6 +148,7 @@ User_Var_Lookup_Table_t* find_var_by_key_or_add(const char* varKey, const void*
 	memcpy(item.userVarKey, varKey, USER_VAR_KEY_LENGTH);
 
     User_Var_Lookup_Table_t* result = find_var_by_key(varKey);
+    describe_app_checksum_valid = false;
 
     if (!result) {
     	result = add_if_sufficient_describe(vars, varKey, "variable", item);
@@ -150,14 +161,7 @@ User_Var_Lookup_Table_t* find_var_by_key_or_add(const char* varKey, const void*
 
 User_Func_Lookup_Table_t* find_func_by_key(const char* funcKey)
 {
-    for (int i = funcs.size(); i-->0; )
-    {
-        if (0 == strncmp(funcs[i].userFuncKey, funcKey, USER_FUNC_KEY_LENGTH))
-        {
-            return &funcs[i];
-        }
-    }
-    return NULL;
+    return funcs.find(funcKey);
 }
 
 User_Func_Lookup_Table_t* find_func_by_key_or_add(const char* funcKey, const cloud_function_descriptor* desc)
@@ -168,6 +172,7 @@ User_Func_Lookup_Table_t* find_func_by_key_or_add(const char* funcKey, const clo
     memcpy(item.userFuncKey, desc->funcKey, USER_FUNC_KEY_LENGTH);
 
     User_Func_Lookup_Table_t* result = find_func_by_key(funcKey);
+    describe_app_checksum_valid = false;
     if (result) {
     	*result = item;
     }
@@ -234,25 +239,41 @@ uint32_t compute_variables_checksum()
  */
 uint32_t compute_describe_app_checksum()
 {
-	uint32_t chk[2];
-	chk[0] = compute_variables_checksum();
-	chk[1] = compute_functions_checksum();
-	return crc(chk, sizeof(chk));
+	if (!describe_app_checksum_valid) {
+		uint32_t chk[2];
+		chk[0] = compute_variables_checksum();
+		chk[1] = compute_functions_checksum();
+		describe_app_checksum = crc(chk, sizeof(chk));
+		describe_app_checksum_valid = true;
+	}
+	return describe_app_checksum;
 }
 
+/**
+ * Computes the checksum of the system section of the describe message. Besides the modules, the
+ * section contains the system key values and the validity of each module, which can change without
+ * a reset, so they are covered as well.
+ */
 uint32_t compute_describe_system_checksum()
 {
-    hal_system_info_t info;
-    memset(&info, 0, sizeof(info));
-    info.size = sizeof(info);
-    HAL_System_Info(&info, true, NULL);
+	hal_system_info_t info;
+	memset(&info, 0, sizeof(info));
+	info.size = sizeof(info);
+	info.flags = HAL_SYSTEM_INFO_FLAGS_CLOUD;
+	HAL_System_Info(&info, true, NULL);
 	uint32_t checksum = info.platform_id;
 	for (int i=0; i<info.module_count; i++)
 	{
-		checksum += crc(info.modules[i].suffix->sha);
+		const hal_module_t& module = info.modules[i];
+		checksum += crc(module.suffix->sha);
+		checksum += crc(uint32_t(module.validity_checked) << 16 | module.validity_result);
+	}
+	for (int i=0; i<info.key_value_count; i++)
+	{
+		checksum += string_crc(info.key_values[i].key) ^ string_crc(info.key_values[i].value);
 	}
 	HAL_System_Info(&info, false, NULL);
-    return checksum;
+	return checksum;
 }
 
 
@@ -639,7 +660,28 @@ int userFuncSchedule(const char *funcKey, const char *paramString, SparkDescript
     APPLICATION_THREAD_CONTEXT_ASYNC_RESULT(userFuncScheduleImpl(item, paramString, true, callback), 0);
     userFuncScheduleImpl(item, paramString, true, callback);
 #else
-    userFuncScheduleImpl(item, paramString, false, callback);
+    // run the function once the protocol loop has returned, rather than while the call is being
+    // handled, so that a slow function doesn't hold up the processing of other messages
+    struct UserFuncTask: ISRTaskQueue::Task {
+        User_Func_Lookup_Table_t* item;
+        char* paramString;
+        SparkDescriptor::FunctionResultCallback callback;
+    };
+    const auto task = new(std::nothrow) UserFuncTask();
+    if (!task || !(task->paramString = strdup(paramString))) {
+        delete task;
+        userFuncScheduleImpl(item, paramString, false, callback);
+        return 0;
+    }
+    task->item = item;
+    task->callback = callback;
+    task->func = [](ISRTaskQueue::Task* t) {
+        const auto task = static_cast<UserFuncTask*>(t);
+        userFuncScheduleImpl(task->item, task->paramString, false, task->callback);
+        free(task->paramString);
+        delete task;
+    };
+    SystemISRTaskQueue.enqueue(task);
 #endif
     return 0;
 }
@@ -847,6 +889,7 @@ void Spark_Protocol_Init(void)
         callbacks.millis = HAL_Timer_Get_Milli_Seconds;
         callbacks.set_time = system_set_time;
         callbacks.notify_client_messages_processed = clientMessagesProcessed;
+        callbacks.firmware_update_flags = Spark_Firmware_Update_Flags;
 
         SparkDescriptor descriptor;
         memset(&descriptor, 0, sizeof(descriptor));
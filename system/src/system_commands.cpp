@@ -128,6 +128,9 @@ void fetchAndExecuteCommand(system_tick_t currentTime) {
         return;
     }
 
+    // remove the files of the commands that have been executed
+    persistCommands.compact();
+
     FileQueue::QueueEntry entry;
 
     // execution is asynchronous. The CallbackHandler is invoked to deliver the asynchronous result.
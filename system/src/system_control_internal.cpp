@@ -23,6 +23,7 @@
 #include "system_network.h"
 #include "system_network_internal.h"
 #include "system_update.h"
+#include "system_diag_encoder.h"
 #include "spark_wiring_system.h"
 #include "appender.h"
 #include "debug.h"
@@ -195,16 +196,33 @@ void SystemControl::processRequest(ctrl_request* req, ControlRequestChannel* /*
         break;
     }
     case CTRL_REQUEST_DIAGNOSTIC_INFO: {
-        if (req->request_size > 0) {
+        if (req->request_size > 1) {
             // TODO: Querying a part of the diagnostic data is not supported
             setResult(req, SYSTEM_ERROR_NOT_SUPPORTED);
+        } else if (req->request_size > 0 && (req->request_data[0] & SYSTEM_FORMAT_DIAG_FLAG_DELTA)) {
+            // Compact snapshot of the values changed since the previous request
+            static DiagnosticsEncoder encoder;
+            unsigned flags = (req->request_data[0] & SYSTEM_FORMAT_DIAG_FLAG_FULL) ? DiagnosticsEncoder::FULL_SNAPSHOT : 0;
+            struct Formatter {
+                static int callback(Appender* appender, void* data) {
+                    return encoder.encode(append_instance, appender, *static_cast<const unsigned*>(data));
+                }
+            };
+            const int ret = formatReplyData(req, Formatter::callback, &flags);
+            if (ret == 0) {
+                encoder.commit();
+            }
+            setResult(req, ret);
         } else {
+            // An optional request byte contains the formatting flags (see system_format_diag_flag)
+            unsigned flags = (req->request_size > 0) ? (uint8_t)req->request_data[0] : 0;
             struct Formatter {
                 static int callback(Appender* appender, void* data) {
-                    return system_format_diag_data(nullptr, 0, 0, append_instance, appender, nullptr);
+                    return system_format_diag_data(nullptr, 0, *static_cast<const unsigned*>(data), append_instance,
+                            appender, nullptr);
                 }
             };
-            const int ret = formatReplyData(req, Formatter::callback);
+            const int ret = formatReplyData(req, Formatter::callback, &flags);
             setResult(req, ret);
         }
         break;
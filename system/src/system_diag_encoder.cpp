@@ -0,0 +1,177 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "system_diag_encoder.h"
+
+#include "system_error.h"
+
+#include <algorithm>
+
+namespace particle {
+
+namespace system {
+
+namespace {
+
+inline uint32_t zigzag(int32_t value) {
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+int getIntValue(const diag_source* src, int32_t* value) {
+    diag_source_get_cmd_data d = { sizeof(diag_source_get_cmd_data), 0 /* reserved */, value, sizeof(int32_t) };
+    return src->callback(src, DIAG_SOURCE_CMD_GET, &d);
+}
+
+} // unnamed
+
+struct DiagnosticsEncoder::Context {
+    DiagnosticsEncoder* encoder;
+    appender_fn append;
+    void* appendData;
+    uint16_t prevId;
+    bool full;
+};
+
+DiagnosticsEncoder::DiagnosticsEncoder() :
+        seq_(0),
+        sent_(false),
+        pending_(false) {
+}
+
+int DiagnosticsEncoder::encode(appender_fn append, void* appendData, unsigned flags) {
+    Context ctx = {};
+    ctx.encoder = this;
+    ctx.append = append;
+    ctx.appendData = appendData;
+    ctx.full = (flags & FULL_SNAPSHOT) || !sent_;
+    pending_ = false;
+    for (Entry& e: entries_) {
+        e.pendingState = e.state;
+        e.pendingValue = e.value;
+    }
+    const uint8_t header[] = { VERSION, uint8_t(ctx.full ? FULL_SNAPSHOT : 0), uint8_t(seq_ & 0xff), uint8_t(seq_ >> 8) };
+    if (!append(appendData, header, sizeof(header))) {
+        return SYSTEM_ERROR_TOO_LARGE;
+    }
+    const int ret = diag_enum_sources(encodeSourceCallback, nullptr, &ctx, nullptr);
+    if (ret != SYSTEM_ERROR_NONE) {
+        return ret;
+    }
+    pending_ = true;
+    return SYSTEM_ERROR_NONE;
+}
+
+void DiagnosticsEncoder::commit() {
+    if (!pending_) {
+        return;
+    }
+    for (Entry& e: entries_) {
+        e.state = e.pendingState;
+        e.value = e.pendingValue;
+    }
+    ++seq_;
+    sent_ = true;
+    pending_ = false;
+}
+
+void DiagnosticsEncoder::reset() {
+    entries_.clear();
+    seq_ = 0;
+    sent_ = false;
+    pending_ = false;
+}
+
+int DiagnosticsEncoder::encodeSource(Context* ctx, const diag_source* src) {
+    if (src->type != DIAG_TYPE_INT) {
+        return SYSTEM_ERROR_NOT_SUPPORTED;
+    }
+    int32_t val = 0;
+    const int ret = getIntValue(src, &val);
+    Entry* e = entry(src->id);
+    if (!e) {
+        return SYSTEM_ERROR_NO_MEMORY;
+    }
+    RecordType type = RECORD_ERROR;
+    int32_t num = ret;
+    if (ret == SYSTEM_ERROR_NONE) {
+        if (!ctx->full && e->state == SENT_VALUE && e->value == val) {
+            return SYSTEM_ERROR_NONE; // Unchanged
+        }
+        if (!ctx->full && e->state == SENT_VALUE) {
+            type = RECORD_DELTA;
+            num = (int32_t)((uint32_t)val - (uint32_t)e->value);
+        } else {
+            type = RECORD_VALUE;
+            num = val;
+        }
+        e->pendingState = SENT_VALUE;
+        e->pendingValue = val;
+    } else {
+        if (!ctx->full && e->state == SENT_ERROR && e->value == ret) {
+            return SYSTEM_ERROR_NONE;
+        }
+        e->pendingState = SENT_ERROR;
+        e->pendingValue = ret;
+    }
+    if (!writeVarint(ctx, ((uint32_t)(src->id - ctx->prevId) << 2) | type) || !writeVarint(ctx, zigzag(num))) {
+        return SYSTEM_ERROR_TOO_LARGE;
+    }
+    ctx->prevId = src->id;
+    return SYSTEM_ERROR_NONE;
+}
+
+DiagnosticsEncoder::Entry* DiagnosticsEncoder::entry(uint16_t id) {
+    // The sources are enumerated in the order of their IDs
+    const auto it = std::lower_bound(entries_.begin(), entries_.end(), id, [](const Entry& e, uint16_t id) {
+        return (e.id < id);
+    });
+    const int index = std::distance(entries_.begin(), it);
+    if (it != entries_.end() && it->id == id) {
+        return &entries_[index];
+    }
+    Entry e = {};
+    e.id = id;
+    e.state = UNSENT;
+    e.pendingState = UNSENT;
+    if (!entries_.insert(index, e)) {
+        return nullptr;
+    }
+    return &entries_[index];
+}
+
+int DiagnosticsEncoder::encodeSourceCallback(const diag_source* src, void* data) {
+    const auto ctx = static_cast<Context*>(data);
+    return ctx->encoder->encodeSource(ctx, src);
+}
+
+bool DiagnosticsEncoder::writeVarint(Context* ctx, uint32_t value) {
+    uint8_t buf[5];
+    size_t n = 0;
+    do {
+        buf[n] = value & 0x7f;
+        value >>= 7;
+        if (value) {
+            buf[n] |= 0x80;
+        }
+        ++n;
+    } while (value);
+    return ctx->append(ctx->appendData, buf, n);
+}
+
+} // particle::system
+
+} // particle
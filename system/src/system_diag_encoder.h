@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "diagnostics.h"
+#include "appender.h"
+
+#include "spark_wiring_vector.h"
+
+namespace particle {
+
+namespace system {
+
+/**
+ * Encodes the values of the registered diagnostic data sources into compact binary snapshots.
+ *
+ * The sources are encoded as they are enumerated, directly into the appender. A snapshot contains
+ * only the values that have changed since the last committed snapshot, unless a full snapshot is
+ * requested or no snapshot has been committed yet. A snapshot is committed by calling commit()
+ * once it has been delivered; until then, encode() can be called again, e.g. to measure the size
+ * of the snapshot before formatting it into a buffer.
+ *
+ * Snapshot format (varints are unsigned LEB128, signed numbers are zigzag-encoded):
+ *
+ *   uint8    version (`VERSION`)
+ *   uint8    flags (`FULL_SNAPSHOT`)
+ *   uint16   sequence number of the snapshot (little-endian)
+ *   records  one per changed source, in the order of the source IDs:
+ *            varint  (source ID - ID of the previous record) << 2 | record type
+ *            varint  signed number
+ *
+ * Record types:
+ *   `RECORD_DELTA`    difference from the value sent previously
+ *   `RECORD_VALUE`    the value itself
+ *   `RECORD_ERROR`    error code returned by the source
+ *
+ * The receiver detects a lost snapshot by a gap in the sequence numbers, and should then request
+ * a full snapshot.
+ */
+class DiagnosticsEncoder {
+public:
+    enum Flag {
+        FULL_SNAPSHOT = 0x01 // Include all sources
+    };
+
+    enum RecordType {
+        RECORD_DELTA = 0,
+        RECORD_VALUE = 1,
+        RECORD_ERROR = 2
+    };
+
+    static const uint8_t VERSION = 1;
+
+    DiagnosticsEncoder();
+
+    int encode(appender_fn append, void* appendData, unsigned flags = 0);
+    void commit();
+    void reset();
+
+    uint16_t sequence() const {
+        return seq_;
+    }
+
+private:
+    enum State {
+        UNSENT,
+        SENT_VALUE,
+        SENT_ERROR
+    };
+
+    struct Entry {
+        uint16_t id;
+        uint8_t state;
+        uint8_t pendingState;
+        int32_t value;
+        int32_t pendingValue;
+    };
+
+    struct Context;
+
+    spark::Vector<Entry> entries_;
+    uint16_t seq_;
+    bool sent_;
+    bool pending_;
+
+    int encodeSource(Context* ctx, const diag_source* src);
+    Entry* entry(uint16_t id);
+
+    static int encodeSourceCallback(const diag_source* src, void* data);
+    static bool writeVarint(Context* ctx, uint32_t value);
+};
+
+} // particle::system
+
+} // particle
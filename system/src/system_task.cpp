@@ -39,7 +39,8 @@
 #include "service_debug.h"
 #include "cellular_hal.h"
 #include "system_power.h"
-#include "simple_pool_allocator.h"
+#include "slab_pool_allocator.h"
+#include "spark_wiring_diagnostics.h"
 
 #include "spark_wiring_network.h"
 #include "spark_wiring_constants.h"
@@ -653,7 +654,54 @@ void cancel_connection()
 namespace {
 
 // Memory pool for small and short-lived allocations
-SimpleAllocedPool g_memPool(512);
+SlabAllocedPool g_memPool(512);
+
+class PoolDiagnosticData: public AbstractIntegerDiagnosticData {
+public:
+    typedef IntType(*func_t)(const SlabPoolStats&);
+    PoolDiagnosticData(uint16_t id, const char* name, func_t f) :
+            AbstractIntegerDiagnosticData(id, name),
+            f_(f) {
+    }
+
+    virtual int get(IntType& val) override {
+        SlabPoolStats stats;
+        ATOMIC_BLOCK() {
+            stats = g_memPool.stats();
+        }
+        val = f_(stats);
+        return SYSTEM_ERROR_NONE;
+    }
+
+private:
+    func_t f_;
+};
+
+PoolDiagnosticData g_poolUsedDiagData(DIAG_ID_SYSTEM_POOL_USED, DIAG_NAME_SYSTEM_POOL_USED,
+    [](const SlabPoolStats& stats) -> PoolDiagnosticData::IntType {
+        return stats.used;
+    }
+);
+
+PoolDiagnosticData g_poolPeakDiagData(DIAG_ID_SYSTEM_POOL_PEAK, DIAG_NAME_SYSTEM_POOL_PEAK,
+    [](const SlabPoolStats& stats) -> PoolDiagnosticData::IntType {
+        return stats.peakUsed;
+    }
+);
+
+// Bytes taken from the untouched part of the pool that hold no requested data: block headers, rounding
+// up to the size classes, and freed blocks kept for reuse by their size class
+PoolDiagnosticData g_poolFragmentedDiagData(DIAG_ID_SYSTEM_POOL_FRAGMENTED, DIAG_NAME_SYSTEM_POOL_FRAGMENTED,
+    [](const SlabPoolStats& stats) -> PoolDiagnosticData::IntType {
+        return stats.cached + stats.used - stats.requested;
+    }
+);
+
+PoolDiagnosticData g_poolFailuresDiagData(DIAG_ID_SYSTEM_POOL_FAILURES, DIAG_NAME_SYSTEM_POOL_FAILURES,
+    [](const SlabPoolStats& stats) -> PoolDiagnosticData::IntType {
+        return stats.failures;
+    }
+);
 
 } // namespace
 
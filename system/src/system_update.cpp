@@ -43,6 +43,11 @@
 #include "system_network_internal.h"
 #include "bytes2hexbuf.h"
 #include "system_threading.h"
+#include "system_error.h"
+#include "miniz.h"
+#include "delta_patch.h"
+#include "system_diag_encoder.h"
+#include <memory>
 #if HAL_PLATFORM_DCT
 #include "dct.h"
 #endif // HAL_PLATFORM_DCT
@@ -277,8 +282,189 @@ void set_flag(void* flag)
 	*p = true;
 }
 
+namespace {
+
+/**
+ * Applies a patch to the current module as its chunks are saved, writing the patched image to the OTA region.
+ * The chunks have to be written in order.
+ */
+class OtaPatcher: public particle::DeltaPatch::Handler {
+public:
+    OtaPatcher(uint32_t address, uint32_t length) :
+            patch_(this, HAL_Core_Compute_CRC32),
+            address_(address),
+            length_(length),
+            module_function_(0),
+            module_index_(0) {
+    }
+
+    int write(const uint8_t* data, size_t length) {
+        return patch_.write(data, length);
+    }
+
+    /**
+     * Returns {@code true} if the whole image has been patched.
+     */
+    bool isDone() const {
+        return patch_.isDone();
+    }
+
+    int openSource(const particle::DeltaPatch::Header& header) override {
+        if (header.targetSize != length_) {
+            return SYSTEM_ERROR_BAD_DATA;
+        }
+        module_function_ = header.moduleFunction;
+        module_index_ = header.moduleIndex;
+        return 0;
+    }
+
+    int readSource(size_t offset, uint8_t* data, size_t size) override {
+        return HAL_FLASH_Read_Module(module_function_, module_index_, offset, data, size, nullptr);
+    }
+
+    int writeTarget(size_t offset, const uint8_t* data, size_t size) override {
+        return HAL_FLASH_Update(data, address_ + offset, size, nullptr);
+    }
+
+private:
+    particle::DeltaPatch patch_;
+    uint32_t address_;
+    uint32_t length_;
+    uint8_t module_function_;
+    uint8_t module_index_;
+};
+
+/**
+ * Inflates a compressed firmware image as its chunks are saved, writing the output to the OTA region.
+ * The chunks have to be written in order. The window is the inflation dictionary, so the image has to be
+ * compressed with a dictionary of at most {@code TINFL_LZ_DICT_SIZE} bytes. The output of a compressed
+ * patch is passed to the patcher instead.
+ */
+class OtaInflater {
+public:
+    OtaInflater(uint32_t address, uint32_t length, OtaPatcher* patcher = nullptr) :
+            patcher_(patcher),
+            address_(address),
+            end_(address + length),
+            offset_(0),
+            status_(TINFL_STATUS_NEEDS_MORE_INPUT) {
+        tinfl_init(&inflator_);
+    }
+
+    int write(const uint8_t* data, size_t length) {
+        if (status_ < TINFL_STATUS_DONE) {
+            return SYSTEM_ERROR_BAD_DATA;
+        }
+        while (status_ != TINFL_STATUS_DONE) {
+            size_t in_length = length;
+            size_t out_length = sizeof(window_) - offset_;
+            status_ = tinfl_decompress(&inflator_, data, &in_length, window_, window_ + offset_, &out_length, TINFL_FLAG_HAS_MORE_INPUT);
+            if (status_ < TINFL_STATUS_DONE) {
+                return SYSTEM_ERROR_BAD_DATA;
+            }
+            data += in_length;
+            length -= in_length;
+            if (out_length) {
+                if (!patcher_ && out_length > end_ - address_) {
+                    status_ = TINFL_STATUS_FAILED;
+                    return SYSTEM_ERROR_TOO_LARGE;
+                }
+                const int result = patcher_ ? patcher_->write(window_ + offset_, out_length) :
+                        HAL_FLASH_Update(window_ + offset_, address_, out_length, nullptr);
+                if (result) {
+                    status_ = TINFL_STATUS_FAILED;
+                    return result;
+                }
+                address_ += out_length;
+                offset_ = (offset_ + out_length) & (sizeof(window_) - 1);
+            }
+            if (status_ == TINFL_STATUS_NEEDS_MORE_INPUT) {
+                break; // All input consumed
+            }
+            // Otherwise the window is full and is flushed before inflating more
+        }
+        return 0;
+    }
+
+    /**
+     * Returns {@code true} if the whole stream has been inflated to the expected length.
+     */
+    bool isDone() const {
+        return status_ == TINFL_STATUS_DONE && (patcher_ || address_ == end_);
+    }
+
+private:
+    OtaPatcher* patcher_;
+    tinfl_decompressor inflator_;
+    uint8_t window_[TINFL_LZ_DICT_SIZE];
+    uint32_t address_;
+    uint32_t end_;
+    size_t offset_;
+    tinfl_status status_;
+};
+
+static_assert((TINFL_LZ_DICT_SIZE & (TINFL_LZ_DICT_SIZE - 1)) == 0, "the inflation window wraps around");
+
+// The inflater and the patcher of the current update, if any
+std::unique_ptr<OtaInflater> ota_inflater;
+std::unique_ptr<OtaPatcher> ota_patcher;
+
+/**
+ * Allocates the inflater and the patcher needed by an update, keeping those already allocated for it.
+ */
+int allocate_ota_state(const FileTransfer::Descriptor& file)
+{
+    if (!(file.flags & FileTransfer::Flag::DELTA)) {
+        ota_patcher.reset();
+    } else if (!ota_patcher) {
+        ota_patcher.reset(new (std::nothrow) OtaPatcher(file.file_address, file.storage_length));
+        if (!ota_patcher) {
+            return SYSTEM_ERROR_NO_MEMORY;
+        }
+    }
+    if (!(file.flags & FileTransfer::Flag::COMPRESSED)) {
+        ota_inflater.reset();
+    } else if (!ota_inflater) {
+        ota_inflater.reset(new (std::nothrow) OtaInflater(file.file_address, file.storage_length, ota_patcher.get()));
+        if (!ota_inflater) {
+            ota_patcher.reset();
+            return SYSTEM_ERROR_NO_MEMORY;
+        }
+    }
+    return 0;
+}
+
+} // namespace
+
+int Spark_Firmware_Update_Flags(void* reserved)
+{
+    int flags = 0;
+    // the inflater is by far the largest allocation of an update
+    std::unique_ptr<OtaInflater> inflater(new (std::nothrow) OtaInflater(0, 0));
+    if (inflater || ota_inflater) {
+        flags |= FileTransfer::Flag::COMPRESSED;
+    }
+#if HAL_PLATFORM_FLASH_READ_MODULE
+    // patches are applied against the current module, which has to be readable
+    flags |= FileTransfer::Flag::DELTA;
+#endif // HAL_PLATFORM_FLASH_READ_MODULE
+    return flags;
+}
+
 int Spark_Prepare_For_Firmware_Update(FileTransfer::Descriptor& file, uint32_t flags, void* reserved)
 {
+    const bool compressed = file.flags & FileTransfer::Flag::COMPRESSED;
+    const bool delta = file.flags & FileTransfer::Flag::DELTA;
+    if ((compressed || delta) && (file.store != FileTransfer::Store::FIRMWARE || file.storage_length > HAL_OTA_FlashLength()))
+    {
+        return 1;
+    }
+#if !HAL_PLATFORM_FLASH_READ_MODULE
+    if (delta)
+    {
+        return 1; // the current module cannot be read to apply the patch
+    }
+#endif // !HAL_PLATFORM_FLASH_READ_MODULE
     if (file.store==FileTransfer::Store::FIRMWARE)
     {
         // address is relative to the OTA region. Normally will be 0.
@@ -293,9 +479,18 @@ int Spark_Prepare_For_Firmware_Update(FileTransfer::Descriptor& file, uint32_t f
     int result = 0;
     if (System.updatesEnabled() || System.updatesForced()) {		// application event is handled asynchronously
         if (flags & 1) {
-            // only check address
+            // only check address, and allocate what the update needs so that a lack of memory is reported
+            // before the update is accepted
+            ota_inflater.reset();
+            ota_patcher.reset();
+            result = allocate_ota_state(file);
 		}
 		else {
+            result = allocate_ota_state(file);
+            if (result) {
+                return result;
+            }
+            const uint32_t length = (compressed || delta) ? file.storage_length : file.file_length;
             system_set_flag(SYSTEM_FLAG_OTA_UPDATE_PENDING, 0, nullptr);
             RGB.control(true);
             // Get base color used for the update process indication
@@ -304,7 +499,7 @@ int Spark_Prepare_For_Firmware_Update(FileTransfer::Descriptor& file, uint32_t f
             SPARK_FLASH_UPDATE = 1;
             TimingFlashUpdateTimeout = 0;
             system_notify_event(firmware_update, firmware_update_begin, &file);
-            HAL_FLASH_Begin(file.file_address, file.file_length, NULL);
+            HAL_FLASH_Begin(file.file_address, length, NULL);
         }
     }
     else {
@@ -376,7 +571,13 @@ int Spark_Finish_Firmware_Update(FileTransfer::Descriptor& file, uint32_t flags,
 
     hal_module_t mod;
 
+    // a compressed image or a patch is complete once it has been fully inflated or applied
+    const bool complete = (!ota_inflater || ota_inflater->isDone()) && (!ota_patcher || ota_patcher->isDone());
+
     if ((flags & (UpdateFlag::VALIDATE_ONLY | UpdateFlag::SUCCESS)) == (UpdateFlag::VALIDATE_ONLY | UpdateFlag::SUCCESS)) {
+        if (!complete) {
+            return 1;
+        }
         res = HAL_FLASH_OTA_Validate(module ? (hal_module_t*)module : &mod, true, (module_validation_flags_t)(MODULE_VALIDATION_INTEGRITY | MODULE_VALIDATION_DEPENDENCIES_FULL), NULL);
         return res;
     }
@@ -384,7 +585,7 @@ int Spark_Finish_Firmware_Update(FileTransfer::Descriptor& file, uint32_t flags,
     if (flags & UpdateFlag::SUCCESS) {    // update successful
         if (file.store==FileTransfer::Store::FIRMWARE)
         {
-            hal_update_complete_t result = HAL_FLASH_End(module ? (hal_module_t*)module : &mod);
+            hal_update_complete_t result = complete ? HAL_FLASH_End(module ? (hal_module_t*)module : &mod) : HAL_UPDATE_ERROR;
             system_notify_event(firmware_update, result<=HAL_UPDATE_ERROR ? firmware_update_complete : firmware_update_failed, &file);
             res = (result <= HAL_UPDATE_ERROR);
 
@@ -400,6 +601,8 @@ int Spark_Finish_Firmware_Update(FileTransfer::Descriptor& file, uint32_t flags,
     {
         system_notify_event(firmware_update, firmware_update_failed, &file);
     }
+    ota_inflater.reset();
+    ota_patcher.reset();
 
     RGB.control(false);
     return res;
@@ -412,7 +615,13 @@ int Spark_Save_Firmware_Chunk(FileTransfer::Descriptor& file, const uint8_t* chu
     system_notify_event(firmware_update, firmware_update_progress, &file);
     if (file.store==FileTransfer::Store::FIRMWARE)
     {
-        result = HAL_FLASH_Update(chunk, file.chunk_address, file.chunk_size, NULL);
+        if (ota_inflater) {
+            result = ota_inflater->write(chunk, file.chunk_size);
+        } else if (ota_patcher) {
+            result = ota_patcher->write(chunk, file.chunk_size);
+        } else {
+            result = HAL_FLASH_Update(chunk, file.chunk_address, file.chunk_size, NULL);
+        }
         LED_Toggle(LED_RGB);
     }
     return result;
@@ -866,7 +1075,21 @@ public:
 
 int system_format_diag_data(const uint16_t* id, size_t count, unsigned flags, appender_fn append, void* append_data,
         void* reserved) {
-	if (flags & 1) {
+	if (flags & SYSTEM_FORMAT_DIAG_FLAG_DELTA) {
+		if (id) {
+			return SYSTEM_ERROR_NOT_SUPPORTED;
+		}
+		static particle::system::DiagnosticsEncoder encoder;
+		const int ret = encoder.encode(append, append_data, (flags & SYSTEM_FORMAT_DIAG_FLAG_FULL) ?
+				particle::system::DiagnosticsEncoder::FULL_SNAPSHOT : 0);
+		// the data is usually formatted more than once, e.g. to get its size first, so the
+		// snapshot only becomes the base of the next one when the caller says so
+		if (ret == 0 && (flags & SYSTEM_FORMAT_DIAG_FLAG_COMMIT)) {
+			encoder.commit();
+		}
+		return ret;
+	}
+	else if (flags & SYSTEM_FORMAT_DIAG_FLAG_BINARY) {
 		AppendData data(append, append_data);
 		BinaryDiagnosticsFormatter fmt(data);
 	    return fmt.format(id, count, flags);
@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "append_list.h"
+
+#include <catch2/catch.hpp>
+
+#include <string>
+
+namespace {
+
+const size_t KEY_LENGTH = 12;
+
+struct Item {
+    char key[KEY_LENGTH + 1];
+    int value;
+};
+
+const char* item_key(const Item& item) {
+    return item.key;
+}
+
+Item make_item(const std::string& key, int value) {
+    Item item = {};
+    strncpy(item.key, key.c_str(), KEY_LENGTH);
+    item.value = value;
+    return item;
+}
+
+typedef keyed_append_list<Item, item_key, KEY_LENGTH> ItemList;
+
+} // namespace
+
+TEST_CASE("keyed_append_list") {
+    ItemList list;
+
+    SECTION("an empty list finds nothing") {
+        CHECK(list.size() == 0);
+        CHECK(list.find("a") == nullptr);
+    }
+
+    SECTION("items are found by key after the index has been resized") {
+        for (int i = 0; i < 200; i++) {
+            REQUIRE(list.add(make_item("key" + std::to_string(i), i)) != nullptr);
+        }
+        CHECK(list.size() == 200);
+        for (int i = 0; i < 200; i++) {
+            const Item* item = list.find(("key" + std::to_string(i)).c_str());
+            REQUIRE(item != nullptr);
+            CHECK(item->value == i);
+        }
+        CHECK(list.find("key200") == nullptr);
+        // items keep their insertion order
+        CHECK(list[0].value == 0);
+        CHECK(list[199].value == 199);
+    }
+
+    SECTION("keys are compared up to the maximum key length") {
+        REQUIRE(list.add(make_item("abcdefghijkl", 1)) != nullptr);
+        const Item* item = list.find("abcdefghijklmnop");
+        REQUIRE(item != nullptr);
+        CHECK(item->value == 1);
+    }
+
+    SECTION("the most recently added item can be removed") {
+        REQUIRE(list.add(make_item("a", 1)) != nullptr);
+        REQUIRE(list.add(make_item("b", 2)) != nullptr);
+        list.removeLast();
+        CHECK(list.size() == 1);
+        CHECK(list.find("b") == nullptr);
+        REQUIRE(list.find("a") != nullptr);
+        REQUIRE(list.add(make_item("b", 3)) != nullptr);
+        CHECK(list.find("b")->value == 3);
+    }
+
+    SECTION("no more than 65535 items can be added") {
+        for (int i = 0; i < 65535; i++) {
+            REQUIRE(list.add(make_item(std::to_string(i), i)) != nullptr);
+        }
+        CHECK(list.add(make_item("overflow", 0)) == nullptr);
+        CHECK(list.size() == 65535);
+        const Item* item = list.find("65534");
+        REQUIRE(item != nullptr);
+        CHECK(item->value == 65534);
+    }
+}
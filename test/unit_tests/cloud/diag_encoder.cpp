@@ -0,0 +1,162 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <map>
+#include <vector>
+
+#include <catch2/catch.hpp>
+
+#include "system_diag_encoder.h"
+#include "system_error.h"
+
+using particle::system::DiagnosticsEncoder;
+
+namespace
+{
+
+std::map<uint16_t, int32_t> values;
+std::map<uint16_t, int> errors;
+
+int getValue(const diag_source* src, int cmd, void* data)
+{
+    if (errors.count(src->id))
+    {
+        return errors[src->id];
+    }
+    const auto d = static_cast<diag_source_get_cmd_data*>(data);
+    *static_cast<int32_t*>(d->data) = values[src->id];
+    d->data_size = sizeof(int32_t);
+    return 0;
+}
+
+diag_source sources[] = {
+    { sizeof(diag_source), 0, 1, DIAG_TYPE_INT, "a", nullptr, getValue },
+    { sizeof(diag_source), 0, 2, DIAG_TYPE_INT, "b", nullptr, getValue },
+    { sizeof(diag_source), 0, 300, DIAG_TYPE_INT, "c", nullptr, getValue }
+};
+
+void startDiagnostics()
+{
+    static bool started = false;
+    if (!started)
+    {
+        for (const auto& src: sources)
+        {
+            REQUIRE(diag_register_source(&src, nullptr) == 0);
+        }
+        REQUIRE(diag_command(DIAG_SERVICE_CMD_START, nullptr, nullptr) == 0);
+        started = true;
+    }
+}
+
+bool append(void* data, const uint8_t* buf, size_t size)
+{
+    const auto v = static_cast<std::vector<uint8_t>*>(data);
+    v->insert(v->end(), buf, buf + size);
+    return true;
+}
+
+bool appendNothing(void* data, const uint8_t* buf, size_t size)
+{
+    return false;
+}
+
+std::vector<uint8_t> encode(DiagnosticsEncoder& encoder, unsigned flags = 0)
+{
+    std::vector<uint8_t> data;
+    REQUIRE(encoder.encode(append, &data, flags) == 0);
+    return data;
+}
+
+} // namespace
+
+TEST_CASE("DiagnosticsEncoder", "[DiagnosticsEncoder]")
+{
+    startDiagnostics();
+    values = { { 1, 10 }, { 2, -1 }, { 300, 100000 } };
+    errors.clear();
+    DiagnosticsEncoder encoder;
+
+    SECTION("The first snapshot contains all values")
+    {
+        CHECK(encode(encoder) == std::vector<uint8_t>({
+            0x01, 0x01, 0x00, 0x00,             // version, full snapshot, sequence number
+            0x05, 0x14,                         // id 1, value 10
+            0x05, 0x01,                         // id 2, value -1
+            0xa9, 0x09, 0xc0, 0x9a, 0x0c        // id 300, value 100000
+        }));
+    }
+
+    SECTION("Unchanged values are suppressed and changed values are encoded as deltas")
+    {
+        encode(encoder);
+        encoder.commit();
+        values[2] = 1;
+        CHECK(encode(encoder) == std::vector<uint8_t>({
+            0x01, 0x00, 0x01, 0x00,
+            0x08, 0x04                          // id 2, delta +2
+        }));
+        encoder.commit();
+        CHECK(encode(encoder) == std::vector<uint8_t>({ 0x01, 0x00, 0x02, 0x00 }));
+    }
+
+    SECTION("A snapshot is repeated until it is committed")
+    {
+        encode(encoder);
+        encoder.commit();
+        values[1] = 11;
+        const auto data = encode(encoder);
+        CHECK(encode(encoder) == data);
+        encoder.commit();
+        CHECK(encode(encoder).size() == 4);
+    }
+
+    SECTION("A snapshot that can't be encoded is not committed")
+    {
+        CHECK(encoder.encode(appendNothing, nullptr) == SYSTEM_ERROR_TOO_LARGE);
+        encoder.commit();
+        CHECK(encoder.sequence() == 0);
+        CHECK(encode(encoder)[1] == DiagnosticsEncoder::FULL_SNAPSHOT);
+    }
+
+    SECTION("Errors are reported once, and the next value is sent as is")
+    {
+        encode(encoder);
+        encoder.commit();
+        errors[1] = SYSTEM_ERROR_BUSY;
+        const auto data = encode(encoder);
+        REQUIRE(data.size() > 5);
+        CHECK(data[4] == 0x06);                 // id 1, error
+        encoder.commit();
+        CHECK(encode(encoder).size() == 4);
+        encoder.commit();
+        errors.clear();
+        CHECK(encode(encoder) == std::vector<uint8_t>({
+            0x01, 0x00, 0x03, 0x00,
+            0x05, 0x14                          // id 1, value 10
+        }));
+    }
+
+    SECTION("A full snapshot can be requested")
+    {
+        encode(encoder);
+        encoder.commit();
+        const auto data = encode(encoder, DiagnosticsEncoder::FULL_SNAPSHOT);
+        CHECK(data.size() == 13);
+        CHECK(data[1] == DiagnosticsEncoder::FULL_SNAPSHOT);
+    }
+}
@@ -0,0 +1,633 @@
+/**
+ ******************************************************************************
+  Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+
+#include "chunked_transfer.h"
+#include "coap.h"
+#include "forward_message_channel.h"
+#include "system_error.h"
+
+#include <catch2/catch.hpp>
+
+#include <random>
+#include <vector>
+
+using namespace particle::protocol;
+
+namespace {
+
+const uint8_t WINDOWED_FLAGS = UpdateBeginFlag::FAST_OTA | UpdateBeginFlag::WINDOWED_OTA;
+const uint16_t Simulation_CHUNK_SIZE = 256;
+
+uint32_t crc32(const uint8_t* data, size_t length)
+{
+	uint32_t crc = 0xFFFFFFFF;
+	while (length--)
+	{
+		crc ^= *data++;
+		for (int i = 0; i < 8; i++)
+			crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+	}
+	return ~crc;
+}
+
+class Storage : public ChunkedTransfer::Callbacks
+{
+public:
+	std::vector<uint8_t> image;
+	std::vector<chunk_index_t> saved;
+	uint32_t flags = 0;
+	uint32_t storage_length = 0;
+	bool finished = false;
+	system_tick_t now = 0;
+	int dry_run_result = 0;
+
+	int prepare_for_firmware_update(FileTransfer::Descriptor& file, uint32_t flags, void*) override
+	{
+		if (flags & 1)
+		{
+			return dry_run_result;
+		}
+		else
+		{
+			image.assign(file.file_length, 0);
+			this->flags = file.flags;
+			storage_length = file.storage_length;
+		}
+		return 0;
+	}
+
+	int save_firmware_chunk(FileTransfer::Descriptor& file, const unsigned char* chunk, void*) override
+	{
+		const size_t offset = file.chunk_address - file.file_address;
+		saved.push_back(offset / Simulation_CHUNK_SIZE);
+		const size_t length = std::min(size_t(file.chunk_size), image.size() - offset);
+		memcpy(image.data() + offset, chunk, length);
+		return 0;
+	}
+
+	int finish_firmware_update(FileTransfer::Descriptor& file, uint32_t flags, void*) override
+	{
+		if (flags == UpdateFlag::SUCCESS)
+			finished = true;
+		return 0;
+	}
+
+	uint32_t calculate_crc(const unsigned char* buf, uint32_t length) override
+	{
+		return crc32(buf, length);
+	}
+
+	system_tick_t millis() override
+	{
+		return now;
+	}
+};
+
+/**
+ * Records the messages sent by the device. Received and created messages share one buffer, as they do
+ * with the DTLS channel, since the chunk bitmap is kept at the end of that buffer.
+ */
+class DeviceChannel : public MessageChannel
+{
+public:
+	uint8_t buffer[1024];
+	uint8_t response_buffer[256];
+	std::vector<std::vector<uint8_t>> sent;
+	ProtocolError create_result = NO_ERROR;
+
+	bool is_unreliable() override { return true; }
+	ProtocolError establish(uint32_t& flags, uint32_t app_state_crc) override { return NO_ERROR; }
+	ProtocolError notify_established() override { return NO_ERROR; }
+	void notify_client_messages_processed() override {}
+	ProtocolError receive(Message& message) override { return NO_ERROR; }
+	ProtocolError command(Command cmd, void* arg) override { return NO_ERROR; }
+
+	ProtocolError create(Message& message, size_t minimum_size) override
+	{
+		message.set_buffer(buffer, sizeof(buffer));
+		return create_result;
+	}
+
+	ProtocolError response(Message& original, Message& response, size_t required) override
+	{
+		response.set_buffer(response_buffer, sizeof(response_buffer));
+		return NO_ERROR;
+	}
+
+	ProtocolError send(Message& message) override
+	{
+		sent.push_back(std::vector<uint8_t>(message.buf(), message.buf() + message.length()));
+		return NO_ERROR;
+	}
+};
+
+/**
+ * Drops non-confirmable messages sent by the device. Confirmable messages are retransmitted by
+ * the CoAP layer, so they are assumed to get through.
+ */
+class LossyChannel : public ForwardMessageChannel
+{
+	std::mt19937& rng;
+	std::bernoulli_distribution& lost;
+
+public:
+	LossyChannel(MessageChannel& channel, std::mt19937& rng, std::bernoulli_distribution& lost) :
+			ForwardMessageChannel(channel), rng(rng), lost(lost)
+	{
+	}
+
+	ProtocolError send(Message& message) override
+	{
+		if (message.get_type() == CoAPType::NON && lost(rng))
+			return NO_ERROR;
+		return ForwardMessageChannel::send(message);
+	}
+};
+
+bool has_path(const CoAPReader& reader, char path)
+{
+	const uint8_t* data = nullptr;
+	size_t length = 0;
+	return reader.find_option(CoAPOption::URI_PATH, &data, &length) && length == 1 && data[0] == path;
+}
+
+/**
+ * Plays the server side of an update over a link that loses chunks and the device's
+ * non-confirmable messages.
+ */
+struct Simulation
+{
+	static const uint16_t CHUNK_SIZE = Simulation_CHUNK_SIZE;
+
+	std::mt19937 rng;
+	std::bernoulli_distribution lost;
+	Storage storage;
+	DeviceChannel device;
+	LossyChannel channel;
+	ChunkedTransfer transfer;
+	std::vector<uint8_t> image;
+	chunk_index_t chunks;
+	uint16_t window;
+	unsigned chunks_sent;
+	unsigned round_trips;
+	uint8_t extra_flags;
+	uint8_t begin_code;
+
+	Simulation(chunk_index_t chunks, double loss, unsigned seed) :
+			rng(seed), lost(loss), channel(device, rng, lost), image(chunks * CHUNK_SIZE),
+			chunks(chunks), window(0), chunks_sent(0), round_trips(0), extra_flags(0), begin_code(0)
+	{
+		transfer.init(&storage);
+		for (size_t i = 0; i < image.size(); i++)
+			image[i] = uint8_t(rng());
+	}
+
+	ProtocolError deliver(ProtocolError (ChunkedTransfer::*handler)(token_t, Message&, MessageChannel&),
+			const uint8_t* data, size_t length)
+	{
+		memcpy(device.buffer, data, length);
+		Message message(device.buffer, sizeof(device.buffer), length);
+		return (transfer.*handler)(0x42, message, channel);
+	}
+
+	/**
+	 * Sends UpdateBegin and returns the flags accepted in UpdateReady.
+	 */
+	int begin(uint8_t flags, uint32_t storage_length = 0)
+	{
+		const size_t length = image.size();
+		const uint8_t msg[] = { 0x41, 0x02, 0x00, 0x01, 0x42, 0xb1, 'u', 0xff, flags,
+				uint8_t(CHUNK_SIZE >> 8), uint8_t(CHUNK_SIZE & 0xFF),
+				uint8_t(length >> 24), uint8_t(length >> 16), uint8_t(length >> 8), uint8_t(length),
+				FileTransfer::Store::FIRMWARE, 0, 0, 0, 0,
+				uint8_t(storage_length >> 24), uint8_t(storage_length >> 16), uint8_t(storage_length >> 8), uint8_t(storage_length) };
+		// the storage length is only sent for compressed files and patches
+		const size_t size = (flags & (UpdateBeginFlag::COMPRESSED | UpdateBeginFlag::DELTA)) ? sizeof(msg) : sizeof(msg) - 4;
+		REQUIRE(deliver(&ChunkedTransfer::handle_update_begin, msg, size) == NO_ERROR);
+		int accepted = -1;
+		for (const auto& m : take_sent())
+		{
+			CoAPReader reader(m.data(), m.size());
+			if (reader.type() == CoAPType::ACK)
+				begin_code = reader.code();
+			if (reader.type() == CoAPType::CON && reader.code() == 0x44 && reader.payload_length())
+			{
+				accepted = reader.payload()[0];
+				if (reader.payload_length() >= 3)
+					window = reader.payload()[1] << 8 | reader.payload()[2];
+			}
+		}
+		return accepted;
+	}
+
+	void send_chunk(chunk_index_t index)
+	{
+		chunks_sent++;
+		storage.now += 1;
+		if (lost(rng))
+			return;
+		const uint8_t* data = image.data() + index * CHUNK_SIZE;
+		const uint32_t crc = crc32(data, CHUNK_SIZE);
+		const uint8_t crc_value[] = { uint8_t(crc >> 24), uint8_t(crc >> 16), uint8_t(crc >> 8), uint8_t(crc) };
+		const uint8_t index_value[] = { uint8_t(index >> 8), uint8_t(index & 0xFF) };
+		const uint8_t token = 0x42;
+		uint8_t msg[512];
+		CoAPWriter writer(msg, sizeof(msg));
+		writer.header(CoAPType::NON, CoAPCode::POST, 0, &token, 1);
+		writer.option(CoAPOption::URI_PATH, "c");
+		writer.option(CoAPOption::URI_QUERY, crc_value, sizeof(crc_value));
+		writer.option(CoAPOption::URI_QUERY, index_value, sizeof(index_value));
+		writer.payload(data, CHUNK_SIZE);
+		REQUIRE_FALSE(writer.overflow());
+		REQUIRE(deliver(&ChunkedTransfer::handle_chunk, msg, writer.length()) == NO_ERROR);
+	}
+
+	/**
+	 * Sends UpdateDone and returns the chunks the device reports missing.
+	 */
+	std::vector<chunk_index_t> update_done(int* code)
+	{
+		round_trips++;
+		const uint8_t msg[] = { 0x41, 0x03, 0x00, 0x02, 0x42, 0xb1, 'u' };
+		REQUIRE(deliver(&ChunkedTransfer::handle_update_done, msg, sizeof(msg)) == NO_ERROR);
+		std::vector<chunk_index_t> missing;
+		for (const auto& m : take_sent())
+		{
+			CoAPReader reader(m.data(), m.size());
+			if (reader.type() == CoAPType::ACK)
+				*code = reader.code();
+			else if (reader.type() == CoAPType::CON && has_path(reader, 'c'))
+			{
+				for (size_t i = 0; i + 1 < reader.payload_length(); i += 2)
+					missing.push_back(reader.payload()[i] << 8 | reader.payload()[i + 1]);
+			}
+		}
+		return missing;
+	}
+
+	std::vector<std::vector<uint8_t>> take_sent()
+	{
+		std::vector<std::vector<uint8_t>> sent;
+		sent.swap(device.sent);
+		return sent;
+	}
+
+	/**
+	 * Sends the whole image, then resends the chunks reported missing after each UpdateDone.
+	 */
+	void run_fast_ota()
+	{
+		const uint8_t flags = UpdateBeginFlag::FAST_OTA | extra_flags;
+		REQUIRE(begin(flags, 2 * image.size()) == flags);
+		for (chunk_index_t i = 0; i < chunks; i++)
+			send_chunk(i);
+		for (;;)
+		{
+			REQUIRE(round_trips < 1000);
+			int code = 0;
+			const auto missing = update_done(&code);
+			if (code == ChunkReceivedCode::OK)
+				break;
+			for (chunk_index_t index : missing)
+				send_chunk(index);
+		}
+	}
+
+	/**
+	 * Sends the chunks within the window reported by the device, resending the missing chunks
+	 * that precede a received one straight away. The server only waits for the device when
+	 * every chunk in the window has been sent.
+	 */
+	void run_windowed_ota()
+	{
+		const uint8_t flags = WINDOWED_FLAGS | extra_flags;
+		REQUIRE(begin(flags, 2 * image.size()) == flags);
+		REQUIRE(window > 0);
+		std::vector<bool> received(chunks), pending(chunks, true);
+		chunk_index_t base = 0;
+		while (base < chunks)
+		{
+			REQUIRE(round_trips < 1000);
+			bool sent = false;
+			const chunk_index_t end = std::min(unsigned(base + window), unsigned(chunks));
+			for (chunk_index_t i = base; i < end; i++)
+			{
+				if (pending[i] && !received[i])
+				{
+					pending[i] = false;
+					send_chunk(i);
+					sent = true;
+					break;
+				}
+			}
+			if (!sent)
+			{
+				// wait for the device to repeat its status, then resend the rest of the window
+				round_trips++;
+				storage.now += OTA_WINDOW_STATUS_TIMEOUT;
+				REQUIRE(transfer.idle(channel) == NO_ERROR);
+				for (chunk_index_t i = base; i < end; i++)
+					pending[i] = true;
+			}
+			for (const auto& m : take_sent())
+			{
+				CoAPReader reader(m.data(), m.size());
+				if (!has_path(reader, 'w'))
+					continue;
+				REQUIRE(reader.type() == CoAPType::NON);
+				REQUIRE(reader.payload_length() >= 4);
+				const uint8_t* status = reader.payload();
+				const chunk_index_t status_base = status[0] << 8 | status[1];
+				const chunk_index_t status_window = status[2] << 8 | status[3];
+				REQUIRE(reader.payload_length() == 4 + size_t(status_window + 7) / 8);
+				base = std::max(base, status_base);
+				for (chunk_index_t i = 0; i < status_base; i++)
+					received[i] = true;
+				chunk_index_t highest = status_base;
+				for (chunk_index_t i = 0; i < status_window && status_base + i < chunks; i++)
+				{
+					if (status[4 + i / 8] & (1 << (i % 8)))
+					{
+						received[status_base + i] = true;
+						highest = status_base + i;
+					}
+				}
+				for (chunk_index_t i = status_base; i < highest; i++)
+				{
+					if (!received[i])
+						pending[i] = true;
+				}
+			}
+		}
+		int code = 0;
+		REQUIRE(update_done(&code).empty());
+		REQUIRE(code == ChunkReceivedCode::OK);
+	}
+};
+
+} // namespace
+
+SCENARIO("the device negotiates the windowed OTA mode")
+{
+	GIVEN("a device that supports windowed OTA")
+	{
+		Simulation sim(16, 0, 1);
+
+		THEN("it accepts the windowed mode with fast OTA and reports the window size")
+		{
+			REQUIRE(sim.begin(WINDOWED_FLAGS) == WINDOWED_FLAGS);
+			REQUIRE(sim.window == OTA_WINDOW_CHUNKS);
+			REQUIRE(sim.transfer.is_windowed());
+		}
+
+		THEN("it doesn't accept the windowed mode without fast OTA")
+		{
+			REQUIRE(sim.begin(UpdateBeginFlag::WINDOWED_OTA) == 0);
+			REQUIRE_FALSE(sim.transfer.is_windowed());
+		}
+
+		THEN("a server that doesn't offer the windowed mode gets the fast OTA response")
+		{
+			REQUIRE(sim.begin(UpdateBeginFlag::FAST_OTA) == UpdateBeginFlag::FAST_OTA);
+			REQUIRE(sim.window == 0);
+			REQUIRE_FALSE(sim.transfer.is_windowed());
+		}
+
+		WHEN("the windowed mode is disabled")
+		{
+			sim.transfer.set_windowed_ota(false);
+
+			THEN("it falls back to fast OTA")
+			{
+				REQUIRE(sim.begin(WINDOWED_FLAGS) == UpdateBeginFlag::FAST_OTA);
+				REQUIRE_FALSE(sim.transfer.is_windowed());
+			}
+		}
+	}
+}
+
+SCENARIO("the device reports the received chunks in the window")
+{
+	GIVEN("a windowed transfer")
+	{
+		Simulation sim(16, 0, 1);
+		REQUIRE(sim.begin(WINDOWED_FLAGS) == WINDOWED_FLAGS);
+
+		WHEN("a chunk is lost")
+		{
+			for (chunk_index_t i = 0; i <= OTA_WINDOW_ACK_INTERVAL; i++)
+			{
+				if (i != 2)
+					sim.send_chunk(i);
+			}
+
+			THEN("a status listing the chunks received after the first missing one is sent")
+			{
+				const auto sent = sim.take_sent();
+				REQUIRE(sent.size() == 1);
+				CoAPReader reader(sent[0].data(), sent[0].size());
+				REQUIRE(reader.type() == CoAPType::NON);
+				REQUIRE(reader.code() == CoAPCode::POST);
+				REQUIRE(has_path(reader, 'w'));
+				REQUIRE(reader.payload_length() == 4 + size_t(OTA_WINDOW_CHUNKS) / 8);
+				const uint8_t* status = reader.payload();
+				REQUIRE((status[0] << 8 | status[1]) == 2);
+				REQUIRE((status[2] << 8 | status[3]) == OTA_WINDOW_CHUNKS);
+				// chunks 3 to 8
+				REQUIRE(status[4] == 0x7e);
+				for (size_t i = 5; i < reader.payload_length(); i++)
+					REQUIRE(status[i] == 0);
+			}
+
+			THEN("the status is repeated when no chunk arrives")
+			{
+				sim.take_sent();
+				REQUIRE(sim.transfer.idle(sim.channel) == NO_ERROR);
+				REQUIRE(sim.take_sent().empty());
+				sim.storage.now += OTA_WINDOW_STATUS_TIMEOUT;
+				REQUIRE(sim.transfer.idle(sim.channel) == NO_ERROR);
+				REQUIRE(sim.take_sent().size() == 1);
+			}
+
+			THEN("the error of a status message that can't be created is returned")
+			{
+				sim.take_sent();
+				sim.device.create_result = INSUFFICIENT_STORAGE;
+				sim.storage.now += OTA_WINDOW_STATUS_TIMEOUT;
+				REQUIRE(sim.transfer.idle(sim.channel) == INSUFFICIENT_STORAGE);
+				REQUIRE(sim.take_sent().empty());
+			}
+		}
+
+		WHEN("a chunk index beyond the end of the file is received")
+		{
+			sim.send_chunk(15);
+			sim.take_sent();
+			const uint8_t msg[] = { 0x51, 0x02, 0x00, 0x00, 0x42, 0xb1, 'c', 0x44, 0, 0, 0, 0, 0x02, 0x00, 0x10, 0xff, 0 };
+			REQUIRE(sim.deliver(&ChunkedTransfer::handle_chunk, msg, sizeof(msg)) == NO_ERROR);
+
+			THEN("it is ignored")
+			{
+				REQUIRE(sim.take_sent().empty());
+			}
+		}
+	}
+}
+
+SCENARIO("the windowed OTA mode recovers from loss in fewer round trips")
+{
+	const chunk_index_t chunks = 512;
+
+	GIVEN("a lossy link")
+	{
+		for (double loss : { 0.1, 0.3 })
+		{
+			for (unsigned seed = 1; seed <= 3; seed++)
+			{
+				Simulation fast(chunks, loss, seed);
+				fast.run_fast_ota();
+				REQUIRE(fast.storage.finished);
+				REQUIRE(fast.storage.image == fast.image);
+
+				Simulation windowed(chunks, loss, seed);
+				windowed.run_windowed_ota();
+				REQUIRE(windowed.storage.finished);
+				REQUIRE(windowed.storage.image == windowed.image);
+
+				INFO("loss " << loss << ": fast OTA " << fast.round_trips << " round trips, " << fast.chunks_sent
+						<< " chunks; windowed OTA " << windowed.round_trips << " round trips, " << windowed.chunks_sent << " chunks");
+				REQUIRE(windowed.round_trips < fast.round_trips);
+			}
+		}
+	}
+}
+
+SCENARIO("the chunks of a compressed file are saved in order")
+{
+	GIVEN("a device")
+	{
+		Simulation sim(16, 0, 1);
+
+		THEN("it accepts a compressed file along with its inflated length")
+		{
+			const uint8_t flags = UpdateBeginFlag::FAST_OTA | UpdateBeginFlag::COMPRESSED;
+			REQUIRE(sim.begin(flags, 12345) == flags);
+			REQUIRE(sim.storage.flags == FileTransfer::Flag::COMPRESSED);
+			REQUIRE(sim.storage.storage_length == 12345);
+		}
+
+		THEN("an uncompressed file is stored as it is")
+		{
+			REQUIRE(sim.begin(UpdateBeginFlag::FAST_OTA) == UpdateBeginFlag::FAST_OTA);
+			REQUIRE(sim.storage.flags == 0);
+			REQUIRE(sim.storage.storage_length == sim.image.size());
+		}
+
+		WHEN("the device lacks the memory to inflate the file")
+		{
+			sim.storage.dry_run_result = SYSTEM_ERROR_NO_MEMORY;
+
+			THEN("a compressed file is refused with 4.15, so that the server sends the plain image")
+			{
+				REQUIRE(sim.begin(UpdateBeginFlag::FAST_OTA | UpdateBeginFlag::COMPRESSED, 12345) == -1);
+				REQUIRE(sim.begin_code == RESPONSE_CODE(4, 15));
+			}
+
+			THEN("an uncompressed file is refused with 5.03")
+			{
+				REQUIRE(sim.begin(UpdateBeginFlag::FAST_OTA) == -1);
+				REQUIRE(sim.begin_code == RESPONSE_CODE(5, 03));
+			}
+		}
+
+		WHEN("chunks of a compressed file arrive out of order")
+		{
+			const uint8_t flags = UpdateBeginFlag::FAST_OTA | UpdateBeginFlag::COMPRESSED;
+			REQUIRE(sim.begin(flags, 12345) == flags);
+			for (chunk_index_t index : { 0, 2, 1, 1, 0, 3, 2 })
+				sim.send_chunk(index);
+
+			THEN("only the chunks that follow the saved ones are saved")
+			{
+				REQUIRE(sim.storage.saved == std::vector<chunk_index_t>({ 0, 1, 2 }));
+			}
+			THEN("the skipped chunks are reported missing")
+			{
+				int code = 0;
+				const auto missing = sim.update_done(&code);
+				REQUIRE_FALSE(missing.empty());
+				REQUIRE(missing.front() == 3);
+				REQUIRE(code == ChunkReceivedCode::BAD);
+			}
+		}
+	}
+
+	GIVEN("a lossy link")
+	{
+		for (bool windowed : { false, true })
+		{
+			Simulation sim(256, 0.2, 4);
+			sim.extra_flags = UpdateBeginFlag::COMPRESSED;
+			if (windowed)
+				sim.run_windowed_ota();
+			else
+				sim.run_fast_ota();
+			REQUIRE(sim.storage.finished);
+			REQUIRE(sim.storage.image == sim.image);
+			REQUIRE(sim.storage.saved.size() == 256);
+			REQUIRE(std::is_sorted(sim.storage.saved.begin(), sim.storage.saved.end()));
+		}
+	}
+}
+
+SCENARIO("the chunks of a patch are saved in order")
+{
+	GIVEN("a device")
+	{
+		Simulation sim(16, 0, 1);
+
+		THEN("it accepts a patch along with the length of the patched image")
+		{
+			const uint8_t flags = UpdateBeginFlag::FAST_OTA | UpdateBeginFlag::DELTA;
+			REQUIRE(sim.begin(flags, 54321) == flags);
+			REQUIRE(sim.storage.flags == FileTransfer::Flag::DELTA);
+			REQUIRE(sim.storage.storage_length == 54321);
+		}
+
+		THEN("it accepts a compressed patch")
+		{
+			const uint8_t flags = UpdateBeginFlag::FAST_OTA | UpdateBeginFlag::COMPRESSED | UpdateBeginFlag::DELTA;
+			REQUIRE(sim.begin(flags, 54321) == flags);
+			REQUIRE(sim.storage.flags == (FileTransfer::Flag::COMPRESSED | FileTransfer::Flag::DELTA));
+		}
+
+		WHEN("chunks of a patch arrive out of order")
+		{
+			const uint8_t flags = UpdateBeginFlag::FAST_OTA | UpdateBeginFlag::DELTA;
+			REQUIRE(sim.begin(flags, 54321) == flags);
+			for (chunk_index_t index : { 1, 0, 2, 0, 1 })
+				sim.send_chunk(index);
+
+			THEN("only the chunks that follow the saved ones are saved")
+			{
+				REQUIRE(sim.storage.saved == std::vector<chunk_index_t>({ 0, 1 }));
+			}
+		}
+	}
+}
@@ -18,10 +18,15 @@
  */
 
 #include "coap.h"
+#include "appender.h"
 
 #define CATCH_CONFIG_MAIN
 #include <catch2/catch.hpp>
 
+#include <random>
+#include <string>
+#include <vector>
+
 using namespace particle::protocol;
 
 SCENARIO("CoAP::code")
@@ -89,3 +94,371 @@ SCENARIO("CoAP::path is retrieved from a CoAP message")
 	}
 }
 
+
+namespace {
+
+struct TestOption
+{
+	unsigned number;
+	std::vector<uint8_t> value;
+};
+
+struct TestMessage
+{
+	CoAPType::Enum type;
+	uint8_t code;
+	message_id_t id;
+	std::vector<uint8_t> token;
+	std::vector<TestOption> options;
+	std::vector<uint8_t> payload;
+};
+
+TestMessage random_message(std::mt19937& rng)
+{
+	std::uniform_int_distribution<int> byte(0, 255);
+	TestMessage m;
+	m.type = CoAPType::Enum(rng() % 4);
+	m.code = byte(rng);
+	m.id = rng();
+	m.token.resize(rng() % 9);
+	for (auto& b: m.token) {
+		b = byte(rng);
+	}
+	unsigned number = 0;
+	const size_t option_count = rng() % 6;
+	for (size_t i = 0; i < option_count; i++) {
+		// exercise the 4-bit, 1-byte and 2-byte encodings of both delta and length
+		static const unsigned deltas[] = { 0, 1, 12, 13, 268, 269, 1000 };
+		static const size_t lengths[] = { 0, 1, 12, 13, 268, 269, 300 };
+		number += deltas[rng() % 7];
+		TestOption option = { number, std::vector<uint8_t>(lengths[rng() % 7]) };
+		for (auto& b: option.value) {
+			b = byte(rng);
+		}
+		m.options.push_back(option);
+	}
+	m.payload.resize(rng() % 3 ? rng() % 100 : 0);
+	for (auto& b: m.payload) {
+		b = byte(rng);
+	}
+	return m;
+}
+
+size_t encode(const TestMessage& m, uint8_t* buf, size_t size, bool* overflow = nullptr)
+{
+	CoAPWriter writer(buf, size);
+	writer.header(m.type, m.code, m.id, m.token.data(), m.token.size());
+	for (const auto& option: m.options) {
+		writer.option(option.number, option.value.data(), option.value.size());
+	}
+	writer.payload(m.payload.data(), m.payload.size());
+	if (overflow) {
+		*overflow = writer.overflow();
+	}
+	return writer.length();
+}
+
+/**
+ * Checks that everything returned by the reader lies within the message.
+ */
+void check_bounds(const CoAPReader& reader, const uint8_t* buf, size_t length)
+{
+	const uint8_t* end = buf + length;
+	auto it = reader.options();
+	while (it.next()) {
+		REQUIRE(it.data() >= buf);
+		REQUIRE(it.data() + it.length() <= end);
+	}
+	if (reader.payload()) {
+		REQUIRE(reader.payload() >= buf);
+		REQUIRE(reader.payload() + reader.payload_length() <= end);
+	}
+	if (reader.token()) {
+		REQUIRE(reader.token() + reader.token_length() <= end);
+	}
+}
+
+} // namespace
+
+SCENARIO("CoAPWriter and CoAPReader")
+{
+	GIVEN("randomly generated messages")
+	{
+		std::mt19937 rng(1234);
+
+		THEN("every message decodes to what was encoded")
+		{
+			for (int i = 0; i < 2000; i++) {
+				const TestMessage m = random_message(rng);
+				std::vector<uint8_t> buf(4096);
+				bool overflow = true;
+				const size_t length = encode(m, buf.data(), buf.size(), &overflow);
+				REQUIRE_FALSE(overflow);
+
+				CoAPReader reader(buf.data(), length);
+				REQUIRE(reader.is_valid());
+				REQUIRE(reader.type()==m.type);
+				REQUIRE(uint8_t(reader.code())==m.code);
+				REQUIRE(reader.id()==m.id);
+				REQUIRE(std::vector<uint8_t>(reader.token(), reader.token() + reader.token_length())==m.token);
+				auto it = reader.options();
+				for (const auto& option: m.options) {
+					REQUIRE(it.next());
+					REQUIRE(it.number()==option.number);
+					REQUIRE(std::vector<uint8_t>(it.data(), it.data() + it.length())==option.value);
+				}
+				REQUIRE_FALSE(it.next());
+				REQUIRE(reader.payload_length()==m.payload.size());
+				if (m.payload.empty()) {
+					REQUIRE(reader.payload()==nullptr);
+				} else {
+					REQUIRE(std::vector<uint8_t>(reader.payload(), reader.payload() + reader.payload_length())==m.payload);
+				}
+			}
+		}
+
+		THEN("the writer never writes past the end of a buffer that is too small")
+		{
+			for (int i = 0; i < 200; i++) {
+				const TestMessage m = random_message(rng);
+				std::vector<uint8_t> full(4096);
+				const size_t length = encode(m, full.data(), full.size());
+				for (size_t size = 0; size < length; size += 1 + size / 8) {
+					std::vector<uint8_t> buf(size + 16, 0xA5);
+					bool overflow = false;
+					REQUIRE(encode(m, buf.data(), size, &overflow) <= size);
+					REQUIRE(overflow);
+					for (size_t j = size; j < buf.size(); j++) {
+						REQUIRE(buf[j]==0xA5);
+					}
+				}
+			}
+		}
+
+		THEN("truncated messages are decoded within bounds")
+		{
+			for (int i = 0; i < 200; i++) {
+				const TestMessage m = random_message(rng);
+				std::vector<uint8_t> full(4096);
+				const size_t length = encode(m, full.data(), full.size());
+				for (size_t size = 0; size <= length; size++) {
+					// an exactly sized copy so that any overrun reads outside the allocation
+					std::vector<uint8_t> buf(full.begin(), full.begin() + size);
+					CoAPReader reader(buf.data(), buf.size());
+					check_bounds(reader, buf.data(), buf.size());
+				}
+			}
+		}
+
+		THEN("random and mutated input is decoded within bounds")
+		{
+			std::uniform_int_distribution<int> byte(0, 255);
+			for (int i = 0; i < 5000; i++) {
+				std::vector<uint8_t> buf;
+				if (i % 2) {
+					buf.resize(rng() % 64);
+					for (auto& b: buf) {
+						b = byte(rng);
+					}
+				} else {
+					const TestMessage m = random_message(rng);
+					buf.resize(4096);
+					buf.resize(encode(m, buf.data(), buf.size()));
+					for (int flips = 0; flips < 4 && !buf.empty(); flips++) {
+						buf[rng() % buf.size()] = byte(rng);
+					}
+				}
+				CoAPReader reader(buf.data(), buf.size());
+				check_bounds(reader, buf.data(), buf.size());
+			}
+		}
+	}
+
+	GIVEN("a malformed message")
+	{
+		THEN("a token longer than 8 bytes is rejected")
+		{
+			const uint8_t msg[] = { 0x49, 0x01, 0, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9 };
+			REQUIRE_FALSE(CoAPReader(msg, sizeof(msg)).is_valid());
+		}
+
+		THEN("the reserved option nibble is rejected")
+		{
+			const uint8_t msg[] = { 0x40, 0x01, 0, 0, 0xbf, 'a' };
+			CoAPReader reader(msg, sizeof(msg));
+			REQUIRE_FALSE(reader.is_valid());
+			REQUIRE_FALSE(reader.options().next());
+			REQUIRE(reader.payload()==nullptr);
+		}
+
+		THEN("an option extending past the end is rejected")
+		{
+			const uint8_t msg[] = { 0x40, 0x01, 0, 0, 0xb5, 'a', 'b' };
+			REQUIRE_FALSE(CoAPReader(msg, sizeof(msg)).is_valid());
+		}
+
+		THEN("a payload marker followed by an empty payload is tolerated")
+		{
+			const uint8_t msg[] = { 0x40, 0x02, 0, 0, 0xb1, 'e', 0xff };
+			CoAPReader reader(msg, sizeof(msg));
+			REQUIRE(reader.is_valid());
+			REQUIRE(reader.payload()==msg + sizeof(msg));
+			REQUIRE(reader.payload_length()==0);
+		}
+	}
+
+	GIVEN("a message with options")
+	{
+		uint8_t buf[64];
+		CoAPWriter writer(buf, sizeof(buf));
+		writer.header(CoAPType::CON, CoAPCode::GET, 0x1234);
+		writer.option(CoAPOption::URI_PATH, "v");
+		writer.option(CoAPOption::URI_PATH, "temperature");
+		writer.option_uint(CoAPOption::URI_QUERY, 0x0102);
+		CoAPReader reader(buf, writer.length());
+
+		THEN("options are found by number")
+		{
+			const uint8_t* data = nullptr;
+			size_t length = 0;
+			REQUIRE(reader.find_option(CoAPOption::URI_PATH, &data, &length));
+			REQUIRE(length==1);
+			REQUIRE(data[0]=='v');
+			REQUIRE(reader.find_option(CoAPOption::URI_QUERY, &data, &length));
+			REQUIRE(length==2);
+			REQUIRE(data[0]==0x01);
+			REQUIRE(data[1]==0x02);
+			REQUIRE_FALSE(reader.find_option(CoAPOption::MAX_AGE, &data, &length));
+		}
+
+		THEN("option values are views into the message")
+		{
+			auto it = reader.options();
+			REQUIRE(it.next());
+			REQUIRE(it.next());
+			REQUIRE(it.data()==buf + 4 + 2 + 1);
+			REQUIRE(it.length()==11);
+		}
+	}
+
+	GIVEN("a payload written in place")
+	{
+		uint8_t buf[16];
+		CoAPWriter writer(buf, sizeof(buf));
+		writer.header(CoAPType::ACK, CoAPCode::CONTENT, 1);
+		size_t available = 0;
+		uint8_t* payload = writer.payload_buffer(&available);
+
+		THEN("the space after the payload marker is available")
+		{
+			REQUIRE(payload==buf + 5);
+			REQUIRE(available==11);
+			memcpy(payload, "abc", 3);
+			writer.commit_payload(3);
+			REQUIRE(writer.length()==8);
+			REQUIRE(buf[4]==0xff);
+			REQUIRE_FALSE(writer.overflow());
+		}
+
+		THEN("an empty payload has no payload marker")
+		{
+			writer.commit_payload(0);
+			REQUIRE(writer.length()==4);
+		}
+	}
+}
+
+SCENARIO("CoAPBlock")
+{
+	GIVEN("a block option value")
+	{
+		CoAPBlock block(21, 2, true);
+
+		THEN("the block number, size and more flag are encoded")
+		{
+			REQUIRE(block.size()==64);
+			REQUIRE(block.offset()==21*64);
+			REQUIRE(block.value()==(21<<4 | 0x08 | 2));
+		}
+
+		THEN("the option can be written and decoded")
+		{
+			uint8_t buf[16];
+			CoAPWriter writer(buf, sizeof(buf));
+			writer.header(CoAPType::CON, CoAPCode::POST, 1);
+			writer.option_uint(CoAPOption::BLOCK1, block.value());
+			CoAPReader reader(buf, writer.length());
+			const uint8_t* data = nullptr;
+			size_t length = 0;
+			REQUIRE(reader.find_option(CoAPOption::BLOCK1, &data, &length));
+			CoAPBlock decoded;
+			REQUIRE(CoAPBlock::decode(data, length, &decoded));
+			REQUIRE(decoded.num==21);
+			REQUIRE(decoded.szx==2);
+			REQUIRE(decoded.more);
+		}
+	}
+
+	GIVEN("option values of various lengths")
+	{
+		CoAPBlock block(1, 1, true);
+
+		THEN("an empty value is the first block of 16 bytes")
+		{
+			REQUIRE(CoAPBlock::decode(nullptr, 0, &block));
+			REQUIRE(block.num==0);
+			REQUIRE(block.szx==0);
+			REQUIRE_FALSE(block.more);
+		}
+
+		THEN("values longer than 3 bytes and the reserved block size are rejected")
+		{
+			const uint8_t too_long[] = { 0x00, 0x00, 0x01, 0x06 };
+			REQUIRE_FALSE(CoAPBlock::decode(too_long, sizeof(too_long), &block));
+			const uint8_t reserved[] = { 0x17 };
+			REQUIRE_FALSE(CoAPBlock::decode(reserved, sizeof(reserved), &block));
+		}
+	}
+
+	GIVEN("a maximum block size")
+	{
+		THEN("the largest block size that fits is chosen")
+		{
+			REQUIRE(CoAPBlock::szx_for(2000)==CoAPBlock::MAX_SZX);
+			REQUIRE(CoAPBlock::szx_for(1024)==6);
+			REQUIRE(CoAPBlock::szx_for(784)==5);
+			REQUIRE(CoAPBlock::szx_for(31)==0);
+		}
+	}
+
+	GIVEN("a payload split by a BlockAppender")
+	{
+		const std::string payload = "the quick brown fox jumps over the lazy dog";
+		auto block_of = [&](const CoAPBlock& block, bool* more) {
+			char buf[16] = {};
+			particle::BlockAppender appender((uint8_t*)buf, block.size(), block.offset());
+			appender.append((const uint8_t*)payload.data(), 10);
+			appender.append((const uint8_t*)payload.data() + 10, payload.size() - 10);
+			*more = appender.hasMore();
+			REQUIRE(appender.dataSize()==payload.size());
+			return std::string(buf, appender.blockSize());
+		};
+
+		THEN("each block holds its part of the payload")
+		{
+			std::string joined;
+			bool more = true;
+			for (unsigned num = 0; more; num++) {
+				joined += block_of(CoAPBlock(num, 0), &more);
+			}
+			REQUIRE(joined==payload);
+		}
+
+		THEN("a block past the end of the payload is empty")
+		{
+			bool more = true;
+			REQUIRE(block_of(CoAPBlock(3, 0), &more).empty());
+			REQUIRE_FALSE(more);
+		}
+	}
+}
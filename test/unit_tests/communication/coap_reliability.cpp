@@ -18,6 +18,10 @@
  */
 
 #include <climits>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
 
 #include "coap_channel.h"
 #include "forward_message_channel.h"
@@ -201,7 +205,7 @@ SCENARIO("a message can be added to a message store with the same id more than o
 
 }
 
-SCENARIO("multiple messages are stored in a list in the order they are added, most recent first")
+SCENARIO("multiple messages with distinct IDs are stored independently")
 {
 	const message_id_t id1 = 456;
 	const message_id_t id2 = 345;
@@ -221,9 +225,9 @@ SCENARIO("multiple messages are stored in a list in the order they are added, mo
 			REQUIRE(store.add(m1)==NO_ERROR);
 			REQUIRE(store.add(m2)==NO_ERROR);
 
-			THEN("the second message points to the first")
+			THEN("both messages are stored")
 			{
-				REQUIRE(m2->get_next()==m1);
+				REQUIRE(store.has_messages());
 				AND_THEN("both messages can be retrieved")
 				{
 					REQUIRE(store.from_id(id1)==m1);
@@ -1254,3 +1258,149 @@ SCENARIO("notify_client_messages_processed() is invoked when all client messages
 		}
 	}
 }
+
+namespace {
+
+/**
+ * A channel that counts the messages sent through it.
+ */
+class CountingChannel : public Channel
+{
+public:
+	unsigned sent = 0;
+
+	ProtocolError receive(Message& msg) override { msg.set_length(0); return NO_ERROR; }
+	ProtocolError send(Message& msg) override { sent++; return NO_ERROR; }
+	ProtocolError command(Command cmd, void* arg) override { return NO_ERROR; }
+};
+
+ProtocolError send_confirmable(CoAPMessageStore& store, message_id_t id, system_tick_t time)
+{
+	uint8_t buf[] = { 0x40, 0x02, uint8_t(id >> 8), uint8_t(id & 0xff) };
+	Message msg(buf, sizeof(buf), sizeof(buf));
+	msg.decode_id();
+	return store.send(msg, time);
+}
+
+ProtocolError receive_ack(CoAPMessageStore& store, Channel& channel, message_id_t id, system_tick_t time)
+{
+	uint8_t buf[4];
+	Message msg(buf, sizeof(buf), Messages::empty_ack(buf, id >> 8, id & 0xff));
+	msg.decode_id();
+	return store.receive(msg, channel, time);
+}
+
+} // namespace
+
+SCENARIO("many in-flight confirmable messages can be acknowledged in any order", "[reliability]")
+{
+	GIVEN("a message store with 128 unacknowledged messages")
+	{
+		const unsigned count = 128;
+		CountingChannel channel;
+		{
+			CoAPMessageStore store;
+			std::vector<message_id_t> ids;
+			for (unsigned i = 0; i < count; i++) {
+				ids.push_back(message_id_t(0xfff0 + i));		// wraps around
+				REQUIRE(send_confirmable(store, ids.back(), 0)==NO_ERROR);
+			}
+			REQUIRE(CoAPMessage::messages()==count);
+			REQUIRE(store.has_unacknowledged_requests());
+
+			WHEN("the messages are acknowledged in shuffled order")
+			{
+				std::shuffle(ids.begin(), ids.end(), std::mt19937(1234));
+				for (unsigned i = 0; i < count; i++) {
+					REQUIRE(store.from_id(ids[i])!=nullptr);
+					REQUIRE(receive_ack(store, channel, ids[i], 100)==NO_ERROR);
+					REQUIRE(store.from_id(ids[i])==nullptr);
+				}
+
+				THEN("no messages remain")
+				{
+					REQUIRE_FALSE(store.has_messages());
+					REQUIRE_FALSE(store.has_unacknowledged_requests());
+					REQUIRE(CoAPMessage::messages()==0);
+				}
+			}
+		}
+		REQUIRE(CoAPMessage::messages()==0);
+		REQUIRE(channel.sent==0);
+	}
+}
+
+SCENARIO("processing the message store only resends the messages that are due", "[reliability]")
+{
+	GIVEN("messages sent one second apart")
+	{
+		const unsigned count = 64;
+		CountingChannel channel;
+		CoAPMessageStore store;
+		for (unsigned i = 0; i < count; i++) {
+			REQUIRE(send_confirmable(store, message_id_t(i), i*1000)==NO_ERROR);
+		}
+
+		WHEN("the store is processed before any message has timed out")
+		{
+			store.process(CoAPMessage::ACK_TIMEOUT-1, channel);
+			THEN("nothing is resent")
+			{
+				REQUIRE(channel.sent==0);
+			}
+		}
+
+		WHEN("the store is processed once the earliest message has timed out")
+		{
+			const system_tick_t first_timeout = store.from_id(0)->get_timeout();
+			store.process(first_timeout, channel);
+			THEN("only messages with an expired timeout are resent")
+			{
+				for (unsigned i = 0; i < count; i++) {
+					const CoAPMessage* msg = store.from_id(message_id_t(i));
+					REQUIRE(msg!=nullptr);
+					REQUIRE_FALSE(time_has_passed(first_timeout, msg->get_timeout()));
+				}
+				REQUIRE(channel.sent>=1);
+				REQUIRE(channel.sent<count);
+			}
+		}
+
+		WHEN("the store is processed after every retransmission has been exhausted")
+		{
+			system_tick_t now = 0;
+			while (store.has_messages()) {
+				now += 1000;
+				store.process(now, channel);
+			}
+			THEN("each message was sent MAX_RETRANSMIT more times")
+			{
+				REQUIRE(channel.sent==count*CoAPMessage::MAX_RETRANSMIT);
+				REQUIRE(CoAPMessage::messages()==0);
+			}
+		}
+	}
+	REQUIRE(CoAPMessage::messages()==0);
+}
+
+TEST_CASE("message store benchmark", "[.][benchmark]")
+{
+	CountingChannel channel;
+	for (unsigned count = 64; count <= 1024; count *= 2) {
+		const unsigned rounds = 100;
+		const auto start = std::chrono::steady_clock::now();
+		for (unsigned r = 0; r < rounds; r++) {
+			CoAPMessageStore store;
+			for (unsigned i = 0; i < count; i++) {
+				send_confirmable(store, message_id_t(i), i);
+				store.process(i, channel);
+			}
+			for (unsigned i = 0; i < count; i++) {
+				receive_ack(store, channel, message_id_t(i), count);
+				store.process(count, channel);
+			}
+		}
+		const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+		WARN(count << " in-flight messages: " << elapsed.count() / rounds << " us to send and acknowledge");
+	}
+}
@@ -0,0 +1,407 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "fake_protocol.h"
+
+#include <catch2/catch.hpp>
+
+#include <string>
+#include <vector>
+
+using namespace particle::protocol;
+using namespace particle::protocol::test;
+
+namespace {
+
+// Flag of the server's hello, acknowledging that it accepts describe messages in blocks
+const uint8_t HELLO_FLAG_BLOCKWISE_SUPPORT = 64;
+
+/**
+ * Registers enough functions for a describe message of about {@code size} bytes.
+ */
+void register_functions(FakeDevice& device, size_t size)
+{
+	for (size_t i = 0; device.functions.size() * 16 < size; i++)
+	{
+		device.functions.push_back("function" + std::to_string(10000 + i));
+	}
+}
+
+struct Block
+{
+	CoAPCode::Enum code;
+	message_id_t id;
+	CoAPBlock block;
+	bool has_block;
+	std::string etag;
+	std::string payload;
+	std::vector<uint8_t> data;
+};
+
+Block decode(const std::vector<uint8_t>& data, unsigned option)
+{
+	CoAPReader reader(data.data(), data.size());
+	Block b = {};
+	b.code = reader.code();
+	b.id = reader.id();
+	const uint8_t* value = nullptr;
+	size_t length = 0;
+	b.has_block = reader.find_option(option, &value, &length) && CoAPBlock::decode(value, length, &b.block);
+	if (reader.find_option(CoAPOption::ETAG, &value, &length))
+	{
+		b.etag = std::string((const char*)value, length);
+	}
+	b.payload = std::string((const char*)reader.payload(), reader.payload_length());
+	b.data = data;
+	return b;
+}
+
+/**
+ * Processes the server's hello with the given flags, and forgets the messages the protocol sent in return.
+ */
+void server_hello(FakeProtocol& protocol, uint8_t flags)
+{
+	protocol.channel.hello(flags);
+	protocol.process();
+	protocol.channel.sent.clear();
+}
+
+std::vector<uint8_t> describe_request(message_id_t id, uint8_t token, const CoAPBlock* block)
+{
+	std::vector<uint8_t> data(32);
+	CoAPWriter writer(data.data(), data.size());
+	writer.header(CoAPType::CON, CoAPCode::GET, id, &token, sizeof(token));
+	writer.option(CoAPOption::URI_PATH, "d");
+	const uint8_t flags = DESCRIBE_APPLICATION;
+	writer.option(CoAPOption::URI_QUERY, &flags, sizeof(flags));
+	if (block)
+	{
+		writer.option_uint(CoAPOption::BLOCK2, block->value());
+	}
+	data.resize(writer.length());
+	return data;
+}
+
+/**
+ * Requests a block of the describe message, and returns the response.
+ */
+Block get_block(FakeProtocol& protocol, const CoAPBlock* block)
+{
+	protocol.channel.sent.clear();
+	protocol.channel.received.push_back(describe_request(0x100, 7, block));
+	protocol.process();
+	REQUIRE(protocol.channel.sent.size()==1);
+	return decode(protocol.channel.sent[0], CoAPOption::BLOCK2);
+}
+
+} // namespace
+
+SCENARIO("a large describe message is posted in blocks")
+{
+	GIVEN("a describe message that doesn't fit in a single message")
+	{
+		FakeDevice device;
+		register_functions(device, 1500);
+		FakeProtocol protocol;
+		protocol.init(device);
+		server_hello(protocol, HELLO_FLAG_BLOCKWISE_SUPPORT);
+		const std::string describe = protocol.describe(DESCRIBE_APPLICATION);
+		REQUIRE(describe.size() > PROTOCOL_BUFFER_SIZE);
+
+		REQUIRE(protocol.post_description(DESCRIBE_APPLICATION)==NO_ERROR);
+		REQUIRE(protocol.channel.sent.size()==1);
+		const Block first = decode(protocol.channel.sent[0], CoAPOption::BLOCK1);
+
+		THEN("the first block is posted with a Block1 option")
+		{
+			REQUIRE(first.code==CoAPCode::POST);
+			REQUIRE(first.has_block);
+			REQUIRE(first.block.num==0);
+			REQUIRE(first.block.more);
+			REQUIRE(first.payload==describe.substr(0, first.block.size()));
+		}
+
+		WHEN("the server continues each block with 2.31")
+		{
+			std::string received = first.payload;
+			Block last = first;
+			while (last.block.more)
+			{
+				protocol.channel.respond(last.data, CoAPCode::BLOCK_CONTINUE, CoAPOption::BLOCK1, last.block.value());
+				protocol.process();
+				const Block next = decode(protocol.channel.sent.back(), CoAPOption::BLOCK1);
+				REQUIRE(next.has_block);
+				REQUIRE(next.block.num==last.block.num + 1);
+				received += next.payload;
+				last = next;
+			}
+
+			THEN("the blocks make up the describe message")
+			{
+				REQUIRE(received==describe);
+			}
+
+			THEN("nothing is posted after the final block is acknowledged")
+			{
+				const size_t count = protocol.channel.sent.size();
+				protocol.channel.respond(last.data, CoAPCode::CHANGED, CoAPOption::BLOCK1, last.block.value());
+				protocol.process();
+				REQUIRE(protocol.channel.sent.size()==count);
+			}
+		}
+
+		WHEN("the server asks for smaller blocks")
+		{
+			const CoAPBlock smaller(0, first.block.szx - 1, true);
+			protocol.channel.respond(first.data, CoAPCode::BLOCK_CONTINUE, CoAPOption::BLOCK1, smaller.value());
+			protocol.process();
+
+			THEN("the next block continues at the smaller size")
+			{
+				const Block next = decode(protocol.channel.sent.back(), CoAPOption::BLOCK1);
+				REQUIRE(next.block.szx==smaller.szx);
+				REQUIRE(next.block.offset()==first.block.size());
+				REQUIRE(next.payload==describe.substr(next.block.offset(), next.block.size()));
+			}
+		}
+
+		WHEN("the server continues a block other than the last one posted")
+		{
+			const CoAPBlock unexpected(first.block.num + 3, first.block.szx, true);
+			protocol.channel.respond(first.data, CoAPCode::BLOCK_CONTINUE, CoAPOption::BLOCK1, unexpected.value());
+			protocol.process();
+
+			THEN("the response is ignored")
+			{
+				REQUIRE(protocol.channel.sent.size()==1);
+			}
+
+			THEN("the expected response continues the transfer")
+			{
+				protocol.channel.respond(first.data, CoAPCode::BLOCK_CONTINUE, CoAPOption::BLOCK1, first.block.value());
+				protocol.process();
+				REQUIRE(protocol.channel.sent.size()==2);
+				REQUIRE(decode(protocol.channel.sent[1], CoAPOption::BLOCK1).block.num==1);
+			}
+		}
+
+		WHEN("a response to another request is received")
+		{
+			std::vector<uint8_t> other = first.data;
+			other[4] ^= 0xff;	// token
+			protocol.channel.respond(other, CoAPCode::BLOCK_CONTINUE, CoAPOption::BLOCK1, first.block.value());
+			protocol.process();
+
+			THEN("no block is posted")
+			{
+				REQUIRE(protocol.channel.sent.size()==1);
+			}
+		}
+
+		WHEN("the server acknowledges a block, and continues it in a separate response")
+		{
+			protocol.channel.ack(first.id);
+			protocol.process();
+
+			THEN("the next block waits for the separate response")
+			{
+				REQUIRE(protocol.channel.sent.size()==1);
+			}
+
+			THEN("the separate response is acknowledged, and the next block is posted")
+			{
+				protocol.channel.respond(first.data, CoAPCode::BLOCK_CONTINUE, CoAPOption::BLOCK1, first.block.value(),
+						CoAPType::CON, 0x200);
+				protocol.process();
+				REQUIRE(protocol.channel.sent.size()==3);
+				const Block next = decode(protocol.channel.sent[1], CoAPOption::BLOCK1);
+				REQUIRE(next.block.num==1);
+				REQUIRE(next.payload==describe.substr(next.block.offset(), next.block.size()));
+				CoAPReader ack(protocol.channel.sent[2].data(), protocol.channel.sent[2].size());
+				REQUIRE(ack.type()==CoAPType::ACK);
+				REQUIRE(ack.code()==CoAPCode::EMPTY);
+				REQUIRE(ack.id()==0x200);
+			}
+		}
+
+		WHEN("the describe message changes during the transfer")
+		{
+			device.functions.push_back("added");
+			const std::string changed = protocol.describe(DESCRIBE_APPLICATION);
+			std::string received;
+			Block last = first;
+			do
+			{
+				protocol.channel.respond(last.data, CoAPCode::BLOCK_CONTINUE, CoAPOption::BLOCK1, last.block.value());
+				protocol.process();
+				last = decode(protocol.channel.sent.back(), CoAPOption::BLOCK1);
+				if (last.block.num==0)
+				{
+					received.clear();
+				}
+				received += last.payload;
+			}
+			while (last.block.more);
+
+			THEN("the transfer restarts with the first block of the changed message")
+			{
+				REQUIRE(decode(protocol.channel.sent[1], CoAPOption::BLOCK1).block.num==0);
+				REQUIRE(received==changed);
+			}
+		}
+
+		WHEN("the server rejects a block")
+		{
+			protocol.channel.respond(first.data, CoAPCode::REQUEST_ENTITY_TOO_LARGE);
+			protocol.process();
+
+			THEN("the transfer is abandoned")
+			{
+				protocol.channel.respond(first.data, CoAPCode::BLOCK_CONTINUE, CoAPOption::BLOCK1, first.block.value());
+				protocol.process();
+				REQUIRE(protocol.channel.sent.size()==1);
+			}
+		}
+	}
+}
+
+SCENARIO("the server fetches a large describe message in blocks")
+{
+	GIVEN("a describe message larger than DESCRIBE_MAX_SIZE")
+	{
+		FakeDevice device;
+		register_functions(device, DESCRIBE_MAX_SIZE + 1000);
+		FakeProtocol protocol;
+		protocol.init(device);
+		server_hello(protocol, HELLO_FLAG_BLOCKWISE_SUPPORT);
+		const std::string describe = protocol.describe(DESCRIBE_APPLICATION);
+		REQUIRE(describe.size() > DESCRIBE_MAX_SIZE);
+
+		WHEN("the describe message is requested without a Block2 option")
+		{
+			const Block first = get_block(protocol, nullptr);
+
+			THEN("the response is the first block")
+			{
+				REQUIRE(first.code==CoAPCode::CONTENT);
+				REQUIRE(first.id==0x100);
+				REQUIRE(first.has_block);
+				REQUIRE(first.block.num==0);
+				REQUIRE(first.block.more);
+				REQUIRE(first.payload==describe.substr(0, first.block.size()));
+			}
+		}
+
+		WHEN("every block is requested in turn")
+		{
+			std::string received;
+			CoAPBlock request(0, CoAPBlock::MAX_SZX);
+			Block response;
+			do
+			{
+				response = get_block(protocol, &request);
+				REQUIRE(response.code==CoAPCode::CONTENT);
+				REQUIRE(response.block.num==request.num * (request.size() / response.block.size()));
+				received += response.payload;
+				request = CoAPBlock(response.block.num + 1, response.block.szx);
+			}
+			while (response.block.more);
+
+			THEN("the blocks make up the whole describe message")
+			{
+				REQUIRE(received==describe);
+			}
+
+			THEN("the blocks have the same ETag")
+			{
+				REQUIRE(!response.etag.empty());
+				REQUIRE(response.etag==get_block(protocol, nullptr).etag);
+			}
+		}
+
+		WHEN("the describe message changes between the requested blocks")
+		{
+			const Block first = get_block(protocol, nullptr);
+			device.functions.push_back("added");
+			const CoAPBlock request(1, first.block.szx);
+			const Block second = get_block(protocol, &request);
+
+			THEN("the ETag changes")
+			{
+				REQUIRE(second.etag!=first.etag);
+			}
+		}
+
+		WHEN("a block past the end of the describe message is requested")
+		{
+			const CoAPBlock request(describe.size() / 64 + 1, 2);
+			const Block response = get_block(protocol, &request);
+
+			THEN("the request is rejected with 4.02")
+			{
+				REQUIRE(response.code==CoAPCode::BAD_OPTION);
+				REQUIRE(response.payload.empty());
+			}
+		}
+
+		WHEN("a block is requested out of order")
+		{
+			const CoAPBlock request(3, 5);
+			const Block response = get_block(protocol, &request);
+
+			THEN("the requested block is sent")
+			{
+				REQUIRE(response.block.num==3);
+				REQUIRE(response.payload==describe.substr(3 * 512, 512));
+			}
+		}
+	}
+}
+
+SCENARIO("a large describe message isn't sent in blocks to a server that doesn't accept them")
+{
+	GIVEN("a server that hasn't acknowledged blockwise support in its hello")
+	{
+		FakeDevice device;
+		register_functions(device, 1500);
+		FakeProtocol protocol;
+		protocol.init(device);
+		server_hello(protocol, 0);
+
+		WHEN("the device posts the describe message")
+		{
+			const ProtocolError error = protocol.post_description(DESCRIBE_APPLICATION);
+
+			THEN("it fails without posting a block")
+			{
+				REQUIRE(error==INSUFFICIENT_STORAGE);
+				REQUIRE(protocol.channel.sent.empty());
+			}
+		}
+
+		WHEN("the server requests the describe message without a Block2 option")
+		{
+			const Block response = get_block(protocol, nullptr);
+
+			THEN("the request fails")
+			{
+				REQUIRE(response.code==CoAPCode::INTERNAL_SERVER_ERROR);
+				REQUIRE(!response.has_block);
+			}
+		}
+	}
+}
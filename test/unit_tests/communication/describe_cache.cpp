@@ -0,0 +1,233 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "describe_cache.h"
+#include "fake_protocol.h"
+
+#include <catch2/catch.hpp>
+
+#include <string>
+#include <vector>
+
+using namespace particle::protocol;
+using namespace particle::protocol::test;
+
+namespace {
+
+/**
+ * Counts the describe messages sent by the device: responses to describe requests, and posts.
+ */
+unsigned count_describes(const FakeChannel& channel)
+{
+	unsigned count = 0;
+	for (const auto& data: channel.sent)
+	{
+		CoAPReader reader(data.data(), data.size());
+		const uint8_t* path = nullptr;
+		size_t length = 0;
+		const bool post = reader.code() == CoAPCode::POST && reader.find_option(CoAPOption::URI_PATH, &path, &length) &&
+				length == 1 && path[0] == 'd';
+		const bool response = reader.type() == CoAPType::ACK && reader.code() == CoAPCode::CONTENT &&
+				reader.payload_length();
+		if (post || response)
+		{
+			++count;
+		}
+	}
+	return count;
+}
+
+/**
+ * Runs the handshake. After a full handshake, the server requests the describe message.
+ */
+void connect(FakeProtocol& protocol, bool resume)
+{
+	protocol.channel.establish_result = resume ? SESSION_RESUMED : NO_ERROR;
+	protocol.channel.establish_flags = resume ? Protocol::SKIP_SESSION_RESUME_HELLO : 0;
+	protocol.begin();
+	if (!resume)
+	{
+		std::vector<uint8_t> request(16);
+		CoAPWriter writer(request.data(), request.size());
+		const uint8_t token = 1;
+		writer.header(CoAPType::CON, CoAPCode::GET, 0x200, &token, sizeof(token));
+		writer.option(CoAPOption::URI_PATH, "d");
+		request.resize(writer.length());
+		protocol.channel.received.push_back(request);
+		protocol.process();
+	}
+}
+
+} // namespace
+
+SCENARIO("the sections of the describe message are cached across reconnects")
+{
+	GIVEN("a device with registered functions")
+	{
+		FakeDevice device;
+		device.functions = { "led", "reset" };
+		FakeProtocol protocol;
+		protocol.init(device);
+		connect(protocol, false);
+
+		THEN("the describe message is built and sent once per section")
+		{
+			REQUIRE(count_describes(protocol.channel)==1);
+			REQUIRE(device.app_builds==2);	// each build counts the size of the section, then stores it
+			REQUIRE(device.system_builds==2);
+			REQUIRE(protocol.describe(DESCRIBE_APPLICATION)=="{\"f\":[\"led\",\"reset\"],\"v\":{}}");
+		}
+
+		WHEN("the session is resumed several times")
+		{
+			for (int i = 0; i < 5; i++)
+			{
+				connect(protocol, true);
+			}
+
+			THEN("the describe message is neither built nor sent again")
+			{
+				REQUIRE(count_describes(protocol.channel)==1);
+				REQUIRE(device.app_builds==2);
+				REQUIRE(device.system_builds==2);
+			}
+
+			THEN("posting the unchanged describe message sends nothing")
+			{
+				REQUIRE(protocol.post_description(DESCRIBE_APPLICATION | DESCRIBE_SYSTEM)==NO_ERROR);
+				REQUIRE(count_describes(protocol.channel)==1);
+			}
+		}
+
+		WHEN("the device goes through several full handshakes")
+		{
+			for (int i = 0; i < 5; i++)
+			{
+				connect(protocol, false);
+			}
+
+			THEN("the describe message requested by the server is sent from the cache")
+			{
+				REQUIRE(count_describes(protocol.channel)==6);
+				REQUIRE(device.app_builds==2);
+				REQUIRE(device.system_builds==2);
+			}
+
+			THEN("posting the describe message already requested in the session sends nothing")
+			{
+				REQUIRE(protocol.post_description(DESCRIBE_APPLICATION | DESCRIBE_SYSTEM)==NO_ERROR);
+				REQUIRE(count_describes(protocol.channel)==6);
+			}
+		}
+
+		WHEN("a function is registered between reconnects")
+		{
+			device.functions.push_back("brew");
+			connect(protocol, true);
+			REQUIRE(protocol.post_description(DESCRIBE_APPLICATION)==NO_ERROR);
+
+			THEN("only the application section is rebuilt, and it is posted once")
+			{
+				REQUIRE(count_describes(protocol.channel)==2);
+				REQUIRE(device.app_builds==4);
+				REQUIRE(device.system_builds==2);
+				REQUIRE(protocol.post_description(DESCRIBE_APPLICATION)==NO_ERROR);
+				connect(protocol, true);
+				REQUIRE(count_describes(protocol.channel)==2);
+				REQUIRE(device.app_builds==4);
+			}
+		}
+
+		WHEN("the system information changes")
+		{
+			device.system_info = "\"p\":6,\"imei\":\"1\"";
+			device.system_crc = 2;
+			connect(protocol, false);
+
+			THEN("only the system section is rebuilt")
+			{
+				REQUIRE(count_describes(protocol.channel)==2);
+				REQUIRE(device.app_builds==2);
+				REQUIRE(device.system_builds==4);
+				REQUIRE(protocol.describe(DESCRIBE_SYSTEM)=="{\"p\":6,\"imei\":\"1\"}");
+			}
+		}
+	}
+}
+
+SCENARIO("DescribeCache")
+{
+	GIVEN("a cache")
+	{
+		DescribeCache cache;
+		cache.init(FakeDevice::calculate_crc);
+		std::string content = "\"f\":[]";
+		unsigned builds = 0;
+		const auto append = [&](uint32_t state_crc) {
+			std::string data(64, '\0');
+			particle::BufferAppender2 appender(&data[0], data.size());
+			cache.append(DescribeCache::APPLICATION, state_crc, appender, [&](Appender& a) {
+				++builds;
+				a.append(content.c_str());
+			});
+			data.resize(appender.dataSize());
+			return data;
+		};
+
+		THEN("a section is built once for a given state checksum")
+		{
+			REQUIRE(append(1)=="\"f\":[]");
+			REQUIRE(append(1)=="\"f\":[]");
+			REQUIRE(cache.build_count()==1);
+			REQUIRE(builds==2);	// each build counts the size of the section, then stores it
+		}
+
+		THEN("a section is rebuilt when the state checksum changes")
+		{
+			append(1);
+			content = "\"f\":[\"led\"]";
+			REQUIRE(append(2)=="\"f\":[\"led\"]");
+			REQUIRE(cache.build_count()==2);
+		}
+
+		THEN("a section that was sent is no longer sent once its content changes")
+		{
+			append(1);
+			cache.set_sent(DescribeCache::APPLICATION);
+			REQUIRE(cache.is_sent(DescribeCache::APPLICATION));
+			content = "\"f\":[\"led\"]";
+			append(2);
+			REQUIRE_FALSE(cache.is_sent(DescribeCache::APPLICATION));
+		}
+
+		THEN("a new session forgets what was sent")
+		{
+			append(1);
+			cache.set_sent(DescribeCache::APPLICATION);
+			cache.reset_sent();
+			REQUIRE_FALSE(cache.is_sent(DescribeCache::APPLICATION));
+		}
+
+		THEN("a cleared cache builds the section again")
+		{
+			append(1);
+			cache.clear();
+			append(1);
+			REQUIRE(cache.build_count()==2);
+		}
+	}
+}
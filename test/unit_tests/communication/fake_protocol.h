@@ -0,0 +1,339 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "protocol.h"
+#include "buffer_message_channel.h"
+#include "messages.h"
+
+#include <cstring>
+#include <deque>
+#include <string>
+#include <vector>
+
+namespace particle { namespace protocol { namespace test {
+
+/**
+ * A message channel that records the messages sent by the protocol, and delivers the messages
+ * queued by the test. Requests are assigned consecutive message IDs, and the IDs of other messages are written
+ * to the buffer, as CoAPChannel does.
+ */
+class FakeChannel : public BufferMessageChannel<PROTOCOL_BUFFER_SIZE>
+{
+public:
+	std::vector<std::vector<uint8_t>> sent;
+	std::deque<std::vector<uint8_t>> received;
+	ProtocolError establish_result = NO_ERROR;
+	uint32_t establish_flags = 0;
+	SessionResumeFailure::Enum resume_failure = SessionResumeFailure::NONE;
+	unsigned established = 0;
+	message_id_t next_id = 1;
+
+	bool is_unreliable() override { return true; }
+	ProtocolError notify_established() override { return NO_ERROR; }
+	void notify_client_messages_processed() override {}
+	ProtocolError command(Command cmd, void* arg) override
+	{
+		if (cmd == GET_RESUME_FAILURE)
+		{
+			*static_cast<SessionResumeFailure::Enum*>(arg) = resume_failure;
+		}
+		return NO_ERROR;
+	}
+
+	ProtocolError establish(uint32_t& flags, uint32_t app_state_crc) override
+	{
+		++established;
+		flags = establish_flags;
+		return establish_result;
+	}
+
+	ProtocolError send(Message& message) override
+	{
+		if (!message.has_id() && (message.get_type() == CoAPType::CON || message.get_type() == CoAPType::NON))
+		{
+			message.set_id(next_id++);
+		}
+		if (message.has_id())
+		{
+			message.buf()[2] = message.get_id() >> 8;
+			message.buf()[3] = message.get_id() & 0xff;
+		}
+		sent.push_back(std::vector<uint8_t>(message.buf(), message.buf() + message.length()));
+		return NO_ERROR;
+	}
+
+	ProtocolError receive(Message& message) override
+	{
+		create(message);
+		if (!received.empty())
+		{
+			const std::vector<uint8_t>& data = received.front();
+			memcpy(message.buf(), data.data(), data.size());
+			message.set_length(data.size());
+			received.pop_front();
+		}
+		return NO_ERROR;
+	}
+
+	/**
+	 * Queues an acknowledgement of the given message.
+	 */
+	void ack(message_id_t id, CoAPCode::Enum code = CoAPCode::EMPTY, unsigned option = 0, uint32_t option_value = 0)
+	{
+		std::vector<uint8_t> data(32);
+		CoAPWriter writer(data.data(), data.size());
+		writer.header(CoAPType::ACK, code, id);
+		if (option)
+		{
+			writer.option_uint(option, option_value);
+		}
+		data.resize(writer.length());
+		received.push_back(data);
+	}
+
+	/**
+	 * Queues a response to the given request, which echoes its token. The response is piggybacked on the
+	 * acknowledgement of the request, unless another type and message ID are given for a separate response.
+	 */
+	void respond(const std::vector<uint8_t>& request, CoAPCode::Enum code, unsigned option = 0,
+			uint32_t option_value = 0, CoAPType::Enum type = CoAPType::ACK, message_id_t id = 0)
+	{
+		CoAPReader reader(request.data(), request.size());
+		std::vector<uint8_t> data(32);
+		CoAPWriter writer(data.data(), data.size());
+		writer.header(type, code, type == CoAPType::ACK ? reader.id() : id, reader.token(), reader.token_length());
+		if (option)
+		{
+			writer.option_uint(option, option_value);
+		}
+		data.resize(writer.length());
+		received.push_back(data);
+	}
+
+	/**
+	 * Queues the server's hello with the given flags.
+	 */
+	void hello(uint8_t flags)
+	{
+		std::vector<uint8_t> data(32);
+		data.resize(Messages::hello(data.data(), 0x1000, flags, PLATFORM_ID, PRODUCT_ID, PRODUCT_FIRMWARE_VERSION,
+				true, nullptr, 0));
+		received.push_back(data);
+	}
+
+	/**
+	 * Returns the sent messages with the given first Uri-Path option.
+	 */
+	std::vector<std::vector<uint8_t>> sent_to(char path) const
+	{
+		std::vector<std::vector<uint8_t>> messages;
+		for (const auto& data: sent)
+		{
+			CoAPReader reader(data.data(), data.size());
+			const uint8_t* value = nullptr;
+			size_t length = 0;
+			if (reader.find_option(CoAPOption::URI_PATH, &value, &length) && length && value[0] == path)
+			{
+				messages.push_back(data);
+			}
+		}
+		return messages;
+	}
+};
+
+/**
+ * The functions and system information described by the device. The protocol reads them via the
+ * descriptor callbacks, which count how often each section of the describe message is built.
+ */
+struct FakeDevice
+{
+	std::vector<std::string> functions;
+	std::string system_info = "\"p\":6";
+	uint32_t system_crc = 1;
+	unsigned app_builds = 0;
+	unsigned system_builds = 0;
+	system_tick_t millis = 0;
+	int firmware_update_flags = 0;
+
+	FakeDevice() { instance() = this; }
+	~FakeDevice() { instance() = nullptr; }
+
+	SparkCallbacks callbacks()
+	{
+		SparkCallbacks callbacks = {};
+		callbacks.size = sizeof(callbacks);
+		callbacks.millis = get_millis;
+		callbacks.calculate_crc = calculate_crc;
+		callbacks.firmware_update_flags = get_firmware_update_flags;
+		return callbacks;
+	}
+
+	SparkDescriptor descriptor()
+	{
+		SparkDescriptor descriptor = {};
+		descriptor.size = sizeof(descriptor);
+		descriptor.num_functions = num_functions;
+		descriptor.get_function_key = get_function_key;
+		descriptor.num_variables = num_variables;
+		descriptor.was_ota_upgrade_successful = was_ota_upgrade_successful;
+		descriptor.ota_upgrade_status_sent = ota_upgrade_status_sent;
+		descriptor.append_system_info = append_system_info;
+		descriptor.app_state_selector_info = app_state_selector_info;
+		return descriptor;
+	}
+
+	uint32_t app_crc() const
+	{
+		std::string keys;
+		for (const auto& f: functions)
+		{
+			keys += f + ",";
+		}
+		return calculate_crc((const uint8_t*)keys.data(), keys.size());
+	}
+
+	static uint32_t calculate_crc(const uint8_t* data, uint32_t length)
+	{
+		uint32_t crc = 0;
+		for (uint32_t i = 0; i < length; i++)
+		{
+			crc = crc * 31 + data[i];
+		}
+		return crc;
+	}
+
+private:
+	static FakeDevice*& instance()
+	{
+		static FakeDevice* device = nullptr;
+		return device;
+	}
+
+	static system_tick_t get_millis() { return instance()->millis; }
+	static int get_firmware_update_flags(void* reserved) { return instance()->firmware_update_flags; }
+
+	static int num_functions()
+	{
+		++instance()->app_builds;
+		return instance()->functions.size();
+	}
+
+	static const char* get_function_key(int index) { return instance()->functions[index].c_str(); }
+	static int num_variables() { return 0; }
+	static bool was_ota_upgrade_successful() { return false; }
+	static void ota_upgrade_status_sent() {}
+
+	static bool append_system_info(appender_fn append, void* data, void* reserved)
+	{
+		++instance()->system_builds;
+		return append(data, (const uint8_t*)instance()->system_info.data(), instance()->system_info.size());
+	}
+
+	static uint32_t app_state_selector_info(SparkAppStateSelector::Enum selector, SparkAppStateUpdate::Enum operation,
+			uint32_t data, void* reserved)
+	{
+		if (operation != SparkAppStateUpdate::COMPUTE)
+		{
+			return 0;
+		}
+		switch (selector)
+		{
+		case SparkAppStateSelector::DESCRIBE_APP:
+			return instance()->app_crc();
+		case SparkAppStateSelector::DESCRIBE_SYSTEM:
+			return instance()->system_crc;
+		default:
+			return 0;
+		}
+	}
+};
+
+/**
+ * A protocol over a {@link FakeChannel}, with access to the internals the tests inspect.
+ */
+class FakeProtocol : public Protocol
+{
+public:
+	FakeChannel channel;
+
+	FakeProtocol() : Protocol(channel)
+	{
+	}
+
+	void init(FakeDevice& device)
+	{
+		const SparkKeys keys = {};
+		init("", keys, device.callbacks(), device.descriptor());
+	}
+
+	void init(const char* id, const SparkKeys& keys, const SparkCallbacks& callbacks,
+			const SparkDescriptor& descriptor) override
+	{
+		set_protocol_flags(0);
+		Protocol::init(callbacks, descriptor);
+	}
+
+	size_t build_hello(Message& message, uint8_t flags) override
+	{
+		return Messages::hello(message.buf(), 0, flags, PLATFORM_ID, PRODUCT_ID, PRODUCT_FIRMWARE_VERSION, true,
+				nullptr, 0);
+	}
+
+	int command(ProtocolCommands::Enum command, uint32_t data) override
+	{
+		return 0;
+	}
+
+	int get_status(protocol_status* status) const override
+	{
+		status->flags = 0;
+		return 0;
+	}
+
+	void set_flags(int flags)
+	{
+		set_protocol_flags(flags);
+	}
+
+	/**
+	 * Returns the complete describe message.
+	 */
+	std::string describe(int desc_flags)
+	{
+		std::string data(8192, '\0');
+		BufferAppender2 appender(&data[0], data.size());
+		build_describe_message(appender, desc_flags);
+		data.resize(appender.dataSize());
+		return data;
+	}
+
+	/**
+	 * Processes the messages queued in the channel.
+	 */
+	void process()
+	{
+		while (!channel.received.empty())
+		{
+			CoAPMessageType::Enum type;
+			event_loop(type);
+		}
+	}
+};
+
+}}} // namespace particle::protocol::test
@@ -0,0 +1,197 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "functions.h"
+
+#include <catch2/catch.hpp>
+
+#include <string>
+#include <vector>
+
+using namespace particle;
+using namespace particle::protocol;
+
+namespace {
+
+/**
+ * Records the messages sent through it.
+ */
+class RecordingChannel : public MessageChannel
+{
+public:
+	std::vector<std::vector<uint8_t>> sent;
+	message_id_t next_id = 100;
+
+	bool is_unreliable() override { return true; }
+	ProtocolError establish(uint32_t& flags, uint32_t app_state_crc) override { return NO_ERROR; }
+	ProtocolError create(Message& message, size_t minimum_size) override
+	{
+		message.set_buffer(buffer, sizeof(buffer));
+		return NO_ERROR;
+	}
+	ProtocolError response(Message& original, Message& response, size_t required) override
+	{
+		return create(response, required);
+	}
+	ProtocolError notify_established() override { return NO_ERROR; }
+	void notify_client_messages_processed() override {}
+	ProtocolError receive(Message& message) override { return NO_ERROR; }
+	ProtocolError send(Message& msg) override
+	{
+		if (!msg.has_id())
+		{
+			msg.set_id(next_id++);
+		}
+		sent.push_back(std::vector<uint8_t>(msg.buf(), msg.buf() + msg.length()));
+		return NO_ERROR;
+	}
+	ProtocolError command(Command cmd, void* arg) override { return NO_ERROR; }
+
+	CoAPType::Enum type(size_t i) const { return CoAP::type(sent.at(i).data()); }
+	uint8_t code(size_t i) const { return sent.at(i)[1]; }
+
+private:
+	uint8_t buffer[PROTOCOL_BUFFER_SIZE];
+};
+
+std::vector<SparkDescriptor::FunctionResultCallback> calls;
+std::vector<std::string> call_args;
+
+int call_function(const char* function_key, const char* arg, SparkDescriptor::FunctionResultCallback callback, void* reserved)
+{
+	if (strcmp(function_key, "brew"))
+		return -1;
+	calls.push_back(callback);
+	call_args.push_back(arg);
+	return 0;
+}
+
+/**
+ * Builds a function call with a one byte token: Uri-Path "f", the function key and the argument.
+ */
+std::vector<uint8_t> function_call(const std::string& key, const std::string& arg)
+{
+	std::vector<uint8_t> msg = { 0x41, 0x02, 0x12, 0x34, 0x07, 0xb1, 'f', uint8_t(key.size()) };
+	msg.insert(msg.end(), key.begin(), key.end());
+	msg.push_back(0x40 | arg.size());
+	msg.insert(msg.end(), arg.begin(), arg.end());
+	return msg;
+}
+
+ProtocolError handle(Functions& functions, RecordingChannel& channel, const std::string& key, const std::string& arg)
+{
+	std::vector<uint8_t> data = function_call(key, arg);
+	data.resize(PROTOCOL_BUFFER_SIZE);
+	Message message(data.data(), data.size(), function_call(key, arg).size());
+	return functions.handle_function_call(0x07, 0x1234, message, channel, call_function);
+}
+
+} // namespace
+
+SCENARIO("Functions")
+{
+	calls.clear();
+	call_args.clear();
+	CompletionHandlerMap<message_id_t> ack_handlers;
+	Functions functions(ack_handlers);
+	RecordingChannel channel;
+
+	GIVEN("a function call")
+	{
+		REQUIRE(handle(functions, channel, "brew", "coffee")==NO_ERROR);
+
+		THEN("the call is acknowledged before the function returns")
+		{
+			REQUIRE(channel.sent.size()==1);
+			REQUIRE(channel.type(0)==CoAPType::ACK);
+			REQUIRE(channel.code(0)==0);
+			REQUIRE(calls.size()==1);
+			REQUIRE(call_args[0]=="coffee");
+			REQUIRE(functions.pending_calls()==1);
+		}
+
+		WHEN("the function returns")
+		{
+			REQUIRE(calls[0]((const void*)42, SparkReturnType::INT));
+
+			THEN("the result is sent in a separate confirmable message")
+			{
+				REQUIRE(channel.sent.size()==2);
+				REQUIRE(channel.type(1)==CoAPType::CON);
+				REQUIRE(channel.code(1)==CoAPCode::CHANGED);
+				REQUIRE(channel.sent[1][4]==0x07);
+				const std::vector<uint8_t> payload(channel.sent[1].end() - 4, channel.sent[1].end());
+				REQUIRE(payload==std::vector<uint8_t>({ 0, 0, 0, 42 }));
+				REQUIRE(functions.pending_calls()==0);
+			}
+
+			THEN("its acknowledgement is awaited")
+			{
+				REQUIRE(ack_handlers.hasHandler(100));
+			}
+		}
+
+		WHEN("a new session is started before the function returns")
+		{
+			functions.reset();
+			REQUIRE_FALSE(calls[0]((const void*)42, SparkReturnType::INT));
+
+			THEN("the result is dropped")
+			{
+				REQUIRE(channel.sent.size()==1);
+				REQUIRE(functions.pending_calls()==0);
+			}
+		}
+	}
+
+	GIVEN("too many calls in progress")
+	{
+		for (unsigned i = 0; i < MAX_PENDING_FUNCTION_CALLS; i++)
+		{
+			REQUIRE(handle(functions, channel, "brew", "tea")==NO_ERROR);
+		}
+		REQUIRE(handle(functions, channel, "brew", "tea")==NO_ERROR);
+
+		THEN("the next call is rejected")
+		{
+			REQUIRE(calls.size()==MAX_PENDING_FUNCTION_CALLS);
+			REQUIRE(channel.type(MAX_PENDING_FUNCTION_CALLS)==CoAPType::ACK);
+			REQUIRE(channel.code(MAX_PENDING_FUNCTION_CALLS)==CoAPCode::SERVICE_UNAVAILABLE);
+		}
+
+		WHEN("a function returns")
+		{
+			calls[0]((const void*)0, SparkReturnType::INT);
+
+			THEN("a call is accepted again")
+			{
+				REQUIRE(handle(functions, channel, "brew", "tea")==NO_ERROR);
+				REQUIRE(calls.size()==MAX_PENDING_FUNCTION_CALLS + 1);
+			}
+		}
+	}
+
+	GIVEN("a call to a function that doesn't exist")
+	{
+		REQUIRE(handle(functions, channel, "grind", "")==NO_ERROR);
+
+		THEN("it is not counted as in progress")
+		{
+			REQUIRE(functions.pending_calls()==0);
+		}
+	}
+}
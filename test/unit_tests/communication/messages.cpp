@@ -21,6 +21,8 @@
 
 #include <catch2/catch.hpp>
 
+#include <string>
+
 using namespace particle::protocol;
 
 SCENARIO("determining message type from a CoAP GET message")
@@ -290,3 +292,138 @@ SCENARIO("confirmable messages")
 	}
 
 }
+
+SCENARIO("encoding a batch of events")
+{
+	GIVEN("a batch message header")
+	{
+		uint8_t buf[16];
+		const size_t len = Messages::event_batch(buf, 0x1234);
+
+		THEN("it is a confirmable POST with a payload marker")
+		{
+			const uint8_t expected[] = { 0x40, 0x02, 0x12, 0x34, 0xb1, 'b', 0xff };
+			REQUIRE(len==sizeof(expected));
+			REQUIRE(memcmp(buf, expected, len)==0);
+			REQUIRE(CoAP::type(buf)==CoAPType::CON);
+		}
+	}
+
+	GIVEN("an event record")
+	{
+		uint8_t buf[32];
+
+		WHEN("the record fits in the buffer")
+		{
+			const size_t len = Messages::event_batch_record(buf, sizeof(buf), "temp", "21.5", 0x010203, EventType::PRIVATE);
+
+			THEN("the type, name, TTL and data are encoded")
+			{
+				const uint8_t expected[] = { 'E', 4, 't', 'e', 'm', 'p', 0x01, 0x02, 0x03, 0, 4, '2', '1', '.', '5' };
+				REQUIRE(len==sizeof(expected));
+				REQUIRE(memcmp(buf, expected, len)==0);
+			}
+		}
+
+		WHEN("the event has no data")
+		{
+			const size_t len = Messages::event_batch_record(buf, sizeof(buf), "a", nullptr, 60, EventType::PUBLIC);
+
+			THEN("the data length is zero")
+			{
+				const uint8_t expected[] = { 'e', 1, 'a', 0, 0, 60, 0, 0 };
+				REQUIRE(len==sizeof(expected));
+				REQUIRE(memcmp(buf, expected, len)==0);
+			}
+		}
+
+		WHEN("the record doesn't fit in the buffer")
+		{
+			THEN("nothing is written")
+			{
+				REQUIRE(Messages::event_batch_record(buf, 14, "temp", "21.5", 60, EventType::PRIVATE)==0);
+				REQUIRE(Messages::event_batch_record(buf, 15, "temp", "21.5", 60, EventType::PRIVATE)==15);
+			}
+		}
+	}
+}
+
+SCENARIO("encoded messages can be decoded with CoAPReader")
+{
+	GIVEN("an event message")
+	{
+		uint8_t buf[128];
+		const size_t len = Messages::event(buf, 0x1234, "temperature/kitchen", "21.5", 0x010203, EventType::PRIVATE, true);
+		CoAPReader reader(buf, len);
+
+		THEN("the event type, name, TTL and data are decoded")
+		{
+			REQUIRE(reader.is_valid());
+			REQUIRE(reader.type()==CoAPType::CON);
+			REQUIRE(reader.code()==CoAPCode::POST);
+			REQUIRE(reader.id()==0x1234);
+			auto option = reader.options();
+			REQUIRE(option.next());
+			REQUIRE(option.number()==CoAPOption::URI_PATH);
+			REQUIRE(option.length()==1);
+			REQUIRE(option.data()[0]=='E');
+			REQUIRE(option.next());
+			REQUIRE(option.number()==CoAPOption::URI_PATH);
+			REQUIRE(std::string((const char*)option.data(), option.length())=="temperature/kitchen");
+			REQUIRE(option.next());
+			REQUIRE(option.number()==CoAPOption::MAX_AGE);
+			REQUIRE(option.length()==3);
+			REQUIRE_FALSE(option.next());
+			REQUIRE(std::string((const char*)reader.payload(), reader.payload_length())=="21.5");
+		}
+	}
+
+	GIVEN("an event message with the default TTL and no data")
+	{
+		uint8_t buf[64];
+		const size_t len = Messages::event(buf, 0, "a", nullptr, 60, EventType::PUBLIC, false);
+
+		THEN("there is no Max-Age option and no payload")
+		{
+			const uint8_t expected[] = { 0x50, 0x02, 0, 0, 0xb1, 'e', 0x01, 'a' };
+			REQUIRE(len==sizeof(expected));
+			REQUIRE(memcmp(buf, expected, len)==0);
+		}
+	}
+
+	GIVEN("a function return message")
+	{
+		uint8_t buf[Messages::function_return_size];
+		const size_t len = Messages::function_return(buf, 0x0102, 0x33, 0x11223344, false);
+
+		THEN("the encoding is unchanged")
+		{
+			const uint8_t expected[] = { 0x51, 0x44, 0x01, 0x02, 0x33, 0xff, 0x11, 0x22, 0x33, 0x44 };
+			REQUIRE(len==sizeof(expected));
+			REQUIRE(memcmp(buf, expected, len)==0);
+		}
+	}
+
+	GIVEN("variable values")
+	{
+		uint8_t buf[32];
+
+		THEN("an int value is encoded big endian")
+		{
+			const size_t len = Messages::variable_value(buf, 0x0102, 0x33, 0x11223344);
+			const uint8_t expected[] = { 0x61, 0x45, 0x01, 0x02, 0x33, 0xff, 0x11, 0x22, 0x33, 0x44 };
+			REQUIRE(len==sizeof(expected));
+			REQUIRE(memcmp(buf, expected, len)==0);
+		}
+
+		THEN("a string value is the payload")
+		{
+			const size_t len = Messages::variable_value(buf, 0x0102, 0x33, "abc", 3);
+			CoAPReader reader(buf, len);
+			REQUIRE(reader.is_valid());
+			REQUIRE(reader.token_length()==1);
+			REQUIRE(reader.token()[0]==0x33);
+			REQUIRE(std::string((const char*)reader.payload(), reader.payload_length())=="abc");
+		}
+	}
+}
@@ -0,0 +1,455 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Runs the protocol stack (Protocol over CoAPChannel and CoAPReliableChannel) against an in-process
+ * cloud over a simulated link with latency, jitter and loss, and reports the event throughput, the
+ * publish-to-ACK latency, the bytes on the wire and the retransmissions.
+ *
+ * Time is simulated, so the results don't depend on the host and can be compared between runs.
+ * The host time spent in the stack is reported as well.
+ *
+ * Usage: communication_benchmark [--events=N] [--window=N] [--payload=BYTES] [--latency=MS]
+ *        [--jitter=MS] [--loss=P] [--overhead=BYTES] [--batch] [--rate-limit] [--seed=N]
+ *        [--max-p99=MS] [--min-rate=EVENTS_PER_SEC]
+ *
+ * The last two options make the benchmark fail if the results are worse, for use in CI.
+ */
+
+#include "protocol.h"
+#include "coap_channel.h"
+#include "buffer_message_channel.h"
+#include "messages.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+using namespace particle;
+using namespace particle::protocol;
+
+namespace {
+
+system_tick_t now = 0;
+
+system_tick_t sim_millis()
+{
+	return now;
+}
+
+uint32_t sim_crc(const uint8_t* data, uint32_t length)
+{
+	uint32_t crc = 0;
+	for (uint32_t i = 0; i < length; i++)
+		crc = crc * 31 + data[i];
+	return crc;
+}
+
+bool ota_upgrade_successful()
+{
+	return true;
+}
+
+struct Options
+{
+	unsigned events = 1000;
+	unsigned window = 4;
+	unsigned payload = 32;
+	unsigned latency = 100;
+	unsigned jitter = 20;
+	double loss = 0.0;
+	unsigned overhead = 57;		// DTLS record (29 bytes) and UDP/IPv4 headers (28 bytes)
+	bool batch = false;
+	bool rate_limit = false;
+	unsigned seed = 1;
+	unsigned max_p99 = 0;
+	double min_rate = 0;
+
+	bool parse(int argc, char* argv[])
+	{
+		for (int i = 1; i < argc; i++)
+		{
+			const char* arg = argv[i];
+			const char* value = strchr(arg, '=');
+			value = value ? value + 1 : "";
+			if (!strncmp(arg, "--events=", 9)) events = atoi(value);
+			else if (!strncmp(arg, "--window=", 9)) window = std::max(1, atoi(value));
+			else if (!strncmp(arg, "--payload=", 10)) payload = atoi(value);
+			else if (!strncmp(arg, "--latency=", 10)) latency = atoi(value);
+			else if (!strncmp(arg, "--jitter=", 9)) jitter = atoi(value);
+			else if (!strncmp(arg, "--loss=", 7)) loss = atof(value);
+			else if (!strncmp(arg, "--overhead=", 11)) overhead = atoi(value);
+			else if (!strcmp(arg, "--batch")) batch = true;
+			else if (!strcmp(arg, "--rate-limit")) rate_limit = true;
+			else if (!strncmp(arg, "--seed=", 7)) seed = atoi(value);
+			else if (!strncmp(arg, "--max-p99=", 10)) max_p99 = atoi(value);
+			else if (!strncmp(arg, "--min-rate=", 11)) min_rate = atof(value);
+			else
+			{
+				fprintf(stderr, "unknown option: %s\n", arg);
+				return false;
+			}
+		}
+		return true;
+	}
+};
+
+/**
+ * One direction of the simulated link. Packets are delivered after the latency plus a random
+ * jitter, and lost with the given probability.
+ */
+class Link
+{
+public:
+	unsigned packets = 0;
+	unsigned bytes = 0;
+	unsigned lost = 0;
+
+	Link(const Options& options, std::mt19937& rng) :
+			options(options), rng(rng), loss(options.loss), jitter(0, options.jitter)
+	{
+	}
+
+	void send(const uint8_t* data, size_t length)
+	{
+		packets++;
+		bytes += length;
+		if (loss(rng))
+		{
+			lost++;
+			return;
+		}
+		queue.emplace(now + options.latency + jitter(rng), std::vector<uint8_t>(data, data + length));
+	}
+
+	bool receive(std::vector<uint8_t>& data)
+	{
+		if (queue.empty() || queue.begin()->first > now)
+			return false;
+		data = std::move(queue.begin()->second);
+		queue.erase(queue.begin());
+		return true;
+	}
+
+	bool idle() const
+	{
+		return queue.empty();
+	}
+
+private:
+	const Options& options;
+	std::mt19937& rng;
+	std::bernoulli_distribution loss;
+	std::uniform_int_distribution<unsigned> jitter;
+	std::multimap<system_tick_t, std::vector<uint8_t>> queue;
+};
+
+/**
+ * Acknowledges the confirmable messages sent by the device, and counts the events received.
+ */
+class FakeCloud
+{
+public:
+	unsigned events = 0;
+	unsigned duplicates = 0;
+
+	FakeCloud(Link& uplink, Link& downlink) :
+			uplink(uplink), downlink(downlink)
+	{
+	}
+
+	void process()
+	{
+		std::vector<uint8_t> data;
+		while (uplink.receive(data))
+		{
+			CoAPReader reader(data.data(), data.size());
+			if (!reader.is_valid() || reader.type() != CoAPType::CON)
+				continue;
+			if (!received.insert(reader.id()).second)
+				duplicates++;
+			else if (is_event(reader))
+				events += count_events(reader);
+			uint8_t ack[4];
+			const size_t length = CoAP::header(ack, CoAPType::ACK, CoAPCode::EMPTY, 0, nullptr, reader.id());
+			downlink.send(ack, length);
+		}
+	}
+
+private:
+	Link& uplink;
+	Link& downlink;
+	std::set<message_id_t> received;
+
+	static bool is_event(const CoAPReader& reader)
+	{
+		const uint8_t* path = nullptr;
+		size_t length = 0;
+		return reader.find_option(CoAPOption::URI_PATH, &path, &length) && length >= 1 &&
+				(path[0] == 'e' || path[0] == 'E' || path[0] == 'b');
+	}
+
+	static unsigned count_events(const CoAPReader& reader)
+	{
+		const uint8_t* path = nullptr;
+		size_t length = 0;
+		reader.find_option(CoAPOption::URI_PATH, &path, &length);
+		if (path[0] != 'b')
+			return 1;
+		// a batch is a sequence of records: type, name length, name, TTL (3 bytes), data length (2 bytes), data
+		unsigned count = 0;
+		const uint8_t* p = reader.payload();
+		const uint8_t* end = p + reader.payload_length();
+		while (p && end - p >= 2)
+		{
+			p += 2 + p[1] + 3;
+			if (end - p < 2)
+				break;
+			p += 2 + (p[0] << 8 | p[1]);
+			count++;
+		}
+		return count;
+	}
+};
+
+/**
+ * The device end of the link. Receiving a message lets the cloud run, and advances the simulated
+ * time when there is nothing to receive.
+ */
+class LinkChannel : public BufferMessageChannel<PROTOCOL_BUFFER_SIZE>
+{
+public:
+	unsigned retransmits = 0;
+	Link* uplink = nullptr;
+	Link* downlink = nullptr;
+	FakeCloud* cloud = nullptr;
+
+	bool is_unreliable() override { return true; }
+	ProtocolError establish(uint32_t& flags, uint32_t app_state_crc) override { return NO_ERROR; }
+	ProtocolError notify_established() override { return NO_ERROR; }
+	void notify_client_messages_processed() override {}
+	ProtocolError command(Command cmd, void* arg) override { return NO_ERROR; }
+
+	ProtocolError send(Message& message) override
+	{
+		if (message.get_type() == CoAPType::CON && !sent.insert(message.get_id()).second)
+			retransmits++;
+		uplink->send(message.buf(), message.length());
+		return NO_ERROR;
+	}
+
+	ProtocolError receive(Message& message) override
+	{
+		create(message);
+		cloud->process();
+		std::vector<uint8_t> data;
+		if (downlink->receive(data) && data.size() <= message.capacity())
+		{
+			memcpy(message.buf(), data.data(), data.size());
+			message.set_length(data.size());
+		}
+		else
+		{
+			now++;
+		}
+		return NO_ERROR;
+	}
+
+private:
+	std::set<message_id_t> sent;
+};
+
+class BenchmarkProtocol : public Protocol
+{
+public:
+	CoAPChannel<CoAPReliableChannel<LinkChannel, decltype(SparkCallbacks::millis)>> channel;
+
+	BenchmarkProtocol() : Protocol(channel)
+	{
+		channel.set_millis(sim_millis);
+	}
+
+	size_t build_hello(Message& message, uint8_t flags) override
+	{
+		const uint8_t device_id[12] = {};
+		return Messages::hello(message.buf(), 0, flags, PLATFORM_ID, PRODUCT_ID, PRODUCT_FIRMWARE_VERSION, true,
+				device_id, sizeof(device_id));
+	}
+
+	int command(ProtocolCommands::Enum command, uint32_t data) override
+	{
+		return 0;
+	}
+
+	void init(const char* id, const SparkKeys& keys, const SparkCallbacks& callbacks,
+			const SparkDescriptor& descriptor) override
+	{
+		Protocol::init(callbacks, descriptor);
+	}
+
+	int get_status(protocol_status* status) const override
+	{
+		status->flags = 0;
+		return 0;
+	}
+};
+
+struct Event
+{
+	system_tick_t published;
+	system_tick_t completed;
+	int error;
+	bool done;
+};
+
+unsigned outstanding = 0;
+
+void event_completed(int error, const void* data, void* callback_data, void* reserved)
+{
+	Event* event = static_cast<Event*>(callback_data);
+	event->completed = now;
+	event->error = error;
+	event->done = true;
+	outstanding--;
+}
+
+system_tick_t percentile(std::vector<system_tick_t>& values, double p)
+{
+	if (values.empty())
+		return 0;
+	std::sort(values.begin(), values.end());
+	return values[std::min(values.size() - 1, size_t(p * values.size()))];
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+	Options options;
+	if (!options.parse(argc, argv))
+		return 2;
+
+	std::mt19937 rng(options.seed);
+	Link uplink(options, rng);
+	Link downlink(options, rng);
+	FakeCloud cloud(uplink, downlink);
+
+	BenchmarkProtocol protocol;
+	protocol.channel.uplink = &uplink;
+	protocol.channel.downlink = &downlink;
+	protocol.channel.cloud = &cloud;
+
+	SparkCallbacks callbacks = {};
+	callbacks.size = sizeof(callbacks);
+	callbacks.millis = sim_millis;
+	callbacks.calculate_crc = sim_crc;
+	SparkDescriptor descriptor = {};
+	descriptor.size = sizeof(descriptor);
+	descriptor.was_ota_upgrade_successful = ota_upgrade_successful;
+	SparkKeys keys = {};
+	protocol.init("", keys, callbacks, descriptor);
+	if (!options.rate_limit)
+		protocol.set_rate_limit(false, 0xffff, 1);
+
+	if (protocol.begin() != NO_ERROR)
+	{
+		fprintf(stderr, "handshake failed\n");
+		return 1;
+	}
+
+	// measure the events only, not the handshake
+	const unsigned handshake_packets = uplink.packets + downlink.packets;
+	const unsigned handshake_bytes = uplink.bytes + downlink.bytes;
+	const unsigned handshake_retransmits = protocol.channel.retransmits;
+	const system_tick_t start = now;
+	const auto host_start = std::chrono::steady_clock::now();
+
+	const std::string data(options.payload, 'x');
+	const int flags = EventType::WITH_ACK | (options.batch ? EventType::BATCH : 0);
+	std::vector<Event> events(options.events);
+	unsigned published = 0;
+	const system_tick_t deadline = start + 3600 * 1000;
+	while (now < deadline)
+	{
+		while (published < options.events && outstanding < options.window)
+		{
+			Event& event = events[published++];
+			event = Event();
+			event.published = now;
+			outstanding++;
+			protocol.send_event("bench", data.c_str(), 60, EventType::PRIVATE, flags,
+					CompletionHandler(event_completed, &event));
+		}
+		if (published == options.events && !outstanding)
+			break;
+		if (!protocol.event_loop())
+		{
+			fprintf(stderr, "event loop failed\n");
+			return 1;
+		}
+	}
+
+	const double host_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - host_start).count();
+	const double seconds = (now - start) / 1000.0;
+	std::vector<system_tick_t> latencies;
+	unsigned failed = 0;
+	for (const Event& event: events)
+	{
+		if (!event.done || event.error)
+			failed++;
+		else
+			latencies.push_back(event.completed - event.published);
+	}
+	const unsigned packets = uplink.packets + downlink.packets - handshake_packets;
+	const unsigned bytes = uplink.bytes + downlink.bytes - handshake_bytes;
+	const double rate = seconds > 0 ? latencies.size() / seconds : 0;
+	const system_tick_t p50 = percentile(latencies, 0.50);
+	const system_tick_t p99 = percentile(latencies, 0.99);
+
+	printf("events:        %u acknowledged, %u failed, %u received by the cloud\n", (unsigned)latencies.size(), failed, cloud.events);
+	printf("throughput:    %.1f events/s (%.1f s simulated)\n", rate, seconds);
+	printf("latency:       p50 %u ms, p99 %u ms\n", (unsigned)p50, (unsigned)p99);
+	printf("packets:       %u (%u lost)\n", packets, uplink.lost + downlink.lost);
+	printf("bytes:         %u CoAP, %u on the wire\n", bytes, bytes + packets * options.overhead);
+	printf("retransmits:   %u (%u duplicates received by the cloud)\n", protocol.channel.retransmits - handshake_retransmits, cloud.duplicates);
+	printf("host time:     %.3f s, %.1f us/event\n", host_seconds, options.events ? host_seconds * 1e6 / options.events : 0);
+
+	int result = 0;
+	if (failed)
+	{
+		fprintf(stderr, "%u events failed\n", failed);
+		result = 1;
+	}
+	if (options.max_p99 && p99 > options.max_p99)
+	{
+		fprintf(stderr, "p99 latency %u ms exceeds %u ms\n", (unsigned)p99, options.max_p99);
+		result = 1;
+	}
+	if (options.min_rate > 0 && rate < options.min_rate)
+	{
+		fprintf(stderr, "throughput %.1f events/s is below %.1f events/s\n", rate, options.min_rate);
+		result = 1;
+	}
+	return result;
+}
@@ -21,8 +21,104 @@
 
 #include <catch2/catch.hpp>
 
+#include <string>
+#include <vector>
+
+using namespace particle;
 using namespace particle::protocol;
 
+namespace {
+
+/**
+ * Records the names of the events sent through it.
+ */
+class RecordingChannel : public MessageChannel
+{
+public:
+	std::vector<std::string> sent;
+	std::vector<std::vector<uint8_t>> batches;
+	ProtocolError send_result = NO_ERROR;
+
+	bool is_unreliable() override { return false; }
+	ProtocolError establish(uint32_t& flags, uint32_t app_state_crc) override { return NO_ERROR; }
+	ProtocolError create(Message& message, size_t minimum_size) override
+	{
+		message.set_buffer(buffer, sizeof(buffer));
+		return NO_ERROR;
+	}
+	ProtocolError response(Message& original, Message& response, size_t required) override { return NO_ERROR; }
+	ProtocolError notify_established() override { return NO_ERROR; }
+	void notify_client_messages_processed() override {}
+	ProtocolError receive(Message& message) override { return NO_ERROR; }
+	ProtocolError send(Message& msg) override
+	{
+		if (send_result == NO_ERROR) {
+			if (msg.buf()[5] == 'b') {
+				batches.push_back(std::vector<uint8_t>(msg.buf() + 7, msg.buf() + msg.length()));
+				return send_result;
+			}
+			// the event name is the second Uri-Path option, following "e"
+			const uint8_t* option = msg.buf() + 4 + 2;
+			size_t length = *option++ & 0x0f;
+			if (length == 13) {
+				length += *option++;
+			}
+			sent.push_back(std::string((const char*)option, length));
+		}
+		return send_result;
+	}
+	ProtocolError command(Command cmd, void* arg) override { return NO_ERROR; }
+
+private:
+	uint8_t buffer[PROTOCOL_BUFFER_SIZE];
+};
+
+struct Completion
+{
+	int count = 0;
+	int error = 0;
+
+	CompletionHandler handler()
+	{
+		return CompletionHandler([](int error, const void* data, void* callback_data, void* reserved) {
+			Completion* c = static_cast<Completion*>(callback_data);
+			c->count++;
+			c->error = error;
+		}, this);
+	}
+};
+
+ProtocolError publish(Publisher& publisher, RecordingChannel& channel, const char* name, system_tick_t time,
+		CompletionHandler handler = CompletionHandler(), int flags = 0)
+{
+	return publisher.send_event(channel, name, "data", 60, EventType::PRIVATE, flags, time, std::move(handler));
+}
+
+ProtocolError publish_batched(Publisher& publisher, RecordingChannel& channel, const char* name, system_tick_t time,
+		CompletionHandler handler = CompletionHandler())
+{
+	return publish(publisher, channel, name, time, std::move(handler), EventType::BATCH);
+}
+
+/**
+ * Extracts the event names from the payload of a batch.
+ */
+std::vector<std::string> batch_event_names(const std::vector<uint8_t>& payload)
+{
+	std::vector<std::string> names;
+	size_t i = 0;
+	while (i < payload.size()) {
+		const size_t name_len = payload[i + 1];
+		names.push_back(std::string((const char*)&payload[i + 2], name_len));
+		i += 2 + name_len + 3;
+		const size_t data_len = payload[i] << 8 | payload[i + 1];
+		i += 2 + data_len;
+	}
+	return names;
+}
+
+} // namespace
+
 SCENARIO("publisher")
 {
 	GIVEN("a publisher")
@@ -37,17 +133,35 @@ SCENARIO("publisher")
 			REQUIRE(publisher.is_rate_limited(false, 1400)==false);
 			REQUIRE(publisher.is_rate_limited(false, 1600)==false);
 
-			const system_tick_t next_app_event = 5000;  // 1000ms + 4s
-			THEN("application events until 4 seconds have elapsed are rate limited")
+			THEN("application events are rate limited until a token is refilled")
 			{
-				for (system_tick_t i=1600; i<next_app_event; i+=100) {
+				for (system_tick_t i=1600; i<2000; i+=100) {
 					REQUIRE(publisher.is_rate_limited(false, i)==true);
 				}
 			}
 
-			THEN("an application event after 4 seconds have elapsed is not rate limited")
+			THEN("application events are allowed at a rate of 1 per second")
 			{
-				REQUIRE(publisher.is_rate_limited(false, next_app_event)==false);
+				REQUIRE(publisher.is_rate_limited(false, 2000)==false);
+				REQUIRE(publisher.is_rate_limited(false, 2000)==true);
+				REQUIRE(publisher.is_rate_limited(false, 2999)==true);
+				REQUIRE(publisher.is_rate_limited(false, 3000)==false);
+			}
+
+			THEN("a full burst is allowed again after 4 seconds")
+			{
+				for (int i=0; i<4; i++) {
+					REQUIRE(publisher.is_rate_limited(false, 5000)==false);
+				}
+				REQUIRE(publisher.is_rate_limited(false, 5000)==true);
+			}
+
+			THEN("idle time doesn't allow bursts larger than 4 events")
+			{
+				for (int i=0; i<4; i++) {
+					REQUIRE(publisher.is_rate_limited(false, 60000)==false);
+				}
+				REQUIRE(publisher.is_rate_limited(false, 60000)==true);
 			}
 		}
 
@@ -58,26 +172,11 @@ SCENARIO("publisher")
 				REQUIRE(publisher.is_rate_limited(true, i)==false);
 			}
 
-			THEN("all system events until the next minute begins are rate limited")
+			THEN("system events are rate limited until a token is refilled")
 			{
-				for (int i=1000; i<60*1000; i+=1000) {
-					INFO("The counter is " << i);
-					REQUIRE(publisher.is_rate_limited(true, i)==true);
-				}
-
-				// it's only approximately 1 minute, the cutoff is 64k milliseconds
-				for (int i=60000; i<65536; i+=8) {
-					INFO("The counter is " << i);
-					REQUIRE(publisher.is_rate_limited(true, i)==true);
-				}
-
-				AND_THEN("system events in the next minute are not rate limited")
-				{
-					for (int i=65536; i<65536+255; i++) {
-						INFO("The counter is " << i);
-						REQUIRE(publisher.is_rate_limited(true, i)==false);
-					}
-				}
+				REQUIRE(publisher.is_rate_limited(true, 255)==true);
+				REQUIRE(publisher.is_rate_limited(true, Publisher::SYSTEM_EVENT_INTERVAL)==false);
+				REQUIRE(publisher.is_rate_limited(true, Publisher::SYSTEM_EVENT_INTERVAL)==true);
 			}
 
 			THEN("application events are still rate limited after a burst of 4")
@@ -89,5 +188,346 @@ SCENARIO("publisher")
 				REQUIRE(publisher.is_rate_limited(false, 1000)==true);
 			}
 		}
+
+		WHEN("the rate limit is reconfigured")
+		{
+			publisher.set_rate_limit(false, 2, 100);
+
+			THEN("the new burst size and refill interval apply")
+			{
+				REQUIRE(publisher.is_rate_limited(false, 0)==false);
+				REQUIRE(publisher.is_rate_limited(false, 0)==false);
+				REQUIRE(publisher.is_rate_limited(false, 0)==true);
+				REQUIRE(publisher.is_rate_limited(false, 100)==false);
+			}
+		}
+
+		WHEN("the millisecond counter overflows")
+		{
+			const system_tick_t start = system_tick_t(-500);
+			for (int i=0; i<4; i++) {
+				REQUIRE(publisher.is_rate_limited(false, start)==false);
+			}
+
+			THEN("tokens are still refilled")
+			{
+				REQUIRE(publisher.is_rate_limited(false, 499)==true);
+				REQUIRE(publisher.is_rate_limited(false, 500)==false);
+			}
+		}
+	}
+
+	GIVEN("two publishers")
+	{
+		Publisher first(nullptr);
+		Publisher second(nullptr);
+
+		THEN("their rate limits are independent")
+		{
+			for (int i=0; i<4; i++) {
+				REQUIRE(first.is_rate_limited(false, 1000)==false);
+			}
+			REQUIRE(first.is_rate_limited(false, 1000)==true);
+			REQUIRE(second.is_rate_limited(false, 1000)==false);
+		}
+	}
+}
+
+SCENARIO("events over the rate limit are queued")
+{
+	GIVEN("a publisher that has used up its burst of application events")
+	{
+		// completions outlive the publisher, which cancels the events it still holds when destroyed
+		Completion completion;
+		Publisher publisher(nullptr);
+		RecordingChannel channel;
+		for (int i=0; i<4; i++) {
+			REQUIRE(publish(publisher, channel, "burst", 0)==NO_ERROR);
+		}
+		REQUIRE(channel.sent.size()==4);
+		channel.sent.clear();
+
+		WHEN("another application event is published")
+		{
+			REQUIRE(publish(publisher, channel, "deferred", 0, completion.handler())==NO_ERROR);
+
+			THEN("it is queued rather than rejected")
+			{
+				REQUIRE(channel.sent.empty());
+				REQUIRE(publisher.queued_events()==1);
+				REQUIRE(completion.count==0);
+			}
+
+			THEN("it is sent once a token is available")
+			{
+				REQUIRE(publisher.process(channel, 999)==NO_ERROR);
+				REQUIRE(channel.sent.empty());
+				REQUIRE(publisher.process(channel, 1000)==NO_ERROR);
+				REQUIRE(channel.sent==std::vector<std::string>({ "deferred" }));
+				REQUIRE(publisher.queued_events()==0);
+				REQUIRE(completion.count==1);
+				REQUIRE(completion.error==SYSTEM_ERROR_NONE);
+			}
+
+			THEN("later events are sent after it even if a token is available")
+			{
+				REQUIRE(publish(publisher, channel, "later", 1000)==NO_ERROR);
+				REQUIRE(channel.sent.empty());
+				REQUIRE(publisher.process(channel, 2000)==NO_ERROR);
+				REQUIRE(channel.sent==std::vector<std::string>({ "deferred", "later" }));
+			}
+
+			THEN("the queued event fails if it can't be sent")
+			{
+				channel.send_result = IO_ERROR;
+				REQUIRE(publisher.process(channel, 1000)==IO_ERROR);
+				REQUIRE(publisher.queued_events()==0);
+				REQUIRE(completion.count==1);
+				REQUIRE(completion.error==toSystemError(IO_ERROR));
+			}
+
+			THEN("the queued event is cancelled when the queue is cleared")
+			{
+				publisher.clear(SYSTEM_ERROR_CANCELLED);
+				REQUIRE(completion.count==1);
+				REQUIRE(completion.error==SYSTEM_ERROR_CANCELLED);
+				REQUIRE(publisher.process(channel, 10000)==NO_ERROR);
+				REQUIRE(channel.sent.empty());
+			}
+		}
+
+		WHEN("the queue is full")
+		{
+			for (int i=0; i<PUBLISH_QUEUE_SIZE; i++) {
+				REQUIRE(publish(publisher, channel, "queued", 0)==NO_ERROR);
+			}
+
+			THEN("further events are rejected")
+			{
+				REQUIRE(publish(publisher, channel, "rejected", 0, completion.handler())==BANDWIDTH_EXCEEDED);
+				REQUIRE(completion.count==1);
+				REQUIRE(completion.error==toSystemError(BANDWIDTH_EXCEEDED));
+				REQUIRE(publisher.queued_events()==PUBLISH_QUEUE_SIZE);
+			}
+
+			THEN("the queue drains at the refill rate")
+			{
+				REQUIRE(publisher.process(channel, 2000)==NO_ERROR);
+				REQUIRE(channel.sent.size()==2);
+				REQUIRE(publisher.process(channel, 60000)==NO_ERROR);
+				REQUIRE(channel.sent.size()==PUBLISH_QUEUE_SIZE);
+			}
+
+			THEN("system events still have room in their own queue")
+			{
+				publisher.set_rate_limit(true, 1, 1000);
+				REQUIRE(publish(publisher, channel, "spark/first", 0)==NO_ERROR);
+				channel.sent.clear();
+				for (int i=0; i<SYSTEM_PUBLISH_QUEUE_SIZE; i++) {
+					REQUIRE(publish(publisher, channel, "spark/queued", 0)==NO_ERROR);
+				}
+				REQUIRE(publisher.queued_events()==PUBLISH_QUEUE_SIZE + SYSTEM_PUBLISH_QUEUE_SIZE);
+				REQUIRE(publish(publisher, channel, "spark/rejected", 0, completion.handler())==BANDWIDTH_EXCEEDED);
+				REQUIRE(channel.sent.empty());
+			}
+		}
+
+		WHEN("system events are queued along with application events")
+		{
+			publisher.set_rate_limit(true, 1, 1000);
+			REQUIRE(publish(publisher, channel, "spark/first", 0)==NO_ERROR);
+			REQUIRE(channel.sent.size()==1);
+			channel.sent.clear();
+			REQUIRE(publish(publisher, channel, "user", 0)==NO_ERROR);
+			REQUIRE(publish(publisher, channel, "particle/second", 0)==NO_ERROR);
+			REQUIRE(channel.sent.empty());
+
+			THEN("queued system events are sent first")
+			{
+				REQUIRE(publisher.process(channel, 1000)==NO_ERROR);
+				REQUIRE(channel.sent==std::vector<std::string>({ "particle/second", "user" }));
+			}
+		}
+	}
+}
+
+SCENARIO("events can be sent in batches")
+{
+	GIVEN("a publisher")
+	{
+		Completion completion;
+		Completion completions[3];
+		Publisher publisher(nullptr);
+		publisher.set_batch_supported(true);
+		RecordingChannel channel;
+
+		WHEN("a few events are batched")
+		{
+			REQUIRE(publish_batched(publisher, channel, "a", 0, completions[0].handler())==NO_ERROR);
+			REQUIRE(publish_batched(publisher, channel, "b", 100, completions[1].handler())==NO_ERROR);
+			REQUIRE(publish_batched(publisher, channel, "c", 200, completions[2].handler())==NO_ERROR);
+
+			THEN("nothing is sent before the deadline")
+			{
+				REQUIRE(publisher.process(channel, PUBLISH_BATCH_DELAY - 1)==NO_ERROR);
+				REQUIRE(channel.batches.empty());
+				REQUIRE(publisher.batched_events()==3);
+				REQUIRE(completions[0].count==0);
+			}
+
+			THEN("the events are sent in a single message once the oldest is due")
+			{
+				REQUIRE(publisher.process(channel, PUBLISH_BATCH_DELAY)==NO_ERROR);
+				REQUIRE(channel.sent.empty());
+				REQUIRE(channel.batches.size()==1);
+				REQUIRE(batch_event_names(channel.batches[0])==std::vector<std::string>({ "a", "b", "c" }));
+				REQUIRE(publisher.batched_events()==0);
+				for (const Completion& c: completions) {
+					REQUIRE(c.count==1);
+					REQUIRE(c.error==SYSTEM_ERROR_NONE);
+				}
+			}
+
+			THEN("every event fails if the batch can't be sent")
+			{
+				channel.send_result = IO_ERROR;
+				REQUIRE(publisher.process(channel, PUBLISH_BATCH_DELAY)==IO_ERROR);
+				for (const Completion& c: completions) {
+					REQUIRE(c.count==1);
+					REQUIRE(c.error==toSystemError(IO_ERROR));
+				}
+			}
+
+			THEN("the events can be flushed before the deadline")
+			{
+				REQUIRE(publisher.has_pending());
+				REQUIRE(publisher.flush(channel, 300)==NO_ERROR);
+				REQUIRE(channel.batches.size()==1);
+				REQUIRE(batch_event_names(channel.batches[0])==std::vector<std::string>({ "a", "b", "c" }));
+				REQUIRE_FALSE(publisher.has_pending());
+			}
+
+			THEN("an event that isn't batched is sent straight away")
+			{
+				REQUIRE(publish(publisher, channel, "now", 300)==NO_ERROR);
+				REQUIRE(channel.sent==std::vector<std::string>({ "now" }));
+				REQUIRE(publisher.batched_events()==3);
+			}
+		}
+
+		WHEN("the maximum number of events is batched")
+		{
+			for (size_t i=0; i<EventBatch::MAX_EVENTS; i++) {
+				REQUIRE(publish_batched(publisher, channel, "event", 0)==NO_ERROR);
+			}
+
+			THEN("the batch is sent without waiting for the deadline")
+			{
+				REQUIRE(channel.batches.size()==1);
+				REQUIRE(batch_event_names(channel.batches[0]).size()==size_t(EventBatch::MAX_EVENTS));
+			}
+		}
+
+		WHEN("the next event doesn't fit in the batch")
+		{
+			publisher.set_batch_policy(40, 1000);
+			REQUIRE(publish_batched(publisher, channel, "first", 0)==NO_ERROR);
+			REQUIRE(publish_batched(publisher, channel, "second", 0)==NO_ERROR);
+			REQUIRE(publish_batched(publisher, channel, "third", 0)==NO_ERROR);
+
+			THEN("the events collected so far are sent first")
+			{
+				REQUIRE(channel.batches.size()==1);
+				REQUIRE(batch_event_names(channel.batches[0])==std::vector<std::string>({ "first", "second" }));
+				REQUIRE(publisher.batched_events()==1);
+			}
+		}
+
+		WHEN("an event is too large for any batch")
+		{
+			publisher.set_batch_policy(8, 1000);
+			REQUIRE(publish_batched(publisher, channel, "large", 0)==NO_ERROR);
+
+			THEN("it is sent as a regular event")
+			{
+				REQUIRE(channel.sent==std::vector<std::string>({ "large" }));
+				REQUIRE(channel.batches.empty());
+			}
+		}
+
+		WHEN("a system event is published with the batch flag")
+		{
+			REQUIRE(publish_batched(publisher, channel, "spark/status", 0)==NO_ERROR);
+
+			THEN("it is not batched")
+			{
+				REQUIRE(channel.sent==std::vector<std::string>({ "spark/status" }));
+				REQUIRE(publisher.batched_events()==0);
+			}
+		}
+
+		WHEN("the batch is due but the rate limit has been reached")
+		{
+			for (int i=0; i<4; i++) {
+				REQUIRE(publish(publisher, channel, "burst", 0)==NO_ERROR);
+			}
+			REQUIRE(publish_batched(publisher, channel, "batched", 0, completion.handler())==NO_ERROR);
+
+			THEN("the batch is sent once a token is available")
+			{
+				REQUIRE(publisher.process(channel, PUBLISH_BATCH_DELAY - 1)==NO_ERROR);
+				REQUIRE(channel.batches.empty());
+				REQUIRE(publisher.process(channel, PUBLISH_BATCH_DELAY)==NO_ERROR);
+				REQUIRE(channel.batches.size()==1);
+				REQUIRE(completion.count==1);
+			}
+		}
+
+		WHEN("the server doesn't support batches")
+		{
+			publisher.set_batch_supported(false);
+			REQUIRE(publish_batched(publisher, channel, "a", 0, completion.handler())==NO_ERROR);
+
+			THEN("the event is sent individually")
+			{
+				REQUIRE(channel.sent==std::vector<std::string>({ "a" }));
+				REQUIRE(channel.batches.empty());
+				REQUIRE(publisher.batched_events()==0);
+				REQUIRE(completion.count==1);
+			}
+		}
+
+		WHEN("the server no longer supports batches once the batch is due")
+		{
+			REQUIRE(publish_batched(publisher, channel, "a", 0, completions[0].handler())==NO_ERROR);
+			REQUIRE(publish_batched(publisher, channel, "b", 0, completions[1].handler())==NO_ERROR);
+			REQUIRE(publish_batched(publisher, channel, "c", 0, completions[2].handler())==NO_ERROR);
+			publisher.set_batch_supported(false);
+			REQUIRE(publisher.process(channel, PUBLISH_BATCH_DELAY)==NO_ERROR);
+
+			THEN("the batched events are sent individually")
+			{
+				REQUIRE(channel.sent==std::vector<std::string>({ "a", "b", "c" }));
+				REQUIRE(channel.batches.empty());
+				REQUIRE(publisher.batched_events()==0);
+				for (const Completion& c: completions) {
+					REQUIRE(c.count==1);
+					REQUIRE(c.error==SYSTEM_ERROR_NONE);
+				}
+			}
+		}
+
+		WHEN("the publisher is cleared")
+		{
+			REQUIRE(publish_batched(publisher, channel, "a", 0, completion.handler())==NO_ERROR);
+			publisher.clear(SYSTEM_ERROR_CANCELLED);
+
+			THEN("batched events are cancelled")
+			{
+				REQUIRE(completion.count==1);
+				REQUIRE(completion.error==SYSTEM_ERROR_CANCELLED);
+				REQUIRE(publisher.batched_events()==0);
+			}
+		}
 	}
 }
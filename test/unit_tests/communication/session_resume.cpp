@@ -0,0 +1,319 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "fake_protocol.h"
+#include "communication_diagnostic.h"
+
+#include <catch2/catch.hpp>
+
+#include <vector>
+
+using namespace particle::protocol;
+using namespace particle::protocol::test;
+
+namespace {
+
+/**
+ * The session resumption diagnostics, relative to their values when the snapshot was taken.
+ */
+struct ResumeDiagnostics
+{
+	int resumes;
+	int failures;
+
+	ResumeDiagnostics() :
+			resumes(g_sessionResumeCounter),
+			failures(g_sessionResumeFailureCounter)
+	{
+	}
+
+	int resumed() const { return int(g_sessionResumeCounter) - resumes; }
+	int failed() const { return int(g_sessionResumeFailureCounter) - failures; }
+	int reason() const { return g_sessionResumeFailureReason; }
+};
+
+unsigned count(const FakeChannel& channel, CoAPType::Enum type, CoAPCode::Enum code)
+{
+	unsigned n = 0;
+	for (const auto& data: channel.sent)
+	{
+		CoAPReader reader(data.data(), data.size());
+		if (reader.type() == type && reader.code() == code)
+		{
+			++n;
+		}
+	}
+	return n;
+}
+
+unsigned pings(const FakeChannel& channel)
+{
+	return count(channel, CoAPType::CON, CoAPCode::EMPTY);
+}
+
+unsigned hellos(const FakeChannel& channel)
+{
+	return channel.sent_to('h').size();
+}
+
+/**
+ * Returns the flags of the hello sent by the device.
+ */
+uint8_t hello_flags(const FakeChannel& channel)
+{
+	const auto sent = channel.sent_to('h');
+	REQUIRE(sent.size()==1);
+	CoAPReader reader(sent[0].data(), sent[0].size());
+	REQUIRE(reader.payload_length() > 5);
+	return reader.payload()[5];
+}
+
+/**
+ * Publishes two events with a rate limit of one event, so that the second one is queued.
+ */
+void queue_event(FakeProtocol& protocol, FakeDevice& device, int flags)
+{
+	protocol.set_rate_limit(false, 1, 1000);
+	protocol.send_event("sent", "data", 60, EventType::PRIVATE, flags, particle::CompletionHandler());
+	protocol.send_event("queued", "data", 60, EventType::PRIVATE, flags, particle::CompletionHandler());
+	REQUIRE(protocol.channel.sent.size()==1);
+	protocol.channel.sent.clear();
+	device.millis += 1000;
+}
+
+void resume(FakeProtocol& protocol)
+{
+	protocol.channel.establish_result = SESSION_RESUMED;
+	protocol.channel.establish_flags = Protocol::SKIP_SESSION_RESUME_HELLO;
+	REQUIRE(protocol.begin()==SESSION_RESUMED);
+}
+
+} // namespace
+
+SCENARIO("session resumption is counted by the diagnostics")
+{
+	GIVEN("a protocol")
+	{
+		FakeDevice device;
+		FakeProtocol protocol;
+		protocol.init(device);
+		const ResumeDiagnostics diag;
+
+		WHEN("a persisted session is resumed")
+		{
+			resume(protocol);
+
+			THEN("the resumption is counted")
+			{
+				REQUIRE(diag.resumed()==1);
+				REQUIRE(diag.failed()==0);
+			}
+		}
+
+		WHEN("the channel falls back to a full handshake")
+		{
+			protocol.channel.establish_result = NO_ERROR;
+			protocol.channel.resume_failure = SessionResumeFailure::KEYS_CHANGED;
+			REQUIRE(protocol.begin()==NO_ERROR);
+
+			THEN("the failure and its reason are counted")
+			{
+				REQUIRE(diag.resumed()==0);
+				REQUIRE(diag.failed()==1);
+				REQUIRE(diag.reason()==SessionResumeFailure::KEYS_CHANGED);
+			}
+
+			THEN("a later failure replaces the reason")
+			{
+				protocol.channel.resume_failure = SessionResumeFailure::EXPIRED;
+				REQUIRE(protocol.begin()==NO_ERROR);
+				REQUIRE(diag.failed()==2);
+				REQUIRE(diag.reason()==SessionResumeFailure::EXPIRED);
+			}
+		}
+
+		WHEN("the channel doesn't persist sessions")
+		{
+			const int reason = diag.reason();
+			protocol.channel.establish_result = NO_ERROR;
+			protocol.channel.resume_failure = SessionResumeFailure::NONE;
+			REQUIRE(protocol.begin()==NO_ERROR);
+
+			THEN("nothing is counted")
+			{
+				REQUIRE(diag.resumed()==0);
+				REQUIRE(diag.failed()==0);
+				REQUIRE(diag.reason()==reason);
+			}
+		}
+
+		WHEN("the handshake fails")
+		{
+			protocol.channel.establish_result = IO_ERROR;
+			protocol.channel.resume_failure = SessionResumeFailure::RESTORE_ERROR;
+			REQUIRE(protocol.begin()==IO_ERROR);
+
+			THEN("the failure to resume is still counted")
+			{
+				REQUIRE(diag.failed()==1);
+				REQUIRE(diag.reason()==SessionResumeFailure::RESTORE_ERROR);
+			}
+
+			THEN("no message is sent")
+			{
+				REQUIRE(protocol.channel.sent.empty());
+			}
+		}
+	}
+}
+
+SCENARIO("begin() confirms a session with a hello, a ping or a queued event")
+{
+	GIVEN("a protocol")
+	{
+		FakeDevice device;
+		FakeProtocol protocol;
+		protocol.init(device);
+
+		WHEN("a full handshake is performed")
+		{
+			protocol.channel.establish_result = NO_ERROR;
+			REQUIRE(protocol.begin()==NO_ERROR);
+
+			THEN("a hello is sent")
+			{
+				REQUIRE(hellos(protocol.channel)==1);
+				REQUIRE(pings(protocol.channel)==0);
+			}
+		}
+
+		WHEN("a session is resumed without fast reconnects")
+		{
+			queue_event(protocol, device, 0);
+			resume(protocol);
+
+			THEN("only a ping is sent")
+			{
+				REQUIRE(hellos(protocol.channel)==0);
+				REQUIRE(protocol.channel.sent.size()==1);
+				REQUIRE(pings(protocol.channel)==1);
+			}
+		}
+
+		WHEN("a session is resumed with fast reconnects and nothing is queued")
+		{
+			protocol.set_fast_reconnect(1);
+			resume(protocol);
+
+			THEN("a ping is sent")
+			{
+				REQUIRE(protocol.channel.sent.size()==1);
+				REQUIRE(pings(protocol.channel)==1);
+			}
+		}
+
+		WHEN("a session is resumed with fast reconnects and a confirmable event is queued")
+		{
+			protocol.set_fast_reconnect(1);
+			queue_event(protocol, device, EventType::WITH_ACK);
+			resume(protocol);
+
+			THEN("the event is sent instead of a ping")
+			{
+				REQUIRE(protocol.channel.sent.size()==1);
+				REQUIRE(count(protocol.channel, CoAPType::CON, CoAPCode::POST)==1);
+				REQUIRE(pings(protocol.channel)==0);
+			}
+		}
+
+		WHEN("a session is resumed with fast reconnects and a non-confirmable event is queued")
+		{
+			protocol.set_fast_reconnect(1);
+			queue_event(protocol, device, EventType::NO_ACK);
+			resume(protocol);
+
+			THEN("the event is sent, followed by a ping that confirms the session")
+			{
+				REQUIRE(protocol.channel.sent.size()==2);
+				REQUIRE(count(protocol.channel, CoAPType::NON, CoAPCode::POST)==1);
+				REQUIRE(pings(protocol.channel)==1);
+			}
+		}
+
+		WHEN("fast reconnects are disabled again")
+		{
+			protocol.set_fast_reconnect(1);
+			protocol.set_fast_reconnect(0);
+			queue_event(protocol, device, EventType::WITH_ACK);
+			resume(protocol);
+
+			THEN("a ping is sent")
+			{
+				REQUIRE(protocol.channel.sent.size()==1);
+				REQUIRE(pings(protocol.channel)==1);
+			}
+		}
+	}
+}
+
+SCENARIO("the hello advertises the compressed and patched updates the system can process")
+{
+	const uint8_t HELLO_FLAG_COMPRESSED_OTA_SUPPORT = 16;
+	const uint8_t HELLO_FLAG_DELTA_OTA_SUPPORT = 32;
+
+	GIVEN("a protocol")
+	{
+		FakeDevice device;
+		FakeProtocol protocol;
+		protocol.init(device);
+		protocol.channel.establish_result = NO_ERROR;
+
+		WHEN("the system can process neither")
+		{
+			REQUIRE(protocol.begin()==NO_ERROR);
+
+			THEN("neither is advertised")
+			{
+				REQUIRE((hello_flags(protocol.channel) & (HELLO_FLAG_COMPRESSED_OTA_SUPPORT | HELLO_FLAG_DELTA_OTA_SUPPORT))==0);
+			}
+		}
+
+		WHEN("the system can only process compressed files")
+		{
+			device.firmware_update_flags = FileTransfer::Flag::COMPRESSED;
+			REQUIRE(protocol.begin()==NO_ERROR);
+
+			THEN("only compressed files are advertised")
+			{
+				REQUIRE((hello_flags(protocol.channel) & (HELLO_FLAG_COMPRESSED_OTA_SUPPORT | HELLO_FLAG_DELTA_OTA_SUPPORT))==
+						HELLO_FLAG_COMPRESSED_OTA_SUPPORT);
+			}
+		}
+
+		WHEN("the system can process both")
+		{
+			device.firmware_update_flags = FileTransfer::Flag::COMPRESSED | FileTransfer::Flag::DELTA;
+			REQUIRE(protocol.begin()==NO_ERROR);
+
+			THEN("both are advertised")
+			{
+				REQUIRE((hello_flags(protocol.channel) & (HELLO_FLAG_COMPRESSED_OTA_SUPPORT | HELLO_FLAG_DELTA_OTA_SUPPORT))==
+						(HELLO_FLAG_COMPRESSED_OTA_SUPPORT | HELLO_FLAG_DELTA_OTA_SUPPORT));
+			}
+		}
+	}
+}
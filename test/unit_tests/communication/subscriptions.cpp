@@ -0,0 +1,183 @@
+/**
+ ******************************************************************************
+  Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+
+#include "message_channel.h"
+#include "messages.h"
+#include "subscriptions.h"
+
+#include <catch2/catch.hpp>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+using namespace particle::protocol;
+
+namespace {
+
+/**
+ * A channel that is never asked to send anything since the events dispatched in these tests
+ * are non-confirmable.
+ */
+class NullMessageChannel : public MessageChannel
+{
+public:
+	bool is_unreliable() override { return false; }
+	ProtocolError establish(uint32_t& flags, uint32_t app_state_crc) override { return NO_ERROR; }
+	ProtocolError create(Message& message, size_t minimum_size) override { return NO_ERROR; }
+	ProtocolError response(Message& original, Message& response, size_t required) override { return NO_ERROR; }
+	ProtocolError notify_established() override { return NO_ERROR; }
+	void notify_client_messages_processed() override {}
+	ProtocolError receive(Message& message) override { return NO_ERROR; }
+	ProtocolError send(Message& msg) override { return IO_ERROR; }
+	ProtocolError command(Command cmd, void* arg) override { return NO_ERROR; }
+};
+
+std::vector<std::string> dispatched;
+
+void record_handler(uint16_t size, FilteringEventHandler* handler, const char* event, const char* data, void* reserved)
+{
+	dispatched.push_back(handler->filter);
+}
+
+void dummy_handler(const char* name, const char* data)
+{
+}
+
+ProtocolError dispatch(Subscriptions& subscriptions, const char* event_name)
+{
+	uint8_t buf[PROTOCOL_BUFFER_SIZE];
+	const size_t len = Messages::event(buf, 0, event_name, "data", 60, EventType::PUBLIC, false);
+	// handle_event() null-terminates the payload one byte past the end of the message
+	Message message(buf, sizeof(buf) - 1, len);
+	NullMessageChannel channel;
+	dispatched.clear();
+	return subscriptions.handle_event(message, record_handler, channel);
+}
+
+} // namespace
+
+SCENARIO("events are dispatched to the handlers whose filter is a prefix of the event name")
+{
+	GIVEN("a set of overlapping subscriptions")
+	{
+		Subscriptions subscriptions;
+		// distinct handler data, since add_event_handler() treats a filter that is a prefix
+		// of an existing one as a duplicate registration
+		int data[5] = {};
+		// registration order is deliberately not sorted
+		REQUIRE(subscriptions.add_event_handler("temp/kitchen", dummy_handler, &data[0], SubscriptionScope::MY_DEVICES, nullptr)==NO_ERROR);
+		REQUIRE(subscriptions.add_event_handler("temp", dummy_handler, &data[1], SubscriptionScope::MY_DEVICES, nullptr)==NO_ERROR);
+		REQUIRE(subscriptions.add_event_handler("t", dummy_handler, &data[2], SubscriptionScope::MY_DEVICES, nullptr)==NO_ERROR);
+		REQUIRE(subscriptions.add_event_handler("temp/garage", dummy_handler, &data[3], SubscriptionScope::MY_DEVICES, nullptr)==NO_ERROR);
+		REQUIRE(subscriptions.add_event_handler("humidity", dummy_handler, &data[4], SubscriptionScope::MY_DEVICES, nullptr)==NO_ERROR);
+
+		THEN("all matching handlers are called in registration order")
+		{
+			REQUIRE(dispatch(subscriptions, "temp/kitchen/sink")==NO_ERROR);
+			REQUIRE(dispatched==std::vector<std::string>({ "temp/kitchen", "temp", "t" }));
+		}
+
+		THEN("a filter longer than the event name does not match")
+		{
+			REQUIRE(dispatch(subscriptions, "tem")==NO_ERROR);
+			REQUIRE(dispatched==std::vector<std::string>({ "t" }));
+		}
+
+		THEN("a filter that sorts between matching filters doesn't hide the shorter match")
+		{
+			REQUIRE(dispatch(subscriptions, "temp/h")==NO_ERROR);
+			REQUIRE(dispatched==std::vector<std::string>({ "temp", "t" }));
+		}
+
+		THEN("an event matching no filter is not dispatched")
+		{
+			REQUIRE(dispatch(subscriptions, "alarm")==NO_ERROR);
+			REQUIRE(dispatched.empty());
+		}
+
+		WHEN("a subscription is removed")
+		{
+			subscriptions.remove_event_handlers("temp");
+
+			THEN("the remaining handlers are still matched")
+			{
+				REQUIRE(dispatch(subscriptions, "temp/garage")==NO_ERROR);
+				REQUIRE(dispatched==std::vector<std::string>({ "t", "temp/garage" }));
+				REQUIRE(dispatch(subscriptions, "humidity/attic")==NO_ERROR);
+				REQUIRE(dispatched==std::vector<std::string>({ "humidity" }));
+			}
+		}
+
+		WHEN("all subscriptions are removed")
+		{
+			subscriptions.remove_event_handlers(nullptr);
+
+			THEN("no handler is called")
+			{
+				REQUIRE(dispatch(subscriptions, "temp/garage")==NO_ERROR);
+				REQUIRE(dispatched.empty());
+			}
+		}
+	}
+
+	GIVEN("two handlers with the same filter")
+	{
+		Subscriptions subscriptions;
+		int data = 0;
+		REQUIRE(subscriptions.add_event_handler("a", dummy_handler, nullptr, SubscriptionScope::MY_DEVICES, nullptr)==NO_ERROR);
+		REQUIRE(subscriptions.add_event_handler("a", dummy_handler, &data, SubscriptionScope::MY_DEVICES, nullptr)==NO_ERROR);
+
+		THEN("both handlers are called")
+		{
+			REQUIRE(dispatch(subscriptions, "abc")==NO_ERROR);
+			REQUIRE(dispatched==std::vector<std::string>({ "a", "a" }));
+		}
+	}
+
+	GIVEN("an empty filter")
+	{
+		Subscriptions subscriptions;
+		REQUIRE(subscriptions.add_event_handler("", dummy_handler, nullptr, SubscriptionScope::MY_DEVICES, nullptr)==NO_ERROR);
+
+		THEN("every event matches")
+		{
+			REQUIRE(dispatch(subscriptions, "anything")==NO_ERROR);
+			REQUIRE(dispatched.size()==1);
+		}
+	}
+}
+
+TEST_CASE("subscription dispatch benchmark", "[.][benchmark]")
+{
+	const unsigned iterations = 100000;
+	for (unsigned n = 1; n <= MAX_SUBSCRIPTIONS; n++) {
+		Subscriptions subscriptions;
+		for (unsigned i = 0; i < n; i++) {
+			const std::string filter = "device/sensor/" + std::to_string(i * 7919 % 1000);
+			REQUIRE(subscriptions.add_event_handler(filter.c_str(), dummy_handler, nullptr, SubscriptionScope::MY_DEVICES, nullptr)==NO_ERROR);
+		}
+		const auto start = std::chrono::steady_clock::now();
+		for (unsigned i = 0; i < iterations; i++) {
+			dispatch(subscriptions, "device/sensor/0/reading");
+		}
+		const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+		WARN(n << " filters: " << elapsed.count() / iterations << " ns per event");
+	}
+}
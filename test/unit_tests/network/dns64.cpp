@@ -0,0 +1,233 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "dns64.h"
+#include "fake_net.h"
+
+#include <catch2/catch.hpp>
+
+#include <cstring>
+
+using namespace particle::net;
+using particle::test::FakeNet;
+
+namespace {
+
+const uint16_t TYPE_A = 1;
+const uint16_t TYPE_AAAA = 28;
+
+const unsigned RCODE_NO_ERROR = 0;
+const unsigned RCODE_SERVER_FAILURE = 2;
+const unsigned RCODE_NAME_ERROR = 3;
+
+struct Response {
+    uint16_t id;
+    unsigned rcode;
+    unsigned ancount;
+    uint32_t ttl;
+    std::vector<uint8_t> addr;
+
+    explicit Response(const FakeNet::Datagram& d) :
+            id(0),
+            rcode(0),
+            ancount(0),
+            ttl(0) {
+        REQUIRE(d.size() >= 12);
+        id = (d[0] << 8) | d[1];
+        REQUIRE((d[2] & 0x80) != 0); // QR
+        rcode = d[3] & 0x0f;
+        ancount = (d[6] << 8) | d[7];
+        if (ancount > 0) {
+            // Skip the question section
+            size_t offs = 12;
+            while (offs < d.size() && d[offs] != 0) {
+                offs += d[offs] + 1;
+            }
+            offs += 1 /* QNAME terminator */ + 4 /* QTYPE, QCLASS */;
+            // Parse the answer, which has a compressed NAME
+            offs += 2 /* NAME */ + 4 /* TYPE, CLASS */;
+            REQUIRE(offs + 6 <= d.size());
+            ttl = (d[offs] << 24) | (d[offs + 1] << 16) | (d[offs + 2] << 8) | d[offs + 3];
+            const size_t rdlength = (d[offs + 4] << 8) | d[offs + 5];
+            offs += 6;
+            REQUIRE(offs + rdlength == d.size());
+            addr.assign(d.begin() + offs, d.end());
+        }
+    }
+};
+
+FakeNet::Datagram query(uint16_t id, const char* name, uint16_t qtype) {
+    FakeNet::Datagram d = { uint8_t(id >> 8), uint8_t(id), 0x01 /* RD */, 0x00, 0, 1, 0, 0, 0, 0, 0, 0 };
+    for (const char* p = name; *p;) {
+        const char* dot = strchr(p, '.');
+        const size_t n = dot ? dot - p : strlen(p);
+        d.push_back(n);
+        d.insert(d.end(), p, p + n);
+        p += n;
+        if (*p) {
+            ++p;
+        }
+    }
+    d.push_back(0);
+    const uint8_t question[] = { uint8_t(qtype >> 8), uint8_t(qtype), 0, 1 /* IN */ };
+    d.insert(d.end(), question, question + sizeof(question));
+    return d;
+}
+
+ip_addr_t ip4(uint32_t addr) {
+    ip_addr_t a = {};
+    a.type = IPADDR_TYPE_V4;
+    ip_2_ip4(&a)->addr = PP_HTONL(addr);
+    return a;
+}
+
+class Dns64Fixture {
+public:
+    Dns64Fixture() {
+        FakeNet::reset();
+        ip6_addr_t prefix = {};
+        IP6_ADDR(&prefix, PP_HTONL(0x0064ff9b), 0, 0, 0);
+        REQUIRE(dns_.init(nullptr, prefix) == 0);
+    }
+
+    Dns64& dns() {
+        return dns_;
+    }
+
+    void send(uint16_t id, const char* name, uint16_t qtype) {
+        FakeNet::received().push_back(query(id, name, qtype));
+        REQUIRE(dns_.run() == 0);
+    }
+
+    // Completes the only lookup in progress
+    void complete(const char* name, const ip_addr_t* addr) {
+        REQUIRE(FakeNet::lookups().size() == 1);
+        const auto lookup = FakeNet::lookups().front();
+        FakeNet::lookups().clear();
+        lookup.complete(name, addr);
+    }
+
+    std::vector<Response> responses() {
+        std::vector<Response> r;
+        for (const auto& d: FakeNet::sent()) {
+            r.push_back(Response(d));
+        }
+        FakeNet::sent().clear();
+        return r;
+    }
+
+private:
+    Dns64 dns_;
+};
+
+} // unnamed
+
+TEST_CASE("Dns64") {
+    Dns64Fixture f;
+    const auto addr = ip4(0x01020304);
+
+    SECTION("an IPv6 address is synthesized for a host that only has an IPv4 address") {
+        f.send(1, "cloud.example.com", TYPE_AAAA);
+        REQUIRE(FakeNet::lookups().size() == 1);
+        REQUIRE(FakeNet::lookups()[0].addrType == LWIP_DNS_ADDRTYPE_IPV6);
+        f.complete("cloud.example.com", nullptr);
+        REQUIRE(FakeNet::lookups()[0].addrType == LWIP_DNS_ADDRTYPE_IPV4);
+        REQUIRE(FakeNet::sent().empty());
+        f.complete("cloud.example.com", &addr);
+        const auto r = f.responses();
+        REQUIRE(r.size() == 1);
+        REQUIRE(r[0].id == 1);
+        REQUIRE(r[0].rcode == RCODE_NO_ERROR);
+        REQUIRE(r[0].ancount == 1);
+        REQUIRE(r[0].addr == std::vector<uint8_t>({ 0, 0x64, 0xff, 0x9b, 0, 0, 0, 0, 0, 0, 0, 0, 1, 2, 3, 4 }));
+    }
+
+    SECTION("identical queries share a lookup") {
+        f.send(1, "cloud.example.com", TYPE_A);
+        f.send(2, "CLOUD.example.com", TYPE_A);
+        f.complete("cloud.example.com", &addr);
+        const auto r = f.responses();
+        REQUIRE(r.size() == 2);
+        REQUIRE(r[0].id + r[1].id == 3);
+        REQUIRE(r[0].addr == std::vector<uint8_t>({ 1, 2, 3, 4 }));
+        REQUIRE(r[1].addr == std::vector<uint8_t>({ 1, 2, 3, 4 }));
+    }
+
+    SECTION("the result of a lookup is cached") {
+        f.send(1, "cloud.example.com", TYPE_A);
+        f.complete("cloud.example.com", &addr);
+        f.responses();
+        FakeNet::millis() += 50 * 1000;
+        f.send(2, "cloud.example.com", TYPE_A);
+        REQUIRE(FakeNet::lookups().empty());
+        const auto r = f.responses();
+        REQUIRE(r.size() == 1);
+        REQUIRE(r[0].addr == std::vector<uint8_t>({ 1, 2, 3, 4 }));
+        REQUIRE(r[0].ttl == 250);
+
+        SECTION("until it expires") {
+            FakeNet::millis() += 251 * 1000;
+            f.send(3, "cloud.example.com", TYPE_A);
+            REQUIRE(FakeNet::lookups().size() == 1);
+        }
+    }
+
+    SECTION("a host that is not found is cached as well") {
+        f.send(1, "nx.example.com", TYPE_A);
+        f.complete("nx.example.com", nullptr);
+        auto r = f.responses();
+        REQUIRE(r.size() == 1);
+        REQUIRE(r[0].rcode == RCODE_NAME_ERROR);
+        f.send(2, "nx.example.com", TYPE_A);
+        REQUIRE(FakeNet::lookups().empty());
+        r = f.responses();
+        REQUIRE(r.size() == 1);
+        REQUIRE(r[0].rcode == RCODE_NAME_ERROR);
+    }
+
+    SECTION("a lookup that fails without a result fails all of the queries waiting for it") {
+        f.send(1, "cloud.example.com", TYPE_AAAA);
+        f.send(2, "cloud.example.com", TYPE_AAAA);
+        f.complete(nullptr, nullptr);
+        REQUIRE(FakeNet::lookups().empty());
+        const auto r = f.responses();
+        REQUIRE(r.size() == 2);
+        REQUIRE(r[0].id + r[1].id == 3);
+        REQUIRE(r[0].rcode == RCODE_SERVER_FAILURE);
+        REQUIRE(r[1].rcode == RCODE_SERVER_FAILURE);
+
+        SECTION("and the next query starts a new lookup") {
+            f.send(3, "cloud.example.com", TYPE_AAAA);
+            REQUIRE(FakeNet::lookups().size() == 1);
+            REQUIRE(FakeNet::lookups()[0].addrType == LWIP_DNS_ADDRTYPE_IPV6);
+            f.complete("cloud.example.com", nullptr);
+            f.complete("cloud.example.com", &addr);
+            const auto r = f.responses();
+            REQUIRE(r.size() == 1);
+            REQUIRE(r[0].id == 3);
+            REQUIRE(r[0].rcode == RCODE_NO_ERROR);
+        }
+    }
+
+    SECTION("a lookup may complete after the resolver is destroyed") {
+        f.send(1, "cloud.example.com", TYPE_A);
+        f.send(2, "cloud.example.com", TYPE_A);
+        f.dns().destroy();
+        f.complete("cloud.example.com", &addr);
+        REQUIRE(FakeNet::sent().empty());
+    }
+}
@@ -0,0 +1,152 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "fake_net.h"
+#include "socket_hal_posix.h"
+#include "ifapi.h"
+#include "timer_hal.h"
+
+#include <algorithm>
+#include <cstring>
+
+using particle::test::FakeNet;
+
+namespace {
+
+const int SOCKET = 3;
+
+struct State {
+    system_tick_t millis = 1000;
+    std::deque<FakeNet::Datagram> received;
+    std::vector<FakeNet::Datagram> sent;
+    std::vector<FakeNet::Lookup> lookups;
+    err_t lookupResult = ERR_INPROGRESS;
+};
+
+State& state() {
+    static State s;
+    return s;
+}
+
+} // unnamed
+
+namespace particle {
+
+namespace test {
+
+void FakeNet::reset() {
+    state() = State();
+}
+
+system_tick_t& FakeNet::millis() {
+    return state().millis;
+}
+
+std::deque<FakeNet::Datagram>& FakeNet::received() {
+    return state().received;
+}
+
+std::vector<FakeNet::Datagram>& FakeNet::sent() {
+    return state().sent;
+}
+
+std::vector<FakeNet::Lookup>& FakeNet::lookups() {
+    return state().lookups;
+}
+
+err_t& FakeNet::lookupResult() {
+    return state().lookupResult;
+}
+
+} // test
+
+} // particle
+
+extern "C" {
+
+system_tick_t HAL_Timer_Get_Milli_Seconds(void) {
+    return state().millis;
+}
+
+int sock_socket(int domain, int type, int protocol) {
+    return SOCKET;
+}
+
+int sock_setsockopt(int s, int level, int optname, const void* optval, socklen_t optlen) {
+    return 0;
+}
+
+int sock_bind(int s, const struct sockaddr* name, socklen_t namelen) {
+    return 0;
+}
+
+int sock_close(int s) {
+    return 0;
+}
+
+ssize_t sock_recvfrom(int s, void* mem, size_t len, int flags, struct sockaddr* from, socklen_t* fromlen) {
+    auto& received = state().received;
+    if (received.empty()) {
+        errno = EWOULDBLOCK;
+        return -1;
+    }
+    const auto d = std::move(received.front());
+    received.pop_front();
+    const size_t n = std::min(len, d.size());
+    memcpy(mem, d.data(), n);
+    if (from && fromlen) {
+        sockaddr_in6 addr = {};
+        addr.sin6_family = AF_INET6;
+        addr.sin6_port = htons(5353);
+        const size_t size = std::min<size_t>(*fromlen, sizeof(addr));
+        memcpy(from, &addr, size);
+        *fromlen = size;
+    }
+    return n;
+}
+
+ssize_t sock_sendto(int s, const void* dataptr, size_t size, int flags, const struct sockaddr* to, socklen_t tolen) {
+    const auto d = (const uint8_t*)dataptr;
+    state().sent.emplace_back(d, d + size);
+    return size;
+}
+
+int lwip_select(int maxfdp1, fd_set* readset, fd_set* writeset, fd_set* exceptset, struct timeval* timeout) {
+    if (state().received.empty()) {
+        if (readset) {
+            FD_ZERO(readset);
+        }
+        return 0;
+    }
+    return 1;
+}
+
+int if_get_name(if_t iface, char* name) {
+    strcpy(name, "th1");
+    return 0;
+}
+
+err_t dns_gethostbyname_addrtype(const char* hostname, ip_addr_t* addr, dns_found_callback found, void* callback_arg,
+        u8_t dns_addrtype) {
+    const err_t r = state().lookupResult;
+    if (r == ERR_INPROGRESS) {
+        state().lookups.push_back({ hostname, dns_addrtype, found, callback_arg });
+    }
+    return r;
+}
+
+} // extern "C"
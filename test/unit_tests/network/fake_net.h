@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <lwip/dns.h>
+
+#include "system_tick_hal.h"
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+namespace particle {
+
+namespace test {
+
+/**
+ * A single socket and the lwIP DNS client, as seen by the code under test.
+ */
+class FakeNet {
+public:
+    typedef std::vector<uint8_t> Datagram;
+
+    // A lookup passed to dns_gethostbyname_addrtype()
+    struct Lookup {
+        std::string name;
+        uint8_t addrType;
+        dns_found_callback callback;
+        void* arg;
+
+        void complete(const char* name, const ip_addr_t* addr) const {
+            callback(name, addr, arg);
+        }
+    };
+
+    static void reset();
+
+    // Current value of HAL_Timer_Get_Milli_Seconds()
+    static system_tick_t& millis();
+    // Datagrams to be received from the socket
+    static std::deque<Datagram>& received();
+    // Datagrams sent to the socket
+    static std::vector<Datagram>& sent();
+    // Lookups that are in progress
+    static std::vector<Lookup>& lookups();
+    // Result of the next call to dns_gethostbyname_addrtype()
+    static err_t& lookupResult();
+};
+
+} // test
+
+} // particle
@@ -0,0 +1,32 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "lwip/opt.h"
+
+#include <arpa/inet.h>
+
+#define PP_HTONS(x) htons(x)
+#define PP_NTOHS(x) ntohs(x)
+#define PP_HTONL(x) htonl(x)
+#define PP_NTOHL(x) ntohl(x)
+
+#define lwip_htons(x) htons(x)
+#define lwip_ntohs(x) ntohs(x)
+#define lwip_htonl(x) htonl(x)
+#define lwip_ntohl(x) ntohl(x)
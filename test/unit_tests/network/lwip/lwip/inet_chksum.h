@@ -0,0 +1,33 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "lwip/ip_addr.h"
+#include "lwip/pbuf.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+u16_t inet_chksum(const void* dataptr, u16_t len);
+u16_t inet_chksum_pseudo(struct pbuf* p, u8_t proto, u16_t proto_len, const ip4_addr_t* src, const ip4_addr_t* dest);
+u16_t ip6_chksum_pseudo(struct pbuf* p, u8_t proto, u16_t proto_len, const ip6_addr_t* src, const ip6_addr_t* dest);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "lwip/def.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct ip4_addr {
+    u32_t addr;
+} ip4_addr_t;
+
+typedef struct ip6_addr {
+    u32_t addr[4];
+    u8_t zone;
+} ip6_addr_t;
+
+enum lwip_ip_addr_type {
+    IPADDR_TYPE_V4 = 0,
+    IPADDR_TYPE_V6 = 6,
+    IPADDR_TYPE_ANY = 46
+};
+
+typedef struct ip_addr {
+    union {
+        ip6_addr_t ip6;
+        ip4_addr_t ip4;
+    } u_addr;
+    u8_t type;
+} ip_addr_t;
+
+#define IP4ADDR_STRLEN_MAX 16
+#define IP6ADDR_STRLEN_MAX 46
+
+#define IP_IS_V4_VAL(ipaddr) ((ipaddr).type == IPADDR_TYPE_V4)
+#define IP_IS_V6_VAL(ipaddr) ((ipaddr).type == IPADDR_TYPE_V6)
+#define IP_IS_V4(ipaddr) IP_IS_V4_VAL(*(ipaddr))
+#define IP_IS_V6(ipaddr) IP_IS_V6_VAL(*(ipaddr))
+
+#define ip_2_ip4(ipaddr) (&((ipaddr)->u_addr.ip4))
+#define ip_2_ip6(ipaddr) (&((ipaddr)->u_addr.ip6))
+
+#define ip4_addr_copy(dest, src) ((dest).addr = (src).addr)
+#define ip4_addr_get_u32(src_ipaddr) ((src_ipaddr)->addr)
+#define ip4_addr_cmp(addr1, addr2) ((addr1)->addr == (addr2)->addr)
+#define ip4_addr_isany(addr1) ((addr1) == NULL || (addr1)->addr == 0)
+
+#define IP6_ADDR(ip6addr, idx0, idx1, idx2, idx3) do { \
+        (ip6addr)->addr[0] = idx0; \
+        (ip6addr)->addr[1] = idx1; \
+        (ip6addr)->addr[2] = idx2; \
+        (ip6addr)->addr[3] = idx3; \
+        (ip6addr)->zone = 0; \
+    } while (0)
+#define ip6_addr_copy(dest, src) ((dest) = (src))
+#define ip6_addr_set(dest, src) (*(dest) = *(src))
+#define ip6_addr_clear_zone(ip6addr) ((ip6addr)->zone = 0)
+#define ip6_addr_cmp_zoneless(addr1, addr2) ((addr1)->addr[0] == (addr2)->addr[0] && \
+        (addr1)->addr[1] == (addr2)->addr[1] && \
+        (addr1)->addr[2] == (addr2)->addr[2] && \
+        (addr1)->addr[3] == (addr2)->addr[3])
+
+#define ip_addr_copy(dest, src) ((dest) = (src))
+#define ip_addr_copy_from_ip4(dest, src) do { \
+        ip4_addr_copy(*ip_2_ip4(&(dest)), src); \
+        (dest).type = IPADDR_TYPE_V4; \
+    } while (0)
+#define ip_addr_copy_from_ip6(dest, src) do { \
+        ip6_addr_copy(*ip_2_ip6(&(dest)), src); \
+        (dest).type = IPADDR_TYPE_V6; \
+    } while (0)
+#define ip_addr_cmp_zoneless(addr1, addr2) ((addr1)->type == (addr2)->type && \
+        (IP_IS_V4(addr1) ? ip4_addr_cmp(ip_2_ip4(addr1), ip_2_ip4(addr2)) : \
+        ip6_addr_cmp_zoneless(ip_2_ip6(addr1), ip_2_ip6(addr2))))
+
+#define unmap_ipv4_mapped_ipv6(ip4addr, ip6addr) ((ip4addr)->addr = (ip6addr)->addr[3])
+
+char* ip4addr_ntoa_r(const ip4_addr_t* addr, char* buf, int buflen);
+char* ip6addr_ntoa_r(const ip6_addr_t* addr, char* buf, int buflen);
+char* ipaddr_ntoa_r(const ip_addr_t* addr, char* buf, int buflen);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <lwip/ip.h>
+#include <lwip/inet_chksum.h>
+#include <lwip/timeouts.h>
+
+#include "rng_hal.h"
+
+#include <cstdio>
+#include <cstring>
+
+// Only the parts of lwIP that are not on the paths under test are stubbed here: the packets
+// are never routed or sent, and timeouts are driven by the tests directly
+
+extern "C" {
+
+char* ip4addr_ntoa_r(const ip4_addr_t* addr, char* buf, int buflen) {
+    const uint8_t* b = (const uint8_t*)&addr->addr;
+    snprintf(buf, buflen, "%u.%u.%u.%u", b[0], b[1], b[2], b[3]);
+    return buf;
+}
+
+char* ip6addr_ntoa_r(const ip6_addr_t* addr, char* buf, int buflen) {
+    snprintf(buf, buflen, "%08x:%08x:%08x:%08x", (unsigned)ntohl(addr->addr[0]), (unsigned)ntohl(addr->addr[1]),
+            (unsigned)ntohl(addr->addr[2]), (unsigned)ntohl(addr->addr[3]));
+    return buf;
+}
+
+char* ipaddr_ntoa_r(const ip_addr_t* addr, char* buf, int buflen) {
+    if (IP_IS_V4(addr)) {
+        return ip4addr_ntoa_r(ip_2_ip4(addr), buf, buflen);
+    }
+    return ip6addr_ntoa_r(ip_2_ip6(addr), buf, buflen);
+}
+
+int ip6_addr_common_prefix_length(const ip6_addr_t* addr1, const ip6_addr_t* addr2, int max) {
+    const uint8_t* a = (const uint8_t*)addr1->addr;
+    const uint8_t* b = (const uint8_t*)addr2->addr;
+    int len = 0;
+    while (len < max && ((a[len / 8] ^ b[len / 8]) & (0x80 >> (len % 8))) == 0) {
+        ++len;
+    }
+    return len;
+}
+
+const ip_addr_t* ip_current_src_addr(void) {
+    return nullptr;
+}
+
+const ip_addr_t* ip_current_dest_addr(void) {
+    return nullptr;
+}
+
+u8_t ip_addr_isbroadcast(const ip_addr_t* addr, const struct netif* netif) {
+    return 0;
+}
+
+struct netif* ip4_route(const ip4_addr_t* dest) {
+    return nullptr;
+}
+
+struct netif* ip6_route(const ip6_addr_t* src, const ip6_addr_t* dest) {
+    return nullptr;
+}
+
+err_t ip4_output(struct pbuf* p, const ip4_addr_t* src, const ip4_addr_t* dest, u8_t ttl, u8_t tos, u8_t proto) {
+    return ERR_RTE;
+}
+
+err_t ip6_output(struct pbuf* p, const ip6_addr_t* src, const ip6_addr_t* dest, u8_t hl, u8_t tc, u8_t nexth) {
+    return ERR_RTE;
+}
+
+err_t ip6_output_if_src(struct pbuf* p, const ip6_addr_t* src, const ip6_addr_t* dest, u8_t hl, u8_t tc, u8_t nexth,
+        struct netif* netif) {
+    return ERR_RTE;
+}
+
+u16_t inet_chksum(const void* dataptr, u16_t len) {
+    return 0;
+}
+
+u16_t inet_chksum_pseudo(struct pbuf* p, u8_t proto, u16_t proto_len, const ip4_addr_t* src, const ip4_addr_t* dest) {
+    return 0;
+}
+
+u16_t ip6_chksum_pseudo(struct pbuf* p, u8_t proto, u16_t proto_len, const ip6_addr_t* src, const ip6_addr_t* dest) {
+    return 0;
+}
+
+u8_t pbuf_free(struct pbuf* p) {
+    return 0;
+}
+
+u8_t pbuf_remove_header(struct pbuf* p, size_t header_size) {
+    return 1;
+}
+
+u8_t pbuf_add_header_force(struct pbuf* p, size_t header_size) {
+    return 1;
+}
+
+struct pbuf* pbuf_clone(pbuf_layer l, pbuf_type type, struct pbuf* p) {
+    return nullptr;
+}
+
+void sys_timeout(u32_t msecs, sys_timeout_handler handler, void* arg) {
+}
+
+void sys_untimeout(sys_timeout_handler handler, void* arg) {
+}
+
+uint32_t HAL_RNG_GetRandomNumber(void) {
+    return 0;
+}
+
+} // extern "C"
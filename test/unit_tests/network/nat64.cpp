@@ -0,0 +1,293 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "nat64.h"
+
+#define CATCH_CONFIG_MAIN
+#include <catch2/catch.hpp>
+
+#include <chrono>
+#include <set>
+#include <vector>
+
+using namespace particle::net::nat;
+
+namespace {
+
+const uint16_t MIN_UDP_PORT = 40000;
+const uint16_t MAX_UDP_PORT = 49000;
+const uint32_t UDP_LIFETIME = 120 * 1000;
+const uint32_t ICMP_LIFETIME = 60 * 1000;
+const uint32_t TICK = 1000;
+
+// Exposes the translation tables
+class Nat64Tables: public Nat64 {
+public:
+    using Nat64::lookupBib;
+    using Nat64::addBib;
+    using Nat64::lookupSession;
+    using Nat64::addSession;
+    using Nat64::refreshSession;
+    using Nat64::timeout;
+
+    // Creates the BIB and session entries for an outgoing packet
+    SessionEntry* addFlow(const IpTransportAddress& src6, const IpTransportAddress& dst6, L4Protocol proto,
+            uint32_t lifetime) {
+        const auto bib = addBib(src6, dst6, proto);
+        if (!bib) {
+            return nullptr;
+        }
+        return addSession(bib, dst6, lifetime);
+    }
+
+    void tick(unsigned count) {
+        for (unsigned i = 0; i < count; ++i) {
+            timeout();
+        }
+    }
+};
+
+// Host on the inside network
+IpTransportAddress host6(uint32_t host, uint16_t l4Id) {
+    ip_addr_t addr = {};
+    addr.type = IPADDR_TYPE_V6;
+    IP6_ADDR(ip_2_ip6(&addr), PP_HTONL(0xfd000000), 0, 0, PP_HTONL(host));
+    return IpTransportAddress(addr, l4Id);
+}
+
+// IPv4 peer as seen from the inside network, using the default 64:ff9b::/96 prefix
+IpTransportAddress peer6(uint32_t peer, uint16_t l4Id) {
+    ip_addr_t addr = {};
+    addr.type = IPADDR_TYPE_V6;
+    IP6_ADDR(ip_2_ip6(&addr), PP_HTONL(0x0064ff9b), 0, 0, PP_HTONL(peer));
+    return IpTransportAddress(addr, l4Id);
+}
+
+// IPv4 peer as seen from the outside network
+IpTransportAddress peer4(uint32_t peer, uint16_t l4Id) {
+    ip_addr_t addr = {};
+    addr.type = IPADDR_TYPE_V4;
+    ip_2_ip4(&addr)->addr = PP_HTONL(peer);
+    return IpTransportAddress(addr, l4Id);
+}
+
+class Nat64Fixture {
+public:
+    Nat64Fixture() :
+            in_(),
+            out_() {
+        out_.ip_addr.type = IPADDR_TYPE_V4;
+        ip_2_ip4(&out_.ip_addr)->addr = PP_HTONL(0x0a000001);
+        REQUIRE(nat_.enable(Rule(&in_, &out_)));
+    }
+
+    Nat64Tables& nat() {
+        return nat_;
+    }
+
+    // Fills the translation tables with UDP flows to a DNS server until no more entries can be allocated
+    std::vector<SessionEntry*> fillUdp(uint32_t firstHost) {
+        std::vector<SessionEntry*> flows;
+        for (uint32_t host = firstHost;; ++host) {
+            const auto s = nat_.addFlow(host6(host, 1000), peer6(0x08080808, 53), L4_PROTO_UDP, UDP_LIFETIME);
+            if (!s) {
+                break;
+            }
+            flows.push_back(s);
+        }
+        return flows;
+    }
+
+private:
+    netif in_;
+    netif out_;
+    Nat64Tables nat_;
+};
+
+} // unnamed
+
+TEST_CASE("L4IdMap") {
+    SECTION("finds the first free ID at or after the given one, wrapping around") {
+        L4IdMap ids(10, 75);
+        REQUIRE(ids.init());
+        uint16_t id = 0;
+        REQUIRE(ids.findFree(10, &id));
+        REQUIRE(id == 10);
+        REQUIRE(ids.findFree(75, &id));
+        REQUIRE(id == 75);
+        for (uint16_t i = 10; i <= 75; ++i) {
+            ids.set(i, true);
+        }
+        ids.set(12, false);
+        ids.set(70, false);
+        REQUIRE(ids.findFree(13, &id));
+        REQUIRE(id == 70);
+        REQUIRE(ids.findFree(71, &id));
+        REQUIRE(id == 12);
+        REQUIRE(ids.findFree(12, &id));
+        REQUIRE(id == 12);
+    }
+
+    SECTION("fails once all of the IDs are allocated") {
+        L4IdMap ids(MIN_UDP_PORT, MAX_UDP_PORT);
+        REQUIRE(ids.init());
+        uint16_t id = 0;
+        for (unsigned i = MIN_UDP_PORT; i <= MAX_UDP_PORT; ++i) {
+            REQUIRE(ids.findFree(MIN_UDP_PORT + 100, &id));
+            ids.set(id, true);
+        }
+        REQUIRE_FALSE(ids.findFree(MIN_UDP_PORT, &id));
+        REQUIRE_FALSE(ids.findFree(MAX_UDP_PORT, &id));
+        ids.set(MIN_UDP_PORT + 99, false);
+        REQUIRE(ids.findFree(MIN_UDP_PORT + 100, &id));
+        REQUIRE(id == MIN_UDP_PORT + 99);
+    }
+
+    SECTION("covers the whole 16-bit range") {
+        L4IdMap ids(0, 65535);
+        REQUIRE(ids.init());
+        uint16_t id = 0;
+        ids.set(65535, true);
+        REQUIRE(ids.findFree(65535, &id));
+        REQUIRE(id == 0);
+    }
+}
+
+TEST_CASE("Nat64") {
+    Nat64Fixture f;
+    auto& nat = f.nat();
+
+    SECTION("UDP flows are allocated distinct ports until the entries are exhausted") {
+        const auto flows = f.fillUdp(1);
+        REQUIRE(flows.size() > 1);
+        std::set<uint16_t> ports;
+        for (const auto s: flows) {
+            const uint16_t port = s->bib()->dst4().port();
+            REQUIRE(port >= MIN_UDP_PORT);
+            REQUIRE(port <= MAX_UDP_PORT);
+            REQUIRE(ports.insert(port).second);
+        }
+        // Neither a new BIB nor a new session fits
+        REQUIRE(nat.addFlow(host6(1000, 1000), peer6(0x08080808, 53), L4_PROTO_UDP, UDP_LIFETIME) == nullptr);
+    }
+
+    SECTION("a UDP flow is found from both of its sides") {
+        const auto flows = f.fillUdp(1);
+        for (size_t i = 0; i < flows.size(); ++i) {
+            const auto src6 = host6(i + 1, 1000);
+            const auto dst6 = peer6(0x08080808, 53);
+            const auto bib = nat.lookupBib(src6, dst6, L4_PROTO_UDP);
+            REQUIRE(bib == flows[i]->bib());
+            REQUIRE(nat.lookupSession(bib, src6, dst6) == flows[i]);
+
+            const auto src4 = peer4(0x08080808, 53);
+            const IpTransportAddress dst4(bib->dst4());
+            REQUIRE(nat.lookupBib(src4, dst4, L4_PROTO_UDP) == bib);
+            REQUIRE(nat.lookupSession(bib, src4, dst4) == flows[i]);
+
+            // The session is endpoint-dependent
+            REQUIRE(nat.lookupSession(bib, peer4(0x08080809, 53), dst4) == nullptr);
+            REQUIRE(nat.lookupSession(bib, peer4(0x08080808, 54), dst4) == nullptr);
+        }
+        REQUIRE(nat.lookupBib(host6(1, 1001), peer6(0x08080808, 53), L4_PROTO_UDP) == nullptr);
+        REQUIRE(nat.lookupBib(host6(1, 1000), peer6(0x08080808, 53), L4_PROTO_ICMP) == nullptr);
+    }
+
+    SECTION("a BIB entry is shared by the sessions of a host to several peers") {
+        const auto s1 = nat.addFlow(host6(1, 1000), peer6(0x08080808, 53), L4_PROTO_UDP, UDP_LIFETIME);
+        REQUIRE(s1);
+        const auto bib = nat.lookupBib(host6(1, 1000), peer6(0x01010101, 53), L4_PROTO_UDP);
+        REQUIRE(bib == s1->bib());
+        const auto s2 = nat.addSession(bib, peer6(0x01010101, 53), UDP_LIFETIME);
+        REQUIRE(s2);
+        const IpTransportAddress dst4(bib->dst4());
+        REQUIRE(nat.lookupSession(bib, peer4(0x08080808, 53), dst4) == s1);
+        REQUIRE(nat.lookupSession(bib, peer4(0x01010101, 53), dst4) == s2);
+    }
+
+    SECTION("ICMP flows are allocated distinct identifiers") {
+        // ICMP is not translated yet, but its BIB entries are allocated the same way
+        std::vector<SessionEntry*> flows;
+        for (uint32_t host = 1;; ++host) {
+            const auto s = nat.addFlow(host6(host, 0x1234), peer6(0x08080808, 0x1234), L4_PROTO_ICMP, ICMP_LIFETIME);
+            if (!s) {
+                break;
+            }
+            flows.push_back(s);
+        }
+        REQUIRE(flows.size() > 1);
+        std::set<uint16_t> ids;
+        for (size_t i = 0; i < flows.size(); ++i) {
+            const auto bib = flows[i]->bib();
+            REQUIRE(ids.insert(bib->dst4().icmpId()).second);
+            const auto src6 = host6(i + 1, 0x1234);
+            const auto dst6 = peer6(0x08080808, 0x1234);
+            REQUIRE(nat.lookupBib(src6, dst6, L4_PROTO_ICMP) == bib);
+            REQUIRE(nat.lookupSession(bib, src6, dst6) == flows[i]);
+            const IpTransportAddress dst4(bib->dst4());
+            REQUIRE(nat.lookupBib(peer4(0x08080808, dst4.icmpId()), dst4, L4_PROTO_ICMP) == bib);
+            REQUIRE(nat.lookupBib(peer4(0x08080808, dst4.icmpId()), dst4, L4_PROTO_UDP) == nullptr);
+        }
+    }
+
+    SECTION("sessions expire on the timer wheel unless they are refreshed") {
+        const auto flows = f.fillUdp(1);
+        const unsigned lifetime = UDP_LIFETIME / TICK;
+        // The lifetime spans more than one round of the wheel
+        REQUIRE(lifetime > NAT64_TIMER_WHEEL_SIZE);
+        nat.tick(lifetime - 20);
+        nat.refreshSession(flows[0], UDP_LIFETIME);
+        nat.tick(19);
+        REQUIRE(nat.lookupBib(host6(2, 1000), peer6(0x08080808, 53), L4_PROTO_UDP) != nullptr);
+        nat.tick(1);
+        REQUIRE(nat.lookupBib(host6(1, 1000), peer6(0x08080808, 53), L4_PROTO_UDP) != nullptr);
+        for (size_t i = 1; i < flows.size(); ++i) {
+            REQUIRE(nat.lookupBib(host6(i + 1, 1000), peer6(0x08080808, 53), L4_PROTO_UDP) == nullptr);
+        }
+
+        SECTION("a refreshed session expires once its new lifetime is over") {
+            nat.tick(lifetime - 21);
+            const auto bib = nat.lookupBib(host6(1, 1000), peer6(0x08080808, 53), L4_PROTO_UDP);
+            REQUIRE(bib != nullptr);
+            const IpTransportAddress dst4(bib->dst4());
+            nat.tick(1);
+            REQUIRE(nat.lookupBib(host6(1, 1000), peer6(0x08080808, 53), L4_PROTO_UDP) == nullptr);
+            REQUIRE(nat.lookupBib(peer4(0x08080808, 53), dst4, L4_PROTO_UDP) == nullptr);
+        }
+
+        SECTION("the entries and ports of the expired sessions are reused") {
+            nat.tick(lifetime);
+            REQUIRE(f.fillUdp(1000).size() == flows.size());
+        }
+    }
+
+    SECTION("lookup throughput") {
+        const auto flows = f.fillUdp(1);
+        const unsigned count = 200000;
+        size_t found = 0;
+        const auto start = std::chrono::steady_clock::now();
+        for (unsigned i = 0; i < count; ++i) {
+            const size_t n = i % flows.size();
+            const auto bib = nat.lookupBib(host6(n + 1, 1000), peer6(0x08080808, 53), L4_PROTO_UDP);
+            found += (nat.lookupSession(bib, peer4(0x08080808, 53), IpTransportAddress(bib->dst4())) == flows[n]);
+        }
+        const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+        INFO(count << " lookups of " << flows.size() << " flows in " << elapsed.count() << " ms");
+        REQUIRE(found == count);
+        REQUIRE(elapsed.count() < 5000);
+    }
+}
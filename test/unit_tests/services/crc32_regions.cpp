@@ -0,0 +1,167 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "crc32_regions.h"
+
+#include <catch2/catch.hpp>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+using namespace particle;
+
+namespace {
+
+std::vector<uint8_t> randomData(size_t size, std::mt19937& rng) {
+    std::vector<uint8_t> data(size);
+    for (auto& b: data) {
+        b = rng();
+    }
+    return data;
+}
+
+void write(Crc32Regions& crc, const std::vector<uint8_t>& data, size_t offset, size_t size) {
+    crc.update(offset, data.data() + offset, std::min(size, data.size() - offset));
+}
+
+} // namespace
+
+TEST_CASE("Crc32Regions::compute()") {
+    SECTION("computes the standard CRC-32") {
+        const char* str = "123456789";
+        CHECK(Crc32Regions::compute((const uint8_t*)str, 9) == 0xcbf43926);
+        CHECK(Crc32Regions::compute(nullptr, 0) == 0);
+    }
+    SECTION("the CRC of two buffers can be combined") {
+        std::mt19937 rng(1);
+        const auto data = randomData(1000, rng);
+        for (size_t split: { 0, 1, 7, 500, 999, 1000 }) {
+            const uint32_t crc1 = Crc32Regions::compute(data.data(), split);
+            const uint32_t crc2 = Crc32Regions::compute(data.data() + split, data.size() - split);
+            CHECK(Crc32Regions::combine(crc1, crc2, data.size() - split) == Crc32Regions::compute(data.data(), data.size()));
+        }
+    }
+}
+
+TEST_CASE("Crc32Regions") {
+    std::mt19937 rng(2);
+    const size_t chunkSize = 512;
+    const auto data = randomData(100 * chunkSize + 123, rng);
+    const size_t chunks = (data.size() + chunkSize - 1) / chunkSize;
+    const uint32_t expected = Crc32Regions::compute(data.data(), data.size() - 4);
+    Crc32Regions crc;
+    crc.reset(data.size(), 4);
+
+    SECTION("chunks written in order") {
+        for (size_t i = 0; i < chunks; ++i) {
+            CHECK_FALSE(crc.isComplete());
+            write(crc, data, i * chunkSize, chunkSize);
+        }
+        REQUIRE(crc.isComplete());
+        CHECK(crc.regionCount() == 1);
+        CHECK(crc.crc() == expected);
+        CHECK(std::equal(data.end() - 4, data.end(), crc.trailer()));
+    }
+    SECTION("chunks written in reverse order") {
+        for (size_t i = chunks; i > 0; --i) {
+            write(crc, data, (i - 1) * chunkSize, chunkSize);
+        }
+        REQUIRE(crc.isComplete());
+        CHECK(crc.crc() == expected);
+    }
+    SECTION("missed chunks written after the others") {
+        // Every 10th chunk is missed on the first pass
+        for (size_t i = 0; i < chunks; ++i) {
+            if (i % 10 != 3) {
+                write(crc, data, i * chunkSize, chunkSize);
+            }
+        }
+        CHECK_FALSE(crc.isComplete());
+        CHECK(crc.regionCount() == 11);
+        for (size_t i = 3; i < chunks; i += 10) {
+            write(crc, data, i * chunkSize, chunkSize);
+        }
+        REQUIRE(crc.isComplete());
+        CHECK(crc.crc() == expected);
+    }
+    SECTION("chunks written more than once") {
+        write(crc, data, 0, chunkSize);
+        write(crc, data, chunkSize, chunkSize);
+        write(crc, data, 0, chunkSize);
+        write(crc, data, chunkSize, chunkSize);
+        write(crc, data, 0, chunkSize / 2);
+        for (size_t i = 2; i < chunks; ++i) {
+            write(crc, data, i * chunkSize, chunkSize);
+            write(crc, data, i * chunkSize, chunkSize);
+        }
+        REQUIRE(crc.isComplete());
+        CHECK(crc.crc() == expected);
+    }
+    SECTION("chunks in random order, with the trailer split across chunks") {
+        const size_t size = 7;
+        std::vector<size_t> order((data.size() + size - 1) / size);
+        for (size_t i = 0; i < order.size(); ++i) {
+            order[i] = i;
+        }
+        // Keep the chunks roughly in order so the number of regions stays small
+        for (size_t i = 0; i + 4 < order.size(); i += 4) {
+            std::shuffle(order.begin() + i, order.begin() + i + 4, rng);
+        }
+        for (size_t i: order) {
+            write(crc, data, i * size, size);
+        }
+        REQUIRE(crc.isComplete());
+        CHECK(crc.crc() == expected);
+        CHECK(std::equal(data.end() - 4, data.end(), crc.trailer()));
+    }
+    SECTION("a missing trailer byte leaves the data incomplete") {
+        write(crc, data, 0, data.size() - 2);
+        write(crc, data, data.size() - 1, 1);
+        CHECK_FALSE(crc.isComplete());
+        write(crc, data, data.size() - 2, 1);
+        CHECK(crc.isComplete());
+    }
+    SECTION("too many regions abandon tracking") {
+        for (size_t i = 0; i < Crc32Regions::MAX_REGIONS + 1; ++i) {
+            write(crc, data, i * 2 * chunkSize, chunkSize);
+        }
+        CHECK_FALSE(crc.isValid());
+        for (size_t i = 0; i < chunks; ++i) {
+            write(crc, data, i * chunkSize, chunkSize);
+        }
+        CHECK_FALSE(crc.isComplete());
+    }
+    SECTION("a partially overlapping write abandons tracking") {
+        write(crc, data, 0, chunkSize);
+        write(crc, data, chunkSize / 2, chunkSize);
+        CHECK_FALSE(crc.isValid());
+    }
+    SECTION("data beyond the end is ignored") {
+        std::vector<uint8_t> padded(data);
+        padded.resize(chunks * chunkSize + chunkSize, 0xff);
+        for (size_t i = 0; i <= chunks; ++i) {
+            crc.update(i * chunkSize, padded.data() + i * chunkSize, chunkSize);
+        }
+        REQUIRE(crc.isComplete());
+        CHECK(crc.crc() == expected);
+    }
+    SECTION("a trailer larger than the data is rejected") {
+        crc.reset(4, 4);
+        CHECK_FALSE(crc.isValid());
+    }
+}
@@ -0,0 +1,247 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "delta_patch.h"
+#include "system_error.h"
+
+#include <catch2/catch.hpp>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+using namespace particle;
+
+namespace {
+
+typedef std::vector<uint8_t> Bytes;
+
+Bytes randomData(size_t size, std::mt19937& rng) {
+    Bytes data(size);
+    for (auto& b: data) {
+        b = rng();
+    }
+    return data;
+}
+
+void appendUint32(Bytes& data, uint32_t val) {
+    for (unsigned i = 0; i < 4; ++i) {
+        data.push_back(val >> (i * 8));
+    }
+}
+
+// Builds a patch command by command
+class PatchBuilder {
+public:
+    PatchBuilder(const Bytes& source, const Bytes& target) :
+            source_(source),
+            target_(target),
+            sourceOffset_(0),
+            targetOffset_(0) {
+        patch_ = { 'P', 'D', 'L', 'T', DeltaPatch::VERSION, 5 /* MODULE_FUNCTION_USER_PART */, 1, 0 };
+        appendUint32(patch_, source.size());
+        appendUint32(patch_, Crc32Regions::compute(source.data(), source.size()));
+        appendUint32(patch_, target.size());
+    }
+
+    // Copies `diff` bytes from the source with the differences to the target, inserts `extra` bytes
+    // of the target, then moves the source position by `seek` bytes
+    PatchBuilder& command(size_t diff, size_t extra, int32_t seek) {
+        appendUint32(patch_, diff);
+        appendUint32(patch_, extra);
+        appendUint32(patch_, seek);
+        for (size_t i = 0; i < diff; ++i) {
+            patch_.push_back(target_[targetOffset_++] - source_[sourceOffset_++]);
+        }
+        for (size_t i = 0; i < extra; ++i) {
+            patch_.push_back(target_[targetOffset_++]);
+        }
+        sourceOffset_ += seek;
+        return *this;
+    }
+
+    const Bytes& patch() const {
+        return patch_;
+    }
+
+private:
+    const Bytes& source_;
+    const Bytes& target_;
+    Bytes patch_;
+    size_t sourceOffset_;
+    size_t targetOffset_;
+};
+
+class Handler: public DeltaPatch::Handler {
+public:
+    explicit Handler(const Bytes& source) :
+            source(source),
+            openResult(0),
+            opened(false) {
+    }
+
+    int openSource(const DeltaPatch::Header& header) override {
+        opened = true;
+        this->header = header;
+        return openResult;
+    }
+
+    int readSource(size_t offset, uint8_t* data, size_t size) override {
+        if (offset + size > source.size()) {
+            return SYSTEM_ERROR_OUT_OF_RANGE;
+        }
+        std::copy(source.begin() + offset, source.begin() + offset + size, data);
+        return 0;
+    }
+
+    int writeTarget(size_t offset, const uint8_t* data, size_t size) override {
+        if (offset + size > target.size()) {
+            target.resize(offset + size);
+        }
+        std::copy(data, data + size, target.begin() + offset);
+        return 0;
+    }
+
+    const Bytes& source;
+    Bytes target;
+    DeltaPatch::Header header;
+    int openResult;
+    bool opened;
+};
+
+int apply(DeltaPatch& patch, const Bytes& data, size_t chunkSize) {
+    for (size_t offset = 0; offset < data.size(); offset += chunkSize) {
+        const int result = patch.write(data.data() + offset, std::min(chunkSize, data.size() - offset));
+        if (result < 0) {
+            return result;
+        }
+    }
+    return 0;
+}
+
+} // namespace
+
+TEST_CASE("DeltaPatch") {
+    std::mt19937 rng(3);
+    const Bytes source = randomData(10000, rng);
+    Handler handler(source);
+    DeltaPatch patch(&handler);
+
+    SECTION("a patch with changed and inserted bytes") {
+        // Change a few bytes, insert 100 bytes at 5000 and drop 20 bytes at 8000
+        Bytes target(source);
+        target[10] ^= 0x55;
+        target[4000] += 1;
+        const Bytes inserted = randomData(100, rng);
+        target.erase(target.begin() + 8000, target.begin() + 8020);
+        target.insert(target.begin() + 5000, inserted.begin(), inserted.end());
+        const auto data = PatchBuilder(source, target)
+                .command(5000, 100, 0)
+                .command(3000, 0, 20)
+                .command(source.size() - 8020, 0, 0)
+                .patch();
+        for (size_t chunkSize: { 1, 7, 512, 100000 }) {
+            Handler handler(source);
+            DeltaPatch patch(&handler);
+            REQUIRE(apply(patch, data, chunkSize) == 0);
+            CHECK(patch.isDone());
+            CHECK(patch.targetOffset() == target.size());
+            CHECK(handler.target == target);
+        }
+    }
+    SECTION("the header describes the source module") {
+        const auto data = PatchBuilder(source, source).command(source.size(), 0, 0).patch();
+        REQUIRE(apply(patch, data, 10) == 0);
+        CHECK(handler.opened);
+        CHECK(handler.header.moduleFunction == 5);
+        CHECK(handler.header.moduleIndex == 1);
+        CHECK(handler.header.sourceSize == source.size());
+        CHECK(handler.header.targetSize == source.size());
+        CHECK(handler.target == source);
+    }
+    SECTION("blocks of the source can be moved around") {
+        // Swap the two halves of the source
+        Bytes target(source.begin() + 5000, source.end());
+        target.insert(target.end(), source.begin(), source.begin() + 5000);
+        const auto data = PatchBuilder(source, target)
+                .command(0, 0, 5000)
+                .command(5000, 0, -10000)
+                .command(5000, 0, 0)
+                .patch();
+        REQUIRE(apply(patch, data, 64) == 0);
+        CHECK(patch.isDone());
+        CHECK(handler.target == target);
+    }
+    SECTION("data after the end of the patch is ignored") {
+        auto data = PatchBuilder(source, source).command(source.size(), 0, 0).patch();
+        data.resize(data.size() + 100, 0xff);
+        REQUIRE(apply(patch, data, 512) == 0);
+        CHECK(patch.isDone());
+        CHECK(handler.target == source);
+    }
+    SECTION("an incomplete patch is not done") {
+        auto data = PatchBuilder(source, source).command(source.size(), 0, 0).patch();
+        data.pop_back();
+        REQUIRE(apply(patch, data, 512) == 0);
+        CHECK_FALSE(patch.isDone());
+    }
+    SECTION("a patch for another module is rejected before anything is written") {
+        Bytes other(source);
+        other[9999] ^= 1;
+        const auto data = PatchBuilder(other, source).command(source.size(), 0, 0).patch();
+        CHECK(apply(patch, data, 512) == SYSTEM_ERROR_BAD_DATA);
+        CHECK(handler.target.empty());
+        CHECK_FALSE(patch.isDone());
+        CHECK(patch.write(data.data(), 1) == SYSTEM_ERROR_INVALID_STATE);
+    }
+    SECTION("the handler can reject the source") {
+        handler.openResult = SYSTEM_ERROR_NOT_FOUND;
+        const auto data = PatchBuilder(source, source).command(source.size(), 0, 0).patch();
+        CHECK(apply(patch, data, 512) == SYSTEM_ERROR_NOT_FOUND);
+    }
+    SECTION("invalid patches are rejected") {
+        Bytes data;
+        SECTION("bad magic") {
+            data = PatchBuilder(source, source).command(source.size(), 0, 0).patch();
+            data[0] = 'X';
+        }
+        SECTION("seeking before the start of the source") {
+            data = PatchBuilder(source, source).command(100, 0, -101).patch();
+        }
+        SECTION("seeking past the end of the source") {
+            data = PatchBuilder(source, source).command(100, 0, source.size()).patch();
+        }
+        SECTION("a command producing more than the target size") {
+            Bytes target(source.begin(), source.begin() + 100);
+            data = PatchBuilder(source, target).command(100, 0, 0).patch();
+            data[16] = 99; // Target size
+        }
+        SECTION("a diff reading past the end of the source") {
+            data = PatchBuilder(source, source).patch();
+            data[16] += 1;
+            appendUint32(data, source.size() + 1);
+            appendUint32(data, 0);
+            appendUint32(data, 0);
+        }
+        CHECK(apply(patch, data, 512) == SYSTEM_ERROR_BAD_DATA);
+    }
+    SECTION("an unsupported version is rejected") {
+        auto data = PatchBuilder(source, source).command(source.size(), 0, 0).patch();
+        data[4] = DeltaPatch::VERSION + 1;
+        CHECK(apply(patch, data, 512) == SYSTEM_ERROR_NOT_SUPPORTED);
+    }
+}
@@ -0,0 +1,346 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "fake_lfs.h"
+#include "filesystem.h"
+
+#include <algorithm>
+#include <cstring>
+#include <set>
+
+using particle::test::FakeLfs;
+
+namespace {
+
+struct File {
+    std::string path;
+    FakeLfs::Data data;
+    size_t pos;
+    int flags;
+    bool dirty;
+};
+
+struct Dir {
+    std::vector<lfs_info> entries;
+    size_t pos;
+};
+
+struct State {
+    FakeLfs::Files files;
+    std::set<std::string> dirs;
+    unsigned syncs = 0;
+    unsigned fullReads = 0;
+    int shortReadSize = -1;
+};
+
+State& state() {
+    static State s;
+    return s;
+}
+
+filesystem_t g_fs = {};
+
+std::string normalize(const char* path) {
+    std::string p(path);
+    while (!p.empty() && p[0] == '/') {
+        p.erase(0, 1);
+    }
+    while (!p.empty() && p.back() == '/') {
+        p.pop_back();
+    }
+    return p;
+}
+
+std::string parent(const std::string& path) {
+    const size_t pos = path.rfind('/');
+    return (pos == std::string::npos) ? std::string() : path.substr(0, pos);
+}
+
+bool dirExists(const std::string& path) {
+    return path.empty() || state().dirs.count(path);
+}
+
+File* file(lfs_file_t* f) {
+    return static_cast<File*>(f->handle);
+}
+
+lfs_info entry(uint8_t type, lfs_size_t size, const std::string& name) {
+    lfs_info info = {};
+    info.type = type;
+    info.size = size;
+    strncpy(info.name, name.c_str(), LFS_NAME_MAX);
+    return info;
+}
+
+} // unnamed
+
+namespace particle {
+
+namespace test {
+
+void FakeLfs::reset() {
+    state() = State();
+}
+
+FakeLfs::Files& FakeLfs::files() {
+    return state().files;
+}
+
+void FakeLfs::restore(const Files& files) {
+    state().files = files;
+}
+
+unsigned FakeLfs::syncCount() {
+    return state().syncs;
+}
+
+void FakeLfs::shortReads(unsigned reads, int size) {
+    state().fullReads = reads;
+    state().shortReadSize = size;
+}
+
+} // test
+
+} // particle
+
+extern "C" {
+
+filesystem_t* filesystem_get_instance(void* reserved) {
+    return &g_fs;
+}
+
+int filesystem_mount(filesystem_t* fs) {
+    return 0;
+}
+
+int filesystem_unmount(filesystem_t* fs) {
+    return 0;
+}
+
+int filesystem_lock(filesystem_t* fs) {
+    return 0;
+}
+
+int filesystem_unlock(filesystem_t* fs) {
+    return 0;
+}
+
+int lfs_remove(lfs_t* lfs, const char* path) {
+    const std::string p = normalize(path);
+    if (state().files.erase(p)) {
+        return LFS_ERR_OK;
+    }
+    if (state().dirs.erase(p)) {
+        return LFS_ERR_OK;
+    }
+    return LFS_ERR_NOENT;
+}
+
+int lfs_rename(lfs_t* lfs, const char* oldpath, const char* newpath) {
+    auto& files = state().files;
+    const auto it = files.find(normalize(oldpath));
+    if (it == files.end()) {
+        return LFS_ERR_NOENT;
+    }
+    FakeLfs::Data data = std::move(it->second);
+    files.erase(it);
+    files[normalize(newpath)] = std::move(data);
+    return LFS_ERR_OK;
+}
+
+int lfs_stat(lfs_t* lfs, const char* path, struct lfs_info* info) {
+    const std::string p = normalize(path);
+    const auto it = state().files.find(p);
+    if (it != state().files.end()) {
+        *info = entry(LFS_TYPE_REG, it->second.size(), p.substr(p.rfind('/') + 1));
+        return LFS_ERR_OK;
+    }
+    if (p.empty() || state().dirs.count(p)) {
+        *info = entry(LFS_TYPE_DIR, 0, p.substr(p.rfind('/') + 1));
+        return LFS_ERR_OK;
+    }
+    return LFS_ERR_NOENT;
+}
+
+int lfs_file_open(lfs_t* lfs, lfs_file_t* f, const char* path, int flags) {
+    const std::string p = normalize(path);
+    if (state().dirs.count(p)) {
+        return LFS_ERR_ISDIR;
+    }
+    auto& files = state().files;
+    auto it = files.find(p);
+    if (it == files.end()) {
+        if (!(flags & LFS_O_CREAT)) {
+            return LFS_ERR_NOENT;
+        }
+        if (!dirExists(parent(p))) {
+            return LFS_ERR_NOENT;
+        }
+        it = files.insert(std::make_pair(p, FakeLfs::Data())).first;
+    } else if ((flags & LFS_O_CREAT) && (flags & LFS_O_EXCL)) {
+        return LFS_ERR_EXIST;
+    }
+    File* file = new File();
+    file->path = p;
+    file->data = it->second;
+    file->pos = 0;
+    file->flags = flags;
+    file->dirty = false;
+    if (flags & LFS_O_TRUNC) {
+        file->data.clear();
+        file->dirty = true;
+    }
+    f->handle = file;
+    return LFS_ERR_OK;
+}
+
+int lfs_file_sync(lfs_t* lfs, lfs_file_t* f) {
+    File* file = ::file(f);
+    if (file->dirty) {
+        state().files[file->path] = file->data;
+        ++state().syncs;
+        file->dirty = false;
+    }
+    return LFS_ERR_OK;
+}
+
+int lfs_file_close(lfs_t* lfs, lfs_file_t* f) {
+    const int r = lfs_file_sync(lfs, f);
+    delete file(f);
+    f->handle = nullptr;
+    return r;
+}
+
+lfs_ssize_t lfs_file_read(lfs_t* lfs, lfs_file_t* f, void* buffer, lfs_size_t size) {
+    File* file = ::file(f);
+    if ((file->flags & 3) == LFS_O_WRONLY) {
+        return LFS_ERR_INVAL;
+    }
+    size_t n = (file->pos < file->data.size()) ? std::min<size_t>(size, file->data.size() - file->pos) : 0;
+    if (state().shortReadSize >= 0) {
+        if (state().fullReads > 0) {
+            --state().fullReads;
+        } else {
+            n = std::min<size_t>(n, state().shortReadSize);
+        }
+    }
+    memcpy(buffer, file->data.data() + file->pos, n);
+    file->pos += n;
+    return n;
+}
+
+lfs_ssize_t lfs_file_write(lfs_t* lfs, lfs_file_t* f, const void* buffer, lfs_size_t size) {
+    File* file = ::file(f);
+    if ((file->flags & 3) == LFS_O_RDONLY) {
+        return LFS_ERR_INVAL;
+    }
+    if (file->flags & LFS_O_APPEND) {
+        file->pos = file->data.size();
+    }
+    if (file->data.size() < file->pos + size) {
+        file->data.resize(file->pos + size);
+    }
+    memcpy(file->data.data() + file->pos, buffer, size);
+    file->pos += size;
+    file->dirty = true;
+    return size;
+}
+
+lfs_soff_t lfs_file_seek(lfs_t* lfs, lfs_file_t* f, lfs_soff_t off, int whence) {
+    File* file = ::file(f);
+    lfs_soff_t pos = off;
+    if (whence == LFS_SEEK_CUR) {
+        pos += file->pos;
+    } else if (whence == LFS_SEEK_END) {
+        pos += file->data.size();
+    }
+    if (pos < 0) {
+        return LFS_ERR_INVAL;
+    }
+    file->pos = pos;
+    return pos;
+}
+
+int lfs_file_truncate(lfs_t* lfs, lfs_file_t* f, lfs_off_t size) {
+    File* file = ::file(f);
+    if ((file->flags & 3) == LFS_O_RDONLY) {
+        return LFS_ERR_INVAL;
+    }
+    file->data.resize(size);
+    file->dirty = true;
+    return LFS_ERR_OK;
+}
+
+lfs_soff_t lfs_file_tell(lfs_t* lfs, lfs_file_t* f) {
+    return file(f)->pos;
+}
+
+lfs_soff_t lfs_file_size(lfs_t* lfs, lfs_file_t* f) {
+    return file(f)->data.size();
+}
+
+int lfs_mkdir(lfs_t* lfs, const char* path) {
+    const std::string p = normalize(path);
+    if (dirExists(p) || state().files.count(p)) {
+        return LFS_ERR_EXIST;
+    }
+    if (!dirExists(parent(p))) {
+        return LFS_ERR_NOENT;
+    }
+    state().dirs.insert(p);
+    return LFS_ERR_OK;
+}
+
+int lfs_dir_open(lfs_t* lfs, lfs_dir_t* d, const char* path) {
+    const std::string p = normalize(path);
+    if (!dirExists(p)) {
+        return LFS_ERR_NOENT;
+    }
+    Dir* dir = new Dir();
+    dir->pos = 0;
+    dir->entries.push_back(entry(LFS_TYPE_DIR, 0, "."));
+    dir->entries.push_back(entry(LFS_TYPE_DIR, 0, ".."));
+    for (const auto& sub: state().dirs) {
+        if (parent(sub) == p) {
+            dir->entries.push_back(entry(LFS_TYPE_DIR, 0, sub.substr(sub.rfind('/') + 1)));
+        }
+    }
+    for (const auto& f: state().files) {
+        if (parent(f.first) == p) {
+            dir->entries.push_back(entry(LFS_TYPE_REG, f.second.size(), f.first.substr(f.first.rfind('/') + 1)));
+        }
+    }
+    d->handle = dir;
+    return LFS_ERR_OK;
+}
+
+int lfs_dir_close(lfs_t* lfs, lfs_dir_t* d) {
+    delete static_cast<Dir*>(d->handle);
+    d->handle = nullptr;
+    return LFS_ERR_OK;
+}
+
+int lfs_dir_read(lfs_t* lfs, lfs_dir_t* d, struct lfs_info* info) {
+    Dir* dir = static_cast<Dir*>(d->handle);
+    if (dir->pos >= dir->entries.size()) {
+        return 0;
+    }
+    *info = dir->entries[dir->pos++];
+    return 1;
+}
+
+} // extern "C"
@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace particle {
+
+namespace test {
+
+/**
+ * An in-memory filesystem behind the littlefs API.
+ *
+ * As with littlefs, the changes made through an open file become visible to other file handles,
+ * and survive a reset, only once the file is synchronized or closed.
+ */
+class FakeLfs {
+public:
+    typedef std::vector<uint8_t> Data;
+    typedef std::map<std::string, Data> Files;
+
+    /**
+     * Removes all files and directories, and resets the fault injection.
+     */
+    static void reset();
+
+    /**
+     * Returns the synchronized contents of the files, keyed by their path without the leading slash.
+     */
+    static Files& files();
+
+    /**
+     * Returns the synchronized contents of the files, as they would be found after a reset.
+     */
+    static Files snapshot() {
+        return files();
+    }
+
+    /**
+     * Restores the contents of the files, e.g. from a snapshot taken before a reset.
+     */
+    static void restore(const Files& files);
+
+    /**
+     * Returns the number of times a file has been synchronized.
+     */
+    static unsigned syncCount();
+
+    /**
+     * Makes the read calls return at most `size` bytes after `reads` more complete reads.
+     * A negative `size` disables the short reads.
+     */
+    static void shortReads(unsigned reads, int size);
+};
+
+} // test
+
+} // particle
@@ -0,0 +1,281 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "file_queue.h"
+#include "fake_lfs.h"
+
+#include <catch2/catch.hpp>
+
+#include <chrono>
+#include <memory>
+#include <string>
+
+using namespace particle::fs;
+using particle::test::FakeLfs;
+
+namespace {
+
+// Entries of 4 + 12 bytes, so that 256 of them fill a segment
+const uint16_t ITEM_SIZE = 12;
+const unsigned ITEMS_PER_SEGMENT = FILE_QUEUE_SEGMENT_SIZE / (ITEM_SIZE + sizeof(FileQueue::QueueEntry));
+
+struct Item {
+    uint32_t value;
+    uint8_t padding[ITEM_SIZE - sizeof(uint32_t)];
+};
+
+int push(FileQueue& queue, uint32_t value) {
+    Item item = {};
+    item.value = value;
+    return queue.pushBack(&item, sizeof(item));
+}
+
+void pushRange(FileQueue& queue, uint32_t first, uint32_t last) {
+    for (uint32_t v = first; v <= last; ++v) {
+        REQUIRE(push(queue, v) == 0);
+    }
+}
+
+// Returns the value of the front entry, or -1 if the queue is empty
+int64_t front(FileQueue& queue) {
+    FileQueue::QueueEntry entry = {};
+    Item item = {};
+    const int r = queue.front(entry, &item, sizeof(item));
+    if (r == SYSTEM_ERROR_NOT_FOUND) {
+        return -1;
+    }
+    REQUIRE(r == 0);
+    REQUIRE(entry.size == sizeof(item) + sizeof(entry));
+    return item.value;
+}
+
+void popRange(FileQueue& queue, uint32_t first, uint32_t last) {
+    for (uint32_t v = first; v <= last; ++v) {
+        REQUIRE(front(queue) == v);
+        REQUIRE(queue.popFront() == 0);
+    }
+}
+
+bool exists(const std::string& path) {
+    return FakeLfs::files().count(path);
+}
+
+} // unnamed
+
+TEST_CASE("FileQueue") {
+    FakeLfs::reset();
+
+    SECTION("entries are read in the order they were added") {
+        FileQueue queue("q");
+        REQUIRE(queue.size() == 0);
+        REQUIRE(front(queue) == -1);
+        pushRange(queue, 1, 10);
+        REQUIRE(queue.size() == 10);
+        popRange(queue, 1, 4);
+        REQUIRE(queue.size() == 6);
+        pushRange(queue, 11, 12);
+        popRange(queue, 5, 12);
+        REQUIRE(queue.size() == 0);
+        REQUIRE(front(queue) == -1);
+        REQUIRE(queue.popFront() == SYSTEM_ERROR_NOT_FOUND);
+    }
+
+    SECTION("an entry is not read into a buffer that is too small") {
+        FileQueue queue("q");
+        pushRange(queue, 1, 1);
+        FileQueue::QueueEntry entry = {};
+        uint8_t buf[ITEM_SIZE - 1] = {};
+        REQUIRE(queue.front(entry, buf, sizeof(buf)) == SYSTEM_ERROR_TOO_LARGE);
+        REQUIRE(front(queue) == 1);
+    }
+
+    SECTION("the log continues in a new segment once a segment is full") {
+        FileQueue queue("q");
+        pushRange(queue, 0, ITEMS_PER_SEGMENT * 3 - 1);
+        REQUIRE(exists("q.0"));
+        REQUIRE(exists("q.1"));
+        REQUIRE(exists("q.2"));
+        REQUIRE(FakeLfs::files()["q.0"].size() == FILE_QUEUE_SEGMENT_SIZE);
+
+        SECTION("compact() removes the segments that have been read through") {
+            popRange(queue, 0, ITEMS_PER_SEGMENT * 2);
+            REQUIRE(queue.compact() == 0);
+            REQUIRE_FALSE(exists("q.0"));
+            REQUIRE_FALSE(exists("q.1"));
+            REQUIRE(exists("q.2"));
+            popRange(queue, ITEMS_PER_SEGMENT * 2 + 1, ITEMS_PER_SEGMENT * 3 - 1);
+        }
+
+        SECTION("compact() removes all of the files once the queue is empty") {
+            popRange(queue, 0, ITEMS_PER_SEGMENT * 3 - 1);
+            REQUIRE(queue.compact() == 0);
+            REQUIRE(FakeLfs::files().empty());
+            pushRange(queue, 100, 100);
+            REQUIRE(exists("q.0"));
+            REQUIRE(front(queue) == 100);
+        }
+    }
+
+    SECTION("clear() removes the entries and the files") {
+        FileQueue queue("q");
+        pushRange(queue, 0, ITEMS_PER_SEGMENT * 2);
+        popRange(queue, 0, 2);
+        REQUIRE(queue.clear() == 0);
+        REQUIRE(queue.size() == 0);
+        REQUIRE(FakeLfs::files().empty());
+    }
+
+    SECTION("a reopened queue continues at the read cursor") {
+        {
+            FileQueue queue("q");
+            pushRange(queue, 0, ITEMS_PER_SEGMENT * 2);
+            popRange(queue, 0, ITEMS_PER_SEGMENT + 9);
+            REQUIRE(queue.compact() == 0);
+        }
+        FileQueue queue("q");
+        REQUIRE(queue.size() == ITEMS_PER_SEGMENT - 9);
+        pushRange(queue, 1000, 1001);
+        popRange(queue, ITEMS_PER_SEGMENT + 10, ITEMS_PER_SEGMENT * 2);
+        popRange(queue, 1000, 1001);
+        REQUIRE(front(queue) == -1);
+    }
+
+    SECTION("changes not yet synchronized are lost on reset") {
+        FakeLfs::Files files;
+        {
+            FileQueue queue("q", 4 /* syncInterval */);
+            pushRange(queue, 0, 9);
+            REQUIRE(queue.sync() == 0);
+            popRange(queue, 0, 5);  // the cursor is saved after the 4th entry
+            pushRange(queue, 10, 11);  // and these are never synchronized
+            files = FakeLfs::snapshot();
+        }
+        FakeLfs::restore(files);
+        FileQueue queue("q", 4);
+        REQUIRE(queue.size() == 6);
+        popRange(queue, 4, 9);
+    }
+
+    SECTION("the segments are found by listing the directory if the read cursor is missing") {
+        const char* idx = GENERATE("missing", "invalid");
+        {
+            FileQueue queue("q");
+            pushRange(queue, 0, ITEMS_PER_SEGMENT * 3 + 4);
+            popRange(queue, 0, ITEMS_PER_SEGMENT + 2);
+            REQUIRE(queue.compact() == 0);
+        }
+        REQUIRE_FALSE(exists("q.0"));
+        REQUIRE(exists("q.idx"));
+        if (std::string(idx) == "missing") {
+            FakeLfs::files().erase("q.idx");
+        } else {
+            FakeLfs::files()["q.idx"] = FakeLfs::Data(16, 0xff);
+        }
+        FakeLfs::files()["q.txt"] = FakeLfs::Data(1);  // not a segment
+
+        FileQueue queue("q");
+        SECTION("the queue is read again from the oldest segment left") {
+            REQUIRE(queue.size() == ITEMS_PER_SEGMENT * 2 + 5);
+            popRange(queue, ITEMS_PER_SEGMENT, ITEMS_PER_SEGMENT * 3 + 4);
+            REQUIRE(front(queue) == -1);
+            REQUIRE(exists("q.txt"));
+        }
+    }
+
+    SECTION("the segments of a queue in a directory are found as well") {
+        REQUIRE(lfs_mkdir(nullptr, "/usr") == LFS_ERR_OK);
+        {
+            FileQueue queue("/usr/q");
+            pushRange(queue, 0, ITEMS_PER_SEGMENT * 2);
+            popRange(queue, 0, ITEMS_PER_SEGMENT);
+            REQUIRE(queue.compact() == 0);
+        }
+        FakeLfs::files().erase("usr/q.idx");
+        FileQueue queue("/usr/q");
+        REQUIRE(queue.size() == ITEMS_PER_SEGMENT + 1);
+        popRange(queue, ITEMS_PER_SEGMENT, ITEMS_PER_SEGMENT * 2);
+    }
+
+    SECTION("an entry that was only partially written is discarded") {
+        const unsigned tornSize = GENERATE(2, 4, 10);
+        {
+            FileQueue queue("q");
+            pushRange(queue, 0, ITEMS_PER_SEGMENT + 9);
+            popRange(queue, 0, 1);
+        }
+        // The header and part of the data of the next entry made it to the tail segment
+        FakeLfs::Data& tail = FakeLfs::files()["q.1"];
+        const size_t size = tail.size();
+        const uint16_t header[2] = { ITEM_SIZE + sizeof(FileQueue::QueueEntry), FileQueue::QueueEntry::ACTIVE };
+        tail.insert(tail.end(), (const uint8_t*)header, (const uint8_t*)header + sizeof(header));
+        tail.resize(size + tornSize, 0xaa);
+
+        FileQueue queue("q");
+        SECTION("the tail segment is truncated at the last complete entry") {
+            REQUIRE(queue.size() == ITEMS_PER_SEGMENT + 8);
+            REQUIRE(FakeLfs::files()["q.1"].size() == size);
+            REQUIRE(exists("q.0"));
+        }
+        SECTION("entries are added after the last complete entry") {
+            pushRange(queue, 5000, 5000);
+            popRange(queue, 2, ITEMS_PER_SEGMENT + 9);
+            popRange(queue, 5000, 5000);
+            REQUIRE(front(queue) == -1);
+        }
+    }
+
+    SECTION("a log corrupted before its last entry is discarded") {
+        {
+            FileQueue queue("q");
+            pushRange(queue, 0, ITEMS_PER_SEGMENT + 9);
+        }
+        FakeLfs::files()["q.0"].resize(100);
+        FileQueue queue("q");
+        REQUIRE(queue.size() == 0);
+        REQUIRE(FakeLfs::files().empty());
+    }
+
+    SECTION("throughput") {
+        // Each synchronization is a metadata commit on the flash, so their number is what limits
+        // the throughput of the queue
+        const unsigned count = 20000;
+        const unsigned syncInterval = 16;
+        FileQueue queue("q", syncInterval);
+        const auto start = std::chrono::steady_clock::now();
+        // Reading an entry that is not synchronized yet synchronizes the tail segment, so the
+        // entries are removed in batches rather than as soon as they are added
+        const unsigned batchSize = syncInterval * 4;
+        for (unsigned i = 0; i < count; ++i) {
+            REQUIRE(push(queue, i) == 0);
+            if (i % batchSize == batchSize - 1) {
+                popRange(queue, i + 1 - batchSize, i);
+            }
+            if (i % ITEMS_PER_SEGMENT == 0) {
+                REQUIRE(queue.compact() == 0);
+            }
+        }
+        REQUIRE(queue.sync() == 0);
+        const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+        const unsigned segments = count / ITEMS_PER_SEGMENT + 1;
+        INFO(count << " entries added and removed in " << elapsed.count() << " ms, " << FakeLfs::syncCount() << " syncs");
+        // Appended entries and the read cursor are synchronized once per interval, and when a
+        // segment is finished or compacted
+        REQUIRE(FakeLfs::syncCount() <= 2 * count / syncInterval + 3 * segments);
+        REQUIRE(FakeLfs::files().size() <= 3);
+        REQUIRE(elapsed.count() < 5000);
+    }
+}
@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+// The subset of the littlefs API used by the services, implemented in memory by fake_lfs.cpp
+
+#include <stdint.h>
+
+#define LFS_NAME_MAX 255
+
+typedef uint32_t lfs_size_t;
+typedef uint32_t lfs_off_t;
+typedef int32_t lfs_ssize_t;
+typedef int32_t lfs_soff_t;
+
+enum lfs_error {
+    LFS_ERR_OK = 0,
+    LFS_ERR_IO = -5,
+    LFS_ERR_CORRUPT = -52,
+    LFS_ERR_NOENT = -2,
+    LFS_ERR_EXIST = -17,
+    LFS_ERR_NOTDIR = -20,
+    LFS_ERR_ISDIR = -21,
+    LFS_ERR_INVAL = -22,
+    LFS_ERR_NOSPC = -28,
+    LFS_ERR_NOMEM = -12
+};
+
+enum lfs_type {
+    LFS_TYPE_REG = 0x11,
+    LFS_TYPE_DIR = 0x22
+};
+
+enum lfs_open_flags {
+    LFS_O_RDONLY = 1,
+    LFS_O_WRONLY = 2,
+    LFS_O_RDWR = 3,
+    LFS_O_CREAT = 0x0100,
+    LFS_O_EXCL = 0x0200,
+    LFS_O_TRUNC = 0x0400,
+    LFS_O_APPEND = 0x0800
+};
+
+enum lfs_whence_flags {
+    LFS_SEEK_SET = 0,
+    LFS_SEEK_CUR = 1,
+    LFS_SEEK_END = 2
+};
+
+struct lfs_config {
+    void* context;
+};
+
+struct lfs_info {
+    uint8_t type;
+    lfs_size_t size;
+    char name[LFS_NAME_MAX + 1];
+};
+
+typedef struct lfs_file {
+    void* handle;
+} lfs_file_t;
+
+typedef struct lfs_dir {
+    void* handle;
+} lfs_dir_t;
+
+typedef struct lfs {
+    void* context;
+} lfs_t;
+
+int lfs_remove(lfs_t* lfs, const char* path);
+int lfs_rename(lfs_t* lfs, const char* oldpath, const char* newpath);
+int lfs_stat(lfs_t* lfs, const char* path, struct lfs_info* info);
+
+int lfs_file_open(lfs_t* lfs, lfs_file_t* file, const char* path, int flags);
+int lfs_file_close(lfs_t* lfs, lfs_file_t* file);
+int lfs_file_sync(lfs_t* lfs, lfs_file_t* file);
+lfs_ssize_t lfs_file_read(lfs_t* lfs, lfs_file_t* file, void* buffer, lfs_size_t size);
+lfs_ssize_t lfs_file_write(lfs_t* lfs, lfs_file_t* file, const void* buffer, lfs_size_t size);
+lfs_soff_t lfs_file_seek(lfs_t* lfs, lfs_file_t* file, lfs_soff_t off, int whence);
+int lfs_file_truncate(lfs_t* lfs, lfs_file_t* file, lfs_off_t size);
+lfs_soff_t lfs_file_tell(lfs_t* lfs, lfs_file_t* file);
+lfs_soff_t lfs_file_size(lfs_t* lfs, lfs_file_t* file);
+
+int lfs_mkdir(lfs_t* lfs, const char* path);
+int lfs_dir_open(lfs_t* lfs, lfs_dir_t* dir, const char* path);
+int lfs_dir_close(lfs_t* lfs, lfs_dir_t* dir);
+int lfs_dir_read(lfs_t* lfs, lfs_dir_t* dir, struct lfs_info* info);
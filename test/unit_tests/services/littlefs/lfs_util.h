@@ -0,0 +1,3 @@
+#pragma once
+
+// Nothing is needed from the littlefs utilities by the fake filesystem
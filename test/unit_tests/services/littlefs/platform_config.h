@@ -0,0 +1,4 @@
+#pragma once
+
+#define sFLASH_PAGESIZE 4096
+#define sFLASH_PAGECOUNT 1024
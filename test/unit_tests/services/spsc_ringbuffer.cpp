@@ -0,0 +1,215 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "spsc_ringbuffer.h"
+
+#include <sys/types.h> // ssize_t, used by ringbuffer.h
+#include "ringbuffer.h"
+
+#include <catch2/catch.hpp>
+
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace particle::services;
+
+namespace {
+
+// Runs a producer and a consumer thread that transfer a sequence of numbers in chunks of varying
+// size, and checks that the consumer receives the whole sequence in order
+template <typename PutFn, typename GetFn>
+bool transfer(uint32_t count, PutFn put, GetFn get) {
+    std::thread producer([&]() {
+        uint32_t chunk[37];
+        uint32_t next = 0;
+        size_t n = 1;
+        while (next < count) {
+            n = n % 37 + 1;
+            const size_t size = std::min<size_t>(n, count - next);
+            for (size_t i = 0; i < size; i++) {
+                chunk[i] = next + i;
+            }
+            size_t written = 0;
+            while (written < size) {
+                const size_t n = put(chunk + written, size - written);
+                if (!n) {
+                    std::this_thread::yield(); // the buffer is full
+                }
+                written += n;
+            }
+            next += size;
+        }
+    });
+    bool ok = true;
+    uint32_t chunk[29];
+    uint32_t expected = 0;
+    size_t n = 1;
+    while (expected < count) {
+        n = n % 29 + 1;
+        const size_t size = get(chunk, n);
+        if (!size) {
+            std::this_thread::yield(); // the buffer is empty
+        }
+        for (size_t i = 0; i < size; i++) {
+            if (chunk[i] != expected++) {
+                ok = false;
+            }
+        }
+    }
+    producer.join();
+    return ok;
+}
+
+} // namespace
+
+TEST_CASE("SpscRingBuffer") {
+    uint8_t buf[8] = {};
+    SpscRingBuffer<uint8_t> rb(buf, sizeof(buf));
+
+    SECTION("is initially empty") {
+        CHECK(rb.empty());
+        CHECK_FALSE(rb.full());
+        CHECK(rb.data() == 0);
+        CHECK(rb.space() == 8);
+    }
+    SECTION("can be filled up to its size") {
+        const uint8_t data[10] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10 };
+        CHECK(rb.put(data, sizeof(data)) == 8);
+        CHECK(rb.full());
+        CHECK(rb.space() == 0);
+        CHECK_FALSE(rb.put(data[0]));
+        uint8_t out[10] = {};
+        CHECK(rb.get(out, sizeof(out)) == 8);
+        CHECK(memcmp(out, data, 8) == 0);
+        CHECK(rb.empty());
+    }
+    SECTION("wraps around") {
+        const uint8_t data[6] = { 1, 2, 3, 4, 5, 6 };
+        uint8_t out[6] = {};
+        for (int i = 0; i < 20; i++) {
+            CHECK(rb.put(data, sizeof(data)) == 6);
+            CHECK(rb.data() == 6);
+            CHECK(rb.get(out, sizeof(out)) == 6);
+            CHECK(memcmp(out, data, sizeof(data)) == 0);
+        }
+        CHECK(rb.empty());
+    }
+    SECTION("gives contiguous regions for zero-copy access") {
+        const uint8_t data[5] = { 1, 2, 3, 4, 5 };
+        CHECK(rb.put(data, sizeof(data)) == 5);
+        CHECK(rb.get(nullptr, 5) == 5);
+        // the free space wraps around the end of the buffer
+        size_t n = 0;
+        uint8_t* p = rb.acquire(&n);
+        REQUIRE(p == buf + 5);
+        REQUIRE(n == 3);
+        memcpy(p, "abc", 3);
+        rb.commit(3);
+        p = rb.acquire(&n);
+        REQUIRE(p == buf);
+        REQUIRE(n == 5);
+        memcpy(p, "de", 2);
+        rb.commit(2);
+        CHECK(rb.data() == 5);
+        // so does the data
+        const uint8_t* d = rb.peek(&n);
+        REQUIRE(d == buf + 5);
+        REQUIRE(n == 3);
+        CHECK(memcmp(d, "abc", 3) == 0);
+        rb.release(3);
+        d = rb.peek(&n);
+        REQUIRE(d == buf);
+        REQUIRE(n == 2);
+        CHECK(memcmp(d, "de", 2) == 0);
+        rb.release(2);
+        CHECK(rb.empty());
+        CHECK(rb.peek(&n) == nullptr);
+        CHECK(n == 0);
+    }
+    SECTION("can be reset") {
+        CHECK(rb.put(1));
+        rb.reset();
+        CHECK(rb.empty());
+    }
+}
+
+TEST_CASE("SpscRingBuffer with concurrent producer and consumer") {
+    const uint32_t count = 200000;
+    uint32_t buf[61] = {};
+    SpscRingBuffer<uint32_t> rb(buf, sizeof(buf) / sizeof(buf[0]));
+
+    SECTION("copying in and out") {
+        CHECK(transfer(count,
+                [&](const uint32_t* v, size_t n) { return rb.put(v, n); },
+                [&](uint32_t* v, size_t n) { return rb.get(v, n); }));
+    }
+    SECTION("with zero-copy regions") {
+        CHECK(transfer(count,
+                [&](const uint32_t* v, size_t n) {
+                    size_t size = 0;
+                    uint32_t* p = rb.acquire(&size);
+                    size = std::min(size, n);
+                    std::copy(v, v + size, p);
+                    rb.commit(size);
+                    return size;
+                },
+                [&](uint32_t* v, size_t n) {
+                    size_t size = 0;
+                    const uint32_t* p = rb.peek(&size);
+                    size = std::min(size, n);
+                    std::copy(p, p + size, v);
+                    rb.release(size);
+                    return size;
+                }));
+    }
+    CHECK(rb.empty());
+}
+
+// Not run by default: ./services "[.benchmark]"
+TEST_CASE("SpscRingBuffer throughput", "[.benchmark]") {
+    const uint32_t count = 5000000;
+    uint32_t buf[256] = {};
+
+    SpscRingBuffer<uint32_t> rb(buf, sizeof(buf) / sizeof(buf[0]));
+    auto start = std::chrono::steady_clock::now();
+    CHECK(transfer(count,
+            [&](const uint32_t* v, size_t n) { return rb.put(v, n); },
+            [&](uint32_t* v, size_t n) { return rb.get(v, n); }));
+    const double spsc = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // the existing ring buffer, guarded by a mutex as its callers do with a critical section
+    RingBuffer<uint32_t> locked(buf, sizeof(buf) / sizeof(buf[0]));
+    std::mutex mutex;
+    start = std::chrono::steady_clock::now();
+    CHECK(transfer(count,
+            [&](const uint32_t* v, size_t n) {
+                std::lock_guard<std::mutex> lock(mutex);
+                n = std::min<size_t>(n, locked.space());
+                return n ? (size_t)locked.put(v, n) : 0;
+            },
+            [&](uint32_t* v, size_t n) {
+                std::lock_guard<std::mutex> lock(mutex);
+                n = std::min<size_t>(n, locked.data());
+                return n ? (size_t)locked.get(v, n) : 0;
+            }));
+    const double mutexed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    WARN("SpscRingBuffer: " << count / spsc / 1e6 << " M elements/s, RingBuffer with a mutex: "
+            << count / mutexed / 1e6 << " M elements/s");
+}
@@ -0,0 +1,231 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "tlv_file.h"
+#include "fake_lfs.h"
+#include "system_error.h"
+
+#include <catch2/catch.hpp>
+
+#include <memory>
+#include <string>
+
+using particle::services::settings::TlvFile;
+using particle::test::FakeLfs;
+
+namespace {
+
+const char* const PATH = "/sys/test.tlv";
+const char* const FILE_NAME = "sys/test.tlv";
+const char* const TMP_FILE_NAME = "sys/test.tlv.tmp";
+
+int set(TlvFile& file, uint16_t key, const std::string& value) {
+    return file.set(key, (const uint8_t*)value.data(), value.size());
+}
+
+int add(TlvFile& file, uint16_t key, const std::string& value) {
+    return file.add(key, (const uint8_t*)value.data(), value.size());
+}
+
+// Returns the value of a record, or an empty string if it is not found
+std::string get(TlvFile& file, uint16_t key, int index = 0) {
+    char buf[32] = {};
+    const ssize_t r = file.get(key, (uint8_t*)buf, sizeof(buf), index);
+    if (r == SYSTEM_ERROR_NOT_FOUND) {
+        return std::string();
+    }
+    REQUIRE(r >= 0);
+    return std::string(buf, r);
+}
+
+bool exists(const std::string& path) {
+    return FakeLfs::files().count(path);
+}
+
+class TlvFileFixture {
+public:
+    TlvFileFixture() {
+        FakeLfs::reset();
+        open();
+    }
+
+    ~TlvFileFixture() {
+        FakeLfs::shortReads(0, -1);
+        if (file_) {
+            file_->deInit();
+        }
+    }
+
+    TlvFile& file() {
+        return *file_;
+    }
+
+    void reopen() {
+        REQUIRE(file_->deInit() == 0);
+        open();
+    }
+
+    // Reopens the file as it would be found after a reset, discarding any changes that have not
+    // been synchronized
+    void reset() {
+        const auto files = FakeLfs::snapshot();
+        file_->deInit();
+        FakeLfs::restore(files);
+        open();
+    }
+
+private:
+    std::unique_ptr<TlvFile> file_;
+
+    void open() {
+        file_.reset(new TlvFile(PATH));
+        REQUIRE(file_->init() == 0);
+    }
+};
+
+} // unnamed
+
+TEST_CASE("TlvFile") {
+    TlvFileFixture f;
+    REQUIRE(set(f.file(), 1, "one") == 0);
+    REQUIRE(set(f.file(), 2, "two") == 0);
+    REQUIRE(set(f.file(), 4, "four") == 0);
+
+    SECTION("records are kept across a reopen") {
+        REQUIRE(add(f.file(), 2, "deux") == 0);
+        f.reopen();
+        CHECK(get(f.file(), 1) == "one");
+        CHECK(get(f.file(), 2, 0) == "two");
+        CHECK(get(f.file(), 2, 1) == "deux");
+        CHECK(get(f.file(), 4) == "four");
+    }
+
+    SECTION("a value of the same size is overwritten in place") {
+        const auto size = f.file().size();
+        REQUIRE(set(f.file(), 1, "uno") == 0);
+        CHECK(f.file().size() == size);
+        f.reopen();
+        CHECK(get(f.file(), 1) == "uno");
+    }
+
+    SECTION("the records following a deleted one are kept") {
+        REQUIRE(f.file().del(2) == 0);
+        CHECK(get(f.file(), 2).empty());
+        CHECK(get(f.file(), 4) == "four");
+        f.reopen();
+        CHECK(get(f.file(), 1) == "one");
+        CHECK(get(f.file(), 2).empty());
+        CHECK(get(f.file(), 4) == "four");
+    }
+
+    SECTION("a short read fails instead of returning a truncated value") {
+        FakeLfs::shortReads(0, 2);
+        uint8_t buf[4] = {};
+        CHECK(f.file().get(4, buf, sizeof(buf)) == SYSTEM_ERROR_BAD_DATA);
+    }
+
+    SECTION("a record is not deleted if the records following it cannot be read") {
+        const auto data = FakeLfs::files()[FILE_NAME];
+        FakeLfs::shortReads(1, 1);
+        CHECK(f.file().del(1) == SYSTEM_ERROR_BAD_DATA);
+        FakeLfs::shortReads(0, -1);
+        CHECK(get(f.file(), 1) == "one");
+        f.reopen();
+        CHECK(FakeLfs::files()[FILE_NAME] == data);
+        CHECK(get(f.file(), 1) == "one");
+        CHECK(get(f.file(), 2) == "two");
+        CHECK(get(f.file(), 4) == "four");
+    }
+
+    SECTION("the changes made in a transaction") {
+        const auto data = FakeLfs::files()[FILE_NAME];
+        REQUIRE(f.file().beginTransaction() == 0);
+        CHECK(f.file().beginTransaction() == SYSTEM_ERROR_INVALID_STATE);
+        REQUIRE(set(f.file(), 1, "uno") == 0);
+        REQUIRE(add(f.file(), 3, "three") == 0);
+        REQUIRE(f.file().del(2) == 0);
+
+        SECTION("are visible before the transaction is committed") {
+            CHECK(get(f.file(), 1) == "uno");
+            CHECK(get(f.file(), 2).empty());
+            CHECK(get(f.file(), 3) == "three");
+            CHECK(get(f.file(), 4) == "four");
+            CHECK(FakeLfs::files()[FILE_NAME] == data);
+        }
+
+        SECTION("are written when the transaction is committed") {
+            REQUIRE(f.file().commitTransaction() == 0);
+            CHECK(f.file().commitTransaction() == SYSTEM_ERROR_INVALID_STATE);
+            CHECK_FALSE(exists(TMP_FILE_NAME));
+            f.reopen();
+            CHECK(get(f.file(), 1) == "uno");
+            CHECK(get(f.file(), 2).empty());
+            CHECK(get(f.file(), 3) == "three");
+            CHECK(get(f.file(), 4) == "four");
+        }
+
+        SECTION("are discarded when the transaction is rolled back") {
+            REQUIRE(f.file().abortTransaction() == 0);
+            CHECK(f.file().abortTransaction() == SYSTEM_ERROR_INVALID_STATE);
+            CHECK(get(f.file(), 1) == "one");
+            CHECK(get(f.file(), 2) == "two");
+            CHECK(get(f.file(), 3).empty());
+            f.reopen();
+            CHECK(FakeLfs::files()[FILE_NAME] == data);
+            CHECK(get(f.file(), 1) == "one");
+            CHECK(get(f.file(), 2) == "two");
+        }
+
+        SECTION("are lost if the device resets before the transaction is committed") {
+            f.reset();
+            CHECK(FakeLfs::files()[FILE_NAME] == data);
+            CHECK(get(f.file(), 1) == "one");
+            CHECK(get(f.file(), 2) == "two");
+            CHECK(get(f.file(), 3).empty());
+            CHECK(get(f.file(), 4) == "four");
+        }
+
+        SECTION("are discarded if a record cannot be copied during the commit") {
+            // The footer is read in full, and the copy of the untouched record is cut short
+            FakeLfs::shortReads(1, 1);
+            CHECK(f.file().commitTransaction() == SYSTEM_ERROR_BAD_DATA);
+            FakeLfs::shortReads(0, -1);
+            CHECK_FALSE(exists(TMP_FILE_NAME));
+            f.reopen();
+            CHECK(FakeLfs::files()[FILE_NAME] == data);
+            CHECK(get(f.file(), 1) == "one");
+            CHECK(get(f.file(), 2) == "two");
+            CHECK(get(f.file(), 3).empty());
+            CHECK(get(f.file(), 4) == "four");
+        }
+    }
+
+    SECTION("a file left over by an interrupted commit is ignored and replaced") {
+        FakeLfs::files()[TMP_FILE_NAME] = FakeLfs::Data(100, 0xaa);
+        f.reset();
+        CHECK(get(f.file(), 1) == "one");
+        CHECK(get(f.file(), 4) == "four");
+        REQUIRE(f.file().beginTransaction() == 0);
+        REQUIRE(set(f.file(), 1, "uno") == 0);
+        REQUIRE(f.file().commitTransaction() == 0);
+        CHECK_FALSE(exists(TMP_FILE_NAME));
+        f.reopen();
+        CHECK(get(f.file(), 1) == "uno");
+        CHECK(get(f.file(), 2) == "two");
+        CHECK(get(f.file(), 4) == "four");
+    }
+}
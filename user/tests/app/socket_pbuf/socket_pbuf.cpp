@@ -0,0 +1,186 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Compares the copying socket API (sock_sendto()/sock_recvfrom()) with the pbuf-based one
+ * (sock_send_pbuf()/sock_recv_pbuf()) on platforms with the POSIX socket HAL.
+ *
+ * The application exchanges datagrams with a UDP echo server, and logs the throughput and
+ * the peak usage of the lwIP heap and pbuf pool for each API. By default, the datagrams are
+ * sent to the device's own port via the loopback interface. Platforms without one (e.g.
+ * mesh-virtual) need an echo server on the host, for example:
+ *
+ *   socat -v UDP-RECVFROM:40000,fork EXEC:cat
+ *
+ * and the application built with ECHO_SERVER_ADDRESS set to the address of the host.
+ */
+
+#include "application.h"
+#include "socket_hal.h"
+#include "inet_hal.h"
+
+#if LWIP_STATS
+#include <lwip/stats.h>
+#include <lwip/memp.h>
+#endif
+
+#ifndef ECHO_SERVER_ADDRESS
+#define ECHO_SERVER_ADDRESS "127.0.0.1"
+#endif
+
+SYSTEM_MODE(SEMI_AUTOMATIC);
+
+SerialLogHandler logHandler(LOG_LEVEL_WARN, {
+    { "app", LOG_LEVEL_ALL }
+});
+
+namespace {
+
+const uint16_t PORT = 40000; // Local port and port of the echo server
+const unsigned DATAGRAM_COUNT = 1000;
+const size_t DATAGRAM_SIZE = 512;
+const unsigned RECEIVE_TIMEOUT = 1000;
+
+struct Result {
+    unsigned count;
+    system_tick_t time;
+    size_t heapPeak;
+    size_t pbufPeak;
+};
+
+uint8_t buf[DATAGRAM_SIZE];
+
+void resetStats() {
+#if MEM_STATS
+    lwip_stats.mem.max = lwip_stats.mem.used;
+#endif
+#if MEMP_STATS
+    lwip_stats.memp[MEMP_PBUF]->max = lwip_stats.memp[MEMP_PBUF]->used;
+    lwip_stats.memp[MEMP_PBUF_POOL]->max = lwip_stats.memp[MEMP_PBUF_POOL]->used;
+#endif
+}
+
+void getStats(Result* r) {
+    r->heapPeak = 0;
+    r->pbufPeak = 0;
+#if MEM_STATS
+    r->heapPeak = lwip_stats.mem.max;
+#endif
+#if MEMP_STATS
+    r->pbufPeak = lwip_stats.memp[MEMP_PBUF]->max + lwip_stats.memp[MEMP_PBUF_POOL]->max;
+#endif
+}
+
+int openSocket(struct sockaddr_in* server) {
+    const int s = sock_socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (s < 0) {
+        return -1;
+    }
+    struct sockaddr_in local = {};
+    local.sin_len = sizeof(local);
+    local.sin_family = AF_INET;
+    local.sin_port = htons(PORT);
+    local.sin_addr.s_addr = INADDR_ANY;
+    struct timeval tv = {};
+    tv.tv_sec = RECEIVE_TIMEOUT / 1000;
+    if (sock_bind(s, (const struct sockaddr*)&local, sizeof(local)) ||
+            sock_setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv))) {
+        sock_close(s);
+        return -1;
+    }
+    server->sin_len = sizeof(*server);
+    server->sin_family = AF_INET;
+    server->sin_port = htons(PORT);
+    inet_inet_pton(AF_INET, ECHO_SERVER_ADDRESS, &server->sin_addr);
+    return s;
+}
+
+Result runCopying(int s, const struct sockaddr_in& server) {
+    Result r = {};
+    resetStats();
+    const auto start = millis();
+    for (unsigned i = 0; i < DATAGRAM_COUNT; ++i) {
+        if (sock_sendto(s, buf, sizeof(buf), 0, (const struct sockaddr*)&server, sizeof(server)) < 0) {
+            break;
+        }
+        if (sock_recvfrom(s, buf, sizeof(buf), 0, nullptr, nullptr) != (ssize_t)sizeof(buf)) {
+            break;
+        }
+        ++r.count;
+    }
+    r.time = millis() - start;
+    getStats(&r);
+    return r;
+}
+
+Result runPbuf(int s, const struct sockaddr_in& server) {
+    Result r = {};
+    resetStats();
+    const auto start = millis();
+    for (unsigned i = 0; i < DATAGRAM_COUNT; ++i) {
+        struct pbuf* p = sock_pbuf_alloc(DATAGRAM_SIZE);
+        if (!p) {
+            break;
+        }
+        memset(p->payload, (uint8_t)i, p->len);
+        if (sock_send_pbuf(s, p, 0, (const struct sockaddr*)&server, sizeof(server)) < 0) {
+            break;
+        }
+        const ssize_t n = sock_recv_pbuf(s, &p, 0, nullptr, nullptr);
+        if (n < 0) {
+            break;
+        }
+        sock_pbuf_free(p);
+        if ((size_t)n != DATAGRAM_SIZE) {
+            break;
+        }
+        ++r.count;
+    }
+    r.time = millis() - start;
+    getStats(&r);
+    return r;
+}
+
+void logResult(const char* name, const Result& r) {
+    const unsigned kbps = r.time ? (uint64_t)r.count * DATAGRAM_SIZE * 2 * 1000 / 1024 / r.time : 0;
+    Log.info("%s: %u/%u datagrams in %u ms, %u KB/s, peak lwIP heap %u bytes, peak pbufs %u", name,
+            r.count, DATAGRAM_COUNT, (unsigned)r.time, kbps, (unsigned)r.heapPeak, (unsigned)r.pbufPeak);
+}
+
+bool done = false;
+
+} // namespace
+
+void setup() {
+    Network.connect();
+}
+
+void loop() {
+    if (done || !Network.ready()) {
+        return;
+    }
+    done = true;
+    struct sockaddr_in server = {};
+    const int s = openSocket(&server);
+    if (s < 0) {
+        Log.error("Unable to create socket");
+        return;
+    }
+    logResult("sock_sendto()/sock_recvfrom()", runCopying(s, server));
+    logResult("sock_send_pbuf()/sock_recv_pbuf()", runPbuf(s, server));
+    sock_close(s);
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "system_network.h"
+#include "socket_hal_loopback.h"
+
+#include "hippomocks.h"
+
+namespace test {
+
+// Resets the in-memory socket HAL, and reports the network as ready
+class LoopbackSocketMocks {
+public:
+    LoopbackSocketMocks() {
+        mocks_.OnCallFunc(network_ready).Return(true);
+        loopback = LoopbackSocket();
+    }
+
+private:
+    MockRepository mocks_;
+};
+
+} // namespace test
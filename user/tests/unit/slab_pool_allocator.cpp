@@ -0,0 +1,214 @@
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+#include "tools/catch.h"
+#include "simple_pool_allocator.h"
+#include "slab_pool_allocator.h"
+
+namespace {
+
+const size_t DEFAULT_POOL_SIZE = 1024;
+
+class TestSlabPool : public SlabStaticPool {
+public:
+    TestSlabPool(void* ptr, size_t size) :
+        SlabStaticPool(ptr, size) {
+    }
+
+    size_t untouched() const {
+        return end_ - ptr_;
+    }
+};
+
+struct Op {
+    bool alloc;
+    size_t size; // Allocation size
+    size_t index; // Index of the block to free
+};
+
+// Generates a trace of allocations and deallocations of short-lived blocks, like the ones made by
+// the system: mostly small task objects, some USB request buffers and a few larger blocks
+std::vector<Op> churnTrace(size_t count, size_t maxLive, unsigned seed) {
+    std::default_random_engine rng(seed);
+    std::discrete_distribution<int> kind({ 70, 20, 10 });
+    std::uniform_int_distribution<size_t> small(4, 32);
+    std::uniform_int_distribution<size_t> large(65, 200);
+    std::vector<Op> trace;
+    size_t live = 0;
+    while (trace.size() < count) {
+        const bool alloc = live == 0 || (live < maxLive && (rng() & 1));
+        if (alloc) {
+            const int k = kind(rng);
+            const size_t size = (k == 0) ? small(rng) : (k == 1) ? 64 : large(rng);
+            trace.push_back({ true, size, 0 });
+            ++live;
+        } else {
+            trace.push_back({ false, 0, std::uniform_int_distribution<size_t>(0, live - 1)(rng) });
+            --live;
+        }
+    }
+    return trace;
+}
+
+// Replays a trace, and returns the time per operation in nanoseconds
+template<typename PoolT>
+double replay(PoolT& pool, const std::vector<Op>& trace, size_t* failures) {
+    std::vector<void*> blocks;
+    blocks.reserve(trace.size());
+    *failures = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (const Op& op: trace) {
+        if (op.alloc) {
+            void* p = pool.allocate(op.size);
+            if (!p) {
+                ++*failures;
+            }
+            blocks.push_back(p);
+        } else {
+            pool.deallocate(blocks[op.index]);
+            blocks[op.index] = blocks.back();
+            blocks.pop_back();
+        }
+    }
+    const auto end = std::chrono::steady_clock::now();
+    for (void* p: blocks) {
+        pool.deallocate(p);
+    }
+    return std::chrono::duration<double, std::nano>(end - start).count() / trace.size();
+}
+
+} // anonymous
+
+TEST_CASE("SlabStaticPool") {
+    std::vector<uint8_t> buf(DEFAULT_POOL_SIZE);
+    TestSlabPool pool(buf.data(), buf.size());
+
+    SECTION("Single allocation/deallocation after construction") {
+        void* p = pool.allocate(1);
+        CHECK(p != nullptr);
+        CHECK(pool.stats().requested == 1);
+        pool.deallocate(p);
+        CHECK(pool.untouched() == DEFAULT_POOL_SIZE);
+        CHECK(pool.stats().used == 0);
+    }
+
+    SECTION("Allocated addresses are aligned") {
+        for (size_t size = 0; size < 50; size += 7) {
+            void* p = pool.allocate(size);
+            REQUIRE(p != nullptr);
+            CHECK(((reinterpret_cast<uintptr_t>(p)) % sizeof(uintptr_t)) == 0);
+        }
+    }
+
+    SECTION("Blocks are reused by their size class") {
+        void* a = pool.allocate(20);
+        void* b = pool.allocate(20);
+        void* c = pool.allocate(100);
+        pool.deallocate(a);
+        CHECK(pool.stats().cached > 0);
+        CHECK(pool.allocate(17) == a);
+        CHECK(pool.stats().cached == 0);
+        pool.deallocate(c);
+        CHECK(pool.allocate(128) == c);
+        (void)b;
+    }
+
+    SECTION("Blocks larger than the largest size class are allocated with their exact size") {
+        void* p = pool.allocate(SlabBasePool::maxBlockSize() + 1);
+        REQUIRE(p != nullptr);
+        CHECK(pool.stats().failures == 0);
+        void* q = pool.allocate(SlabBasePool::maxBlockSize() * 2);
+        REQUIRE(q != nullptr);
+        CHECK(pool.allocate(DEFAULT_POOL_SIZE) == nullptr);
+        CHECK(pool.stats().failures == 1);
+        // A freed block is reused by a request that fits in it
+        pool.deallocate(p);
+        CHECK(pool.stats().cached > 0);
+        CHECK(pool.allocate(SlabBasePool::maxBlockSize() + 1) == p);
+        CHECK(pool.stats().cached == 0);
+        (void)q;
+    }
+
+    SECTION("The last block of exact size is returned to the untouched part of the pool") {
+        void* a = pool.allocate(8);
+        const size_t untouched = pool.untouched();
+        void* p = pool.allocate(SlabBasePool::maxBlockSize() + 1);
+        REQUIRE(p != nullptr);
+        pool.deallocate(p);
+        CHECK(pool.untouched() == untouched);
+        CHECK(pool.stats().cached == 0);
+        (void)a;
+    }
+
+    SECTION("The rest of the pool is used when a request is too small for its size class block") {
+        std::vector<void*> blocks;
+        void* p;
+        while ((p = pool.allocate(SlabBasePool::maxBlockSize())) != nullptr) {
+            blocks.push_back(p);
+        }
+        const size_t untouched = pool.untouched();
+        REQUIRE(untouched > 0);
+        REQUIRE(untouched < SlabBasePool::maxBlockSize() + sizeof(uintptr_t));
+        const size_t size = untouched - 2 * sizeof(uintptr_t);
+        CHECK(pool.allocate(size) != nullptr);
+    }
+
+    SECTION("Larger free blocks are used when the pool is exhausted") {
+        std::vector<void*> large;
+        void* p;
+        while ((p = pool.allocate(200)) != nullptr) {
+            large.push_back(p);
+        }
+        while (pool.allocate(8) != nullptr) {
+        }
+        pool.deallocate(large[0]);
+        CHECK(pool.allocate(8) == large[0]);
+    }
+
+    SECTION("The pool is untouched again once all blocks are freed") {
+        std::vector<void*> blocks;
+        std::default_random_engine rng(1);
+        std::uniform_int_distribution<size_t> dist(1, 100);
+        void* p;
+        while ((p = pool.allocate(dist(rng))) != nullptr) {
+            blocks.push_back(p);
+        }
+        const size_t peak = pool.stats().peakUsed;
+        CHECK(peak > DEFAULT_POOL_SIZE / 2);
+        std::shuffle(blocks.begin(), blocks.end(), rng);
+        for (void* b: blocks) {
+            pool.deallocate(b);
+        }
+        CHECK(pool.untouched() == DEFAULT_POOL_SIZE);
+        CHECK(pool.stats().used == 0);
+        CHECK(pool.stats().cached == 0);
+        CHECK(pool.stats().peakUsed == peak);
+    }
+
+    SECTION("Fragmentation is reported") {
+        void* a = pool.allocate(8);
+        pool.allocate(8);
+        pool.deallocate(a);
+        CHECK(pool.fragmented(100) > 0);
+        CHECK(pool.fragmented(8) == 0);
+    }
+}
+
+TEST_CASE("Pool allocators with alloc/free churn") {
+    const auto trace = churnTrace(100000, 8, 1);
+
+    SlabAllocedPool slab(DEFAULT_POOL_SIZE);
+    size_t slabFailures = 0;
+    const double slabTime = replay(slab, trace, &slabFailures);
+    CHECK(slab.stats().used == 0);
+
+    SimpleAllocedPool simple(DEFAULT_POOL_SIZE);
+    size_t simpleFailures = 0;
+    const double simpleTime = replay(simple, trace, &simpleFailures);
+
+    CATCH_WARN("SlabAllocedPool: " << slabTime << " ns/op, " << slabFailures << " failures, peak "
+            << slab.stats().peakUsed << " bytes; SimpleAllocedPool: " << simpleTime << " ns/op, "
+            << simpleFailures << " failures");
+    CHECK(slabFailures <= simpleFailures);
+}
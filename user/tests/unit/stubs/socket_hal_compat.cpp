@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "socket_hal.h"
+#include "socket_hal_loopback.h"
+
+#include <algorithm>
+
+namespace test {
+
+LoopbackSocket loopback;
+
+} // namespace test
+
+using test::loopback;
+
+namespace {
+
+const sock_handle_t LOOPBACK_SOCKET = 1;
+
+} // unnamed
+
+uint8_t socket_handle_valid(sock_handle_t handle) {
+    return handle == LOOPBACK_SOCKET;
+}
+
+sock_handle_t socket_handle_invalid() {
+    return (sock_handle_t)-1;
+}
+
+uint8_t socket_active_status(sock_handle_t socket) {
+    return loopback.open ? SOCKET_STATUS_ACTIVE : SOCKET_STATUS_INACTIVE;
+}
+
+sock_handle_t socket_create(uint8_t family, uint8_t type, uint8_t protocol, uint16_t port, network_interface_t nif) {
+    loopback.open = true;
+    return LOOPBACK_SOCKET;
+}
+
+sock_result_t socket_connect(sock_handle_t sd, const sockaddr_t *addr, long addrlen) {
+    return 0;
+}
+
+sock_result_t socket_send_ex(sock_handle_t sd, const void* buffer, socklen_t len, uint32_t flags, system_tick_t timeout,
+        void* reserved) {
+    const auto p = static_cast<const uint8_t*>(buffer);
+    loopback.data.insert(loopback.data.end(), p, p + len);
+    return len;
+}
+
+sock_result_t socket_receive(sock_handle_t sd, void* buffer, socklen_t len, system_tick_t _timeout) {
+    ++loopback.receiveCalls;
+    const auto p = static_cast<uint8_t*>(buffer);
+    if (loopback.generate) {
+        const size_t n = std::min((size_t)len, loopback.maxChunk);
+        for (size_t i = 0; i < n; ++i) {
+            p[i] = loopback.next++;
+        }
+        return n;
+    }
+    const size_t n = std::min({ (size_t)len, loopback.maxChunk, loopback.data.size() });
+    std::copy(loopback.data.begin(), loopback.data.begin() + n, p);
+    loopback.data.erase(loopback.data.begin(), loopback.data.begin() + n);
+    return n;
+}
+
+sock_result_t socket_close(sock_handle_t sd) {
+    loopback.open = false;
+    return 0;
+}
+
+sock_result_t socket_sendto(sock_handle_t sd, const void* buffer, socklen_t len, uint32_t flags, sockaddr_t* addr,
+        socklen_t addr_size) {
+    const auto p = static_cast<const uint8_t*>(buffer);
+    loopback.datagrams.push_back({ std::vector<uint8_t>(p, p + len), *addr });
+    return len;
+}
+
+sock_result_t socket_receivefrom(sock_handle_t sd, void* buffer, socklen_t len, uint32_t flags, sockaddr_t* addr,
+        socklen_t* addr_size) {
+    ++loopback.receiveCalls;
+    if (loopback.datagrams.empty()) {
+        return 0;
+    }
+    const auto& d = loopback.datagrams.front();
+    const size_t n = std::min((size_t)len, d.data.size());
+    std::copy(d.data.begin(), d.data.begin() + n, static_cast<uint8_t*>(buffer));
+    *addr = d.addr;
+    *addr_size = sizeof(sockaddr_t);
+    loopback.datagrams.pop_front();
+    return n;
+}
+
+sock_result_t socket_join_multicast(const HAL_IPAddress* address, network_interface_t nif,
+        socket_multicast_info_t* reserved) {
+    return -1;
+}
+
+sock_result_t socket_leave_multicast(const HAL_IPAddress* address, network_interface_t nif,
+        socket_multicast_info_t* reserved) {
+    return -1;
+}
@@ -0,0 +1,47 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "socket_hal.h"
+
+#include <cstdint>
+#include <cstddef>
+#include <deque>
+#include <vector>
+
+namespace test {
+
+// State of the in-memory socket HAL: the data sent through the socket is received back from it
+struct LoopbackSocket {
+    struct Datagram {
+        std::vector<uint8_t> data;
+        sockaddr_t addr;
+    };
+
+    std::deque<uint8_t> data;
+    std::deque<Datagram> datagrams;
+    size_t maxChunk = 1460; // Maximum number of bytes returned by a single receive call
+    size_t receiveCalls = 0;
+    bool open = false;
+    bool generate = false; // Receive an endless stream of bytes instead of the data sent
+    uint8_t next = 0; // Next generated byte
+};
+
+extern LoopbackSocket loopback;
+
+} // namespace test
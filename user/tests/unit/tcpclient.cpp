@@ -0,0 +1,143 @@
+#include <algorithm>
+#include <chrono>
+#include <vector>
+#include "tools/catch.h"
+#include "mocks/socket.h"
+#include "spark_wiring_tcpclient.h"
+#include "spark_wiring_network.h"
+
+using test::loopback;
+using test::LoopbackSocketMocks;
+
+namespace {
+
+std::vector<uint8_t> pattern(size_t size) {
+    std::vector<uint8_t> v(size);
+    for (size_t i = 0; i < size; ++i) {
+        v[i] = i & 0xff;
+    }
+    return v;
+}
+
+void connect(TCPClient& client) {
+    REQUIRE(client.connect(IPAddress(127, 0, 0, 1), 80) == 1);
+}
+
+void send(TCPClient& client, const std::vector<uint8_t>& data) {
+    REQUIRE(client.write(data.data(), data.size()) == data.size());
+}
+
+// Receives `size` bytes from the generator, and returns the throughput in MB/s
+template<typename ReadFn>
+double measure(size_t size, ReadFn read) {
+    size_t total = 0;
+    const auto start = std::chrono::steady_clock::now();
+    while (total < size) {
+        const int n = read();
+        if (n <= 0) {
+            break;
+        }
+        total += n;
+    }
+    const auto end = std::chrono::steady_clock::now();
+    REQUIRE(total >= size);
+    return total / std::chrono::duration<double, std::micro>(end - start).count();
+}
+
+} // anonymous
+
+TEST_CASE("TCPClient receive path") {
+    LoopbackSocketMocks mocks;
+    TCPClient client;
+    connect(client);
+
+    SECTION("A bulk read is received directly into the caller's buffer") {
+        const auto data = pattern(1000);
+        send(client, data);
+        std::vector<uint8_t> buf(1000);
+        CHECK(client.read(buf.data(), buf.size()) == 1000);
+        CHECK(buf == data);
+        CHECK(loopback.receiveCalls == 1);
+        CHECK(client.read(buf.data(), buf.size()) == -1);
+    }
+
+    SECTION("Buffered data is returned before receiving more") {
+        const auto data = pattern(300);
+        send(client, data);
+        CHECK(client.read() == 0);
+        CHECK(client.available() == TCPCLIENT_BUF_MAX_SIZE - 1);
+        std::vector<uint8_t> buf(300);
+        CHECK(client.read(buf.data(), buf.size()) == TCPCLIENT_BUF_MAX_SIZE - 1);
+        CHECK(client.read(buf.data() + TCPCLIENT_BUF_MAX_SIZE - 1, buf.size() - TCPCLIENT_BUF_MAX_SIZE + 1) == 300 - TCPCLIENT_BUF_MAX_SIZE);
+        buf.insert(buf.begin(), 0);
+        buf.resize(300);
+        CHECK(buf == data);
+    }
+
+    SECTION("readv() fills the buffers in order") {
+        const auto data = pattern(250);
+        send(client, data);
+        CHECK(client.peek() == 0);
+        std::vector<uint8_t> a(100), b(100), c(100);
+        const TCPClient::Buffer bufs[] = { { a.data(), a.size() }, { b.data(), b.size() }, { c.data(), c.size() } };
+        CHECK(client.readv(bufs, 3) == 250);
+        CHECK(std::equal(a.begin(), a.end(), data.begin()));
+        CHECK(std::equal(b.begin(), b.end(), data.begin() + 100));
+        CHECK(std::equal(c.begin(), c.begin() + 50, data.begin() + 200));
+        CHECK(client.readv(bufs, 3) == -1);
+    }
+
+    SECTION("setBuffer() keeps the buffered data") {
+        const auto data = pattern(1000);
+        send(client, data);
+        CHECK(client.read() == 0);
+        CHECK(!client.setBuffer(TCPCLIENT_BUF_MAX_SIZE / 2));
+        CHECK(client.setBuffer(512));
+        CHECK(client.read() == 1);
+        CHECK(client.available() == 512 - 1);
+        std::vector<uint8_t> buf(1000);
+        CHECK(client.read(buf.data(), buf.size()) == 512 - 1);
+        CHECK(std::equal(buf.begin(), buf.begin() + 511, data.begin() + 2));
+        uint8_t static_buf[64];
+        CHECK(client.setBuffer(sizeof(static_buf), static_buf));
+        CHECK(client.read() == (513 & 0xff));
+        CHECK(client.available() == sizeof(static_buf) - 1);
+        // the default buffer is large enough, so it is used again, and is filled up
+        CHECK(client.setBuffer(TCPCLIENT_BUF_MAX_SIZE));
+        CHECK(client.read() == (514 & 0xff));
+        CHECK(client.available() == TCPCLIENT_BUF_MAX_SIZE - 1);
+        CHECK(client.read() == (515 & 0xff));
+    }
+}
+
+TEST_CASE("TCPClient receive throughput") {
+    LoopbackSocketMocks mocks;
+    TCPClient client;
+    connect(client);
+    loopback.generate = true;
+    const size_t SIZE = 4 * 1024 * 1024;
+
+    const double byteRate = measure(SIZE, [&]() {
+        return (client.read() >= 0) ? 1 : -1;
+    });
+    const size_t byteCalls = loopback.receiveCalls;
+
+    loopback.receiveCalls = 0;
+    std::vector<uint8_t> buf(loopback.maxChunk);
+    const double readRate = measure(SIZE, [&]() {
+        return client.read(buf.data(), buf.size());
+    });
+    const size_t readCalls = loopback.receiveCalls;
+
+    loopback.receiveCalls = 0;
+    std::vector<uint8_t> head(64), body(loopback.maxChunk - 64);
+    const TCPClient::Buffer bufs[] = { { head.data(), head.size() }, { body.data(), body.size() } };
+    const double readvRate = measure(SIZE, [&]() {
+        return client.readv(bufs, 2);
+    });
+
+    CATCH_WARN("read(): " << byteRate << " MB/s, " << byteCalls << " receive calls; read(buf, "
+            << buf.size() << "): " << readRate << " MB/s, " << readCalls << " receive calls; readv(): "
+            << readvRate << " MB/s, " << loopback.receiveCalls << " receive calls");
+    CHECK(readCalls < byteCalls);
+}
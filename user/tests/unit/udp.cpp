@@ -0,0 +1,85 @@
+#include <vector>
+#include "tools/catch.h"
+#include "mocks/socket.h"
+#include "spark_wiring_udp.h"
+#include "spark_wiring_network.h"
+#include "spark_wiring_ticks.h"
+
+using test::loopback;
+using test::LoopbackSocketMocks;
+
+namespace {
+
+const uint16_t PORT = 5683;
+
+} // anonymous
+
+TEST_CASE("UDP batched send/receive") {
+    LoopbackSocketMocks mocks;
+    UDP udp;
+    REQUIRE(udp.begin(PORT) == 1);
+
+    SECTION("sendPackets() sends the packets in order") {
+        uint8_t a[] = { 1, 2, 3 };
+        uint8_t b[] = { 4, 5 };
+        UDP::Packet packets[] = {
+            { a, sizeof(a), 0, IPAddress(10, 0, 0, 1), 1000 },
+            { b, sizeof(b), 0, IPAddress(10, 0, 0, 2), 2000 }
+        };
+        CHECK(udp.sendPackets(packets, 2) == 2);
+        CHECK(packets[0].length == 3);
+        CHECK(packets[1].length == 2);
+        REQUIRE(loopback.datagrams.size() == 2);
+        CHECK(loopback.datagrams[0].data == std::vector<uint8_t>({ 1, 2, 3 }));
+        CHECK(loopback.datagrams[1].data == std::vector<uint8_t>({ 4, 5 }));
+        CHECK(loopback.datagrams[1].addr.sa_data[1] == (2000 & 0xff));
+        CHECK(loopback.datagrams[1].addr.sa_data[5] == 2);
+        CHECK(udp.sendPackets(packets, 0) == 0);
+    }
+
+    SECTION("receivePackets() returns the queued packets and their sources") {
+        uint8_t data[] = { 1, 2, 3, 4 };
+        CHECK(udp.sendPacket(data, 4, IPAddress(10, 0, 0, 1), 1000) == 4);
+        CHECK(udp.sendPacket(data, 2, IPAddress(10, 0, 0, 2), 2000) == 2);
+        uint8_t a[3] = {}, b[8] = {}, c[8] = {};
+        UDP::Packet packets[] = {
+            { a, sizeof(a) },
+            { b, sizeof(b) },
+            { c, sizeof(c) }
+        };
+        CHECK(udp.receivePackets(packets, 3) == 2);
+        CHECK(packets[0].length == 3); // Truncated
+        CHECK(packets[0].remoteIP[3] == 1);
+        CHECK(packets[0].remotePort == 1000);
+        CHECK(packets[1].length == 2);
+        CHECK(packets[1].remoteIP[3] == 2);
+        CHECK(b[1] == 2);
+        CHECK(udp.remotePort() == 2000);
+        CHECK(udp.receivePackets(packets, 3) == 0);
+    }
+
+    SECTION("receivePackets() waits for the first packet until the timeout expires") {
+        uint8_t a[4];
+        UDP::Packet packet = { a, sizeof(a) };
+        const system_tick_t start = millis();
+        CHECK(udp.receivePackets(&packet, 1, 20) == 0);
+        const system_tick_t elapsed = millis() - start;
+        CHECK(elapsed >= 20);
+        CHECK(loopback.receiveCalls > 1);
+    }
+
+    SECTION("sendPackets() fails if the socket is closed") {
+        udp.stop();
+        uint8_t a[] = { 1, 2, 3 };
+        UDP::Packet packet = { a, sizeof(a), 0, IPAddress(10, 0, 0, 1), 1000 };
+        CHECK(udp.sendPackets(&packet, 1) < 0);
+        CHECK(loopback.datagrams.empty());
+    }
+
+    SECTION("receivePackets() fails if the socket is closed") {
+        udp.stop();
+        uint8_t a[4];
+        UDP::Packet packet = { a, sizeof(a) };
+        CHECK(udp.receivePackets(&packet, 1) < 0);
+    }
+}
@@ -193,6 +193,7 @@ test(api_spark_connection) {
     API_COMPILE(Particle.keepAlive(s));
     API_COMPILE(Particle.keepAlive(1200s));
     API_COMPILE(Particle.keepAlive(20min));
+    API_COMPILE(Particle.fastReconnect(true));
 #endif
 }
 
@@ -0,0 +1,123 @@
+#include "application.h"
+#include "unit-test/unit-test.h"
+
+#if HAL_USE_SOCKET_HAL_POSIX
+
+#include "socket_hal.h"
+#include "scope_guard.h"
+#include <lwip/pbuf.h>
+
+namespace {
+
+const system_tick_t SOCKET_TIMEOUT = 10000;
+
+bool setTimeout(int s) {
+    struct timeval tv = {};
+    tv.tv_sec = SOCKET_TIMEOUT / 1000;
+    return sock_setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) == 0;
+}
+
+void toSockAddr(const IPAddress& ip, uint16_t port, sockaddr_in* addr) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sin_len = sizeof(*addr);
+    addr->sin_family = AF_INET;
+    addr->sin_port = htons(port);
+    addr->sin_addr.s_addr = htonl(ip.raw().ipv4);
+}
+
+struct pbuf* makePbuf(const void* data, size_t size) {
+    struct pbuf* p = sock_pbuf_alloc(size);
+    if (p) {
+        memcpy(p->payload, data, size);
+    }
+    return p;
+}
+
+} // anonymous
+
+test(SOCKET_PBUF_01_tcp_stream_is_received_in_full_when_mixing_sock_recv_and_sock_recv_pbuf)
+{
+    // Larger than the receive window, which closes if the data returned by sock_recv_pbuf()
+    // is not acknowledged to the stack
+    const size_t BODY_SIZE = 32768;
+    const IPAddress ip = Network.resolve("www.httpbin.org");
+    assertTrue(ip.version() == 4);
+    const int s = sock_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    assertMoreOrEqual(s, 0);
+    SCOPE_GUARD({
+        sock_close(s);
+    });
+    assertTrue(setTimeout(s));
+    sockaddr_in addr = {};
+    toSockAddr(ip, 80, &addr);
+    assertEqual(sock_connect(s, (const sockaddr*)&addr, sizeof(addr)), 0);
+
+    char request[96] = {};
+    const int len = snprintf(request, sizeof(request), "GET /range/%u HTTP/1.0\r\nHost: www.httpbin.org\r\n\r\n",
+            (unsigned)BODY_SIZE);
+    struct pbuf* p = makePbuf(request, len);
+    assertTrue(p != nullptr);
+    assertEqual(sock_send_pbuf(s, p, 0, nullptr, 0), len);
+
+    // Each sock_recv() leaves the rest of a segment to be returned by sock_recv_pbuf()
+    size_t total = 0;
+    for (;;) {
+        char c = 0;
+        ssize_t n = sock_recv(s, &c, 1, 0);
+        assertMoreOrEqual(n, 0);
+        if (n == 0) {
+            break;
+        }
+        total += n;
+        n = sock_recv_pbuf(s, &p, 0, nullptr, nullptr);
+        assertMoreOrEqual(n, 0);
+        const size_t pbufLen = p ? p->tot_len : 0;
+        sock_pbuf_free(p);
+        assertEqual(pbufLen, (size_t)n);
+        if (n == 0) {
+            break;
+        }
+        total += n;
+    }
+    assertMore(total, BODY_SIZE);
+}
+
+test(SOCKET_PBUF_02_udp_datagram_is_sent_and_received_as_pbuf)
+{
+    // A DNS query for www.particle.io
+    const uint8_t query[] = {
+        0x5a, 0xa5, 0x01, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x03, 'w', 'w', 'w', 0x08, 'p', 'a', 'r', 't', 'i', 'c', 'l', 'e', 0x02, 'i', 'o', 0x00,
+        0x00, 0x01, 0x00, 0x01
+    };
+    const int s = sock_socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    assertMoreOrEqual(s, 0);
+    SCOPE_GUARD({
+        sock_close(s);
+    });
+    assertTrue(setTimeout(s));
+    sockaddr_in server = {};
+    toSockAddr(IPAddress(8, 8, 8, 8), 53, &server);
+    struct pbuf* p = makePbuf(query, sizeof(query));
+    assertTrue(p != nullptr);
+    assertEqual(sock_send_pbuf(s, p, 0, (const sockaddr*)&server, sizeof(server)), (ssize_t)sizeof(query));
+
+    sockaddr_storage from = {};
+    socklen_t fromLen = sizeof(from);
+    const ssize_t n = sock_recv_pbuf(s, &p, 0, (sockaddr*)&from, &fromLen);
+    assertMore(n, (ssize_t)sizeof(query));
+    assertTrue(p != nullptr);
+    SCOPE_GUARD({
+        sock_pbuf_free(p);
+    });
+    assertEqual(p->tot_len, n);
+    const uint8_t* response = (const uint8_t*)p->payload;
+    assertMoreOrEqual(p->len, 4);
+    assertEqual(response[0], query[0]); // ID
+    assertEqual(response[1], query[1]);
+    assertTrue((response[2] & 0x80) != 0); // QR
+    assertEqual(from.ss_family, AF_INET);
+    assertEqual(ntohs(((const sockaddr_in*)&from)->sin_port), 53);
+}
+
+#endif // HAL_USE_SOCKET_HAL_POSIX
@@ -0,0 +1,192 @@
+#include "application.h"
+#include "unit-test/unit-test.h"
+
+#if HAL_USE_SOCKET_HAL_POSIX
+
+#include "socket_hal.h"
+#include "scope_guard.h"
+
+namespace {
+
+const system_tick_t SOCKET_TIMEOUT = 10000;
+const uint16_t LOCAL_PORT = 40001;
+const uint16_t REMOTE_PORT = 40002;
+const size_t PACKET_COUNT = 8;
+const size_t PACKET_SIZE = 64;
+
+bool setTimeout(int s) {
+    struct timeval tv = {};
+    tv.tv_sec = SOCKET_TIMEOUT / 1000;
+    return sock_setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) == 0;
+}
+
+void toSockAddr(const IPAddress& ip, uint16_t port, sockaddr_in* addr) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sin_len = sizeof(*addr);
+    addr->sin_family = AF_INET;
+    addr->sin_port = htons(port);
+    addr->sin_addr.s_addr = htonl(ip.raw().ipv4);
+}
+
+// Creates a UDP socket bound to the loopback interface
+int loopbackSocket(uint16_t port) {
+    const int s = sock_socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (s < 0) {
+        return -1;
+    }
+    sockaddr_in addr = {};
+    toSockAddr(IPAddress(127, 0, 0, 1), port, &addr);
+    if (!setTimeout(s) || sock_bind(s, (const sockaddr*)&addr, sizeof(addr)) != 0) {
+        sock_close(s);
+        return -1;
+    }
+    return s;
+}
+
+// Fills the packets with data that tells them apart
+void fillPackets(uint8_t (*bufs)[PACKET_SIZE], size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        for (size_t j = 0; j < PACKET_SIZE; ++j) {
+            bufs[i][j] = i + j;
+        }
+    }
+}
+
+} // anonymous
+
+test(UDP_BATCH_01_datagrams_sent_with_sock_sendmmsg_are_received_in_order_with_sock_recvmmsg)
+{
+    const int tx = loopbackSocket(LOCAL_PORT);
+    assertMoreOrEqual(tx, 0);
+    SCOPE_GUARD({
+        sock_close(tx);
+    });
+    const int rx = loopbackSocket(REMOTE_PORT);
+    assertMoreOrEqual(rx, 0);
+    SCOPE_GUARD({
+        sock_close(rx);
+    });
+
+    uint8_t sent[PACKET_COUNT][PACKET_SIZE] = {};
+    fillPackets(sent, PACKET_COUNT);
+    sockaddr_in to = {};
+    toSockAddr(IPAddress(127, 0, 0, 1), REMOTE_PORT, &to);
+    sock_mmsghdr msgs[PACKET_COUNT] = {};
+    for (size_t i = 0; i < PACKET_COUNT; ++i) {
+        msgs[i].msg_buf = sent[i];
+        msgs[i].msg_buflen = PACKET_SIZE - i; // Datagrams of different sizes
+        msgs[i].msg_name = (sockaddr*)&to;
+        msgs[i].msg_namelen = sizeof(to);
+    }
+    assertEqual(sock_sendmmsg(tx, msgs, PACKET_COUNT, 0), (int)PACKET_COUNT);
+    for (size_t i = 0; i < PACKET_COUNT; ++i) {
+        assertEqual(msgs[i].msg_len, PACKET_SIZE - i);
+    }
+
+    // The loopback interface may deliver the datagrams to the socket over several calls
+    uint8_t received[PACKET_COUNT][PACKET_SIZE] = {};
+    sockaddr_in from[PACKET_COUNT] = {};
+    size_t count = 0;
+    while (count < PACKET_COUNT) {
+        memset(msgs, 0, sizeof(msgs));
+        for (size_t i = count; i < PACKET_COUNT; ++i) {
+            msgs[i - count].msg_buf = received[i];
+            msgs[i - count].msg_buflen = PACKET_SIZE;
+            msgs[i - count].msg_name = (sockaddr*)&from[i];
+            msgs[i - count].msg_namelen = sizeof(from[i]);
+        }
+        const int n = sock_recvmmsg(rx, msgs, PACKET_COUNT - count, 0);
+        assertMore(n, 0);
+        for (int i = 0; i < n; ++i) {
+            assertEqual(msgs[i].msg_len, PACKET_SIZE - count - i);
+        }
+        count += n;
+    }
+    for (size_t i = 0; i < PACKET_COUNT; ++i) {
+        assertEqual(memcmp(received[i], sent[i], PACKET_SIZE - i), 0);
+        assertEqual(from[i].sin_family, AF_INET);
+        assertEqual(ntohs(from[i].sin_port), LOCAL_PORT);
+    }
+
+    // Nothing else is queued
+    msgs[0].msg_buf = received[0];
+    msgs[0].msg_buflen = PACKET_SIZE;
+    msgs[0].msg_name = nullptr;
+    assertEqual(sock_recvmmsg(rx, msgs, 1, MSG_DONTWAIT), -1);
+    assertTrue(errno == EAGAIN || errno == EWOULDBLOCK);
+}
+
+test(UDP_BATCH_02_sock_sendmmsg_does_not_send_through_a_stream_socket)
+{
+    const int s = sock_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    assertMoreOrEqual(s, 0);
+    SCOPE_GUARD({
+        sock_close(s);
+    });
+    uint8_t data[4] = {};
+    sock_mmsghdr msg = {};
+    msg.msg_buf = data;
+    msg.msg_buflen = sizeof(data);
+    assertEqual(sock_sendmmsg(s, &msg, 1, 0), -1);
+    assertEqual(errno, EOPNOTSUPP);
+}
+
+test(UDP_BATCH_03_packets_sent_with_udp_send_packets_are_received_in_order_with_udp_receive_packets)
+{
+    UDP tx;
+    assertTrue(tx.begin(LOCAL_PORT));
+    SCOPE_GUARD({
+        tx.stop();
+    });
+    UDP rx;
+    assertTrue(rx.begin(REMOTE_PORT));
+    SCOPE_GUARD({
+        rx.stop();
+    });
+
+    // More packets than UDP passes to the socket HAL in a single batch
+    const size_t COUNT = PACKET_COUNT * 2;
+    uint8_t sent[COUNT][PACKET_SIZE] = {};
+    fillPackets(sent, COUNT);
+    UDP::Packet packets[COUNT] = {};
+    for (size_t i = 0; i < COUNT; ++i) {
+        packets[i] = { sent[i], PACKET_SIZE - i, 0, IPAddress(127, 0, 0, 1), REMOTE_PORT };
+    }
+    assertEqual(tx.sendPackets(packets, COUNT), (int)COUNT);
+    for (size_t i = 0; i < COUNT; ++i) {
+        assertEqual(packets[i].length, PACKET_SIZE - i);
+    }
+
+    uint8_t received[COUNT][PACKET_SIZE] = {};
+    size_t count = 0;
+    while (count < COUNT) {
+        for (size_t i = count; i < COUNT; ++i) {
+            packets[i] = { received[i], PACKET_SIZE };
+        }
+        const int n = rx.receivePackets(packets + count, COUNT - count, SOCKET_TIMEOUT);
+        assertMore(n, 0);
+        count += n;
+    }
+    for (size_t i = 0; i < COUNT; ++i) {
+        assertEqual(packets[i].length, PACKET_SIZE - i);
+        assertEqual(memcmp(received[i], sent[i], PACKET_SIZE - i), 0);
+        assertEqual(packets[i].remotePort, LOCAL_PORT);
+    }
+    assertEqual(rx.remotePort(), LOCAL_PORT);
+}
+
+test(UDP_BATCH_04_udp_receive_packets_waits_for_the_first_packet_until_the_timeout_expires)
+{
+    UDP rx;
+    assertTrue(rx.begin(REMOTE_PORT));
+    SCOPE_GUARD({
+        rx.stop();
+    });
+    uint8_t buf[PACKET_SIZE] = {};
+    UDP::Packet packet = { buf, sizeof(buf) };
+    const system_tick_t start = millis();
+    assertEqual(rx.receivePackets(&packet, 1, 500), 0);
+    assertMoreOrEqual(millis() - start, 500);
+}
+
+#endif // HAL_USE_SOCKET_HAL_POSIX
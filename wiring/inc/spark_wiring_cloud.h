@@ -67,6 +67,7 @@ const PublishFlag PUBLIC(PUBLISH_EVENT_FLAG_PUBLIC);
 const PublishFlag PRIVATE(PUBLISH_EVENT_FLAG_PRIVATE);
 const PublishFlag NO_ACK(PUBLISH_EVENT_FLAG_NO_ACK);
 const PublishFlag WITH_ACK(PUBLISH_EVENT_FLAG_WITH_ACK);
+const PublishFlag WITH_BATCH(PUBLISH_EVENT_FLAG_BATCH);
 
 // Test if the paramater a regular C "string" literal
 template <typename T>
@@ -373,6 +374,19 @@ class CloudClass {
     }
 
     inline static void keepAlive(std::chrono::seconds s) { keepAlive(s.count()); }
+
+    /**
+     * Enables or disables fast reconnects. When a session is resumed, queued events are sent
+     * right away instead of a ping.
+     */
+    inline static void fastReconnect(bool enabled)
+    {
+        particle::protocol::connection_properties_t conn_prop = {0};
+        conn_prop.size = sizeof(conn_prop);
+        CLOUD_FN(spark_set_connection_property(particle::protocol::Connection::FAST_RECONNECT,
+                                               enabled, &conn_prop, nullptr),
+                 (void)0);
+    }
 #endif
 
 private:
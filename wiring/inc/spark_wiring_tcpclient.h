@@ -41,6 +41,14 @@
 class TCPClient : public Client {
 
 public:
+    /**
+     * Buffer descriptor for {@link #readv}.
+     */
+    struct Buffer {
+        uint8_t* data;
+        size_t size;
+    };
+
     TCPClient();
     TCPClient(sock_handle_t sock);
     virtual ~TCPClient() {};
@@ -54,10 +62,29 @@ public:
     virtual size_t write(const uint8_t *buffer, size_t size, system_tick_t timeout);
     virtual int available();
     virtual int read();
+    /**
+     * Reads the available data into the caller's buffer. If no data is buffered internally,
+     * the data is received directly into the caller's buffer.
+     * @return the number of bytes read, or -1 if no data is available
+     */
     virtual int read(uint8_t *buffer, size_t size);
+    /**
+     * Reads the available data into several buffers, filling them in order.
+     * @return the total number of bytes read, or -1 if no data is available
+     */
+    int readv(const Buffer* buffers, size_t count);
     virtual int peek();
     virtual void flush();
     void flush_buffer();
+    /**
+     * Sets the internal receive buffer used by {@link #available}, {@link #peek} and single-byte reads.
+     * Data that is already buffered is moved to the new buffer.
+     * @param size The size of the buffer. The default buffer has {@code TCPCLIENT_BUF_MAX_SIZE} bytes.
+     * @param buffer A pre-allocated buffer. If not specified, the default buffer is used if it is large
+     *        enough, otherwise the buffer is allocated dynamically.
+     * @return {@code false} if the buffer could not be allocated or the buffered data doesn't fit in it
+     */
+    bool setBuffer(size_t size, uint8_t* buffer = nullptr);
     virtual void stop();
     virtual uint8_t connected();
     virtual operator bool();
@@ -74,10 +101,13 @@ protected:
 private:
     struct Data {
         sock_handle_t sock;
-        uint8_t buffer[TCPCLIENT_BUF_MAX_SIZE];
-        uint16_t offset;
-        uint16_t total;
+        uint8_t* buffer; // defaultBuffer, or the buffer set with setBuffer()
+        size_t bufferSize;
+        size_t offset;
+        size_t total;
+        std::unique_ptr<uint8_t[]> bufferStorage; // Set if setBuffer() allocated the buffer
         IPAddress remoteIP;
+        uint8_t defaultBuffer[TCPCLIENT_BUF_MAX_SIZE];
 
         explicit Data(sock_handle_t sock);
         ~Data();
@@ -86,6 +116,7 @@ private:
     std::shared_ptr<Data> d_;
 
     inline int bufferCount();
+    int receive(uint8_t* buffer, size_t size);
 };
 
 #endif
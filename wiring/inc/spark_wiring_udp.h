@@ -91,6 +91,17 @@ private:
 
 
 public:
+    /**
+     * A packet for {@link #sendPackets} and {@link #receivePackets}.
+     */
+    struct Packet {
+        uint8_t* buffer;        // Packet data
+        size_t size;            // Size of the packet (sendPackets()) or of the buffer (receivePackets())
+        size_t length;          // On return, the number of bytes sent or received
+        IPAddress remoteIP;     // Destination (sendPackets()) or source (receivePackets()) address
+        uint16_t remotePort;    // Destination or source port
+    };
+
     UDP();
     virtual ~UDP() { stop(); releaseBuffer(); }
     /**
@@ -153,6 +164,30 @@ public:
         return receivePacket((uint8_t*)buffer, buf_size, timeout);
     }
 
+    /**
+     * Sends several packets directly, in order. This does not require the UDP instance to have an
+     * allocated buffer. The packets are passed to the network stack in batches, which is cheaper
+     * than calling {@link #sendPacket} for each packet.
+     *
+     * @param packets       The packets to send
+     * @param count         The number of packets
+     * @return The number of packets sent, or a negative value if no packet could be sent.
+     */
+    int sendPackets(Packet* packets, size_t count);
+
+    /**
+     * Retrieves several packets directly. This does not require the UDP instance to have an allocated buffer.
+     * Waits for the first packet up to the given timeout, and then retrieves only the packets that have
+     * already been received. If a buffer is not large enough for its packet, the remainder that doesn't
+     * fit is discarded. {@link #remoteIP} and {@link #remotePort} return the source of the last packet.
+     *
+     * @param packets       The buffers to read the packets to
+     * @param count         The number of buffers
+     * @param timeout       The time to wait for the first packet, in milliseconds
+     * @return The number of packets retrieved, or a negative value on error.
+     */
+    int receivePackets(Packet* packets, size_t count, system_tick_t timeout = 0);
+
     /**
      * Begin writing a packet to the given destination.
      * @param ip        The IP address of the destination peer.
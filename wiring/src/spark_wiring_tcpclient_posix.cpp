@@ -33,6 +33,8 @@
 #include <arpa/inet.h>
 #include "spark_wiring_constants.h"
 #include "spark_wiring_posix_common.h"
+#include <algorithm>
+#include <new>
 
 using namespace spark;
 
@@ -156,35 +158,33 @@ int TCPClient::bufferCount() {
     return d_->total - d_->offset;
 }
 
-int TCPClient::available()
-{
-    int avail = 0;
+int TCPClient::receive(uint8_t* buffer, size_t size) {
+    if (!isOpen(d_->sock)) {
+        return 0;
+    }
+    int ret = sock_recv(d_->sock, buffer, size, MSG_DONTWAIT);
+    if (ret > 0) {
+        return ret;
+    }
+    if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        LOG(ERROR, "recv error = %d", errno);
+        sock_close(d_->sock);
+        d_->sock = -1;
+    }
+    return 0;
+}
 
+int TCPClient::available() {
     // At EOB => Flush it
     if (d_->total && (d_->offset == d_->total)) {
         flush_buffer();
     }
 
-    if (isOpen(d_->sock)) {
-        // Have room
-        if (d_->total < arraySize(d_->buffer)) {
-            int ret = sock_recv(d_->sock, d_->buffer + d_->total, arraySize(d_->buffer) - d_->total, MSG_DONTWAIT);
-            if (ret > 0) {
-                if (d_->total == 0) {
-                    d_->offset = 0;
-                }
-                d_->total += ret;
-            } else {
-                if (errno != EAGAIN && errno != EWOULDBLOCK) {
-                    LOG(ERROR, "recv error = %d", errno);
-                    sock_close(d_->sock);
-                    d_->sock = -1;
-                }
-            }
-        } // Have Space
-    } // isOpen(d_->sock)
-    avail = bufferCount();
-    return avail;
+    // Have room
+    if (d_->total < d_->bufferSize) {
+        d_->total += receive(d_->buffer + d_->total, d_->bufferSize - d_->total);
+    }
+    return bufferCount();
 }
 
 int TCPClient::read() {
@@ -192,15 +192,38 @@ int TCPClient::read() {
 }
 
 int TCPClient::read(uint8_t *buffer, size_t size) {
-    int read = -1;
-    if (bufferCount() || available()) {
-        read = (size > (size_t) bufferCount()) ? bufferCount() : size;
-        memcpy(buffer, &d_->buffer[d_->offset], read);
-        d_->offset += read;
+    if (!bufferCount()) {
+        // Nothing buffered, receive directly into the caller's buffer
+        flush_buffer();
+        const int ret = receive(buffer, size);
+        return (ret > 0) ? ret : -1;
     }
+    const size_t read = std::min(size, (size_t)bufferCount());
+    memcpy(buffer, d_->buffer + d_->offset, read);
+    d_->offset += read;
     return read;
 }
 
+int TCPClient::readv(const Buffer* buffers, size_t count) {
+    size_t total = 0;
+    for (size_t i = 0; i < count; ++i) {
+        uint8_t* data = buffers[i].data;
+        size_t size = buffers[i].size;
+        const size_t n = std::min(size, (size_t)bufferCount());
+        memcpy(data, d_->buffer + d_->offset, n);
+        d_->offset += n;
+        total += n;
+        if (n < size) {
+            const size_t ret = receive(data + n, size - n);
+            total += ret;
+            if (ret < size - n) {
+                break; // No more data for now
+            }
+        }
+    }
+    return total ? total : -1;
+}
+
 int TCPClient::peek() {
     return (bufferCount() || available()) ? d_->buffer[d_->offset] : -1;
 }
@@ -210,6 +233,30 @@ void TCPClient::flush_buffer() {
     d_->total = 0;
 }
 
+bool TCPClient::setBuffer(size_t size, uint8_t* buffer) {
+    const size_t count = bufferCount();
+    if (!size || size < count) {
+        return false;
+    }
+    std::unique_ptr<uint8_t[]> storage;
+    if (!buffer && size <= sizeof(d_->defaultBuffer)) {
+        buffer = d_->defaultBuffer;
+    } else if (!buffer) {
+        storage.reset(new(std::nothrow) uint8_t[size]);
+        buffer = storage.get();
+        if (!buffer) {
+            return false;
+        }
+    }
+    memmove(buffer, d_->buffer + d_->offset, count);
+    d_->bufferStorage = std::move(storage);
+    d_->buffer = buffer;
+    d_->bufferSize = size;
+    d_->offset = 0;
+    d_->total = count;
+    return true;
+}
+
 void TCPClient::flush() {
 }
 
@@ -247,6 +294,8 @@ IPAddress TCPClient::remoteIP() {
 
 TCPClient::Data::Data(sock_handle_t sock)
         : sock(sock),
+          buffer(defaultBuffer),
+          bufferSize(TCPCLIENT_BUF_MAX_SIZE),
           offset(0),
           total(0) {
 }
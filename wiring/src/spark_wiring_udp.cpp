@@ -36,6 +36,7 @@
 #include "spark_macros.h"
 #include "spark_wiring_network.h"
 #include "spark_wiring_constants.h"
+#include "spark_wiring_ticks.h"
 
 using namespace spark;
 
@@ -44,6 +45,25 @@ static bool inline isOpen(sock_handle_t sd)
    return sd != socket_handle_invalid();
 }
 
+static void toSockAddr(const IPAddress& ip, uint16_t port, sockaddr_t* addr)
+{
+    addr->sa_family = AF_INET;
+
+    addr->sa_data[0] = (port & 0xFF00) >> 8;
+    addr->sa_data[1] = (port & 0x00FF);
+
+    addr->sa_data[2] = ip[0];
+    addr->sa_data[3] = ip[1];
+    addr->sa_data[4] = ip[2];
+    addr->sa_data[5] = ip[3];
+}
+
+static void fromSockAddr(const sockaddr_t& addr, IPAddress* ip, uint16_t* port)
+{
+    *port = addr.sa_data[0] << 8 | addr.sa_data[1];
+    *ip = &addr.sa_data[2];
+}
+
 UDP::UDP() : _sock(socket_handle_invalid()), _offset(0), _total(0), _buffer(0), _buffer_size(512)
 {
 }
@@ -152,15 +172,7 @@ int UDP::endPacket()
 int UDP::sendPacket(const uint8_t* buffer, size_t buffer_size, IPAddress remoteIP, uint16_t port)
 {
     sockaddr_t remoteSockAddr;
-    remoteSockAddr.sa_family = AF_INET;
-
-    remoteSockAddr.sa_data[0] = (port & 0xFF00) >> 8;
-    remoteSockAddr.sa_data[1] = (port & 0x00FF);
-
-    remoteSockAddr.sa_data[2] = remoteIP[0];
-    remoteSockAddr.sa_data[3] = remoteIP[1];
-    remoteSockAddr.sa_data[4] = remoteIP[2];
-    remoteSockAddr.sa_data[5] = remoteIP[3];
+    toSockAddr(remoteIP, port, &remoteSockAddr);
 
     int rv = socket_sendto(_sock, buffer, buffer_size, 0, &remoteSockAddr, sizeof(remoteSockAddr));
     DEBUG("sendto(buffer=%lx, size=%d)=%d",buffer, buffer_size , rv);
@@ -209,13 +221,79 @@ int UDP::receivePacket(uint8_t* buffer, size_t size, system_tick_t timeout)
         ret = socket_receivefrom(_sock, buffer, size, 0, &remoteSockAddr, &remoteSockAddrLen);
         if (ret >= 0)
         {
-            _remotePort = remoteSockAddr.sa_data[0] << 8 | remoteSockAddr.sa_data[1];
-            _remoteIP = &remoteSockAddr.sa_data[2];
+            fromSockAddr(remoteSockAddr, &_remoteIP, &_remotePort);
         }
     }
     return ret;
 }
 
+int UDP::sendPackets(Packet* packets, size_t count)
+{
+    if (!Network.from(_nif).ready() || !isOpen(_sock))
+    {
+        return -1;
+    }
+    // The compat socket HAL has no batched send, but the socket is only looked up once
+    size_t sent = 0;
+    for (; sent < count; ++sent)
+    {
+        Packet& p = packets[sent];
+        sockaddr_t remoteSockAddr;
+        toSockAddr(p.remoteIP, p.remotePort, &remoteSockAddr);
+        int rv = socket_sendto(_sock, p.buffer, p.size, 0, &remoteSockAddr, sizeof(remoteSockAddr));
+        if (rv < 0)
+        {
+            break;
+        }
+        p.length = rv;
+    }
+    DEBUG("sendPackets(count=%d)=%d", count, sent);
+    return (sent || !count) ? sent : -1;
+}
+
+int UDP::receivePackets(Packet* packets, size_t count, system_tick_t timeout)
+{
+    if (!Network.from(_nif).ready() || !isOpen(_sock))
+    {
+        return -1;
+    }
+    // socket_receivefrom() doesn't block: poll for the first packet until the timeout expires
+    const system_tick_t start = millis();
+    size_t received = 0;
+    while (received < count)
+    {
+        Packet& p = packets[received];
+        sockaddr_t remoteSockAddr;
+        socklen_t remoteSockAddrLen = sizeof(remoteSockAddr);
+        int ret = socket_receivefrom(_sock, p.buffer, p.size, 0, &remoteSockAddr, &remoteSockAddrLen);
+        if (ret < 0)
+        {
+            if (!received)
+            {
+                return ret;
+            }
+            break;
+        }
+        if (ret == 0)
+        {
+            if (!received && millis() - start < timeout)
+            {
+                continue;
+            }
+            break;
+        }
+        p.length = ret;
+        fromSockAddr(remoteSockAddr, &p.remoteIP, &p.remotePort);
+        ++received;
+    }
+    if (received)
+    {
+        _remoteIP = packets[received - 1].remoteIP;
+        _remotePort = packets[received - 1].remotePort;
+    }
+    return received;
+}
+
 int UDP::read()
 {
   return available() ? _buffer[_offset++] : -1;
@@ -31,6 +31,8 @@
 #endif // HAL_PLATFORM_IFAPI
 #include "netdb_hal.h"
 #include <arpa/inet.h>
+#include <algorithm>
+#include <cerrno>
 #include "spark_wiring_constants.h"
 #include "spark_wiring_posix_common.h"
 
@@ -38,10 +40,25 @@ using namespace spark;
 
 namespace {
 
+// Maximum number of packets passed to the socket HAL at once
+const size_t PACKET_BATCH_SIZE = 8;
+
 inline bool isOpen(sock_handle_t sd) {
     return socket_handle_valid(sd);
 }
 
+int setReceiveTimeout(int sock, system_tick_t timeout, int* flags) {
+    if (timeout == 0) {
+        *flags = MSG_DONTWAIT;
+        return 0;
+    }
+    struct timeval tv = {};
+    tv.tv_sec = timeout / 1000;
+    tv.tv_usec = (timeout % 1000) * 1000;
+    *flags = 0;
+    return sock_setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+}
+
 int joinLeaveMulticast(int sock, const IPAddress& addr, uint8_t ifindex, bool join) {
     sockaddr_storage s = {};
     detail::ipAddressPortToSockaddr(addr, 0, (struct sockaddr*)&s);
@@ -282,16 +299,9 @@ int UDP::receivePacket(uint8_t* buffer, size_t size, system_tick_t timeout) {
         sockaddr_storage saddr = {};
         socklen_t slen = sizeof(saddr);
         int flags = 0;
-        if (timeout == 0) {
-            flags = MSG_DONTWAIT;
-        } else {
-            struct timeval tv = {};
-            tv.tv_sec = timeout / 1000;
-            tv.tv_usec = (timeout % 1000) * 1000;
-            ret = sock_setsockopt(_sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
-            if (ret) {
-                return ret;
-            }
+        ret = setReceiveTimeout(_sock, timeout, &flags);
+        if (ret) {
+            return ret;
         }
         ret = sock_recvfrom(_sock, buffer, size, flags, (struct sockaddr*)&saddr, &slen);
         if (ret >= 0) {
@@ -302,6 +312,83 @@ int UDP::receivePacket(uint8_t* buffer, size_t size, system_tick_t timeout) {
     return ret;
 }
 
+int UDP::sendPackets(Packet* packets, size_t count) {
+    size_t sent = 0;
+    while (sent < count) {
+        sock_mmsghdr msgs[PACKET_BATCH_SIZE] = {};
+        sockaddr_storage addrs[PACKET_BATCH_SIZE] = {};
+        const size_t n = std::min(count - sent, PACKET_BATCH_SIZE);
+        size_t valid = 0;
+        for (; valid < n; ++valid) {
+            const Packet& p = packets[sent + valid];
+            detail::ipAddressPortToSockaddr(p.remoteIP, p.remotePort, (struct sockaddr*)&addrs[valid]);
+            if (addrs[valid].ss_family == AF_UNSPEC) {
+                break;
+            }
+            msgs[valid].msg_buf = p.buffer;
+            msgs[valid].msg_buflen = p.size;
+            msgs[valid].msg_name = (struct sockaddr*)&addrs[valid];
+            msgs[valid].msg_namelen = sizeof(addrs[valid]);
+        }
+        const int ret = valid ? sock_sendmmsg(_sock, msgs, valid, 0) : -1;
+        if (ret < 0) {
+            break;
+        }
+        for (int i = 0; i < ret; ++i) {
+            packets[sent + i].length = msgs[i].msg_len;
+        }
+        sent += ret;
+        if ((size_t)ret < n) {
+            break;
+        }
+    }
+    LOG_DEBUG(TRACE, "sendPackets count %d, sent %d", count, sent);
+    return (sent || !count) ? sent : -1;
+}
+
+int UDP::receivePackets(Packet* packets, size_t count, system_tick_t timeout) {
+    if (!isOpen(_sock)) {
+        return -1;
+    }
+    int flags = 0;
+    CHECK(setReceiveTimeout(_sock, timeout, &flags));
+    size_t received = 0;
+    while (received < count) {
+        sock_mmsghdr msgs[PACKET_BATCH_SIZE] = {};
+        sockaddr_storage addrs[PACKET_BATCH_SIZE] = {};
+        const size_t n = std::min(count - received, PACKET_BATCH_SIZE);
+        for (size_t i = 0; i < n; ++i) {
+            msgs[i].msg_buf = packets[received + i].buffer;
+            msgs[i].msg_buflen = packets[received + i].size;
+            msgs[i].msg_name = (struct sockaddr*)&addrs[i];
+            msgs[i].msg_namelen = sizeof(addrs[i]);
+        }
+        const int ret = sock_recvmmsg(_sock, msgs, n, flags);
+        if (ret < 0) {
+            if (!received && errno != EAGAIN && errno != EWOULDBLOCK) {
+                return ret;
+            }
+            break;
+        }
+        for (int i = 0; i < ret; ++i) {
+            Packet& p = packets[received + i];
+            p.length = msgs[i].msg_len;
+            detail::sockaddrToIpAddressPort((const struct sockaddr*)&addrs[i], p.remoteIP, &p.remotePort);
+        }
+        received += ret;
+        if ((size_t)ret < n) {
+            break;
+        }
+        // Don't wait for the next batch
+        flags = MSG_DONTWAIT;
+    }
+    if (received) {
+        _remoteIP = packets[received - 1].remoteIP;
+        _remotePort = packets[received - 1].remotePort;
+    }
+    return received;
+}
+
 int UDP::read() {
     return available() ? _buffer[_offset++] : -1;
 }